@@ -66,9 +66,11 @@ public:
 	/**
 	 * Creates an ABB board object.
 	 * @param number The number of the board to initialize
+	 * @param write_combining Map the memory BAR write-combining, and write
+	 * blocks to it with wide non-temporal stores (default: false).
 	 * @todo How are boards enumerated?
 	 */
-	ABB(const unsigned int number);
+	ABB(const unsigned int number, const bool write_combining = false);
 
 	/**
 	 * Releases a board.
@@ -156,6 +158,8 @@ public:
 
 	/**
 	 * Write multiple values from a DMA Buffer to the board address space.
+	 * Incrementing writes over DMA_MAX_COUNT dwords are split in chunks,
+	 * chained in the descriptor list of the channel.
 	 *
 	 * @param address Address in the board.
 	 * @param data Values to write.
@@ -189,6 +193,8 @@ public:
 
 	/**
 	 * Read multiple values from the board address space to a DMA Buffer.
+	 * Incrementing reads over DMA_MAX_COUNT dwords are split in chunks,
+	 * chained in the descriptor list of the channel.
 	 *
 	 * WARNING: If you pass lock = false, you need to manually issue
 	 * buf.sync(DMABuffer::FROMDEVICE); after the DMA transaction!
@@ -225,6 +231,28 @@ public:
 			const bool inc = true, const bool lock = true,
 			const float timeout = 0.0);
 
+	/**
+	 * Write a DMA Buffer to the board memory on channel 0 and read
+	 * another one from it on channel 1, both running at the same time.
+	 * Returns when both transfers are done. Transfers over DMA_MAX_COUNT
+	 * dwords run one after the other, each in chunks.
+	 *
+	 * @param write_address Address in the board to write to.
+	 * @param write_buf Values to write.
+	 * @param write_count Number of values to write, in dwords.
+	 * @param read_address Address in the board to read from.
+	 * @param read_buf Buffer to read the values into.
+	 * @param read_count Number of values to read, in dwords.
+	 * @param inc Increment the addresses on the FPGA side (default: true).
+	 * @param timeout The timeout for each of the transfers (in miliseconds).
+	 * @exception mprace::Exception On error.
+	 */
+	virtual void transferDuplex(const unsigned int write_address,
+			const DMABuffer& write_buf, const unsigned int write_count,
+			const unsigned int read_address, DMABuffer& read_buf,
+			const unsigned int read_count, const bool inc = true,
+			const float timeout = 0.0);
+
 
 	/**
 	 * Get the DMA Engine for this board.
@@ -313,12 +341,15 @@ public:
 	const static unsigned int DMA_MEM;		// Perform DMA to Memory
 	const static unsigned int DMA_FIFO;		// Perform DMA to FIFO
 
+	const static unsigned int DMA_MAX_COUNT;	// Largest incrementing DMA transaction, in dwords
+
 protected:
 	unsigned int *regs;
 	unsigned int regs_size;
 
 	unsigned int *mem;
 	unsigned int mem_size;
+	bool mem_wc;			// mem mapped write-combining, stores are fenced
 
 	unsigned int *fifo;
 	unsigned int fifo_size;
@@ -60,6 +60,14 @@ public:
 		BUSY 				//>** Device is busy.
 	};
 
+	/**
+	 * Direction of a transfer().
+	 */
+	enum Direction {
+		TO_BOARD = 0,		//>** From the host to the board memory.
+		FROM_BOARD = 1		//>** From the board memory to the host.
+	};
+
 	/**
 	 * Probes a Driver if it handles this type of Board.
 	 * @param device The device to probe.
@@ -216,6 +224,82 @@ public:
 			const bool inc = true, const bool lock = true,
 			const float timeout = 0.0);
 
+	/**
+	 * Write a DMA Buffer to the board and read another one from it at
+	 * the same time, for boards with one DMA channel per direction. Both
+	 * transfers start from the beginning of their buffer, and the call
+	 * returns when both are done.
+	 *
+	 * The default implementation does a writeDMA and then a readDMA.
+	 *
+	 * @param write_address Address in the board to write to.
+	 * @param write_buf Values to write.
+	 * @param write_count Number of values to write, in dwords.
+	 * @param read_address Address in the board to read from.
+	 * @param read_buf Buffer to read the values into.
+	 * @param read_count Number of values to read, in dwords.
+	 * @param inc Increment the addresses on the FPGA side (default: true).
+	 * @param timeout The timeout for each of the transfers (in miliseconds).
+	 * @exception mprace::Exception On error.
+	 */
+	virtual void transferDuplex(const unsigned int write_address,
+			const DMABuffer& write_buf, const unsigned int write_count,
+			const unsigned int read_address, DMABuffer& read_buf,
+			const unsigned int read_count, const bool inc = true,
+			const float timeout = 0.0);
+
+	/**
+	 * Transfer between a DMA Buffer and the board memory, with PIO
+	 * (writeBlock/readBlock on the buffer memory) for fewer dwords than
+	 * the crossover of the direction, and with DMA from it on.
+	 *
+	 * @param dir Direction of the transfer.
+	 * @param address Address in the board.
+	 * @param buf The DMA Buffer in the host.
+	 * @param count Number of values to transfer, in dwords.
+	 * @param offset Offset in the DMA buffer, in dwords (default = 0).
+	 * @exception mprace::Exception On error.
+	 */
+	virtual void transfer(const Direction dir, const unsigned int address,
+			DMABuffer& buf, const unsigned int count,
+			const unsigned int offset = 0);
+
+	/**
+	 * Measure the crossovers of transfer() on this board: PIO and DMA
+	 * are timed for 1, 2, 4... up to max_count dwords in each direction,
+	 * and the crossover is the smallest size from which DMA is always
+	 * faster. It overwrites the board memory from address on.
+	 *
+	 * @param address Address in the board of a free memory area.
+	 * @param buf A DMA Buffer of at least max_count dwords.
+	 * @param max_count Largest size measured, in dwords.
+	 * @exception mprace::Exception On error.
+	 */
+	void calibrateTransfer(const unsigned int address, DMABuffer& buf,
+			const unsigned int max_count);
+
+	/**
+	 * Get the crossover of a direction, in dwords.
+	 */
+	inline unsigned int getCrossover(const Direction dir) const { return crossover[dir]; }
+
+	/**
+	 * Set the crossover of a direction, in dwords. 0 always uses DMA.
+	 */
+	inline void setCrossover(const Direction dir, const unsigned int count) { crossover[dir] = count; }
+
+	/**
+	 * Save the crossovers to a file, to be loaded instead of calibrating again.
+	 * @exception mprace::Exception FILE_NOT_FOUND if the file can not be written.
+	 */
+	void saveCalibration(const char *filename) const;
+
+	/**
+	 * Load the crossovers from a file written by saveCalibration().
+	 * @exception mprace::Exception FILE_NOT_FOUND, UNKNOWN_FILE_FORMAT
+	 */
+	void loadCalibration(const char *filename);
+
 
 	/**
 	 * Enable the logging features.
@@ -282,12 +366,22 @@ protected:
 	 * The driver used by the board. Must be initialized by the subclass.
 	 */
 	Driver *driver;
-		
+
+	/**
+	 * Smallest transfer() done with DMA, in dwords, for each direction.
+	 */
+	unsigned int crossover[2];
+
 	/**
 	 * Creates a board. Protected because only subclasses should 
 	 * be instantiated.
 	 */
-	Board() : log(0), driver(0) {};
+	Board() : log(0), driver(0) { crossover[TO_BOARD] = DEFAULT_CROSSOVER; crossover[FROM_BOARD] = DEFAULT_CROSSOVER; };
+
+	/**
+	 * Crossover used until the board is calibrated, in dwords.
+	 */
+	const static unsigned int DEFAULT_CROSSOVER;
 	
 	/* Avoid copy constructor, and copy assignment operator */
 
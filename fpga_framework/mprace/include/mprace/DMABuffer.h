@@ -62,7 +62,8 @@ public:
 	enum MemType { 
 		KERNEL, 		//>** Kernel Memory
 		KERNEL_PIECES,	//>** Kernel with descriptors, used for debugging
-		USER 			//>** User Memory
+		USER, 			//>** User Memory
+		USER_HUGEPAGES	//>** User Memory backed by huge pages, with fewer SG entries
 	};
 	
 	/**
@@ -82,6 +83,9 @@ public:
 	 * @param board The board to associate this DMA Buffer with
 	 * @param size Size of the buffer to allocate, in bytes
 	 * @param type Type of the buffer (kernel/user memory).
+	 *   USER_HUGEPAGES takes 2 MB pages from hugetlbfs when some are
+	 *   reserved, else asks for transparent huge pages. The size is
+	 *   rounded up to whole huge pages.
 	 * @param pieces Number of kernel pieces to divide the buffer. For debug only.
 	 */
 	DMABuffer(Board& board, const unsigned int size, MemType type, unsigned int kernel_pieces=1 );
@@ -121,6 +125,16 @@ public:
 	 * @param dir Direction to sync
 	 */
 	void sync( SyncDir dir=BOTH ) const;
+
+	/**
+	 * Synchronizes only the part of the buffer used by a transfer. With
+	 * bounce buffers this copies the SG entries holding the range, not
+	 * the whole buffer.
+	 * @param dir Direction to sync
+	 * @param offset Start of the range, in dwords, as in the transfers.
+	 * @param count Size of the range, in dwords.
+	 */
+	void sync( SyncDir dir, const unsigned int offset, const unsigned int count ) const;
 	
 	/**
 	 * Returns a user space memory pointer, to access the
@@ -171,6 +185,12 @@ private:
 
 	DMADescriptorList *descriptors;
 
+	/**
+	 * Allocates the memory of a USER_HUGEPAGES buffer.
+	 * @param size Size in bytes, rounded up to whole huge pages.
+	 */
+	unsigned int *allocHugePages(const unsigned int size);
+
 #if 0
 	// old descriptor implementation. Replaced by DMADescriptorList class.
 	// this is soon to be removed.
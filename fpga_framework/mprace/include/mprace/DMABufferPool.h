@@ -0,0 +1,153 @@
+#ifndef DMABUFFERPOOL_H_
+#define DMABUFFERPOOL_H_
+
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include "DMABuffer.h"
+
+namespace mprace {
+
+class Board;
+
+/**
+ * Cache of DMA buffers, to avoid allocating, pinning and mapping the
+ * memory (and building the SG descriptor list) each time a buffer is needed.
+ *
+ * Buffers are kept by memory type and size class. The size classes are
+ * powers of two, from one page up. A buffer handed out by the pool is
+ * at least as big as requested, and comes back to the pool with its
+ * mapping and descriptor list untouched. Buffers are handed out through
+ * a Lease, which returns them to the pool when it goes out of scope.
+ *
+ * A buffer must not be returned to the pool while a DMA transaction on
+ * it is still running. The pool is thread-safe.
+ */
+class DMABufferPool {
+public:
+	/**
+	 * Holds a buffer from the pool, and gives it back when destroyed.
+	 * A lease can not be copied.
+	 */
+	class Lease {
+	public:
+		/**
+		 * Get a buffer of at least the given size from the pool.
+		 *
+		 * @param pool The pool to take the buffer from.
+		 * @param size Size of the buffer, in bytes.
+		 * @param type Type of the buffer memory.
+		 */
+		Lease(DMABufferPool& pool, const unsigned int size, const DMABuffer::MemType type = DMABuffer::USER);
+
+		/**
+		 * Gives the buffer back to the pool, if not done yet.
+		 */
+		~Lease();
+
+		/**
+		 * Gives the buffer back to the pool before the lease is destroyed.
+		 */
+		void release();
+
+		/**
+		 * Get the leased buffer. It is not valid anymore after release().
+		 */
+		inline DMABuffer& get() { return *buf; }
+		inline DMABuffer& operator*() { return *buf; }
+		inline DMABuffer *operator->() { return buf; }
+
+	private:
+		DMABufferPool& pool;
+		DMABuffer *buf;
+
+		Lease(const Lease&);
+		Lease& operator=(const Lease&);
+	}; /* class Lease */
+
+	/**
+	 * Creates an empty pool for a board.
+	 *
+	 * @param board     The board the buffers are allocated for.
+	 * @param max_idle  Most bytes kept in idle buffers. Buffers coming back
+	 *                  over this limit are freed. 0 means no limit.
+	 */
+	DMABufferPool(Board& board, const unsigned long long max_idle = 0);
+
+	/**
+	 * Frees all the idle buffers. All the leases must be released before.
+	 */
+	~DMABufferPool();
+
+	/**
+	 * Takes a buffer from the pool, allocating a new one if none is idle.
+	 * The buffer must be given back with put(). Prefer a Lease.
+	 *
+	 * @param size Minimum size of the buffer, in bytes.
+	 * @param type Type of the buffer memory.
+	 * @return A buffer of the size class of size.
+	 */
+	DMABuffer *get(const unsigned int size, const DMABuffer::MemType type = DMABuffer::USER);
+
+	/**
+	 * Gives a buffer taken with get() back to the pool.
+	 */
+	void put(DMABuffer *buf);
+
+	/**
+	 * Allocates buffers in advance, so the first requests find them idle.
+	 *
+	 * @param size  Size of the buffers, in bytes.
+	 * @param type  Type of the buffer memory.
+	 * @param count Number of idle buffers of this class to have.
+	 */
+	void reserve(const unsigned int size, const DMABuffer::MemType type, const unsigned int count);
+
+	/**
+	 * Frees all the idle buffers.
+	 */
+	void trim();
+
+	/**
+	 * Get the size of the buffers handed out for a requested size.
+	 */
+	static unsigned int sizeClass(const unsigned int size);
+
+	/** Requests served with an idle buffer. */
+	inline unsigned long getHits() const { return hits; }
+
+	/** Requests which allocated a new buffer. */
+	inline unsigned long getMisses() const { return misses; }
+
+	/** Bytes in all the buffers of the pool, idle or leased. */
+	inline unsigned long long getPinnedBytes() const { return pinned_bytes; }
+
+	/** Bytes in the idle buffers. */
+	inline unsigned long long getIdleBytes() const { return idle_bytes; }
+
+	/** Number of buffers leased and not given back yet. */
+	inline unsigned int getLeased() const { return leased; }
+
+private:
+	typedef std::pair<DMABuffer::MemType, unsigned int> pool_key;
+
+	Board& board;
+	unsigned long long max_idle;
+
+	std::map<pool_key, std::vector<DMABuffer *> > idle;	//** Idle buffers per type and size class.
+
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long long pinned_bytes;
+	unsigned long long idle_bytes;
+	unsigned int leased;
+
+	pthread_mutex_t lock;
+
+	DMABufferPool(const DMABufferPool&);
+	DMABufferPool& operator=(const DMABufferPool&);
+}; /* class DMABufferPool */
+
+} /* namespace mprace */
+
+#endif /*DMABUFFERPOOL_H_*/
@@ -14,8 +14,66 @@ namespace mprace {
 class DMABuffer;
 class DMADescriptorWG;
 
+/**
+ * Descriptor list of a DMABuffer for the DMAEngineWG. The native
+ * descriptors are contiguous in user space, and their physical addresses
+ * are kept in a flat array. operator[] returns a view of one entry, so
+ * there is no descriptor object per entry.
+ */
 class DMADescriptorListWG : public DMADescriptorList {
 public:
+	/**
+	 * View of an entry of the list: the native descriptor and its
+	 * physical address. It is copied by value, and valid as long as the
+	 * list exists.
+	 */
+	class view {
+	public:
+		view(DMADescriptorWG::descriptor *d, const unsigned long long addr) : native(d), pa(addr) {}
+
+		inline unsigned long long getPhysicalAddress() const
+			{ return pa; }
+
+		inline unsigned long long getHostAddress() const
+			{ return ((static_cast<unsigned long long>(native->host_addr_h) << 32) + native->host_addr_l); }
+
+		inline unsigned long long getPeripheralAddress() const
+			{ return ((static_cast<unsigned long long>(native->per_addr_h) << 32) + native->per_addr_l); }
+
+		inline unsigned long long getNextDescriptorAddress() const
+			{ return ((static_cast<unsigned long long>(native->next_bda_h) << 32) + native->next_bda_l); }
+
+		inline unsigned long getLength() const
+			{ return native->length; }
+
+		inline unsigned long getControl() const
+			{ return native->control; }
+
+		inline DMADescriptorWG::descriptor *getNativeDescriptor() const
+			{ return native; }
+
+		inline void setPeripheralAddress(const unsigned long long addr)
+			{ native->per_addr_h = HIGH(addr); native->per_addr_l = LOW(addr); }
+
+		inline void setHostAddress(const unsigned long long addr)
+			{ native->host_addr_h = HIGH(addr); native->host_addr_l = LOW(addr); }
+
+		inline void setNextDescriptorAddress(const unsigned long long addr)
+			{ native->next_bda_h = HIGH(addr); native->next_bda_l = LOW(addr); }
+
+		inline void setLength(const unsigned long l)
+			{ native->length = l; }
+
+		inline void setControl(const unsigned long ctrl)
+			{ native->control = ctrl; }
+
+		void printLine() const;
+
+	private:
+		DMADescriptorWG::descriptor *native;	//**> Native descriptor of the entry.
+		unsigned long long pa;					//**> Physical address of the native descriptor.
+	};
+
 	/**
 	 * Possible types for the native descriptor list.
 	 */
@@ -28,12 +86,35 @@ public:
 	
 	~DMADescriptorListWG();
 
-	inline DMADescriptorWG& operator[](const unsigned int idx)
-		{ return array[idx]; } 
+	inline view operator[](const unsigned int idx)
+		{ return view(native + idx, pa[idx]); }
 
 	inline unsigned int getSize()
 		{ return size; }
-	
+
+	/**
+	 * Writes one entry per scatter/gather entry, each linked to the next
+	 * one, in a single pass over the native list. The last entry ends
+	 * the chain, with a control word of 0 as all the others.
+	 * @param sg Mapping of the buffer, with getSize() entries.
+	 */
+	void build(pciDriver::UserMemory& sg);
+
+	/**
+	 * Same, for a buffer physically contiguous split in equal pieces. The
+	 * last piece takes what is left.
+	 * @param base Physical address of the buffer.
+	 * @param step Size of a piece, in bytes.
+	 * @param total Size of the buffer, in bytes.
+	 */
+	void build(const unsigned long long base, const unsigned int step, const unsigned int total);
+
+	/**
+	 * Physical address of each entry, getSize() of them.
+	 */
+	inline const unsigned long long *getPhysicalAddresses() const
+		{ return pa; }
+
 	void print();
 
 	void sync();
@@ -47,7 +128,8 @@ private:
 	Type type;								//**> Type of Buffer used for the native descriptors
 	
 	unsigned int size;						//**> Number of entries (descriptors)
-	DMADescriptorWG *array;					//**> Array of Descriptor objects
+	DMADescriptorWG::descriptor *native;	//**> Native descriptors, contiguous in user space
+	unsigned long long *pa;					//**> Physical address of each native descriptor
 	
 	typedef struct {
 		unsigned int size;					//**> in native descriptors
@@ -67,6 +149,25 @@ private:
 	void init(const unsigned int nr_descriptors);
 	
 	void link();
+
+	/**
+	 * Writes a whole entry, linked to the next one.
+	 */
+	inline void put(const unsigned int i, const unsigned long long host, const unsigned int length)
+	{
+		DMADescriptorWG::descriptor *d = native + i;
+		const unsigned long long next = (i == size-1) ? 0ULL : pa[i+1];
+
+		// Fields in memory order, the compiler merges the stores
+		d->per_addr_h = 0;
+		d->per_addr_l = 0;
+		d->host_addr_h = HIGH(host);
+		d->host_addr_l = LOW(host);
+		d->next_bda_h = HIGH(next);
+		d->next_bda_l = LOW(next);
+		d->length = length;
+		d->control = 0;
+	}
 	
 };	// end class
 
@@ -1,12 +1,21 @@
 #ifndef DMAENGINEWG_H_
 #define DMAENGINEWG_H_
 
+#include <vector>
+#include <pthread.h>
 #include "DMAEngine.h"
+#include "DMADescriptorWG.h"
+
+namespace pciDriver {
+	class UserMemory;
+}
 
 namespace mprace {
 
 class Driver;
 class DMADescriptorWG;
+class DMATransfer;
+class DMAWaitPolicy;
 
 // This is needed to compile properly in x86_64
 typedef unsigned int * puint;
@@ -14,11 +23,21 @@ typedef unsigned int * puint;
 /**
  * DMA Engine interface for the Wengxue Gao's (WG) DMA controller.
  *
+ * The two channels can be used from different threads at the same time,
+ * e.g. one thread writing with host2board() and another one reading with
+ * board2host(). Each channel has its own lock, held while a transaction
+ * is started and waited for, and the interrupt enable register shared by
+ * both channels is modified under a separate lock. The settings (use of
+ * interrupts, loop limit, wait policy) should not change while
+ * transactions are ongoing.
+ *
  * @author  Guillermo Marcus
  * @version $Revision: 1.12 $
  * @date    $Date: 2009-05-29 13:48:46 $
  */
 class DMAEngineWG : public DMAEngine {
+	friend class DMATransfer;
+	friend class DMAWaitPolicy;
 public:
 	/**
 	 * Creates an instance of the DMA Engine, to interface with Wenxue's design.
@@ -40,7 +59,7 @@ public:
 	 *
 	 * @param channel The channel to query
 	 */
-	virtual inline DMAStatus getStatus(const unsigned int channel);
+	virtual DMAStatus getStatus(const unsigned int channel);
 
 	/**
 	 * Reset the status of a DMA channel.
@@ -81,6 +100,93 @@ public:
 			const unsigned int offset=0, const bool inc=true,
 			const bool lock=true, const float timeout = 0.0);
 
+	/**
+	 * Starts a DMA transaction and returns without waiting for it.
+	 * Channel 0 transfers from host to board, channel 1 from board to host.
+	 * If the channel still has a transfer in flight, this call waits for
+	 * it first. The returned handle must be deleted by the caller, and
+	 * always before the engine itself.
+	 *
+	 * @param channel The channel to use.
+	 * @param bar    The BAR number in the board.
+	 * @param addr   The address in the board (dword address).
+	 * @param buf    The DMA buffer in the host.
+	 * @param count  Number of dwords to transfer.
+	 * @param offset Initial dword to transfer.
+	 * @param inc    If the address in the board is incremented or not.
+	 * @return A handle to poll or wait for the transfer.
+	 */
+	DMATransfer *submit(const unsigned int channel, const unsigned int bar,
+			const unsigned int addr, DMABuffer& buf,
+			const unsigned int count, const unsigned int offset=0,
+			const bool inc=true);
+
+	/**
+	 * Adds a transaction to the queue of a channel, to be started later by
+	 * flush(). The queue holds at most QUEUE_SIZE transactions. A buffer
+	 * may be queued more than once, e.g. for several sub-ranges.
+	 *
+	 * @param channel The channel to use.
+	 * @param bar    The BAR number in the board.
+	 * @param addr   The address in the board (dword address).
+	 * @param buf    The DMA buffer in the host.
+	 * @param count  Number of dwords to transfer.
+	 * @param offset Initial dword to transfer.
+	 * @param inc    If the address in the board is incremented or not.
+	 * @exception mprace::Exception DMA_QUEUE_ERROR if the queue is full.
+	 */
+	void enqueue(const unsigned int channel, const unsigned int bar,
+			const unsigned int addr, DMABuffer& buf,
+			const unsigned int count, const unsigned int offset=0,
+			const bool inc=true);
+
+	/**
+	 * Starts all the transactions queued in a channel as a single chained
+	 * descriptor list, so the engine runs them back-to-back in queue order.
+	 * The returned handle covers all of them, and must be deleted by the
+	 * caller before the engine. If the batch can not be started, the
+	 * queue is dropped.
+	 *
+	 * @param channel The channel to start.
+	 * @return A handle to the batch, or NULL if the queue is empty.
+	 */
+	DMATransfer *flush(const unsigned int channel);
+
+	/**
+	 * Performs a transaction larger than the engine or the board accepts
+	 * at once, as chunks of at most chunk dwords. The chunks are chained
+	 * in the descriptor list of the channel, up to QUEUE_SIZE of them, so
+	 * the engine starts each one as soon as the previous one is done.
+	 * Longer transfers run as several such chains, one after the other.
+	 * The queue of the channel must be empty.
+	 *
+	 * @param channel The channel to use.
+	 * @param bar    The BAR number in the board.
+	 * @param addr   The address in the board (dword address).
+	 * @param buf    The DMA buffer in the host.
+	 * @param count  Number of dwords to transfer.
+	 * @param offset Initial dword to transfer.
+	 * @param inc    If the address in the board is incremented or not.
+	 * @param chunk  Maximum number of dwords of a chunk.
+	 * @param lock   If the function waits until the last chain is complete or not.
+	 * @param timeout Timeout in milliseconds for each chain, 0.0 waits forever.
+	 */
+	void transferChunked(const unsigned int channel, const unsigned int bar,
+			const unsigned int addr, DMABuffer& buf,
+			const unsigned int count, const unsigned int offset,
+			const bool inc, const unsigned int chunk,
+			const bool lock = true, const float timeout = 0.0);
+
+	/**
+	 * Get the number of transactions queued in a channel.
+	 */
+	inline unsigned int getQueueLength(const unsigned int channel) { return queue[channel].size(); }
+
+	/**
+	 * Maximum number of transactions in the queue of a channel.
+	 */
+	const static unsigned int QUEUE_SIZE;
+
 	/**
 	 * Fills the Descriptor List of the the DMA Buffer for the current engine.
 	 *
@@ -119,6 +225,21 @@ public:
 	 */
 	inline unsigned int getLoopLimit() { return loop_limit; }
 
+	/**
+	 * Set how waitChannel() waits for a channel. The policy is not owned
+	 * by the engine, and must live as long as it is set. With no policy
+	 * (NULL, the default), the engine polls or waits for the interrupt
+	 * as selected by setUseInterrupts().
+	 * This should not be changed while DMA transactions are ongoing.
+	 * @param policy The wait policy, or NULL for the default one.
+	 */
+	inline void setWaitPolicy(DMAWaitPolicy *policy) { wait_policy = policy; }
+
+	/**
+	 * Get the wait policy set in the engine, NULL if none.
+	 */
+	inline DMAWaitPolicy *getWaitPolicy() { return wait_policy; }
+
 	/**
 	 * Wait for the channel to be done.
 	 * @param channel The channel number to wait for.
@@ -158,60 +279,161 @@ protected:
 	 *
 	 * @param channel The channel to modify
 	 */
-	inline void enableInterrupt(const unsigned int channel);
+	void enableInterrupt(const unsigned int channel);
 
 	/**
 	 * Disable Interrupts for a DMA channel.
 	 *
 	 * @param channel The channel to modify
 	 */
-	inline void disableInterrupt(const unsigned int channel);
+	void disableInterrupt(const unsigned int channel);
 
 	/**
 	 * Wait the Interrupt from a given DMA channel.
 	 *
 	 * @param channel The channel to modify
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @return false if the timeout expired first.
+	 */
+	bool waitForInterrupt(const unsigned int ch, const float timeout = 0.0);
+
+	/**
+	 * Holds the lock of a channel while in scope. The lock is recursive,
+	 * so a thread holding it can call the engine again.
 	 */
-	inline void waitForInterrupt(const unsigned int ch);
+	class ChannelLock {
+	public:
+		ChannelLock(DMAEngineWG& engine, const unsigned int ch);
+		~ChannelLock();
+	private:
+		pthread_mutex_t *mutex;
+	};
 
 	/**
-	 * Prepares and sends a descriptor list for a DMA transaction
+	 * Part of the descriptor list of a buffer covered by a transaction.
+	 */
+	typedef struct {
+		unsigned int init;			//** First descriptor of the list used.
+		unsigned int last;			//** Last descriptor of the list used.
+		unsigned int init_offset;	//** Bytes skipped at the start of the first descriptor.
+		unsigned int last_length;	//** Bytes used in the last descriptor.
+		bool shared;				//** The chain ends in the list itself, from init+2 on.
+		unsigned int patches;		//** Descriptors needed in the patch area.
+	} range_t;
+
+	/**
+	 * Checks, prepares and starts a DMA transaction on a channel, without waiting.
 	 *
+	 * @param ch     Channel to perform the transaction
 	 * @param bar    The BAR number to use in the CTRL word.
 	 * @param addr   The address in the board (dword address).
 	 * @param buf    The DMA buffer in the host.
-	 * @param count  Number of bytes to transfer.
+	 * @param count  Number of dwords to transfer.
 	 * @param offset Initial dword to transfer.
 	 * @param inc    If the address in the board is incremented or not.
-	 * @param ch     Channel to perform the transaction
 	 */
-	void sendDescriptorList(const unsigned int bar, const unsigned int addr, const DMABuffer& buf, const unsigned int count, const unsigned int offset, const bool inc, const unsigned int ch);
+	void startTransfer(const unsigned int ch, const unsigned int bar, const unsigned int addr, const DMABuffer& buf, const unsigned int count, const unsigned int offset, const bool inc);
 
 	/**
-	 * Restore data saved for a descriptor list
+	 * Finds the part of the descriptor list of a buffer used by a transaction.
 	 *
-	 * @param ch     Channel that saved the data
+	 * @param buf      The DMA buffer in the host.
+	 * @param count    Number of dwords to transfer.
+	 * @param offset   Initial dword to transfer.
+	 * @param terminal If the transaction ends the chain, so it may end in the list itself.
+	 * @param r        Filled with the range.
+	 */
+	void locate(const DMABuffer& buf, const unsigned int count, const unsigned int offset, const bool terminal, range_t& r);
+
+	/**
+	 * Starts the transactions queued in a channel as one chain, after the
+	 * previous transaction of the channel is finished, and empties the
+	 * queue. The channel is left patched, as an unlocked transfer.
+	 * @param t Handle to add the transactions to, or NULL.
 	 */
-	void restoreSavedData(unsigned int ch);
+	void startBatch(const unsigned int ch, DMATransfer *t);
+
+	/**
+	 * Builds the descriptors of a transaction in the patch area of a channel.
+	 * The head takes the offset into the first descriptor of the list and
+	 * the tail the cut in the last one; the descriptor list of the buffer
+	 * is only read, and is linked from the chain when the range allows it.
+	 *
+	 * @param ch     Channel of the patch area.
+	 * @param next   Next free descriptor of the patch area, advanced.
+	 * @param bar    The BAR number to use in the CTRL word.
+	 * @param addr   The address in the board (dword address).
+	 * @param buf    The DMA buffer in the host.
+	 * @param r      The range of the list, from locate().
+	 * @param inc    If the address in the board is incremented or not.
+	 * @param last   Set to the last descriptor of the chain.
+	 * @return The head of the chain.
+	 */
+	DMADescriptorWG::descriptor *buildChain(const unsigned int ch, unsigned int& next, const unsigned int bar, const unsigned int addr, const DMABuffer& buf, const range_t& r, const bool inc, DMADescriptorWG::descriptor *&last);
 
 private:
 	volatile puint channel[2];	//** pointers to each channel base address
 	volatile puint inte;		//** pointer to the Interrupt Enable Register.
 	volatile puint ints;		//** pointer to the Interupt Status Register.
         volatile puint dmatrans[2];     //** pointer to the DMA Actual Transferred Registers
+	pthread_mutex_t chan_lock[2];	//** Lock of each channel state.
+	pthread_mutex_t inte_lock;	//** Lock for the read-modify-write of the IER.
 	bool useInterrupts;			//** Use interrupts on the DMA transfer / wait.
 	unsigned int loop_limit;	//** limit for the loop in waitChannel
+	DMAWaitPolicy *wait_policy;	//** Policy used in waitChannel, NULL for the default.
+	unsigned int last_bytes[2];	//** Size of the last transaction started in a channel.
+
+	bool patched[2];					//** The patch area of a channel is used by a transaction not waited for.
+	DMATransfer *pending[2];			//** Submitted transfer still in flight in a channel, if any.
+
+	typedef struct {
+		unsigned int bar;
+		unsigned int addr;
+		DMABuffer *buf;
+		unsigned int count;
+		unsigned int offset;
+		bool inc;
+	} queued_t;
+
+	std::vector<queued_t> queue[2];		//** Transactions waiting for flush() in a channel.
+	std::vector<range_t> batch_ranges[2];	//** Ranges of the transactions of a flush(), kept between calls.
 
+	// Descriptors written for each transaction of a channel (heads, tails and
+	// Kernel buffers), so the descriptor lists of the buffers stay unchanged.
 	typedef struct {
-		DMABuffer const *saved_buf;			//** The buffer related to the saved data.
-		unsigned int saved_init_descriptor;	//** Saved descriptor index, when transferring an user buffer.
-		unsigned int saved_last_descriptor;	//** Saved descriptor index, when transferring an user buffer.
-		unsigned int saved_offset;		//** Saved descriptor offset (at init), when transferring an user buffer.
-		unsigned int saved_length;		//** Saved descriptor length (at last), when transferring an user buffer.
-	} saved_data_t;
-
-	bool saved[2];						//** Signal that valid data was saved for a channel.
-	saved_data_t saved_data[2];			//** Data saved for a SG transaction in a channel.
+		DMADescriptorWG::descriptor *desc;	//** Native descriptors, in user memory.
+		unsigned int size;					//** Number of descriptors.
+		unsigned long long *pa;				//** Physical address of each page.
+		pciDriver::UserMemory *mem;			//** Mapping of the area.
+	} patch_t;
+
+	patch_t patch[2];					//** Patch area of each channel.
+
+	/**
+	 * Get the policy used to wait for a channel.
+	 */
+	DMAWaitPolicy& waitPolicy();
+
+	/**
+	 * True if the transactions are started with the interrupt enabled.
+	 */
+	bool interruptsArmed();
+
+	/**
+	 * Makes the patch area of a channel hold at least n descriptors.
+	 * The channel must be idle, as a larger area replaces the old one.
+	 */
+	void reservePatch(const unsigned int ch, const unsigned int n);
+
+	/**
+	 * Frees the patch area of a channel.
+	 */
+	void releasePatch(const unsigned int ch);
+
+	/**
+	 * Get the physical address of a descriptor in the patch area of a channel.
+	 */
+	unsigned long long patchAddress(const unsigned int ch, const unsigned int index);
 }; /* class DMAEngineWG */
 
 } /* namespace mprace */
@@ -0,0 +1,148 @@
+#ifndef DMASTREAM_H_
+#define DMASTREAM_H_
+
+#include <vector>
+#include <pthread.h>
+#include "DMABuffer.h"
+
+namespace mprace {
+
+class Board;
+class DMAEngineWG;
+
+/**
+ * Continuous board to host acquisition into a ring of DMA buffers.
+ *
+ * The stream owns N buffers (slots) of the same size. Once started, a
+ * service thread keeps channel 1 of the engine busy, filling the free
+ * slots in ring order. The free slots are queued in the engine as one
+ * chain, up to half the ring, run back to back. The consumer takes the filled slots with
+ * acquire(), reads them in place, and gives them back with release(),
+ * in the same order.
+ *
+ * When every slot is filled or held by the consumer, the engine stops
+ * until a slot is released. Each time this happens is counted as an
+ * overrun: with a FIFO source, the board has to hold the data meanwhile.
+ *
+ * Channel 1 of the engine must not be used by anyone else while the
+ * stream runs.
+ */
+class DMAStream {
+public:
+	/**
+	 * Creates a stream and its buffers. The stream is not started.
+	 *
+	 * @param board  The board to read from. It must have a DMAEngineWG.
+	 * @param bar    The BAR number in the board.
+	 * @param addr   The address in the board (dword address).
+	 * @param words  Size of each slot, in dwords.
+	 * @param slots  Number of slots in the ring, at least 2.
+	 * @param inc    If the address in the board is incremented or not (FIFO).
+	 * @param type   Type of the buffers memory.
+	 * @exception mprace::Exception DMA_NOT_SUPPORTED if the engine is not a DMAEngineWG.
+	 */
+	DMAStream(Board& board, const unsigned int bar, const unsigned int addr,
+			const unsigned int words, const unsigned int slots,
+			const bool inc = false, const DMABuffer::MemType type = DMABuffer::USER);
+
+	/**
+	 * Stops the stream and frees the buffers.
+	 */
+	~DMAStream();
+
+	/**
+	 * Starts filling the slots.
+	 */
+	void start();
+
+	/**
+	 * Stops filling the slots. Returns once the transfers in flight are
+	 * finished. Filled slots can still be acquired.
+	 */
+	void stop();
+
+	/**
+	 * Get the oldest filled slot. The data is read in place, and the
+	 * slot must be given back with release().
+	 *
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @return The slot, or NULL on timeout or if the stream is stopped
+	 * and has no filled slots.
+	 */
+	DMABuffer *acquire(const float timeout = 0.0);
+
+	/**
+	 * Get the oldest filled slot if there is one, without waiting.
+	 * @return The slot, or NULL.
+	 */
+	DMABuffer *tryAcquire();
+
+	/**
+	 * Gives back the oldest acquired slot, to be filled again.
+	 *
+	 * @param slot The slot returned by acquire().
+	 * @exception mprace::Exception DMA_STREAM_ERROR if it is not the oldest acquired slot.
+	 */
+	void release(DMABuffer *slot);
+
+	/** Number of slots in the ring. */
+	inline unsigned int getSlots() const { return bufs.size(); }
+
+	/** Size of a slot, in dwords. */
+	inline unsigned int getSlotWords() const { return words; }
+
+	/** Slots filled and not acquired yet. */
+	unsigned int getFillLevel();
+
+	/** Times the engine stopped because the ring was full. */
+	unsigned long getOverruns();
+
+	/** Slots filled since the stream was created. */
+	unsigned long long getFilled();
+
+	/** Transfers which failed, their slots were filled again. */
+	unsigned long getErrors();
+
+	/** True if the service thread is running. */
+	inline bool isRunning() const { return running; }
+
+private:
+	DMAEngineWG *engine;
+	unsigned int bar;
+	unsigned int addr;
+	unsigned int words;
+	bool inc;
+
+	std::vector<DMABuffer *> bufs;	//** The slots, in ring order.
+	unsigned int fill_idx;			//** Next slot to fill.
+	unsigned int read_idx;			//** Next slot to acquire.
+	unsigned int release_idx;		//** Next slot to release.
+	unsigned int filled;			//** Slots filled, not acquired.
+	unsigned int acquired;			//** Slots held by the consumer.
+
+	unsigned long overruns;
+	unsigned long long total;
+	unsigned long errors;
+	bool stalled;					//** The engine is stopped by a full ring.
+
+	bool running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t slot_filled;		//** Signaled when a slot is filled.
+	pthread_cond_t slot_free;		//** Signaled when a slot is released.
+
+	/**
+	 * Body of the service thread.
+	 */
+	void service();
+	static void *serviceThread(void *stream);
+
+	DMABuffer *take();
+
+	DMAStream(const DMAStream&);
+	DMAStream& operator=(const DMAStream&);
+}; /* class DMAStream */
+
+} /* namespace mprace */
+
+#endif /*DMASTREAM_H_*/
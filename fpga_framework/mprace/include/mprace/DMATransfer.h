@@ -0,0 +1,175 @@
+#ifndef DMATRANSFER_H_
+#define DMATRANSFER_H_
+
+#include <vector>
+#include <cstddef>
+#include "DMAEngine.h"
+#include "DMAEngineWG.h"
+
+namespace mprace {
+
+class DMABuffer;
+
+/**
+ * Handle to a DMA transaction started with DMAEngineWG::submit(), or to
+ * a batch of chained transactions started with DMAEngineWG::flush().
+ *
+ * The transaction runs in the background. Completion is detected by
+ * poll() or wait(), which also sync the buffers from the device for
+ * board to host transfers. An optional callback is invoked once, when
+ * the completion is detected.
+ *
+ * Deleting a handle of an unfinished transaction resets its channel.
+ *
+ * The memory of deleted handles is kept and given to the next ones, so
+ * that a submit() and wait() loop does not go to the heap.
+ */
+class DMATransfer {
+	friend class DMAEngineWG;
+public:
+	/**
+	 * Function called when a transfer completes.
+	 * @param transfer The completed transfer.
+	 * @param arg The argument given to setCallback().
+	 */
+	typedef void (*Callback)(DMATransfer& transfer, void *arg);
+
+	/**
+	 * Releases the handle. Aborts the transfer if still running.
+	 */
+	~DMATransfer();
+
+	/**
+	 * Check if the transfer has finished, without blocking.
+	 * @return true if the transfer is finished.
+	 */
+	bool poll();
+
+	/**
+	 * Wait until the transfer is finished.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @exception mprace::Exception* DMA_TIMEOUT if the timeout expires.
+	 * In that case the transfer is aborted.
+	 */
+	void wait(const float timeout = 0.0);
+
+	/**
+	 * Set the function to call on completion. If the transfer is already
+	 * finished, it is called immediately.
+	 * @param cb The function to call, NULL to remove it.
+	 * @param arg Argument passed to the function.
+	 */
+	void setCallback(Callback cb, void *arg = 0);
+
+	/**
+	 * True if the transfer is finished (successfully or not).
+	 */
+	inline bool isDone() const { return done; }
+
+	/**
+	 * Get the final status of the channel, valid once the transfer is done.
+	 * IDLE means success.
+	 */
+	inline DMAEngine::DMAStatus getStatus() const { return status; }
+
+	/**
+	 * Get the channel used by the transfer.
+	 */
+	inline unsigned int getChannel() const { return ch; }
+
+	/**
+	 * Get the number of buffers transferred, more than one for a batch.
+	 */
+	inline unsigned int getSize() const { return nparts; }
+
+	/**
+	 * Get a DMA buffer used by the transfer.
+	 * @param index Position of the buffer in the batch.
+	 */
+	inline DMABuffer& getBuffer(const unsigned int index = 0) { return *(part(index).buf); }
+
+	/**
+	 * Get the number of dwords requested in the transfer, for all its buffers.
+	 */
+	unsigned int getCount() const;
+
+	/**
+	 * Takes the memory of a handle deleted before, if any.
+	 */
+	static void *operator new(size_t size);
+
+	/**
+	 * Keeps the memory of the handle for the next one.
+	 */
+	static void operator delete(void *ptr);
+
+protected:
+	/**
+	 * Creates a handle. Only the engine creates handles.
+	 */
+	DMATransfer(DMAEngineWG& engine, const unsigned int ch);
+
+	/**
+	 * A buffer of the transfer.
+	 */
+	struct part_t {
+		DMABuffer *buf;						//** Buffer transferred.
+		unsigned int count;					//** Dwords requested.
+		unsigned int offset;				//** Offset in the buffer, in dwords.
+	};
+
+	/**
+	 * Adds a buffer to the transfer.
+	 * @return The new part, to be filled by the engine.
+	 */
+	part_t& add(DMABuffer& buf, const unsigned int count, const unsigned int offset = 0);
+
+	/**
+	 * Get a buffer of the transfer.
+	 * @param index Position of the buffer in the batch.
+	 */
+	inline part_t& part(const unsigned int index)
+		{ return (index == 0) ? first : more[index-1]; }
+
+	inline const part_t& part(const unsigned int index) const
+		{ return (index == 0) ? first : more[index-1]; }
+
+	/**
+	 * Marks the transfer as finished, syncs the buffers and frees the channel.
+	 * @param status Final status of the channel.
+	 */
+	void release(DMAEngine::DMAStatus status);
+
+	/**
+	 * Releases the transfer and calls the callback.
+	 * @param status Final status of the channel.
+	 */
+	void complete(DMAEngine::DMAStatus status);
+
+private:
+	DMAEngineWG& engine;		//** Engine running the transfer.
+	unsigned int ch;			//** Channel of the transfer.
+	part_t first;				//** First buffer of the transfer, the only one unless a batch.
+	std::vector<part_t> more;	//** Following buffers of a batch, in order.
+	unsigned int nparts;		//** Number of buffers of the transfer.
+
+	bool done;					//** The transfer is finished.
+	DMAEngine::DMAStatus status;	//** Final status of the channel.
+
+	Callback callback;			//** Function to call on completion.
+	void *callback_arg;			//** Argument for the callback.
+
+	/**
+	 * Overrides default copy constructor, does nothing.
+	 */
+	DMATransfer(const DMATransfer& t) : engine(t.engine) {}
+
+	/**
+	 * Overrides default assignment operation, does nothing.
+	 */
+	DMATransfer& operator=(const DMATransfer&) { return *this; }
+}; /* class DMATransfer */
+
+} /* namespace mprace */
+
+#endif /*DMATRANSFER_H_*/
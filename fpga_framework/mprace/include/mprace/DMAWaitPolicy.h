@@ -0,0 +1,135 @@
+#ifndef DMAWAITPOLICY_H_
+#define DMAWAITPOLICY_H_
+
+namespace mprace {
+
+class DMAEngineWG;
+
+/**
+ * Strategy used by DMAEngineWG::waitChannel() to wait for the end of a
+ * DMA transaction. A policy is selected per engine with
+ * DMAEngineWG::setWaitPolicy().
+ */
+class DMAWaitPolicy {
+public:
+	virtual ~DMAWaitPolicy() {}
+
+	/**
+	 * Wait until the channel is not busy anymore.
+	 *
+	 * @param engine  The engine running the transaction.
+	 * @param channel The channel to wait for.
+	 * @param bytes   Size of the running transaction, in bytes.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @return false if the timeout expired, true otherwise.
+	 */
+	virtual bool wait(DMAEngineWG& engine, const unsigned int channel,
+			const unsigned int bytes, const float timeout) = 0;
+
+	/**
+	 * If the policy waits for interrupts, transactions must be started
+	 * with their interrupts enabled.
+	 */
+	virtual bool usesInterrupts() const = 0;
+
+protected:
+	DMAWaitPolicy() {}
+
+	/**
+	 * True if the channel finished, successfully or by a device timeout.
+	 */
+	static bool finished(DMAEngineWG& engine, const unsigned int channel);
+
+	/**
+	 * Block in the driver until the interrupt of the channel arrives.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @return false if the timeout expired first.
+	 */
+	static bool sleep(DMAEngineWG& engine, const unsigned int channel, const float timeout = 0.0);
+
+	/**
+	 * Sleep on the interrupt of the channel until it finished. A wake up
+	 * alone does not end the wait, the status is checked after each one.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @return false if the timeout expired first.
+	 */
+	static bool sleepUntilFinished(DMAEngineWG& engine, const unsigned int channel, const float timeout = 0.0);
+}; /* class DMAWaitPolicy */
+
+/**
+ * Polls the channel status. After the loop limit of the engine, it
+ * sleeps between polls to release the CPU.
+ */
+class DMAPollWaitPolicy : public DMAWaitPolicy {
+public:
+	virtual bool wait(DMAEngineWG& engine, const unsigned int channel,
+			const unsigned int bytes, const float timeout);
+
+	virtual bool usesInterrupts() const { return false; }
+}; /* class DMAPollWaitPolicy */
+
+/**
+ * Sleeps in the driver until the interrupt of the channel arrives.
+ */
+class DMAInterruptWaitPolicy : public DMAWaitPolicy {
+public:
+	virtual bool wait(DMAEngineWG& engine, const unsigned int channel,
+			const unsigned int bytes, const float timeout);
+
+	virtual bool usesInterrupts() const { return true; }
+}; /* class DMAInterruptWaitPolicy */
+
+/**
+ * Spins while the transaction is expected to finish soon, and sleeps on
+ * the interrupt otherwise.
+ *
+ * The completion time is learned per channel and size class (powers of
+ * two of the byte count), as a moving average of the measured waits.
+ * A wait spins for the expected time times a slack factor, and then
+ * sleeps on the interrupt. If the expected time is longer than the
+ * spin limit, it sleeps on the interrupt right away.
+ */
+class DMAAdaptiveWaitPolicy : public DMAWaitPolicy {
+public:
+	/**
+	 * @param max_spin Longest time to spin, in microseconds.
+	 * @param slack    Factor applied to the expected time to get the spin window.
+	 */
+	DMAAdaptiveWaitPolicy(const float max_spin = 200.0, const float slack = 1.5);
+
+	virtual bool wait(DMAEngineWG& engine, const unsigned int channel,
+			const unsigned int bytes, const float timeout);
+
+	virtual bool usesInterrupts() const { return true; }
+
+	/**
+	 * Get the expected completion time, in microseconds (0.0 if unknown).
+	 */
+	float getExpected(const unsigned int channel, const unsigned int bytes) const;
+
+	/**
+	 * Forget the learned completion times.
+	 */
+	void reset();
+
+	/** Number of waits finished while spinning. */
+	inline unsigned long getSpinCount() const { return spin_count; }
+
+	/** Number of waits which slept on the interrupt. */
+	inline unsigned long getSleepCount() const { return sleep_count; }
+
+private:
+	const static unsigned int NR_CLASSES = 33;	//** Size classes, one per power of two.
+
+	float max_spin;						//** Spin limit, in usec.
+	float slack;						//** Spin window factor.
+	float expected[2][NR_CLASSES];		//** Learned completion times, in usec.
+	unsigned long spin_count;
+	unsigned long sleep_count;
+
+	static unsigned int sizeClass(unsigned int bytes);
+}; /* class DMAAdaptiveWaitPolicy */
+
+} /* namespace mprace */
+
+#endif /*DMAWAITPOLICY_H_*/
@@ -59,6 +59,16 @@ public:
 	 * @exception mprace::Exception on Error.
 	 */
 	virtual void *mmapArea(const unsigned int num) =0;
+
+	/**
+	 * Memory Map an area into User Space Memory, write-combining if the
+	 * driver supports it. Stores into it must be fenced, see util/PIO.h.
+	 * If the area is already mapped, the existing mapping is returned.
+	 * @param num the area number to mmap.
+	 * @return A pointer to access the requested area.
+	 * @exception mprace::Exception on Error.
+	 */
+	virtual void *mmapAreaWC(const unsigned int num) { return mmapArea(num); }
 	
 	/**
 	 * Release an area previously mapped into User Space Memory.
@@ -80,6 +90,15 @@ public:
 	 * This is a blocking call.
 	 */
 	virtual void waitForInterrupt(unsigned int int_id)=0;
+
+	/**
+	 * Wait for the interrupts of several sources, up to a timeout.
+	 * @param mask The IRQ id numbers to wait for, bit i for id i.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @param counts If not NULL, gets the interrupts taken per id.
+	 * @return the mask of the ids which had interrupts, 0 if the timeout expired.
+	 */
+	virtual unsigned int waitForInterrupts(unsigned int mask, float timeout, unsigned int *counts = 0)=0;
 	
 protected:
 	Driver() { }
@@ -57,7 +57,9 @@ public:
 		FIFO_NOT_SUPPORTED,
 		DMA_TIMEOUT,
 		EMPTY_TRANSFER,
-		OVERSIZED_TRANSFER
+		OVERSIZED_TRANSFER,
+		DMA_QUEUE_ERROR,
+		DMA_STREAM_ERROR
 	 };
 	
 	const static char* descriptions[];
@@ -31,9 +31,11 @@ public:
 	/**
 	 * Creates an ML605 board object.
 	 * @param number The number of the board to initialize
+	 * @param write_combining Map the memory BAR write-combining, and write
+	 * blocks to it with wide non-temporal stores (default: false).
 	 * @todo How are boards enumerated?
 	 */
-	ML605(const unsigned int number);
+	ML605(const unsigned int number, const bool write_combining = false);
 
 	/**
 	 * Releases a board.
@@ -284,6 +286,7 @@ protected:
 
 	unsigned int *mem;
 	unsigned int mem_size;
+	bool mem_wc;			// mem mapped write-combining, stores are fenced
 
 	unsigned int *fifo;
 	unsigned int fifo_size;
@@ -58,6 +58,14 @@ public:
 	 * @exception mprace::Exception on Error.
 	 */
 	void *mmapArea(const unsigned int num);
+
+	/**
+	 * Memory Map a BAR into User Space Memory, write-combining.
+	 * @param num the area number to mmap. BAR0-5.
+	 * @return A pointer to access the requested area.
+	 * @exception mprace::Exception on Error.
+	 */
+	void *mmapAreaWC(const unsigned int num);
 	
 	/**
 	 * Release an area previously mapped into User Space Memory.
@@ -97,6 +105,16 @@ public:
 	 * @param int_id The ID value of the interrupt to wait for. This is driver dependent.
 	 */
 	void waitForInterrupt(unsigned int int_id);
+
+	/**
+	 * Wait for the interrupts of several sources, up to a timeout. The
+	 * timeout is enforced in the driver.
+	 * @param mask The interrupt IDs to wait for, bit i for ID i.
+	 * @param timeout Timeout in milliseconds, 0.0 waits forever.
+	 * @param counts If not NULL, gets the interrupts taken per ID.
+	 * @return the mask of the IDs which had interrupts, 0 if the timeout expired.
+	 */
+	unsigned int waitForInterrupts(unsigned int mask, float timeout, unsigned int *counts = 0);
 	
 protected:
 	/**
@@ -0,0 +1,145 @@
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+/* x86 keeps stores in order and loads in order, so stopping the
+ * compiler from reordering is enough there. */
+#if defined(__i386__) || defined(__x86_64__)
+#define MPRACE_SPSC_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define MPRACE_SPSC_BARRIER() __sync_synchronize()
+#endif
+
+namespace mprace {
+
+class DMABuffer;
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one
+ * consumer thread, e.g. the thread driving the DMA engine and the one
+ * processing the data.
+ *
+ * push() and pop() never block and never take a lock. The producer and
+ * consumer indices live in separate cache lines, and each side keeps a
+ * cached copy of the other index so that it reads the shared one only
+ * when the queue looks full (or empty).
+ */
+template <typename T>
+class SPSCQueue {
+public:
+	/**
+	 * Creates an empty queue.
+	 * @param capacity Number of elements, rounded up to a power of two.
+	 */
+	SPSCQueue(const unsigned int capacity);
+
+	~SPSCQueue();
+
+	/**
+	 * Adds an element. Only the producer thread calls it.
+	 * @return false if the queue is full.
+	 */
+	bool push(const T& item);
+
+	/**
+	 * Takes the oldest element. Only the consumer thread calls it.
+	 * @return false if the queue is empty.
+	 */
+	bool pop(T& item);
+
+	/**
+	 * Number of elements in the queue. Only a snapshot while both threads run.
+	 */
+	inline unsigned int size() const { return tail - head; }
+
+	inline bool empty() const { return size() == 0; }
+
+	inline unsigned int capacity() const { return mask + 1; }
+
+private:
+	enum { CACHE_LINE = 64 };
+
+	T *items;
+	unsigned int mask;
+
+	char pad0[CACHE_LINE];
+	volatile unsigned int head;		//** Next element to pop, written by the consumer.
+	unsigned int tail_cache;		//** Consumer copy of tail.
+	char pad1[CACHE_LINE - 2 * sizeof(unsigned int)];
+	volatile unsigned int tail;		//** Next element to push, written by the producer.
+	unsigned int head_cache;		//** Producer copy of head.
+	char pad2[CACHE_LINE - 2 * sizeof(unsigned int)];
+
+	SPSCQueue(const SPSCQueue&);
+	SPSCQueue& operator=(const SPSCQueue&);
+}; /* class SPSCQueue */
+
+/**
+ * Queue of DMA buffers handed from the thread driving the engine to the
+ * thread consuming the data (or back, for the free buffers).
+ */
+typedef SPSCQueue<DMABuffer *> DMABufferQueue;
+
+template <typename T>
+SPSCQueue<T>::SPSCQueue(const unsigned int capacity)
+	: head(0), tail_cache(0), tail(0), head_cache(0)
+{
+	unsigned int c = 1;
+
+	while (c < capacity)
+		c <<= 1;
+
+	mask = c - 1;
+	items = new T[c];
+}
+
+template <typename T>
+SPSCQueue<T>::~SPSCQueue()
+{
+	delete [] items;
+}
+
+template <typename T>
+bool SPSCQueue<T>::push(const T& item)
+{
+	const unsigned int t = tail;
+
+	if (t - head_cache > mask) {
+		head_cache = head;
+		if (t - head_cache > mask)
+			return false;
+	}
+
+	items[t & mask] = item;
+
+	// The element must be visible before the new tail
+	MPRACE_SPSC_BARRIER();
+	tail = t + 1;
+
+	return true;
+}
+
+template <typename T>
+bool SPSCQueue<T>::pop(T& item)
+{
+	const unsigned int h = head;
+
+	if (h == tail_cache) {
+		tail_cache = tail;
+		if (h == tail_cache)
+			return false;
+	}
+
+	// Read the element only after seeing the tail that covers it
+	MPRACE_SPSC_BARRIER();
+	item = items[h & mask];
+
+	// The element must be read before its place is given back
+	MPRACE_SPSC_BARRIER();
+	head = h + 1;
+
+	return true;
+}
+
+} /* namespace mprace */
+
+#endif /*SPSCQUEUE_H_*/
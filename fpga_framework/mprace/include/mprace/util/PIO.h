@@ -0,0 +1,111 @@
+#ifndef PIO_H_
+#define PIO_H_
+
+/********************************************************************
+ * Stores for PIO block writes into a BAR mapped write-combining.
+ *
+ * A plain dword loop into an uncached BAR produces one TLP per dword.
+ * In a write-combining mapping the CPU merges consecutive stores into
+ * full lines, which go out as full-payload TLPs, but it may also merge
+ * repeated stores to one address and reorder stores with respect to
+ * later accesses. These functions use wide non-temporal stores (256 bits
+ * with AVX, 128 bits with SSE2) and end with a store fence, so the data
+ * has left the CPU in order when they return.
+ *
+ * On other mappings the same stores are still correct, only slower
+ * than a plain loop for small blocks in uncached memory.
+ *
+ *******************************************************************/
+
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+ #include <immintrin.h>
+#endif
+
+// Namespace declarations
+namespace mprace {
+	namespace util {
+
+/**
+ * Wait until all the previous stores are globally visible.
+ */
+inline void pioFence()
+{
+#if defined(__SSE2__)
+	_mm_sfence();
+#else
+	__sync_synchronize();
+#endif
+}
+
+/**
+ * Write a block of dwords to incrementing addresses with non-temporal
+ * stores, as wide as the destination alignment allows, then fence.
+ *
+ * @param dst Destination, usually inside a write-combined BAR.
+ * @param src Source values, any alignment.
+ * @param count Number of dwords to write.
+ */
+inline void pioStreamWrite(unsigned int *dst, const unsigned int *src, unsigned int count)
+{
+#if defined(__SSE2__)
+	// single dwords up to a 16 byte boundary of the destination
+	while ((count > 0) && ((reinterpret_cast<unsigned long>(dst) & 15) != 0)) {
+		_mm_stream_si32(reinterpret_cast<int *>(dst), static_cast<int>(*src));
+		dst++; src++; count--;
+	}
+
+#if defined(__AVX__)
+	if ((count >= 4) && ((reinterpret_cast<unsigned long>(dst) & 31) != 0)) {
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+		dst += 4; src += 4; count -= 4;
+	}
+	for ( ; count >= 8; count -= 8) {
+		_mm256_stream_si256(reinterpret_cast<__m256i *>(dst),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+		dst += 8; src += 8;
+	}
+#endif
+
+	for ( ; count >= 4; count -= 4) {
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+		dst += 4; src += 4;
+	}
+
+	for ( ; count > 0; count--)
+		_mm_stream_si32(reinterpret_cast<int *>(dst++), static_cast<int>(*src++));
+#else
+	volatile unsigned int *vdst = dst;
+
+	for (unsigned int i = 0; i < count; i++)
+		vdst[i] = src[i];
+#endif
+	pioFence();
+}
+
+/**
+ * Write a block of dwords to a single address, as to a FIFO. Each store
+ * is fenced, so the write-combining buffer can not merge them into one.
+ *
+ * @param dst Destination address.
+ * @param src Source values.
+ * @param count Number of dwords to write.
+ */
+inline void pioRepeatWrite(unsigned int *dst, const unsigned int *src, unsigned int count)
+{
+	volatile unsigned int *vdst = dst;
+
+	for (unsigned int i = 0; i < count; i++) {
+		*vdst = src[i];
+		pioFence();
+	}
+}
+
+	} /* namespace util */
+} /* namespace mprace */
+
+#endif /*PIO_H_*/
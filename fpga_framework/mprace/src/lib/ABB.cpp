@@ -45,9 +45,11 @@
 #include "PCIDriver.h"
 #include "DMABuffer.h"
 #include "DMAEngineWG.h"
+#include "DMATransfer.h"
 #include "Pin.h"
 #include "Register.h"
 #include "RegisterTristate.h"
+#include "util/PIO.h"
 #include "PinInRegister.h"
 
 using namespace mprace;
@@ -92,7 +94,9 @@ const unsigned int ABB::IRQ_IG = (2);
 const unsigned int ABB::DMA_MEM = (1);
 const unsigned int ABB::DMA_FIFO = (2);
 
-ABB::ABB(const unsigned int number) {
+const unsigned int ABB::DMA_MAX_COUNT = (8192);
+
+ABB::ABB(const unsigned int number, const bool write_combining) : mem_wc(write_combining) {
 	// We need to open the device, map the BARs.
 
 	try {
@@ -104,14 +108,14 @@ ABB::ABB(const unsigned int number) {
 
 		// The board has 2 BARs at the moment
 #ifdef OLD_REGISTERS
-		mem = static_cast<unsigned int *>( driver->mmapArea(0) );
+		mem = static_cast<unsigned int *>( mem_wc ? driver->mmapAreaWC(0) : driver->mmapArea(0) );
 		regs = static_cast<unsigned int *>( driver->mmapArea(1) );
 
 		// The driver returns the size in bytes, we convert it to words
 		mem_size = (driver->getAreaSize(0) >> 2);
 		regs_size = (driver->getAreaSize(1) >> 2);
 #else
-		mem = static_cast<unsigned int *>( driver->mmapArea(CINT_BRAM_SPACE_BAR) );
+		mem = static_cast<unsigned int *>( mem_wc ? driver->mmapAreaWC(CINT_BRAM_SPACE_BAR) : driver->mmapArea(CINT_BRAM_SPACE_BAR) );
 		regs = static_cast<unsigned int *>( driver->mmapArea(CINT_REGS_SPACE_BAR) );
 		fifo = static_cast<unsigned int *>( driver->mmapArea(CINT_FIFO_SPACE_BAR) );
 
@@ -204,6 +208,8 @@ void ABB::write(const unsigned int address, const unsigned int value) {
 	if (address >= mem_size)
 		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
 	*(mem+address) = value;
+	if (mem_wc)
+		util::pioFence();
 
 	if (log != 0)
 		log->write(address,value);
@@ -267,9 +273,13 @@ void ABB::writeBlock(const unsigned int address, const unsigned int *data, const
 		/* for performance, we take the comparison out of the loop,
 		 * and repeat the code.
 		 */
-		if (inc) {
+		if (inc && mem_wc) {
+			util::pioStreamWrite(mem+address, data, count);
+		} else if (inc) {
 			for( i=0 ; i<count ; i++ )
 				*(mem+address+i) = *(data+i);
+		} else if (mem_wc) {
+			util::pioRepeatWrite(mem+address, data, count);
 		} else {
 			for( i=0 ; i<count ; i++ )
 				*(mem+address) = *(data+i);
@@ -282,9 +292,13 @@ void ABB::writeBlock(const unsigned int address, const unsigned int *data, const
 		 */
 		unsigned int fifo_address = address-mem_size;
 
-		if (inc) {
+		if (inc && mem_wc) {
+			util::pioStreamWrite(mem+fifo_address, data, count);
+		} else if (inc) {
 			for( i=0 ; i<count ; i++ )
 				*(mem+fifo_address+i) = *(data+i);
+		} else if (mem_wc) {
+			util::pioRepeatWrite(mem+fifo_address, data, count);
 		} else {
 			for( i=0 ; i<count ; i++ )
 				*(mem+fifo_address) = *(data+i);
@@ -349,9 +363,10 @@ void ABB::writeDMA(const unsigned int address, const DMABuffer& buf, const
 	if (address >= mem_size)
 		throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
 
-	if (inc) {
-		if (count > 8192)
-			throw Exception(Exception::OVERSIZED_TRANSFER);
+	if (inc && (count > DMA_MAX_COUNT)) {
+		dma->transferChunked(0, DMA_MEM, address, const_cast<DMABuffer&>(buf),
+				count, offset, inc, DMA_MAX_COUNT, lock, timeout);
+		return;
 	}
 
 	dma->host2board(DMA_MEM, address, buf, count, offset, inc, lock);
@@ -374,9 +389,10 @@ void ABB::readDMA(const unsigned int address, DMABuffer& buf,
 	if (address >= mem_size)
 		throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
 
-	if (inc) {
-		if (count > 8192)
-			throw Exception(Exception::OVERSIZED_TRANSFER);
+	if (inc && (count > DMA_MAX_COUNT)) {
+		dma->transferChunked(1, DMA_MEM, address, buf, count, offset,
+				inc, DMA_MAX_COUNT, lock, timeout);
+		return;
 	}
 
 	dma->board2host(DMA_MEM, address, buf, count, offset, inc, lock, timeout);
@@ -392,6 +408,42 @@ void ABB::readDMAFIFO(const unsigned int address, DMABuffer& buf,
 	dma->board2host(DMA_FIFO, address, buf, count, offset, inc, lock, timeout);
 }
 
+void ABB::transferDuplex(const unsigned int write_address, const DMABuffer&
+		write_buf, const unsigned int write_count, const unsigned int
+		read_address, DMABuffer& read_buf, const unsigned int
+		read_count, const bool inc, const float timeout)
+{
+	if ((write_address >= mem_size) || (read_address >= mem_size))
+		throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
+
+	// Chunked transfers keep a channel busy for several chains
+	if (inc && ((write_count > DMA_MAX_COUNT) || (read_count > DMA_MAX_COUNT))) {
+		Board::transferDuplex(write_address, write_buf, write_count,
+				read_address, read_buf, read_count, inc, timeout);
+		return;
+	}
+
+	DMATransfer *w = dma->submit(0, DMA_MEM, write_address,
+			const_cast<DMABuffer&>(write_buf), write_count, 0, inc);
+	DMATransfer *r = NULL;
+
+	try {
+		r = dma->submit(1, DMA_MEM, read_address, read_buf, read_count, 0, inc);
+
+		// Both channels are running now, the order of the waits does not matter
+		w->wait(timeout);
+		r->wait(timeout);
+	} catch (...) {
+		// Deleting a transfer still running aborts it
+		delete w;
+		delete r;
+		throw;
+	}
+
+	delete w;
+	delete r;
+}
+
 void ABB::waitForInterrupt(unsigned int int_id) {
 	static_cast<PCIDriver*>(driver)->waitForInterrupt(int_id);
 }
@@ -17,11 +17,20 @@
  *******************************************************************/
 
 #include "Board.h"
+#include "DMABuffer.h"
 #include "Logger.h"
 #include "Exception.h"
+#include "util/Timer.h"
+#include <fstream>
+#include <string>
 
 using namespace mprace;
 
+const unsigned int Board::DEFAULT_CROSSOVER = 64;
+
+/* Runs of each size in calibrateTransfer(), the best one counts */
+#define CALIBRATION_RUNS	5
+
 void Board::enableLog() {
 	log = new Logger();
 }
@@ -78,6 +87,112 @@ void Board::readDMAFIFO(const unsigned int address, DMABuffer& buf, const
 	throw Exception( Exception::DMA_NOT_SUPPORTED );
 }
 
+void Board::transferDuplex(const unsigned int write_address, const DMABuffer&
+		write_buf, const unsigned int write_count, const unsigned int
+		read_address, DMABuffer& read_buf, const unsigned int
+		read_count, const bool inc, const float timeout) {
+	this->writeDMA(write_address, write_buf, write_count, 0, inc, true, timeout);
+	this->readDMA(read_address, read_buf, read_count, 0, inc, true, timeout);
+}
+
+void Board::transfer(const Direction dir, const unsigned int address,
+		DMABuffer& buf, const unsigned int count, const unsigned int offset) {
+	if (count >= crossover[dir]) {
+		if (dir == TO_BOARD)
+			this->writeDMA(address, buf, count, offset);
+		else
+			this->readDMA(address, buf, count, offset);
+		return;
+	}
+
+	if (buf.size() < (offset + count) * sizeof(int))
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+
+	if (dir == TO_BOARD)
+		this->writeBlock(address, buf.getPointer() + offset, count);
+	else
+		this->readBlock(address, buf.getPointer() + offset, count);
+}
+
+void Board::calibrateTransfer(const unsigned int address, DMABuffer& buf,
+		const unsigned int max_count) {
+	util::Timer timer;
+
+	if (buf.size() < max_count * sizeof(int))
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+
+	for (int d = TO_BOARD; d <= FROM_BOARD; d++) {
+		const Direction dir = static_cast<Direction>(d);
+		unsigned int found = 0;		// DMA faster from this size on, 0 if not yet
+
+		for (unsigned int count = 1; count <= max_count; count *= 2) {
+			float pio = 0.0, dma = 0.0;
+
+			for (int run = 0; run < CALIBRATION_RUNS; run++) {
+				timer.start();
+				if (dir == TO_BOARD)
+					this->writeBlock(address, buf.getPointer(), count);
+				else
+					this->readBlock(address, buf.getPointer(), count);
+				timer.stop();
+				if ((run == 0) || (timer.asMillis() < pio))
+					pio = timer.asMillis();
+
+				timer.start();
+				if (dir == TO_BOARD)
+					this->writeDMA(address, buf, count);
+				else
+					this->readDMA(address, buf, count);
+				timer.stop();
+				if ((run == 0) || (timer.asMillis() < dma))
+					dma = timer.asMillis();
+			}
+
+			if (dma < pio) {
+				if (found == 0)
+					found = count;
+			} else {
+				found = 0;
+			}
+		}
+
+		// PIO up to the largest size measured if DMA never won
+		crossover[dir] = (found != 0) ? found : max_count + 1;
+	}
+}
+
+void Board::saveCalibration(const char *filename) const {
+	std::ofstream out(filename);
+
+	if (!out)
+		throw Exception( Exception::FILE_NOT_FOUND );
+
+	out << "mprace-crossover 1" << std::endl
+		<< "to_board " << crossover[TO_BOARD] << std::endl
+		<< "from_board " << crossover[FROM_BOARD] << std::endl;
+
+	if (!out)
+		throw Exception( Exception::FILE_NOT_FOUND );
+}
+
+void Board::loadCalibration(const char *filename) {
+	std::ifstream in(filename);
+	std::string magic, to_key, from_key;
+	unsigned int version, to, from;
+
+	if (!in)
+		throw Exception( Exception::FILE_NOT_FOUND );
+
+	in >> magic >> version >> to_key >> to >> from_key >> from;
+
+	if (!in || (magic != "mprace-crossover") || (version != 1) ||
+			(to_key != "to_board") || (from_key != "from_board"))
+		throw Exception( Exception::UNKNOWN_FILE_FORMAT );
+
+	crossover[TO_BOARD] = to;
+	crossover[FROM_BOARD] = from;
+}
+
 /**
  *
  * As we are not sure whether the specific board instance has a FIFO, we
@@ -41,6 +41,10 @@
 #include "Exception.h"
 #include "pciDriver/lib/pciDriver.h"
 #include <cstdlib>
+#include <sys/mman.h>
+
+/* Size of the huge pages asked for in USER_HUGEPAGES buffers */
+#define HUGEPAGE_SIZE	(2*1024*1024)
 
 using namespace mprace;
 using namespace pciDriver;
@@ -87,6 +91,16 @@ DMABuffer::DMABuffer(Board& b, const unsigned int size, MemType t, unsigned int
 				// Fill the descriptors list of the buffer
 				board.getDMAEngine().fillDescriptorList(*this);
 
+				break;
+			case DMABuffer::USER_HUGEPAGES:
+				ptr = allocHugePages(size);
+				uBuf = &drv->mapUserMemory(ptr,size);
+				kBuf = NULL;
+				this->buf = ptr;
+
+				// Contiguous pages were merged, the list is shorter
+				board.getDMAEngine().fillDescriptorList(*this);
+
 				break;
 			default:
 				throw mprace::Exception( mprace::Exception::UNKNOWN );
@@ -161,54 +175,52 @@ DMABuffer::~DMABuffer()
 				delete [] buf;
 		}
 	}
+
+	// Delete User buffer in huge pages
+	if ((type == DMABuffer::USER_HUGEPAGES) && (uBuf != NULL))  {
+		delete uBuf;
+		munmap(buf, (_size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1));
+	}
 	
 	// Free descriptors	
 	board.getDMAEngine().releaseDescriptorList(*this);
 }
 
+/* The pciDriver directions, for a buffer direction */
+static UserMemory::sync_dir userDir(DMABuffer::SyncDir dir)
+{
+	switch (dir) {
+	case DMABuffer::FROMDEVICE:
+		return UserMemory::FROM_DEVICE;
+	case DMABuffer::TODEVICE:
+		return UserMemory::TO_DEVICE;
+	default:
+		return UserMemory::BIDIRECTIONAL;
+	}
+}
+
+static KernelMemory::sync_dir kernelDir(DMABuffer::SyncDir dir)
+{
+	switch (dir) {
+	case DMABuffer::FROMDEVICE:
+		return KernelMemory::FROM_DEVICE;
+	case DMABuffer::TODEVICE:
+		return KernelMemory::TO_DEVICE;
+	default:
+		return KernelMemory::BIDIRECTIONAL;
+	}
+}
+
 void DMABuffer::sync(SyncDir dir) const
 {	
 	switch (type) {
 	case DMABuffer::USER:
-		UserMemory::sync_dir du;
-		switch (dir) {
-		case DMABuffer::FROMDEVICE:
-			du = UserMemory::FROM_DEVICE;
-			break;
-		case DMABuffer::TODEVICE:
-			du = UserMemory::TO_DEVICE;
-			break;
-		case DMABuffer::BOTH:
-			du = UserMemory::BIDIRECTIONAL;
-			break;
-		default:
-			// ERROR
-			break;
-		}
-
-		uBuf->sync(du);
-		
+	case DMABuffer::USER_HUGEPAGES:
+		uBuf->sync(userDir(dir));
 		break;
 		
 	case DMABuffer::KERNEL:
-		KernelMemory::sync_dir dk;
-		switch (dir) {
-		case DMABuffer::FROMDEVICE:
-			dk = KernelMemory::FROM_DEVICE;
-			break;
-		case DMABuffer::TODEVICE:
-			dk = KernelMemory::TO_DEVICE;
-			break;
-		case DMABuffer::BOTH:
-			dk = KernelMemory::BIDIRECTIONAL;
-			break;
-		default:
-			// ERROR
-			break;
-		}
-
-		kBuf->sync(dk);
-		
+		kBuf->sync(kernelDir(dir));
 		break;
 		
 	default:
@@ -216,3 +228,63 @@ void DMABuffer::sync(SyncDir dir) const
 		break;
 	}
 }
+
+void DMABuffer::sync(SyncDir dir, const unsigned int offset, const unsigned int count) const
+{
+	if (count == 0)
+		return;
+	if (_size < (offset + count) * sizeof(int))
+		throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
+
+	switch (type) {
+	case DMABuffer::USER:
+	case DMABuffer::USER_HUGEPAGES:
+		uBuf->sync(userDir(dir), offset * sizeof(int), count * sizeof(int));
+		break;
+
+	case DMABuffer::KERNEL:
+		kBuf->sync(kernelDir(dir), offset * sizeof(int), count * sizeof(int));
+		break;
+
+	default:
+		// ERROR
+		break;
+	}
+}
+
+unsigned int *DMABuffer::allocHugePages(const unsigned int size)
+{
+	const size_t length = (size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+	char *ptr;
+	size_t head;
+
+	this->alignedMem = true;
+
+#ifdef MAP_HUGETLB
+	// Reserved huge pages, if the administrator set some aside
+	ptr = static_cast<char *>(mmap(NULL, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+	if (ptr != MAP_FAILED)
+		return reinterpret_cast<unsigned int *>(ptr);
+#endif
+
+	// Else transparent huge pages, in a mapping of its own aligned to a
+	// huge page. Not from the heap, where the advice would stay on the
+	// memory after the buffer is gone.
+	ptr = static_cast<char *>(mmap(NULL, length + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (ptr == MAP_FAILED)
+		throw mprace::Exception( mprace::Exception::HUGEPAGES_MMAP_FAILED );
+
+	head = (HUGEPAGE_SIZE - (reinterpret_cast<unsigned long>(ptr) & (HUGEPAGE_SIZE - 1))) & (HUGEPAGE_SIZE - 1);
+	if (head > 0)
+		munmap(ptr, head);
+	munmap(ptr + head + length, HUGEPAGE_SIZE - head);
+	ptr += head;
+
+#ifdef MADV_HUGEPAGE
+	madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+
+	return reinterpret_cast<unsigned int *>(ptr);
+}
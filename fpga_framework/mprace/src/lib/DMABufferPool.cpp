@@ -0,0 +1,148 @@
+#include "Board.h"
+#include "DMABuffer.h"
+#include "DMABufferPool.h"
+
+/* Smallest size class, one page */
+#define POOL_MIN_SIZE 4096
+
+using namespace mprace;
+
+DMABufferPool::Lease::Lease(DMABufferPool& p, const unsigned int size, const DMABuffer::MemType type)
+	: pool(p)
+{
+	buf = pool.get(size, type);
+}
+
+DMABufferPool::Lease::~Lease()
+{
+	release();
+}
+
+void DMABufferPool::Lease::release()
+{
+	if (buf != NULL) {
+		pool.put(buf);
+		buf = NULL;
+	}
+}
+
+DMABufferPool::DMABufferPool(Board& b, const unsigned long long max)
+	: board(b), max_idle(max), hits(0), misses(0), pinned_bytes(0),
+	  idle_bytes(0), leased(0)
+{
+	pthread_mutex_init(&lock, NULL);
+}
+
+DMABufferPool::~DMABufferPool()
+{
+	trim();
+	pthread_mutex_destroy(&lock);
+}
+
+unsigned int DMABufferPool::sizeClass(const unsigned int size)
+{
+	unsigned int c = POOL_MIN_SIZE;
+
+	while ((c < size) && (c < 0x80000000))
+		c <<= 1;
+
+	return c;
+}
+
+DMABuffer *DMABufferPool::get(const unsigned int size, const DMABuffer::MemType type)
+{
+	const unsigned int csize = sizeClass(size);
+	DMABuffer *buf = NULL;
+
+	pthread_mutex_lock(&lock);
+
+	std::vector<DMABuffer *>& list = idle[pool_key(type, csize)];
+	if (!list.empty()) {
+		buf = list.back();
+		list.pop_back();
+		idle_bytes -= csize;
+		hits++;
+		leased++;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (buf != NULL)
+		return buf;
+
+	// Allocating and mapping is slow, do it unlocked
+	buf = new DMABuffer(board, csize, type);
+
+	pthread_mutex_lock(&lock);
+	misses++;
+	leased++;
+	pinned_bytes += csize;
+	pthread_mutex_unlock(&lock);
+
+	return buf;
+}
+
+void DMABufferPool::put(DMABuffer *buf)
+{
+	if (buf == NULL)
+		return;
+
+	const unsigned int csize = buf->size();
+	bool keep;
+
+	pthread_mutex_lock(&lock);
+
+	leased--;
+	keep = (max_idle == 0) || (idle_bytes + csize <= max_idle);
+	if (keep) {
+		idle[pool_key(buf->getType(), csize)].push_back(buf);
+		idle_bytes += csize;
+	} else {
+		pinned_bytes -= csize;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (!keep)
+		delete buf;
+}
+
+void DMABufferPool::reserve(const unsigned int size, const DMABuffer::MemType type, const unsigned int count)
+{
+	const unsigned int csize = sizeClass(size);
+	unsigned int have;
+
+	pthread_mutex_lock(&lock);
+	have = idle[pool_key(type, csize)].size();
+	pthread_mutex_unlock(&lock);
+
+	for (; have < count; have++) {
+		DMABuffer *buf = new DMABuffer(board, csize, type);
+
+		pthread_mutex_lock(&lock);
+		idle[pool_key(type, csize)].push_back(buf);
+		idle_bytes += csize;
+		pinned_bytes += csize;
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+void DMABufferPool::trim()
+{
+	std::vector<DMABuffer *> victims;
+
+	pthread_mutex_lock(&lock);
+
+	std::map<pool_key, std::vector<DMABuffer *> >::iterator it;
+	for (it = idle.begin(); it != idle.end(); ++it) {
+		victims.insert(victims.end(), it->second.begin(), it->second.end());
+		it->second.clear();
+	}
+	pinned_bytes -= idle_bytes;
+	idle_bytes = 0;
+
+	pthread_mutex_unlock(&lock);
+
+	for (unsigned int i = 0; i < victims.size(); i++)
+		delete victims[i];
+}
@@ -29,26 +29,24 @@ DMADescriptorListWG::DMADescriptorListWG( DMABuffer& parent, Type t )
 		this->size = parent.kernel_pieces;
 		break;
 	case DMABuffer::USER:
+	case DMABuffer::USER_HUGEPAGES:
 		this->size = parent.uBuf->getSGcount();
 		break;
 	default:
 		throw "Unknown DMA Buffer Type!";
 	}
 
-	// Chreate the array of descriptor objects
-	array = new DMADescriptorWG[ this->size ];
-
 	// Initialize the native descriptor list
 	this->init( this->size );
 
-	// Link the descriptor objects to the native list
+	// Get the physical address of every native descriptor
 	this->link();
 }
 
 DMADescriptorListWG::~DMADescriptorListWG()
 {
 	delete[] blocks;
-	delete[] array;
+	delete[] pa;
 
 	if ((type == KERNEL) && (kBuf != NULL))
 		delete kBuf;
@@ -65,7 +63,7 @@ void DMADescriptorListWG::init( const unsigned int nr_descriptors )
 	// Initialize native buffer
 	PCIDriver& driver = dynamic_cast<PCIDriver&>( parent->getBoard().getDriver() );
 	void *buf;
-	unsigned int byte_size,nr_pages;
+	unsigned int byte_size,nr_pages,page;
 	
 	switch(type) {
 	case USER:
@@ -80,10 +78,17 @@ void DMADescriptorListWG::init( const unsigned int nr_descriptors )
 		blocks = new block[nr_blocks];
 		for(int i=0;i<nr_blocks;i++) {
 			blocks[i].size = (i==(nr_blocks-1) && (nr_descriptors % desc_per_page)!=0) ? (nr_descriptors % desc_per_page) : desc_per_page;
-			blocks[i].pa = uBuf->getSGentryAddress(i);
 			blocks[i].ptr = static_cast<char*>(buf)+(i*page_size);
 		}
 
+		// An SG entry may still span more than one page: the driver merges
+		// physically contiguous pages, in a non merged list too
+		page = 0;
+		for (unsigned int i = 0; (i < uBuf->getSGcount()) && (page < nr_blocks); i++) {
+			for (unsigned long off = 0; (off < uBuf->getSGentrySize(i)) && (page < nr_blocks); off += page_size)
+				blocks[page++].pa = uBuf->getSGentryAddress(i) + off;
+		}
+
 #if 0
 		for(int i=0;i<nr_blocks;i++) {
 			cerr << i << ": " << hex
@@ -122,47 +127,33 @@ void DMADescriptorListWG::init( const unsigned int nr_descriptors )
 
 void DMADescriptorListWG::link()
 {
-	unsigned int cur_block_index=0;
-	unsigned int cur_block_count=0;
+	unsigned int i = 0;
 
-	unsigned long long pa;
-	DMADescriptorWG::descriptor *native_block;
+	native = static_cast<DMADescriptorWG::descriptor *>(native_ptr);
+	pa = new unsigned long long[size];
 
-	block *cur_block = &(blocks[0]);
-	native_block = static_cast<DMADescriptorWG::descriptor *>(cur_block->ptr);
-	
-	// Walk over the descriptors, linking them to their corresponding native descriptor
-	for( int i=0 ; i<size ; i++,cur_block_count++) {
-		DMADescriptorWG *cur_descriptor = &(array[i]);
-		if (cur_block_count >= cur_block->size) {
-			// go to next block
-			cur_block_index++;
-			cur_block = &(blocks[cur_block_index]);
-			native_block = static_cast<DMADescriptorWG::descriptor *>(cur_block->ptr);
-			cur_block_count=0;
-		}
-		
-		// get the native descriptor addresses
-		pa = cur_block->pa + (cur_block_count*sizeof(DMADescriptorWG::descriptor));
-		cur_descriptor->setNativeDescriptor( native_block+cur_block_count );
-		cur_descriptor->setPhysicalAddress(pa);		
-	}
-	
-#if 0
-	cout << "Linked Descriptors" << endl;
-	for( int i=0 ; i<size ; i++) {
-		DMADescriptorWG *cur_descriptor = &(array[i]);
-		cout << i << ": ";
-		cur_descriptor->printLine();
-		cout << endl;
-	}
-#endif
-	
+	// The blocks follow each other in user space, only their physical
+	// addresses are scattered
+	for (unsigned int b = 0; b < nr_blocks; b++)
+		for (unsigned int j = 0; j < blocks[b].size; j++, i++)
+			pa[i] = blocks[b].pa + j*sizeof(DMADescriptorWG::descriptor);
+}
+
+void DMADescriptorListWG::build(UserMemory& sg)
+{
+	for (unsigned int i = 0; i < size; i++)
+		put(i, sg.getSGentryAddress(i), sg.getSGentrySize(i));
+}
+
+void DMADescriptorListWG::build(const unsigned long long base, const unsigned int step, const unsigned int total)
+{
+	for (unsigned int i = 0; i < size; i++)
+		put(i, base + static_cast<unsigned long long>(i)*step, (i == size-1) ? total - i*step : step);
 }
 
 void DMADescriptorListWG::print()
 {
-	cout << "DescriptorWG size: " << sizeof(DMADescriptorWG) << " bytes" << endl;
+	cout << "Entry view size: " << sizeof(view) << " bytes" << endl;
 	cout << "Native DescriptorWG size: " << sizeof(DMADescriptorWG::descriptor) << " bytes" << endl;
 	
 	cout << "Blocks" << endl;
@@ -176,14 +167,24 @@ void DMADescriptorListWG::print()
 	
 	cout << "Linked Descriptors" << endl;
 	for( int i=0 ; i<size ; i++) {
-		DMADescriptorWG *cur_descriptor = &(array[i]);
 		cout << i << ": ";
-		cur_descriptor->printLine();
+		(*this)[i].printLine();
 		cout << endl;
 	}
 	
 }
 
+void DMADescriptorListWG::view::printLine() const
+{
+	cout << hex
+		<< "[" << getPhysicalAddress() << "] "
+		<< getHostAddress() << " "
+		<< getPeripheralAddress() << " "
+		<< getNextDescriptorAddress() << " "
+		<< getLength() << " "
+		<< getControl() << dec;
+}
+
 void DMADescriptorListWG::sync()
 {
 	switch(type) {
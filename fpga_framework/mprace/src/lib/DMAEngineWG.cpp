@@ -6,19 +6,23 @@
 #include "DMADescriptor.h"
 #include "DMADescriptorWG.h"
 #include "DMADescriptorListWG.h"
+#include "DMATransfer.h"
+#include "DMAWaitPolicy.h"
 #include "Driver.h"
 #include "Exception.h"
 #include "PCIDriver.h"
 #include "pciDriver/lib/pciDriver.h"
 #include <iostream>
+#include <cstdlib>
 #include "util/Timer.h"
 
-/* Call usleep() with 250 between checking for status changes. */
-#define TIMEOUT_PRECISION_USLEEP 1
-
 using namespace mprace;
 using namespace std;
 
+// Wait policies used when none is set in the engine
+static DMAPollWaitPolicy poll_policy;
+static DMAInterruptWaitPolicy interrupt_policy;
+
 const unsigned int DMAEngineWG::STATUS_TOUT = 0x00000010;
 const unsigned int DMAEngineWG::STATUS_BUSY = 0x00000002;
 const unsigned int DMAEngineWG::STATUS_DONE = 0x00000001;
@@ -39,6 +43,12 @@ const unsigned int DMAEngineWG::INTE_CH1   = 0x00000001;
 const unsigned int DMAEngineWG::IRQ_SRC_CH0   = 0;
 const unsigned int DMAEngineWG::IRQ_SRC_CH1   = 1;
 
+// A flushed batch has at most one page worth of heads
+const unsigned int DMAEngineWG::QUEUE_SIZE = 4096 / sizeof(DMADescriptorWG::descriptor);
+
+// Native descriptors in a page of the patch area
+static const unsigned int patch_per_page = 4096 / sizeof(DMADescriptorWG::descriptor);
+
 DMAEngineWG::DMAEngineWG( Driver& drv, unsigned int *base0, unsigned int *base1, unsigned int *INTE, unsigned int *INTS, unsigned int *DMATRANS0, unsigned int *DMATRANS1 )
 	: DMAEngine(drv)
 {
@@ -54,16 +64,41 @@ DMAEngineWG::DMAEngineWG( Driver& drv, unsigned int *base0, unsigned int *base1,
         dmatrans[0] = DMATRANS0;
         dmatrans[1] = DMATRANS1;
 
+	// Recursive, as a channel operation may wait for a previous one
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&chan_lock[0], &attr);
+	pthread_mutex_init(&chan_lock[1], &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_init(&inte_lock, NULL);
+
 	// Reset both DMA channels
 	reset(0);
 	reset(1);
 
+	// Nothing started or submitted yet
+	patched[0] = patched[1] = false;
+	pending[0] = pending[1] = NULL;
+
+	// The patch areas are allocated when first needed
+	for (int i = 0; i < 2; i++) {
+		patch[i].desc = NULL;
+		patch[i].size = 0;
+		patch[i].pa = NULL;
+		patch[i].mem = NULL;
+	}
+
 	// Default value for use Interrupts
 	useInterrupts = false;
 
 	// Default value for loop limit
 	loop_limit = 10;
 
+	// Wait as selected by useInterrupts
+	wait_policy = NULL;
+	last_bytes[0] = last_bytes[1] = 0;
+
 	// Calibrated timer needed for the timeout functionality
 	if (!mprace::util::Timer::is_calibrated())
 		mprace::util::Timer::calibrate();
@@ -71,6 +106,26 @@ DMAEngineWG::DMAEngineWG( Driver& drv, unsigned int *base0, unsigned int *base1,
 
 DMAEngineWG::~DMAEngineWG()
 {
+	releasePatch(0);
+	releasePatch(1);
+
+	pthread_mutex_destroy(&inte_lock);
+	pthread_mutex_destroy(&chan_lock[1]);
+	pthread_mutex_destroy(&chan_lock[0]);
+}
+
+DMAEngineWG::ChannelLock::ChannelLock(DMAEngineWG& engine, const unsigned int ch)
+{
+	if (ch > 1)
+		throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
+
+	mutex = &engine.chan_lock[ch];
+	pthread_mutex_lock(mutex);
+}
+
+DMAEngineWG::ChannelLock::~ChannelLock()
+{
+	pthread_mutex_unlock(mutex);
 }
 
 void DMAEngineWG::reset(const unsigned int ch)
@@ -120,7 +175,10 @@ void DMAEngineWG::enableInterrupt(const unsigned int ch)
 			break;
 	}
 
+	// The IER is shared with the other channel
+	pthread_mutex_lock(&inte_lock);
 	*inte |= mask;
+	pthread_mutex_unlock(&inte_lock);
 }
 
 void DMAEngineWG::disableInterrupt(const unsigned int ch)
@@ -129,17 +187,19 @@ void DMAEngineWG::disableInterrupt(const unsigned int ch)
 
 	switch (ch) {
 		case 0:
-			mask = !INTE_CH0;
+			mask = ~INTE_CH0;
 			break;
 		case 1:
-			mask = !INTE_CH1;
+			mask = ~INTE_CH1;
 			break;
 	}
 
+	pthread_mutex_lock(&inte_lock);
 	*inte &= mask;
+	pthread_mutex_unlock(&inte_lock);
 }
 
-void DMAEngineWG::waitForInterrupt(const unsigned int ch)
+bool DMAEngineWG::waitForInterrupt(const unsigned int ch, const float timeout)
 {
 	unsigned int src;
 
@@ -152,107 +212,43 @@ void DMAEngineWG::waitForInterrupt(const unsigned int ch)
 		break;
 	}
 
+	if (timeout > 0.0)
+		return (drv->waitForInterrupts(1U << src, timeout) != 0);
+
 	drv->waitForInterrupt(src);
+	return true;
 }
 
-void DMAEngineWG::waitChannel(const unsigned int ch, const float timeout)
+DMAWaitPolicy& DMAEngineWG::waitPolicy()
 {
-	if (useInterrupts) {
-                mprace::util::Timer timer;
-
-                timer.start();
-
-		DMAStatus dma_status;
-		if (((dma_status = getStatus(ch)) != IDLE) && (dma_status != TIMEOUT)){
-			enableInterrupt(ch);
-			waitForInterrupt(ch);
-			disableInterrupt(ch);
-		}
-
-                timer.stop();
+	if (wait_policy != NULL)
+		return *wait_policy;
 
-                if (timeout > 0.0 && timer.asMillis() > timeout) {
-                        if (saved[ch]) {
-                                restoreSavedData(ch);
-                                saved[ch] = false;
-                        }
-                        if (dmatrans[ch] != NULL)
-                                throw new mprace::Exception(Exception::DMA_TIMEOUT, *dmatrans[ch]);
-                        else throw new mprace::Exception(Exception::DMA_TIMEOUT);
-                }
-	}
-	else {
-		unsigned long status = (channel[ch])[8];
-                unsigned int loop_count = 0;
-		DMAStatus dma_status;
-		mprace::util::Timer timer;
-
-		timer.start();
-
-		/* Wait for the card being IDLE (success) or the DMA timeout (failure) */
-		while (((dma_status = getStatus(ch)) != IDLE) && (dma_status != TIMEOUT)) {
-			timer.stop();
-			if (timeout > 0.0 && timer.asMillis() > timeout) {
-				if (saved[ch]) {
-					restoreSavedData(ch);
-					saved[ch] = false;
-				}
-
-				if (dmatrans[ch] != NULL)
-					throw new mprace::Exception(Exception::DMA_TIMEOUT, *dmatrans[ch]);
-				else
-					throw new mprace::Exception(Exception::DMA_TIMEOUT);
-			}
-
-			/* Before calling usleep(), we try 10 times if the DMA finishes.
-			 * If it did not finish, it is likely that it will timeout and
-			 * we call usleep() to prevent hogging the CPU. The usleep() will
-			 * make the scheduler select other processes and wait quite
-			 * long (~ 15 msec) until our process gets cpu time again. This
-			 * would drain the performance to < 1 MB/s. */
-			if (loop_count++ > getLoopLimit())
-				usleep(TIMEOUT_PRECISION_USLEEP);
-
-			status = (channel[ch])[8];
-		}
-//		cerr << "Timeout after loop? " << (getStatus(ch) == TIMEOUT ? "yes" : "no") << endl;
-//		cerr << "idle after loop? " << (getStatus(ch) == IDLE ? "yes" : "no") << endl;
-	}
-
-	// If a descriptor was saved, restore it to it correct position in the SG list.
-	// This is only for UserMemory buffers
-	if (saved[ch]) {
-		restoreSavedData(ch);
-		saved[ch] = false;
-	}
+	if (useInterrupts)
+		return interrupt_policy;
+	else
+		return poll_policy;
 }
 
-void DMAEngineWG::restoreSavedData(unsigned int ch)
+bool DMAEngineWG::interruptsArmed()
 {
-	DMADescriptorList *dlist = const_cast<DMADescriptorList *>(saved_data[ch].saved_buf->descriptors);
-	DMADescriptorListWG& list = static_cast<DMADescriptorListWG&>(*dlist);
+	return waitPolicy().usesInterrupts();
+}
 
-	unsigned int max_descriptor = list.getSize()-1;
-	unsigned int index;
+void DMAEngineWG::waitChannel(const unsigned int ch, const float timeout)
+{
+	ChannelLock guard(*this, ch);
 
-	if (saved_data[ch].saved_offset != 0) {
-		// Restore initial descriptor
-		index = saved_data[ch].saved_init_descriptor;
-		list[index].setHostAddress( list[index].getHostAddress() - saved_data[ch].saved_offset );
-		list[index].setLength( list[index].getLength() + saved_data[ch].saved_offset );
-	}
+	bool finished = waitPolicy().wait(*this, ch, last_bytes[ch], timeout);
 
-	if ( saved_data[ch].saved_init_descriptor != max_descriptor )
-		list[ saved_data[ch].saved_init_descriptor+1 ].setControl( 0 );
+	// Finished or given up, the patch area can be written again
+	patched[ch] = false;
 
-	index = saved_data[ch].saved_last_descriptor;
-	list[index].setLength( saved_data[ch].saved_length );
-	list[index].setControl( 0 );
-	if (saved_data[ch].saved_last_descriptor == max_descriptor) {
-		list[index].setNextDescriptorAddress( 0UL );
-	}
-	else {
-		list[index].setNextDescriptorAddress( list[index+1].getPhysicalAddress() );
+	if (!finished) {
+		if (dmatrans[ch] != NULL)
+			throw new mprace::Exception(Exception::DMA_TIMEOUT, *dmatrans[ch]);
+		else
+			throw new mprace::Exception(Exception::DMA_TIMEOUT);
 	}
 }
 
@@ -266,56 +262,42 @@ void DMAEngineWG::fillDescriptorList(DMABuffer& buf)
 	if (buf.getType() == DMABuffer::KERNEL_PIECES) {
 		DMADescriptorListWG *dlist = new DMADescriptorListWG(buf, DMADescriptorListWG::USER);
 		buf.descriptors = dlist;
-		DMADescriptorListWG& list = *dlist;
-
-		unsigned long long base_ha = buf.kBuf->getPhysicalAddress();
-		unsigned int step = buf.size() / buf.kernel_pieces;
-		unsigned int count = 0;
-
-		for(int i=0 ; i<buf.kernel_pieces ; i++) {
-			DMADescriptorWG *descriptor;
-			descriptor = &(list[i]);
-
-			descriptor->setHostAddress( base_ha + i*step );
-			descriptor->setLength( (i == (buf.kernel_pieces-1)) ? buf.size()-count : step );
-			descriptor->setControl( 0 );
-			descriptor->setPeripheralAddress(0UL);
-			descriptor->setNextDescriptorAddress( (i == (buf.kernel_pieces-1)) ? 0UL : list[i+1].getPhysicalAddress() );
-			count += step;
-		}
+
+		dlist->build(buf.kBuf->getPhysicalAddress(), buf.size() / buf.kernel_pieces, buf.size());
 	}
 
 
-	if (buf.getType() == DMABuffer::USER) {
+	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::USER_HUGEPAGES)) {
 		DMADescriptorListWG *dlist = new DMADescriptorListWG(buf, DMADescriptorListWG::USER);
 		buf.descriptors = dlist;
-		DMADescriptorListWG& list = *dlist;
-
-		// Set the pointer to the next descriptor
-		for( int i=0 ; i < buf.uBuf->getSGcount() ; i++ ) {
-			DMADescriptorWG *descriptor;
-			descriptor = &list[i];
-
-			descriptor->setHostAddress( buf.uBuf->getSGentryAddress(i) );
-			descriptor->setLength( buf.uBuf->getSGentrySize(i) );
-			descriptor->setControl( 0 );
-			descriptor->setPeripheralAddress(0UL);
-			descriptor->setNextDescriptorAddress( (i == (buf.uBuf->getSGcount()-1)) ? 0UL : list[i+1].getPhysicalAddress() );
-		}
+
+		// One entry per SG entry, each pointing to the next one
+		dlist->build(*(buf.uBuf));
+	}
+
+	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::USER_HUGEPAGES) ||
+		(buf.getType() == DMABuffer::KERNEL_PIECES)) {
+		DMADescriptorListWG& list = *(static_cast<DMADescriptorListWG*>(buf.descriptors));
+
+		// The list is not modified by the transactions anymore. Its last
+		// descriptor ends the chain of those running up to the end.
+		list[ list.getSize()-1 ].setControl( CTRL_LAST | CTRL_V );
+		list.sync();
 	}
 }
 
 void DMAEngineWG::releaseDescriptorList(DMABuffer& buf)
 {
 	// Release the Kernel Buffer associated with the Descriptor List of the buffer
-	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::KERNEL_PIECES)) {
+	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::USER_HUGEPAGES) ||
+		(buf.getType() == DMABuffer::KERNEL_PIECES)) {
 		delete buf.descriptors;
 	}
 }
 
-void DMAEngineWG::host2board(const unsigned int bar, const unsigned int addr,
-		const DMABuffer& buf, const unsigned int count, const unsigned
-		int offset, const bool inc, const bool lock, const float timeout)
+void DMAEngineWG::startTransfer(const unsigned int ch, const unsigned int bar,
+		const unsigned int addr, const DMABuffer& buf, const unsigned int
+		count, const unsigned int offset, const bool inc)
 {
         /* Checks if count != 0 */
         if (count == 0)
@@ -325,44 +307,81 @@ void DMAEngineWG::host2board(const unsigned int bar, const unsigned int addr,
         if (buf.size() < (offset + count) * sizeof(int))
                 throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
 
-	this->reset(0);
+	/* The channel must be free before it is programmed again. A submitted
+	 * transfer, or an unlocked one still using the patch area, is
+	 * finished first. */
+	if (pending[ch] != NULL)
+		pending[ch]->wait();
+	if (patched[ch])
+		this->waitChannel(ch);
+
+	this->reset(ch);
+	last_bytes[ch] = count * 4;
 
 #ifndef OLD_REGISTERS
-	if (!useInterrupts)
-		this->disableInterrupt(0);
+	if (!interruptsArmed())
+		this->disableInterrupt(ch);
 #endif
 
+	if (ch == 0) {
+		buf.sync(DMABuffer::TODEVICE, offset, count);
+	}
+	else if (offset > 0 || count < buf.size() / 4) {
+		/* If the transfersize is not equal to the buffersize we need
+		 * to sync the range into the SWIOTLB, otherwise the SWIOTLB
+		 * might sync invalid data back into the buffer (it syncs whole
+		 * SG entries, which may hold more than the device writes).  */
+		buf.sync(DMABuffer::TODEVICE, offset, count);
+	}
+
 	if (buf.getType() == DMABuffer::KERNEL) {
 		// Single descriptor, easy
 		pciDriver::KernelMemory *kb = buf.kBuf;
-		DMADescriptorWG d;
+		DMADescriptorWG::descriptor native;
+		DMADescriptorWG d(&native);
 		unsigned long control;
 		unsigned int CTRL_BAR = (bar & 0x00000007) << 16;
 
-		d.setHostAddress( kb->getPhysicalAddress() + offset );
+		d.setHostAddress( kb->getPhysicalAddress() + offset*4 );
 		d.setPeripheralAddress(addr*4);
 		d.setNextDescriptorAddress(0L);
 		d.setLength(count*4);
 		control = CTRL_LAST | CTRL_BAR;
 #ifndef OLD_REGISTERS
 		control |= CTRL_UPA | CTRL_V;
-		control |= (useInterrupts) ? CTRL_EDI : 0x0;
+		control |= (interruptsArmed()) ? CTRL_EDI : 0x0;
 #endif
 		control |= (inc) ? CTRL_INC : 0x0;
 		d.setControl(control);
 
-		saved[0] = false;
+		this->write(ch,d);
+	}
+
+	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::USER_HUGEPAGES) ||
+		(buf.getType() == DMABuffer::KERNEL_PIECES)) {
+		range_t r;
+		unsigned int next = 0;
+		DMADescriptorWG::descriptor *last;
 
-		buf.sync(DMABuffer::BOTH);
+		locate(buf, count, offset, true, r);
+		reservePatch(ch, r.patches);
 
-		// host2board is channel 0
-		this->write(0,d);
-	}
+		DMADescriptorWG head( buildChain(ch, next, bar, addr, buf, r, inc, last) );
+		patch[ch].mem->sync(pciDriver::UserMemory::TO_DEVICE, 0, next * sizeof(DMADescriptorWG::descriptor));
+		patched[ch] = true;
 
-	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::KERNEL_PIECES)) {
-		buf.sync(DMABuffer::BOTH);
-		sendDescriptorList(bar,addr,buf,count,offset,inc,0);
+		this->write(ch,head);
 	}
+}
+
+void DMAEngineWG::host2board(const unsigned int bar, const unsigned int addr,
+		const DMABuffer& buf, const unsigned int count, const unsigned
+		int offset, const bool inc, const bool lock, const float timeout)
+{
+	ChannelLock guard(*this, 0);
+
+	// host2board is channel 0
+	startTransfer(0, bar, addr, buf, count, offset, inc);
 
 	if (lock)
 		this->waitChannel(0, timeout);
@@ -372,6 +391,50 @@ void DMAEngineWG::board2host(const unsigned int bar, const unsigned int addr,
 		DMABuffer& buf, const unsigned int count, const unsigned int
 		offset, const bool inc, const bool lock, const float timeout)
 {
+	ChannelLock guard(*this, 1);
+
+	// board2host is channel 1
+	startTransfer(1, bar, addr, buf, count, offset, inc);
+
+	if (lock) {
+                try {
+                        this->waitChannel(1, timeout);
+                } catch (...) {
+                        buf.sync(DMABuffer::FROMDEVICE, offset, count);
+                        throw;
+                }
+		buf.sync(DMABuffer::FROMDEVICE, offset, count);
+	}
+}
+
+DMATransfer *DMAEngineWG::submit(const unsigned int ch, const unsigned int bar,
+		const unsigned int addr, DMABuffer& buf, const unsigned int count,
+		const unsigned int offset, const bool inc)
+{
+	ChannelLock guard(*this, ch);
+
+	DMATransfer *t = new DMATransfer(*this, ch);
+	t->add(buf, count, offset);
+
+	try {
+		startTransfer(ch, bar, addr, buf, count, offset, inc);
+	} catch (...) {
+		// Nothing was started, release the handle without touching the channel
+		t->done = true;
+		delete t;
+		throw;
+	}
+
+	pending[ch] = t;
+	return t;
+}
+
+void DMAEngineWG::enqueue(const unsigned int ch, const unsigned int bar,
+		const unsigned int addr, DMABuffer& buf, const unsigned int count,
+		const unsigned int offset, const bool inc)
+{
+	ChannelLock guard(*this, ch);
+
         /* Checks if count != 0 */
         if (count == 0)
                 throw Exception(Exception::EMPTY_TRANSFER);
@@ -380,204 +443,333 @@ void DMAEngineWG::board2host(const unsigned int bar, const unsigned int addr,
         if (buf.size() < (offset + count) * sizeof(int))
                 throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
 
-	this->reset(1);
+	if (queue[ch].size() >= QUEUE_SIZE)
+		throw Exception(Exception::DMA_QUEUE_ERROR);
+
+	queued_t q;
+	q.bar = bar;
+	q.addr = addr;
+	q.buf = &buf;
+	q.count = count;
+	q.offset = offset;
+	q.inc = inc;
+	queue[ch].push_back(q);
+}
 
-#ifndef OLD_REGISTERS
-	if (!useInterrupts)
-		this->disableInterrupt(1);
-#endif
+DMATransfer *DMAEngineWG::flush(const unsigned int ch)
+{
+	ChannelLock guard(*this, ch);
 
-        if (offset > 0 || count < buf.size() / 4) {
-		/* If the transfersize is not equal to the buffersize we need
-		 * to sync the buffer into the SWIOTLB, otherwise the SWIOTLB
-		 * might sync invalid data back into the buffer (it will sync
-		 * more than actually transferred because only the device
-		 * itself knows where it will transfer data to).  */
-                buf.sync(DMABuffer::TODEVICE);
-        }
+	std::vector<queued_t>& q = queue[ch];
 
-	if (buf.getType() == DMABuffer::KERNEL) {
-		// Single descriptor, easy
-		pciDriver::KernelMemory *kb = buf.kBuf;
-		DMADescriptorWG d;
-		unsigned long control;
-		unsigned int CTRL_BAR = (bar & 0x00000007) << 16;
+	if (q.empty())
+		return NULL;
 
-		d.setPeripheralAddress(addr*4);
-		d.setHostAddress( kb->getPhysicalAddress() + offset );
-		d.setNextDescriptorAddress(0);
-		d.setLength(count*4);
-		control = CTRL_LAST | CTRL_BAR;
-#ifndef OLD_REGISTERS
-		control |= CTRL_UPA | CTRL_V;
-		control |= (useInterrupts) ? CTRL_EDI : 0x0;
-#endif
-		control |= (inc) ? CTRL_INC : 0x0;
-		d.setControl(control);
+	// A single transaction needs no chaining
+	if (q.size() == 1) {
+		queued_t e = q[0];
+		q.clear();
+		return submit(ch, e.bar, e.addr, *(e.buf), e.count, e.offset, e.inc);
+	}
 
-		saved[1] = false;
+	DMATransfer *t = new DMATransfer(*this, ch);
 
-		// board2host is channel 1
-		this->write(1,d);
+	try {
+		startBatch(ch, t);
+	} catch (...) {
+		q.clear();
+		t->done = true;
+		delete t;
+		throw;
 	}
 
-	if ((buf.getType() == DMABuffer::USER) || (buf.getType() == DMABuffer::KERNEL_PIECES)) {
-		sendDescriptorList(bar,addr,buf,count,offset,inc,1);
+	pending[ch] = t;
+	return t;
+}
+
+void DMAEngineWG::startBatch(const unsigned int ch, DMATransfer *t)
+{
+	std::vector<queued_t>& q = queue[ch];
+
+	// The channel must be free before it is programmed again
+	if (pending[ch] != NULL)
+		pending[ch]->wait();
+	if (patched[ch])
+		this->waitChannel(ch);
+
+	// Where each transaction falls in its descriptor list. Only the last
+	// one may end in the list itself, the others are chained to the next.
+	std::vector<range_t>& ranges = batch_ranges[ch];
+	unsigned int needed = 0;
+
+	ranges.resize(q.size());
+
+	for (unsigned int i = 0; i < q.size(); i++) {
+		if (q[i].buf->getType() == DMABuffer::KERNEL) {
+			needed++;
+		} else {
+			locate(*(q[i].buf), q[i].count, q[i].offset, (i == q.size()-1), ranges[i]);
+			needed += ranges[i].patches;
+		}
 	}
 
-	if (lock) {
-                try {
-                        this->waitChannel(1, timeout);
-                } catch (...) {
-                        buf.sync(DMABuffer::FROMDEVICE);
-                        throw;
-                }
-		buf.sync(DMABuffer::FROMDEVICE);
+	reservePatch(ch, needed);
+	this->reset(ch);
+
+#ifndef OLD_REGISTERS
+	if (!interruptsArmed())
+		this->disableInterrupt(ch);
+#endif
+
+	if (t != NULL)
+		t->more.reserve(q.size() - 1);
+
+	last_bytes[ch] = 0;
+	for (unsigned int i = 0; i < q.size(); i++)
+		last_bytes[ch] += q[i].count * 4;
+
+	DMADescriptorWG::descriptor *first = NULL;	// head of the batch
+	DMADescriptorWG::descriptor *prev = NULL;	// last descriptor of the previous transaction
+	unsigned int next = 0;						// next free descriptor of the patch area
+
+	for (unsigned int i = 0; i < q.size(); i++) {
+		queued_t& e = q[i];
+		DMADescriptorWG::descriptor *head, *last;
+		unsigned long long head_pa = patchAddress(ch, next);
+
+		if (t != NULL)
+			t->add(*(e.buf), e.count, e.offset);
+
+		if ((ch == 0) || (e.offset > 0 || e.count < e.buf->size() / 4))
+			e.buf->sync(DMABuffer::TODEVICE, e.offset, e.count);
+
+		if (e.buf->getType() == DMABuffer::KERNEL) {
+			// A single descriptor
+			unsigned long control = CTRL_LAST | CTRL_UPA | CTRL_V | ((e.bar & 0x00000007) << 16);
+			control |= (e.inc) ? CTRL_INC : 0x0;
+			control |= (interruptsArmed()) ? CTRL_EDI : 0x0;
+
+			DMADescriptorWG d( patch[ch].desc+next, head_pa, e.addr*4,
+					e.buf->kBuf->getPhysicalAddress() + e.offset*4,
+					e.count*4, 0UL, control );
+
+			head = last = patch[ch].desc+next;
+			next++;
+		}
+		else {
+			head = buildChain(ch, next, e.bar, e.addr, *(e.buf), ranges[i], e.inc, last);
+		}
+
+		if (prev == NULL) {
+			first = head;
+		} else {
+			// Chain the previous transaction to this one. Only the end of
+			// the batch raises the interrupt.
+			prev->next_bda_h = HIGH(head_pa);
+			prev->next_bda_l = LOW(head_pa);
+			prev->control &= ~(CTRL_LAST | CTRL_EDI);
+		}
+		prev = last;
 	}
+
+	// The chain is complete, make the descriptors used visible to the device
+	patch[ch].mem->sync(pciDriver::UserMemory::TO_DEVICE, 0, next * sizeof(DMADescriptorWG::descriptor));
+	patched[ch] = true;
+
+	q.clear();
+
+	// Send the head of the batch
+	DMADescriptorWG d(first);
+	this->write(ch,d);
 }
 
-void DMAEngineWG::sendDescriptorList(const unsigned int bar, const unsigned int addr, const DMABuffer& buf, const unsigned int count, const unsigned int offset, const bool inc, const unsigned int ch)
+void DMAEngineWG::transferChunked(const unsigned int ch, const unsigned int bar,
+		const unsigned int addr, DMABuffer& buf, const unsigned int count,
+		const unsigned int offset, const bool inc, const unsigned int chunk,
+		const bool lock, const float timeout)
 {
-	pciDriver::UserMemory *uBuf = buf.uBuf;
-
-	// get the list of descriptors for this buffer
-	DMADescriptorList *dlist = buf.descriptors;
-	DMADescriptorListWG& list = *(static_cast<DMADescriptorListWG*>(dlist));
+	ChannelLock guard(*this, ch);
 
-	unsigned int nr_descriptors = list.getSize();
+        /* Checks if count != 0 */
+        if ((count == 0) || (chunk == 0))
+                throw Exception(Exception::EMPTY_TRANSFER);
 
-	unsigned int init_descriptor,last_descriptor;
-	unsigned int control_word;
-	unsigned int CTRL_BAR = (bar & 0x00000007) << 16;
-	DMADescriptorWG temp;
+        /* Checks if the transfer-size exceeds the buffer size */
+        if (buf.size() < (offset + count) * sizeof(int))
+                throw Exception(Exception::ADDRESS_OUT_OF_RANGE);
 
-	control_word = CTRL_V | CTRL_BAR;
-	control_word |= (inc) ? CTRL_INC : 0x0;
-	#ifdef OLD_REGISTERS
-		control_word |= (useInterrupts) ? CTRL_EDI : 0x0;
-	#endif
+	// The chunks use the queue of the channel
+	if (!queue[ch].empty())
+		throw Exception(Exception::DMA_QUEUE_ERROR);
 
-	// Check first for the fast and easy conditions
-	// Optimize for the fast case
-	if ((offset==0) && ((count*4)==buf.size())) {
-		// set first, second and last descriptors
-		last_descriptor = nr_descriptors-1;
-
-                /* because the board will propagate the control_word of the
-                 * first descriptor to all other descriptors, we need to set
-                 * the "real" control_word on the second descriptor (as the
-                 * first one and the last one have special flags). */
-		if (nr_descriptors > 2)
-			list[1].setControl( control_word );
-
-		list[last_descriptor].setControl( control_word | CTRL_LAST );
-
-		saved_data[ch].saved_last_descriptor = last_descriptor;
-		saved_data[ch].saved_length = list[last_descriptor].getLength();
-		saved_data[ch].saved_offset = 0;
-		saved_data[ch].saved_init_descriptor = 0;
-		saved_data[ch].saved_buf = &buf;
-		saved[ch] = true;
-
-		// write first descriptor
-		temp = list[0];
-		temp.setPeripheralAddress( addr*4 );
-		temp.setControl( (control_word | CTRL_UPA) | ((nr_descriptors == 1) ? CTRL_LAST : 0x0) );
-
-		//list.print();
-		list.sync();
+	unsigned int done = 0;
 
-		// Send
-		this->write(ch,temp);
-	} // end fast condition: offset=0, length=max
-	else {
-		// We need either to apply an offset, end the buffer before its limit, or both.
-		// get to the starting point
-		unsigned int init_descriptor = 0;
-		unsigned int byte_count=0;
-		unsigned int byte_offset = offset*4;
-		unsigned int block_offset=0;
-
-		if (offset != 0) {
-			while (init_descriptor < nr_descriptors) {
-				if (byte_offset > byte_count + list[init_descriptor].getLength()) {
-					byte_count += list[init_descriptor].getLength();
-					init_descriptor++;
-				} else {
-                                        /* We found the descriptor with which we will start.
-                                         * Because we may have skipped some descriptors, we
-                                         * need to decrease the offset by these skipped bytes */
-					block_offset = byte_offset - byte_count;
-					break;
-				}
-			}
+	while (done < count) {
+		// Up to a queue of chunks in one chain, run back-to-back by the engine
+		for (unsigned int n = 0; (n < QUEUE_SIZE) && (done < count); n++) {
+			const unsigned int c = (count - done > chunk) ? chunk : count - done;
+			enqueue(ch, bar, (inc) ? addr + done : addr, buf, c, offset + done, inc);
+			done += c;
 		}
 
-                last_descriptor = init_descriptor;
-
-		byte_count = (count * 4);
-
-		while (last_descriptor < nr_descriptors) {
-                        bool fits_in_descriptor;
-
-                        /* Check if the amount of bytes we want to transfer fits into
-                         * this descriptor. For the first descriptor, we need to take
-                         * the block offset into account (the descriptor length is not
-                         * yet modified as we might need to save it when there is only
-                         * one descriptor). */
-                        if (last_descriptor == init_descriptor)
-                                fits_in_descriptor = (byte_count <= (list[init_descriptor].getLength() - block_offset));
-                        else fits_in_descriptor = (byte_count <= list[last_descriptor].getLength());
-
-			if (fits_in_descriptor) {
-				// save the current descriptor
-				// we are interested only in the descriptor number and the length.
-				saved_data[ch].saved_length = list[last_descriptor].getLength();
-				saved_data[ch].saved_offset = block_offset;
-				saved_data[ch].saved_init_descriptor = init_descriptor;
-				saved_data[ch].saved_last_descriptor = last_descriptor;
-				saved_data[ch].saved_buf = &buf;
-				saved[ch] = true;
-
-				// set this as truly the last descriptor
-				list[last_descriptor].setLength( byte_count );
-				list[last_descriptor].setNextDescriptorAddress( 0L );
-				list[last_descriptor].setControl( control_word | CTRL_LAST );
-				break;
-			} else {
-                                if (last_descriptor == init_descriptor)
-                                        byte_count -= (list[init_descriptor].getLength() - block_offset);
-                                else byte_count -= list[last_descriptor].getLength();
-				last_descriptor++;
-			}
+		try {
+			startBatch(ch, NULL);
+			if (lock || (done < count))
+				this->waitChannel(ch, timeout);
+		} catch (...) {
+			queue[ch].clear();
+			if (ch == 1)
+				buf.sync(DMABuffer::FROMDEVICE, offset, count);
+			throw;
 		}
+	}
+
+	if (lock && (ch == 1))
+		buf.sync(DMABuffer::FROMDEVICE, offset, count);
+}
 
-		// Adjust control word of second descriptor
-		if (init_descriptor+1 < last_descriptor)
-			list[ init_descriptor+1 ].setControl( control_word );
+void DMAEngineWG::reservePatch(const unsigned int ch, const unsigned int n)
+{
+	if (n <= patch[ch].size)
+		return;
 
-		temp = list[init_descriptor];
-                unsigned long long new_host_address = temp.getHostAddress() + block_offset;
+	PCIDriver *pd = dynamic_cast<PCIDriver*>(drv);
+	if (pd == NULL)
+		throw Exception(Exception::DMA_NOT_SUPPORTED);
 
-                temp.setHostAddress(new_host_address);
-                list[init_descriptor].setHostAddress(new_host_address);
+	unsigned int pages = (n + patch_per_page - 1) / patch_per_page;
+	void *area;
+	pciDriver::UserMemory *mem;
 
-                /* If only one descriptor is involved, we have already set the
-                 * correct length (byte_count) a few lines above, so do not
-                 * touch it here. */
-                if (init_descriptor != last_descriptor) {
-                        unsigned long new_length = temp.getLength() - block_offset;
-                        temp.setLength(new_length);
-                        list[init_descriptor].setLength(new_length);
-                }
+	if (posix_memalign(&area, 4096, pages*4096) != 0)
+		throw Exception(Exception::USER_MMAP_FAILED);
 
-		temp.setPeripheralAddress( addr*4 );
-		temp.setControl( (control_word | CTRL_UPA) | ((init_descriptor == last_descriptor) ? CTRL_LAST : 0x0) );
+	try {
+		mem = &pd->mapUserMemory(area, pages*4096, false);
+	} catch (...) {
+		free(area);
+		throw;
+	}
 
-		//list.print();
-		list.sync();
+	releasePatch(ch);
+
+	patch[ch].desc = static_cast<DMADescriptorWG::descriptor *>(area);
+	patch[ch].size = pages * patch_per_page;
+	patch[ch].mem = mem;
+
+	// An SG entry may still span more than one page
+	patch[ch].pa = new unsigned long long[pages];
+	unsigned int page = 0;
+	for (unsigned int i = 0; (i < mem->getSGcount()) && (page < pages); i++) {
+		for (unsigned int off = 0; (off < mem->getSGentrySize(i)) && (page < pages); off += 4096)
+			patch[ch].pa[page++] = mem->getSGentryAddress(i) + off;
+	}
+}
+
+void DMAEngineWG::releasePatch(const unsigned int ch)
+{
+	if (patch[ch].mem == NULL)
+		return;
+
+	delete patch[ch].mem;
+	free(patch[ch].desc);
+	delete [] patch[ch].pa;
+
+	patch[ch].desc = NULL;
+	patch[ch].size = 0;
+	patch[ch].pa = NULL;
+	patch[ch].mem = NULL;
+}
+
+unsigned long long DMAEngineWG::patchAddress(const unsigned int ch, const unsigned int index)
+{
+	return patch[ch].pa[index / patch_per_page] + (index % patch_per_page) * sizeof(DMADescriptorWG::descriptor);
+}
+
+void DMAEngineWG::locate(const DMABuffer& buf, const unsigned int count, const unsigned int offset, const bool terminal, range_t& r)
+{
+	DMADescriptorListWG& list = *(static_cast<DMADescriptorListWG*>(buf.descriptors));
+	const unsigned int nr_descriptors = list.getSize();
+
+	unsigned long skip = offset*4;
+	unsigned long left = count*4;
+
+	// Skip the descriptors before the offset
+	r.init = 0;
+	while ((r.init < nr_descriptors-1) && (skip >= list[r.init].getLength())) {
+		skip -= list[r.init].getLength();
+		r.init++;
+	}
+	r.init_offset = skip;
+
+	// Go on until the count fits. The caller checked it fits in the buffer.
+	unsigned long avail = list[r.init].getLength() - skip;
+	r.last = r.init;
+	while ((left > avail) && (r.last < nr_descriptors-1)) {
+		left -= avail;
+		r.last++;
+		avail = list[r.last].getLength();
+	}
+	r.last_length = left;
+
+	/* A transaction running up to the end of the buffer ends with the
+	 * list itself. Only the head and the descriptor after it are written,
+	 * this one because the engine takes the control word for the rest of
+	 * the chain from the first descriptor it fetches. */
+	r.shared = terminal && (r.last == nr_descriptors-1) && (r.last > r.init+1) &&
+			(r.last_length == list[r.last].getLength());
+
+	if (r.init == r.last)
+		r.patches = 1;
+	else if (r.shared)
+		r.patches = 2;
+	else
+		r.patches = r.last - r.init + 1;
+}
+
+DMADescriptorWG::descriptor *DMAEngineWG::buildChain(const unsigned int ch, unsigned int& next, const unsigned int bar, const unsigned int addr, const DMABuffer& buf, const range_t& r, const bool inc, DMADescriptorWG::descriptor *&last)
+{
+	DMADescriptorListWG& list = *(static_cast<DMADescriptorListWG*>(buf.descriptors));
+
+	unsigned int control_word;
+	unsigned int CTRL_BAR = (bar & 0x00000007) << 16;
+
+	control_word = CTRL_V | CTRL_BAR;
+	control_word |= (inc) ? CTRL_INC : 0x0;
+	#ifdef OLD_REGISTERS
+		control_word |= (interruptsArmed()) ? CTRL_EDI : 0x0;
+	#endif
+
+	// The head starts at the offset, and loads the peripheral address
+	const bool single = (r.init == r.last);
+	DMADescriptorWG head( patch[ch].desc+next, patchAddress(ch, next), addr*4,
+			list[r.init].getHostAddress() + r.init_offset,
+			(single) ? r.last_length : list[r.init].getLength() - r.init_offset,
+			0UL, (control_word | CTRL_UPA) | ((single) ? CTRL_LAST : 0x0) );
+	next++;
+
+	last = head.getNativeDescriptor();
+
+	for (unsigned int i = r.init+1; i <= r.last; i++) {
+		const bool tail = (i == r.last);
+		unsigned long control = (tail) ? (control_word | CTRL_LAST) : ((i == r.init+1) ? control_word : 0);
+		unsigned long long pa = patchAddress(ch, next);
+
+		DMADescriptorWG d( patch[ch].desc+next, pa, 0UL, list[i].getHostAddress(),
+				(tail) ? r.last_length : list[i].getLength(), 0UL, control );
+		next++;
+
+		last->next_bda_h = HIGH(pa);
+		last->next_bda_l = LOW(pa);
+		last = d.getNativeDescriptor();
+
+		if (r.shared) {
+			// The rest of the list, unchanged, up to its end
+			d.setNextDescriptorAddress( list[i].getNextDescriptorAddress() );
+			last = list[r.last].getNativeDescriptor();
+			break;
+		}
+	}
 
-		// Send
-		this->write(ch,temp);
-	} // End conditional cases
+	return head.getNativeDescriptor();
 }
@@ -0,0 +1,272 @@
+#include "Board.h"
+#include "DMABuffer.h"
+#include "DMAEngine.h"
+#include "DMAEngineWG.h"
+#include "DMAStream.h"
+#include "DMATransfer.h"
+#include "Exception.h"
+#include <errno.h>
+#include <time.h>
+#include <exception>
+
+using namespace mprace;
+
+DMAStream::DMAStream(Board& board, const unsigned int b, const unsigned int a,
+		const unsigned int w, const unsigned int slots, const bool i,
+		const DMABuffer::MemType type)
+	: bar(b), addr(a), words(w), inc(i), fill_idx(0), read_idx(0),
+	  release_idx(0), filled(0), acquired(0), overruns(0), total(0),
+	  errors(0), stalled(false), running(false)
+{
+	engine = dynamic_cast<DMAEngineWG *>(&board.getDMAEngine());
+	if (engine == NULL)
+		throw Exception(Exception::DMA_NOT_SUPPORTED);
+
+	if (words == 0)
+		throw Exception(Exception::EMPTY_TRANSFER);
+	if (slots < 2)
+		throw Exception(Exception::DMA_STREAM_ERROR);
+
+	bufs.reserve(slots);
+	for (unsigned int k = 0; k < slots; k++)
+		bufs.push_back(new DMABuffer(board, words * 4, type));
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&slot_filled, NULL);
+	pthread_cond_init(&slot_free, NULL);
+}
+
+DMAStream::~DMAStream()
+{
+	stop();
+
+	pthread_cond_destroy(&slot_free);
+	pthread_cond_destroy(&slot_filled);
+	pthread_mutex_destroy(&lock);
+
+	for (unsigned int k = 0; k < bufs.size(); k++)
+		delete bufs[k];
+}
+
+void DMAStream::start()
+{
+	pthread_mutex_lock(&lock);
+	if (running) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	running = true;
+	pthread_mutex_unlock(&lock);
+
+	if (pthread_create(&thread, NULL, serviceThread, this) != 0) {
+		running = false;
+		throw Exception(Exception::DMA_STREAM_ERROR);
+	}
+}
+
+void DMAStream::stop()
+{
+	pthread_mutex_lock(&lock);
+	if (!running) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	running = false;
+	pthread_cond_broadcast(&slot_free);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(thread, NULL);
+}
+
+void *DMAStream::serviceThread(void *stream)
+{
+	static_cast<DMAStream *>(stream)->service();
+	return NULL;
+}
+
+void DMAStream::service()
+{
+	pthread_mutex_lock(&lock);
+
+	while (running) {
+		unsigned int n = bufs.size() - filled - acquired;
+
+		// No free slot, the engine has to wait for the consumer
+		if (n == 0) {
+			if (!stalled) {
+				overruns++;
+				stalled = true;
+			}
+			pthread_cond_wait(&slot_free, &lock);
+			continue;
+		}
+		stalled = false;
+
+		// The free slots go in one chain, run back to back by the engine.
+		// Up to half the ring, so the consumer gets slots while the rest
+		// is filled; the slots released meanwhile go in the next chain.
+		const unsigned int half = (bufs.size() + 1) / 2;
+		if (n > half)
+			n = half;
+		if (n > DMAEngineWG::QUEUE_SIZE)
+			n = DMAEngineWG::QUEUE_SIZE;
+
+		const unsigned int first = fill_idx;
+		bool ok = false;
+
+		pthread_mutex_unlock(&lock);
+
+		try {
+			for (unsigned int k = 0; k < n; k++)
+				engine->enqueue(1, bar, addr, *bufs[(first + k) % bufs.size()], words, 0, inc);
+
+			DMATransfer *t = engine->flush(1);
+			try {
+				t->wait();
+				ok = (t->getStatus() == DMAEngine::IDLE);
+			} catch (Exception *e) {
+				delete e;
+			} catch (std::exception&) {
+				// The sync of the finished slots failed, fill them again
+			}
+			delete t;
+		} catch (std::exception&) {
+			// The transfers can not be started at all, give up.
+			// The driver throws its own exceptions, not only mprace ones.
+			pthread_mutex_lock(&lock);
+			errors++;
+			running = false;
+			break;
+		}
+
+		pthread_mutex_lock(&lock);
+
+		if (ok) {
+			fill_idx = (fill_idx + n) % bufs.size();
+			filled += n;
+			total += n;
+			pthread_cond_broadcast(&slot_filled);
+		} else {
+			// Fill the same slots again
+			errors++;
+		}
+	}
+
+	// Wake up the consumers waiting for a slot that will not come
+	pthread_cond_broadcast(&slot_filled);
+	pthread_mutex_unlock(&lock);
+}
+
+/* Take the oldest filled slot, called locked */
+DMABuffer *DMAStream::take()
+{
+	if (filled == 0)
+		return NULL;
+
+	DMABuffer *slot = bufs[read_idx];
+	read_idx = (read_idx + 1) % bufs.size();
+	filled--;
+	acquired++;
+
+	return slot;
+}
+
+DMABuffer *DMAStream::acquire(const float timeout)
+{
+	struct timespec deadline;
+	DMABuffer *slot;
+
+	if (timeout > 0.0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		long long ns = deadline.tv_nsec + static_cast<long long>(timeout * 1e6);
+		deadline.tv_sec += ns / 1000000000LL;
+		deadline.tv_nsec = ns % 1000000000LL;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	while ((filled == 0) && running) {
+		if (timeout > 0.0) {
+			if (pthread_cond_timedwait(&slot_filled, &lock, &deadline) == ETIMEDOUT)
+				break;
+		} else {
+			pthread_cond_wait(&slot_filled, &lock);
+		}
+	}
+	slot = take();
+
+	pthread_mutex_unlock(&lock);
+
+	return slot;
+}
+
+DMABuffer *DMAStream::tryAcquire()
+{
+	DMABuffer *slot;
+
+	pthread_mutex_lock(&lock);
+	slot = take();
+	pthread_mutex_unlock(&lock);
+
+	return slot;
+}
+
+void DMAStream::release(DMABuffer *slot)
+{
+	pthread_mutex_lock(&lock);
+
+	if ((acquired == 0) || (slot != bufs[release_idx])) {
+		pthread_mutex_unlock(&lock);
+		throw Exception(Exception::DMA_STREAM_ERROR);
+	}
+
+	release_idx = (release_idx + 1) % bufs.size();
+	acquired--;
+	pthread_cond_signal(&slot_free);
+
+	pthread_mutex_unlock(&lock);
+}
+
+unsigned int DMAStream::getFillLevel()
+{
+	unsigned int level;
+
+	pthread_mutex_lock(&lock);
+	level = filled;
+	pthread_mutex_unlock(&lock);
+
+	return level;
+}
+
+unsigned long DMAStream::getOverruns()
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&lock);
+	n = overruns;
+	pthread_mutex_unlock(&lock);
+
+	return n;
+}
+
+unsigned long long DMAStream::getFilled()
+{
+	unsigned long long n;
+
+	pthread_mutex_lock(&lock);
+	n = total;
+	pthread_mutex_unlock(&lock);
+
+	return n;
+}
+
+unsigned long DMAStream::getErrors()
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&lock);
+	n = errors;
+	pthread_mutex_unlock(&lock);
+
+	return n;
+}
@@ -0,0 +1,153 @@
+#include "DMABuffer.h"
+#include "DMAEngine.h"
+#include "DMAEngineWG.h"
+#include "DMATransfer.h"
+#include "Exception.h"
+#include <new>
+#include <pthread.h>
+
+using namespace mprace;
+
+/* Memory of deleted handles, linked through their first bytes */
+static void *free_handles = NULL;
+static pthread_mutex_t free_handles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *DMATransfer::operator new(size_t size)
+{
+	void *ptr = NULL;
+
+	pthread_mutex_lock(&free_handles_lock);
+	if ((free_handles != NULL) && (size <= sizeof(DMATransfer))) {
+		ptr = free_handles;
+		free_handles = *static_cast<void **>(ptr);
+	}
+	pthread_mutex_unlock(&free_handles_lock);
+
+	return (ptr != NULL) ? ptr : ::operator new(size);
+}
+
+void DMATransfer::operator delete(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	pthread_mutex_lock(&free_handles_lock);
+	*static_cast<void **>(ptr) = free_handles;
+	free_handles = ptr;
+	pthread_mutex_unlock(&free_handles_lock);
+}
+
+DMATransfer::DMATransfer(DMAEngineWG& e, const unsigned int channel)
+	: engine(e), ch(channel), nparts(0), done(false), status(DMAEngine::BUSY),
+	  callback(0), callback_arg(0)
+{
+}
+
+DMATransfer::~DMATransfer()
+{
+	// Abort a transfer still running, but do not call the callback anymore
+	if (!done) {
+		DMAEngineWG::ChannelLock guard(engine, ch);
+		engine.reset(ch);
+		release(DMAEngine::ERROR);
+	}
+}
+
+bool DMATransfer::poll()
+{
+	if (done)
+		return true;
+
+	DMAEngineWG::ChannelLock guard(engine, ch);
+	if (done)
+		return true;
+
+	DMAEngine::DMAStatus s = engine.getStatus(ch);
+	if ((s != DMAEngine::IDLE) && (s != DMAEngine::TIMEOUT))
+		return false;
+
+	complete(s);
+	return true;
+}
+
+void DMATransfer::wait(const float timeout)
+{
+	if (done)
+		return;
+
+	DMAEngineWG::ChannelLock guard(engine, ch);
+	if (done)
+		return;
+
+	try {
+		// The handle keeps its own saved data, the engine has none to restore
+		engine.waitChannel(ch, timeout);
+	} catch (...) {
+		engine.reset(ch);
+		release(DMAEngine::TIMEOUT);
+		throw;
+	}
+
+	complete(engine.getStatus(ch));
+}
+
+DMATransfer::part_t& DMATransfer::add(DMABuffer& buf, const unsigned int count, const unsigned int offset)
+{
+	part_t p;
+
+	p.buf = &buf;
+	p.count = count;
+	p.offset = offset;
+
+	if (nparts++ == 0) {
+		first = p;
+		return first;
+	}
+
+	more.push_back(p);
+	return more.back();
+}
+
+unsigned int DMATransfer::getCount() const
+{
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < nparts; i++)
+		count += part(i).count;
+
+	return count;
+}
+
+void DMATransfer::setCallback(Callback cb, void *arg)
+{
+	callback = cb;
+	callback_arg = arg;
+
+	if (done && (callback != 0))
+		callback(*this, callback_arg);
+}
+
+void DMATransfer::release(DMAEngine::DMAStatus s)
+{
+	done = true;
+	status = s;
+
+	// board2host is channel 1
+	if (ch == 1) {
+		for (unsigned int i = 0; i < nparts; i++)
+			part(i).buf->sync(DMABuffer::FROMDEVICE, part(i).offset, part(i).count);
+	}
+
+	if (engine.pending[ch] == this) {
+		engine.pending[ch] = 0;
+		engine.patched[ch] = false;
+	}
+}
+
+void DMATransfer::complete(DMAEngine::DMAStatus s)
+{
+	release(s);
+
+	if (callback != 0)
+		callback(*this, callback_arg);
+}
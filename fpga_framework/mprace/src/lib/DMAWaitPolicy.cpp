@@ -0,0 +1,172 @@
+#include "DMAEngine.h"
+#include "DMAEngineWG.h"
+#include "DMAWaitPolicy.h"
+#include "util/Timer.h"
+#include <unistd.h>
+
+/* Call usleep() with 1 usec between checking for status changes. */
+#define TIMEOUT_PRECISION_USLEEP 1
+
+/* Weight of a new sample in the learned completion time */
+#define ADAPTIVE_ALPHA 0.25
+
+using namespace mprace;
+
+bool DMAWaitPolicy::finished(DMAEngineWG& engine, const unsigned int ch)
+{
+	DMAEngine::DMAStatus s = engine.getStatus(ch);
+
+	return (s == DMAEngine::IDLE) || (s == DMAEngine::TIMEOUT);
+}
+
+bool DMAWaitPolicy::sleep(DMAEngineWG& engine, const unsigned int ch, const float timeout)
+{
+	bool woken;
+
+	engine.enableInterrupt(ch);
+	woken = engine.waitForInterrupt(ch, timeout);
+	engine.disableInterrupt(ch);
+
+	return woken;
+}
+
+bool DMAWaitPolicy::sleepUntilFinished(DMAEngineWG& engine, const unsigned int ch, const float timeout)
+{
+	mprace::util::Timer timer;
+	float left = timeout;
+
+	timer.start();
+
+	/* An interrupt left queued by an earlier transaction wakes the first
+	 * sleep at once: only the status tells this one ended */
+	while (!finished(engine, ch)) {
+		if (timeout > 0.0) {
+			timer.stop();
+			left = timeout - timer.asMillis();
+			if (left <= 0.0)
+				return false;
+		}
+
+		sleep(engine, ch, left);
+	}
+
+	return true;
+}
+
+bool DMAPollWaitPolicy::wait(DMAEngineWG& engine, const unsigned int ch,
+		const unsigned int bytes, const float timeout)
+{
+	unsigned int loop_count = 0;
+	mprace::util::Timer timer;
+
+	timer.start();
+
+	/* Wait for the card being IDLE (success) or the DMA timeout (failure) */
+	while (!finished(engine, ch)) {
+		timer.stop();
+		if (timeout > 0.0 && timer.asMillis() > timeout)
+			return false;
+
+		/* Before calling usleep(), we try loop_limit times if the DMA
+		 * finishes. If it did not finish, it is likely that it will
+		 * timeout and we call usleep() to prevent hogging the CPU. The
+		 * usleep() will make the scheduler select other processes and
+		 * wait quite long (~ 15 msec) until our process gets cpu time
+		 * again. This would drain the performance to < 1 MB/s. */
+		if (loop_count++ > engine.getLoopLimit())
+			usleep(TIMEOUT_PRECISION_USLEEP);
+	}
+
+	return true;
+}
+
+bool DMAInterruptWaitPolicy::wait(DMAEngineWG& engine, const unsigned int ch,
+		const unsigned int bytes, const float timeout)
+{
+	return sleepUntilFinished(engine, ch, timeout);
+}
+
+DMAAdaptiveWaitPolicy::DMAAdaptiveWaitPolicy(const float spin, const float s)
+	: max_spin(spin), slack(s)
+{
+	reset();
+}
+
+void DMAAdaptiveWaitPolicy::reset()
+{
+	for (unsigned int ch = 0; ch < 2; ch++)
+		for (unsigned int i = 0; i < NR_CLASSES; i++)
+			expected[ch][i] = 0.0;
+
+	spin_count = 0;
+	sleep_count = 0;
+}
+
+unsigned int DMAAdaptiveWaitPolicy::sizeClass(unsigned int bytes)
+{
+	unsigned int c = 0;
+
+	while (bytes > 1) {
+		bytes >>= 1;
+		c++;
+	}
+
+	return c;
+}
+
+float DMAAdaptiveWaitPolicy::getExpected(const unsigned int ch, const unsigned int bytes) const
+{
+	return expected[ch][ sizeClass(bytes) ];
+}
+
+bool DMAAdaptiveWaitPolicy::wait(DMAEngineWG& engine, const unsigned int ch,
+		const unsigned int bytes, const float timeout)
+{
+	float& learned = expected[ch][ sizeClass(bytes) ];
+	mprace::util::Timer timer;
+	bool done = false;
+	float elapsed;
+
+	/* Unknown sizes spin up to the limit, to measure them */
+	float window = (learned == 0.0) ? max_spin : learned * slack;
+
+	timer.start();
+
+	if (window <= max_spin) {
+		do {
+			if (finished(engine, ch)) {
+				done = true;
+				break;
+			}
+			timer.stop();
+		} while (timer.asMillis() * 1000.0 < window);
+	}
+
+	// Both channels may be waited for at the same time
+	if (done) {
+		__sync_fetch_and_add(&spin_count, 1);
+	} else {
+		/* Sleep for what is left of the timeout, at least a little */
+		timer.stop();
+		float left = (timeout > 0.0) ? timeout - timer.asMillis() : 0.0;
+		if (timeout > 0.0 && left <= 0.0)
+			left = 0.001;
+
+		if (!sleepUntilFinished(engine, ch, left))
+			return false;
+		__sync_fetch_and_add(&sleep_count, 1);
+	}
+
+	timer.stop();
+	elapsed = timer.asMillis();
+
+	/* Learn from the measured time. A sleep overestimates it by the
+	 * interrupt latency, which only makes the next wait spin longer. */
+	if (learned == 0.0)
+		learned = elapsed * 1000.0;
+	else
+		learned += ADAPTIVE_ALPHA * (elapsed * 1000.0 - learned);
+
+	/* Finished, while spinning or woken before the timeout */
+	return true;
+}
@@ -19,5 +19,7 @@ const char* Exception::descriptions[] = {
 	"This board does not have a FIFO",
 	"DMA transfer timed out",
 	"Empty transfer (size == 0)",
-	"Transfersize greater than available Buffer"
+	"Transfersize greater than available Buffer",
+	"DMA queue full",
+	"DMA stream slot released out of order"
 };
@@ -13,6 +13,7 @@
 #include "Pin.h"
 #include "Register.h"
 #include "RegisterTristate.h"
+#include "util/PIO.h"
 
 using namespace mprace;
 
@@ -48,7 +49,7 @@ const unsigned int ML605::IRQ_IG = (2);
 const unsigned int ML605::DMA_MEM = (1);
 const unsigned int ML605::DMA_FIFO = (2);
 
-ML605::ML605(const unsigned int number) {
+ML605::ML605(const unsigned int number, const bool write_combining) : mem_wc(write_combining) {
 	// We need to open the device, map the BARs.
 
 	try {
@@ -59,7 +60,7 @@ ML605::ML605(const unsigned int number) {
 		driver->open();
 
 		// The board has 2 BARs at the moment
-		mem = static_cast<unsigned int *>( driver->mmapArea(CINT_BRAM_SPACE_BAR) );
+		mem = static_cast<unsigned int *>( mem_wc ? driver->mmapAreaWC(CINT_BRAM_SPACE_BAR) : driver->mmapArea(CINT_BRAM_SPACE_BAR) );
 		regs = static_cast<unsigned int *>( driver->mmapArea(CINT_REGS_SPACE_BAR) );
 		fifo = static_cast<unsigned int *>( driver->mmapArea(CINT_FIFO_SPACE_BAR) );
 
@@ -122,6 +123,8 @@ void ML605::write(const unsigned int address, const unsigned int value) {
 	if (address >= mem_size)
 		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
 	*(mem+address) = value;
+	if (mem_wc)
+		util::pioFence();
 
 	if (log != 0)
 		log->write(address,value);
@@ -185,9 +188,13 @@ void ML605::writeBlock(const unsigned int address, const unsigned int *data, con
 		/* for performance, we take the comparison out of the loop,
 		 * and repeat the code.
 		 */
-		if (inc) {
+		if (inc && mem_wc) {
+			util::pioStreamWrite(mem+address, data, count);
+		} else if (inc) {
 			for( i=0 ; i<count ; i++ )
 				*(mem+address+i) = *(data+i);
+		} else if (mem_wc) {
+			util::pioRepeatWrite(mem+address, data, count);
 		} else {
 			for( i=0 ; i<count ; i++ )
 				*(mem+address) = *(data+i);
@@ -200,9 +207,13 @@ void ML605::writeBlock(const unsigned int address, const unsigned int *data, con
 		 */
 		unsigned int fifo_address = address-mem_size;
 
-		if (inc) {
+		if (inc && mem_wc) {
+			util::pioStreamWrite(mem+fifo_address, data, count);
+		} else if (inc) {
 			for( i=0 ; i<count ; i++ )
 				*(mem+fifo_address+i) = *(data+i);
+		} else if (mem_wc) {
+			util::pioRepeatWrite(mem+fifo_address, data, count);
 		} else {
 			for( i=0 ; i<count ; i++ )
 				*(mem+fifo_address) = *(data+i);
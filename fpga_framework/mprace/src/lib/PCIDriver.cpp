@@ -62,6 +62,13 @@ void *PCIDriver::mmapArea(const unsigned int num) {
 	return bar[num];
 }
 
+void *PCIDriver::mmapAreaWC(const unsigned int num) {
+	if (bar[num] == 0) {
+		bar[num] = dev->mapBAR(num, true);
+	}
+	return bar[num];
+}
+
 void PCIDriver::unmapArea(const unsigned int num) {
 	if (bar[num] != 0) {
 		dev->unmapBAR(num,bar[num]);
@@ -120,6 +127,24 @@ pciDriver::UserMemory& PCIDriver::mapUserMemory( void *mem, unsigned int size, b
 	}
 }
 
+unsigned int PCIDriver::waitForInterrupts(unsigned int mask, float timeout, unsigned int *counts) {
+	// round up, so a short timeout does not turn into waiting forever
+	unsigned int timeout_us = (timeout > 0.0) ? static_cast<unsigned int>(timeout * 1000.0) + 1 : 0;
+
+	try {
+		return dev->waitForInterrupts(mask, timeout_us, counts);
+	} catch ( pciDriver::Exception& e) {
+		if (e.getType() == pciDriver::Exception::NOT_OPEN)
+			throw mprace::Exception( mprace::Exception::NOT_OPEN );
+		else if (e.getType() == pciDriver::Exception::INTERRUPT_FAILED)
+			throw mprace::Exception( mprace::Exception::INTERRUPT_FAILED );
+		else
+			throw e;
+	} catch (...) {
+		throw mprace::Exception( mprace::Exception::UNKNOWN );
+	}
+}
+
 void PCIDriver::waitForInterrupt(unsigned int int_id) {
 	try {
 		dev->waitForInterrupt(int_id);
@@ -0,0 +1,61 @@
+/**
+ *
+ * @file SimCheck.hpp
+ * @date 2026-10-17
+ *
+ * Helpers shared by the tests on the simulated device: the check of a
+ * condition, counting the failures, and a copy of a descriptor list to
+ * compare it before and after a transfer.
+ *
+ */
+#ifndef _SIM_CHECK_HPP
+#define _SIM_CHECK_HPP
+
+#include <iostream>
+#include <vector>
+#include <mprace/DMABuffer.h>
+#include <mprace/DMADescriptorListWG.h>
+
+/* Failed checks, the test fails if any */
+static int failures = 0;
+
+inline void check(bool ok, const char *what)
+{
+	std::cout << (ok ? "OK      " : "FAILED  ") << what << std::endl;
+	if (!ok)
+		failures++;
+}
+
+/* Copy of a descriptor list, to check a transfer leaves it unchanged */
+struct list_copy {
+	std::vector<unsigned long long> host;
+	std::vector<unsigned long long> next;
+	std::vector<unsigned long> length;
+	std::vector<unsigned long> control;
+};
+
+inline void snapshot(mprace::DMABuffer& buf, list_copy& c)
+{
+	mprace::DMADescriptorListWG& list = static_cast<mprace::DMADescriptorListWG&>(buf.getDescriptors());
+
+	const unsigned int n = list.getSize();
+
+	c.host.resize(n);
+	c.next.resize(n);
+	c.length.resize(n);
+	c.control.resize(n);
+	for (unsigned int i = 0; i < n; i++) {
+		c.host[i] = list[i].getHostAddress();
+		c.next[i] = list[i].getNextDescriptorAddress();
+		c.length[i] = list[i].getLength();
+		c.control[i] = list[i].getControl();
+	}
+}
+
+inline bool same(const list_copy& a, const list_copy& b)
+{
+	return (a.host == b.host) && (a.next == b.next) &&
+	       (a.length == b.length) && (a.control == b.control);
+}
+
+#endif /* _SIM_CHECK_HPP */
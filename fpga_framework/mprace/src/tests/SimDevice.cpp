@@ -0,0 +1,732 @@
+/**
+ *
+ * @file SimDevice.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMADescriptorWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/Driver.h>
+#include <mprace/PCIDriver.h>
+#include <mprace/Exception.h>
+#include <pciDriver/lib/pciDriver.h>
+
+#include "SimDevice.hpp"
+
+using namespace mprace;
+
+/* Bits of the WG DMA controller, see DMAEngineWG.cpp */
+#define WG_STATUS_DONE	0x00000001
+#define WG_STATUS_BUSY	0x00000002
+#define WG_STATUS_TOUT	0x00000010
+#define WG_CTRL_RESET	0x0000000A
+#define WG_CTRL_INC	0x00008000
+#define WG_CTRL_UPA	0x00100000
+#define WG_CTRL_LAST	0x01000000
+#define WG_CTRL_EDI	0x10000000
+
+#define SIM_PAGE_SIZE	4096
+
+static double now_usec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+static inline unsigned long long join(unsigned int h, unsigned int l)
+{
+	return (static_cast<unsigned long long>(h) << 32) | l;
+}
+
+/*******************************************************************
+ * SimDMAModel
+ *******************************************************************/
+
+SimDMAModel *SimDMAModel::active = NULL;
+unsigned int SimDMAModel::sg_pages = 4;
+
+SimDMAModel::SimDMAModel(unsigned int mem_words)
+	: mem_size(mem_words), latency_usec(0.0), rate_mbps(0.0),
+	  irq_latency_usec(0.0), errors(0), bounce(false), synced(0),
+	  tracing(false), counter_word(~0U), counter(0)
+{
+	pio_usec[0] = pio_usec[1] = 0.0;
+	memset(regs, 0, sizeof(regs));
+	mem = new unsigned int[mem_words];
+	memset(mem, 0, mem_words * sizeof(unsigned int));
+
+	for (int i = 0; i < 2; i++) {
+		state[i].busy = false;
+		transfers[i] = 0;
+		bytes[i] = 0;
+		descriptors[i] = 0;
+		starts[i] = 0;
+		interrupts[i] = 0;
+		stale[i] = 0;
+	}
+
+	pthread_mutex_init(&lock, NULL);
+	active = this;
+}
+
+SimDMAModel::~SimDMAModel()
+{
+	if (active == this)
+		active = NULL;
+	pthread_mutex_destroy(&lock);
+	delete [] mem;
+}
+
+void SimDMAModel::setLatency(double usec, double mbps)
+{
+	latency_usec = usec;
+	rate_mbps = mbps;
+}
+
+void SimDMAModel::setInterruptLatency(double usec)
+{
+	irq_latency_usec = usec;
+}
+
+void SimDMAModel::setPIOLatency(double write_usec, double read_usec)
+{
+	pio_usec[0] = write_usec;
+	pio_usec[1] = read_usec;
+}
+
+void SimDMAModel::accessPIO(bool read)
+{
+	const double cost = pio_usec[read ? 1 : 0];
+
+	if (cost <= 0.0)
+		return;
+	for (double end = now_usec() + cost; now_usec() < end; )
+		;
+}
+
+void SimDMAModel::setBounce(bool enable)
+{
+	bounce = enable;
+}
+
+void SimDMAModel::sync(const void *addr, unsigned long length)
+{
+	pthread_mutex_lock(&lock);
+	synced += length;
+	if (bounce) {
+		if (bounce_area.size() < length)
+			bounce_area.resize(length);
+		memcpy(&bounce_area[0], addr, length);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void SimDMAModel::setCounterSource(unsigned int word, unsigned int first)
+{
+	pthread_mutex_lock(&lock);
+	counter_word = word;
+	counter = first;
+	pthread_mutex_unlock(&lock);
+}
+
+static void sleep_usec(double usec)
+{
+	struct timespec ts;
+
+	if (usec <= 0.0)
+		return;
+	ts.tv_sec = static_cast<time_t>(usec / 1e6);
+	ts.tv_nsec = static_cast<long>((usec - ts.tv_sec * 1e6) * 1e3);
+	nanosleep(&ts, NULL);
+}
+
+void SimDMAModel::setTrace(bool enable)
+{
+	pthread_mutex_lock(&lock);
+	tracing = enable;
+	if (enable)
+		trace.clear();
+	pthread_mutex_unlock(&lock);
+}
+
+unsigned int *SimDMAModel::channel(unsigned int ch)
+{
+	return regs + ((ch == 0) ? REG_DMA0 : REG_DMA1);
+}
+
+/* Bytes described by the latched descriptor and the list it points to */
+unsigned int SimDMAModel::chainLength(unsigned int ch)
+{
+	unsigned int total = state[ch].desc[6];
+	unsigned int control = state[ch].control;
+	unsigned long long next = join(state[ch].desc[4], state[ch].desc[5]);
+
+	while (!(control & WG_CTRL_LAST) && (next != 0)) {
+		DMADescriptorWG::descriptor *d = reinterpret_cast<DMADescriptorWG::descriptor *>(next);
+		total += d->length;
+		control = d->control;
+		next = join(d->next_bda_h, d->next_bda_l);
+	}
+
+	return total;
+}
+
+/* Consume a control word written to a channel. Called locked. */
+void SimDMAModel::latch(unsigned int ch)
+{
+	unsigned int *c = channel(ch);
+
+	unsigned int control = c[7];
+	if (control == 0)
+		return;
+
+	c[7] = 0;
+
+	if ((control & 0xF) == WG_CTRL_RESET) {
+		state[ch].busy = false;
+		c[8] = 0;
+	} else {
+		memcpy(state[ch].desc, c, sizeof(state[ch].desc));
+		state[ch].control = control;
+		state[ch].busy = true;
+		starts[ch]++;
+		state[ch].start = now_usec();
+		state[ch].duration = latency_usec;
+		if (rate_mbps > 0.0)
+			state[ch].duration += chainLength(ch) / rate_mbps;
+		c[8] = WG_STATUS_BUSY;
+	}
+}
+
+void SimDMAModel::step(unsigned int ch)
+{
+	pthread_mutex_lock(&lock);
+
+	// Both channels start running as soon as either one is looked at,
+	// so that a transfer started on the other channel is not delayed
+	// until its own status is read.
+	latch(0);
+	latch(1);
+
+	if (state[ch].busy && (now_usec() - state[ch].start >= state[ch].duration))
+		run(ch);
+
+	pthread_mutex_unlock(&lock);
+}
+
+/* Move the data of a latched transfer, and finish it. Called locked. */
+void SimDMAModel::run(unsigned int ch)
+{
+	unsigned int *c = channel(ch);
+	unsigned long long per = join(state[ch].desc[0], state[ch].desc[1]);
+	unsigned long long host = join(state[ch].desc[2], state[ch].desc[3]);
+	unsigned long long next = join(state[ch].desc[4], state[ch].desc[5]);
+	unsigned int length = state[ch].desc[6];
+	unsigned int control = state[ch].control;
+	bool inc = (control & WG_CTRL_INC);
+	unsigned int total = 0;
+	bool failed = false;
+
+	for (;;) {
+		unsigned int word = per / 4;
+		unsigned int words = length / 4;
+		unsigned int *h = reinterpret_cast<unsigned int *>(host);
+
+		if ((word >= mem_size) || (inc && (word + words > mem_size))) {
+			failed = true;
+			break;
+		}
+
+		if (tracing) {
+			segment sg = { ch, per, host, length };
+			trace.push_back(sg);
+		}
+
+		if (inc) {
+			if (ch == 0)
+				memcpy(mem + word, h, words * 4);
+			else
+				memcpy(h, mem + word, words * 4);
+			per += length;
+		} else {
+			for (unsigned int i = 0; i < words; i++) {
+				if (ch == 0)
+					mem[word] = h[i];
+				else if (word == counter_word)
+					h[i] = counter++;
+				else
+					h[i] = mem[word];
+			}
+		}
+
+		total += length;
+		descriptors[ch]++;
+		if (control & WG_CTRL_EDI)
+			interrupts[ch]++;
+
+		if ((control & WG_CTRL_LAST) || (next == 0))
+			break;
+
+		DMADescriptorWG::descriptor *d = reinterpret_cast<DMADescriptorWG::descriptor *>(next);
+		host = join(d->host_addr_h, d->host_addr_l);
+		next = join(d->next_bda_h, d->next_bda_l);
+		length = d->length;
+		control = d->control;
+
+		// The head of a chained transfer loads a new peripheral address
+		if (control & WG_CTRL_UPA) {
+			per = join(d->per_addr_h, d->per_addr_l);
+			inc = (control & WG_CTRL_INC);
+		}
+	}
+
+	state[ch].busy = false;
+	regs[(ch == 0) ? REG_TRANS0 : REG_TRANS1] = total;
+	regs[REG_ISR] |= (ch == 0) ? 0x2 : 0x1;
+
+	if (failed) {
+		errors++;
+		c[8] = WG_STATUS_TOUT;
+	} else {
+		transfers[ch]++;
+		bytes[ch] += total;
+		c[8] = WG_STATUS_DONE;
+	}
+}
+
+void SimDMAModel::queueStaleInterrupt(unsigned int ch)
+{
+	pthread_mutex_lock(&lock);
+	stale[ch]++;
+	pthread_mutex_unlock(&lock);
+}
+
+void SimDMAModel::clearInterrupts(unsigned int ch)
+{
+	pthread_mutex_lock(&lock);
+	stale[ch] = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+void SimDMAModel::waitForInterrupt(unsigned int ch)
+{
+	waitForInterrupts(1U << ch, 0.0);
+}
+
+unsigned int SimDMAModel::waitForInterrupts(unsigned int mask, double timeout)
+{
+	double deadline = now_usec() + timeout;
+
+	mask &= 0x3;
+	if (mask == 0)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+	for (unsigned int ch = 0; ch < 2; ch++) {
+		if ((mask & (1U << ch)) && (stale[ch] > 0)) {
+			stale[ch]--;
+			pthread_mutex_unlock(&lock);
+			return (1U << ch);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	/* Sleep until the first transfer is due, as the process would in
+	 * the driver, then pay the interrupt latency on top. */
+	for (;;) {
+		unsigned int done = 0;
+		double left = -1.0;
+
+		for (unsigned int ch = 0; ch < 2; ch++) {
+			if ((mask & (1U << ch)) == 0)
+				continue;
+
+			step(ch);
+
+			pthread_mutex_lock(&lock);
+			bool busy = state[ch].busy;
+			double due = state[ch].start + state[ch].duration - now_usec();
+			pthread_mutex_unlock(&lock);
+
+			if (!busy)
+				done |= (1U << ch);
+			else if ((left < 0.0) || (due < left))
+				left = due;
+		}
+
+		if (done != 0) {
+			sleep_usec(irq_latency_usec);
+			return done;
+		}
+
+		if (timeout > 0.0) {
+			double rest = deadline - now_usec();
+			if (rest <= 0.0)
+				return 0;
+			if (left > rest)
+				left = rest;
+		}
+
+		if (left > 0.0)
+			sleep_usec(left);
+		else
+			sched_yield();
+	}
+}
+
+/*******************************************************************
+ * SimDMAEngine
+ *******************************************************************/
+
+SimDMAEngine::SimDMAEngine(Driver& driver, SimDMAModel& m)
+	: DMAEngineWG(driver,
+		m.getRegisters() + SimDMAModel::REG_DMA0,
+		m.getRegisters() + SimDMAModel::REG_DMA1,
+		m.getRegisters() + SimDMAModel::REG_IER,
+		m.getRegisters() + SimDMAModel::REG_ISR,
+		m.getRegisters() + SimDMAModel::REG_TRANS0,
+		m.getRegisters() + SimDMAModel::REG_TRANS1),
+	  model(m)
+{
+	// Consume the resets written by the base constructor
+	model.step(0);
+	model.step(1);
+}
+
+DMAEngine::DMAStatus SimDMAEngine::getStatus(const unsigned int ch)
+{
+	model.step(ch);
+	return DMAEngineWG::getStatus(ch);
+}
+
+/*******************************************************************
+ * SimBoard
+ *******************************************************************/
+
+SimBoard::SimBoard(unsigned int mem_words)
+{
+	model = new SimDMAModel(mem_words);
+	driver = new PCIDriver(0);
+	driver->open();
+	dma = new SimDMAEngine(*driver, *model);
+}
+
+SimBoard::~SimBoard()
+{
+	delete dma;
+	delete driver;
+	delete model;
+}
+
+void SimBoard::setReg(const unsigned int address, const unsigned int value)
+{
+	if (address >= SimDMAModel::REG_SIZE)
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+	model->getRegisters()[address] = value;
+}
+
+unsigned int SimBoard::getReg(const unsigned int address)
+{
+	if (address >= SimDMAModel::REG_SIZE)
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+	return model->getRegisters()[address];
+}
+
+void SimBoard::write(const unsigned int address, const unsigned int value)
+{
+	if (address >= model->getMemorySize())
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+	model->accessPIO(false);
+	model->getMemory()[address] = value;
+}
+
+unsigned int SimBoard::read(const unsigned int address)
+{
+	if (address >= model->getMemorySize())
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+	model->accessPIO(true);
+	return model->getMemory()[address];
+}
+
+void SimBoard::writeDMA(const unsigned int address, const DMABuffer& buf,
+		const unsigned int count, const unsigned int offset, const bool inc,
+		const bool lock, const float timeout)
+{
+	if (address >= model->getMemorySize())
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+
+	if (inc && (count > DMA_MAX_COUNT)) {
+		dma->transferChunked(0, DMA_MEM, address, const_cast<DMABuffer&>(buf),
+				count, offset, inc, DMA_MAX_COUNT, lock, timeout);
+		return;
+	}
+
+	dma->host2board(DMA_MEM, address, buf, count, offset, inc, lock, timeout);
+}
+
+void SimBoard::readDMA(const unsigned int address, DMABuffer& buf,
+		const unsigned int count, const unsigned int offset, const bool inc,
+		const bool lock, const float timeout)
+{
+	if (address >= model->getMemorySize())
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+
+	if (inc && (count > DMA_MAX_COUNT)) {
+		dma->transferChunked(1, DMA_MEM, address, buf, count, offset,
+				inc, DMA_MAX_COUNT, lock, timeout);
+		return;
+	}
+
+	dma->board2host(DMA_MEM, address, buf, count, offset, inc, lock, timeout);
+}
+
+/* The same as ABB::transferDuplex */
+void SimBoard::transferDuplex(const unsigned int write_address,
+		const DMABuffer& write_buf, const unsigned int write_count,
+		const unsigned int read_address, DMABuffer& read_buf,
+		const unsigned int read_count, const bool inc, const float timeout)
+{
+	if ((write_address >= model->getMemorySize()) || (read_address >= model->getMemorySize()))
+		throw Exception( Exception::ADDRESS_OUT_OF_RANGE );
+
+	if (inc && ((write_count > DMA_MAX_COUNT) || (read_count > DMA_MAX_COUNT))) {
+		Board::transferDuplex(write_address, write_buf, write_count,
+				read_address, read_buf, read_count, inc, timeout);
+		return;
+	}
+
+	DMATransfer *w = dma->submit(0, DMA_MEM, write_address,
+			const_cast<DMABuffer&>(write_buf), write_count, 0, inc);
+	DMATransfer *r = NULL;
+
+	try {
+		r = dma->submit(1, DMA_MEM, read_address, read_buf, read_count, 0, inc);
+		w->wait(timeout);
+		r->wait(timeout);
+	} catch (...) {
+		delete w;
+		delete r;
+		throw;
+	}
+
+	delete w;
+	delete r;
+}
+
+void SimBoard::waitForInterrupt(unsigned int int_id)
+{
+	driver->waitForInterrupt(int_id);
+}
+
+/*******************************************************************
+ * In-memory pciDriver
+ *
+ * These replace the ones from libpcidriver in the programs linked with
+ * this file. Physical addresses are the user space addresses.
+ *******************************************************************/
+
+namespace pciDriver {
+
+PciDevice::PciDevice(int number)
+{
+	device = number;
+	handle = -1;
+	pagesize = SIM_PAGE_SIZE;
+	pageshift = 12;
+	pagemask = ~(SIM_PAGE_SIZE - 1);
+	strcpy(name, "/dev/fpga-sim");
+	pthread_mutex_init(&mmap_mutex, NULL);
+}
+
+PciDevice::~PciDevice()
+{
+	pthread_mutex_destroy(&mmap_mutex);
+}
+
+void PciDevice::open() { handle = 0; }
+void PciDevice::close() { handle = -1; }
+int PciDevice::getHandle() { return handle; }
+
+KernelMemory& PciDevice::allocKernelMemory(unsigned int size)
+{
+	return *(new KernelMemory(*this, size));
+}
+
+UserMemory& PciDevice::mapUserMemory(void *mem, unsigned int size, bool merged)
+{
+	return *(new UserMemory(*this, mem, size, merged));
+}
+
+void PciDevice::waitForInterrupt(unsigned int int_id)
+{
+	if (SimDMAModel::active != NULL)
+		SimDMAModel::active->waitForInterrupt(int_id);
+}
+
+unsigned int PciDevice::waitForInterrupts(unsigned int mask, unsigned int timeout_us,
+		unsigned int *counts, unsigned int max_events)
+{
+	unsigned int done = 0;
+
+	if (SimDMAModel::active != NULL)
+		done = SimDMAModel::active->waitForInterrupts(mask, timeout_us);
+
+	if (counts != NULL)
+		for (unsigned int i = 0; i < 16; i++)		// PCIDRIVER_INT_MAXSOURCES
+			counts[i] = (done >> i) & 1;
+
+	return done;
+}
+
+void PciDevice::clearInterruptQueue(unsigned int int_id)
+{
+	if ((SimDMAModel::active != NULL) && (int_id < 2))
+		SimDMAModel::active->clearInterrupts(int_id);
+}
+
+unsigned int PciDevice::getBARsize(unsigned int bar) { return 0; }
+void *PciDevice::mapBAR(unsigned int bar, bool writeCombining) { return NULL; }
+void PciDevice::unmapBAR(unsigned int bar, void *ptr) { }
+
+KernelMemory::KernelMemory(PciDevice& dev, unsigned int size)
+{
+	this->device = &dev;
+	this->size = size;
+	this->handle_id = 0;
+	if (posix_memalign(&mem, SIM_PAGE_SIZE, size) != 0)
+		throw Exception(Exception::ALLOC_FAILED);
+	memset(mem, 0, size);
+	this->pa = reinterpret_cast<unsigned long>(mem);
+}
+
+KernelMemory::~KernelMemory()
+{
+	free(mem);
+}
+
+void KernelMemory::sync(sync_dir dir)
+{
+	if (SimDMAModel::active != NULL)
+		SimDMAModel::active->sync(mem, size);
+}
+
+void KernelMemory::sync(sync_dir dir, unsigned int offset, unsigned int length)
+{
+	if ((length == 0) || (offset >= size) || (length > size - offset))
+		throw Exception(Exception::INTERNAL_ERROR);
+	if (SimDMAModel::active != NULL)
+		SimDMAModel::active->sync(static_cast<char *>(mem) + offset, length);
+}
+
+/* Size of the pages backing addr, from the mapping holding it in
+ * /proc/self/smaps: 2 MB for hugetlbfs or transparent huge pages. */
+static unsigned long backing_page_size(unsigned long addr)
+{
+	FILE *f = fopen("/proc/self/smaps", "r");
+	char line[256];
+	unsigned long start, end, kb;
+	bool inside = false;
+	unsigned long page = SIM_PAGE_SIZE;
+
+	if (f == NULL)
+		return page;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			if (inside)
+				break;
+			inside = (addr >= start) && (addr < end);
+			continue;
+		}
+		if (!inside)
+			continue;
+		if ((sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) && (kb > 0))
+			page = 2 * 1024 * 1024;
+		if ((sscanf(line, "KernelPageSize: %lu kB", &kb) == 1) && (kb * 1024 > page))
+			page = kb * 1024;
+	}
+	fclose(f);
+
+	return page;
+}
+
+UserMemory::UserMemory(PciDevice& dev, void *mem, unsigned int size, bool merged)
+{
+	unsigned long addr = reinterpret_cast<unsigned long>(mem);
+	unsigned long end = addr + size;
+	unsigned long chunk = SIM_PAGE_SIZE * ((merged) ? SimDMAModel::sg_pages : 1);
+
+	this->device = &dev;
+	this->vma = addr;
+	this->size = size;
+	this->handle_id = 0;
+
+	/* Fault the pages in, as get_user_pages() does in the driver */
+	for (unsigned long p = addr & ~(SIM_PAGE_SIZE - 1UL); p < end; p += SIM_PAGE_SIZE) {
+		volatile char *c = reinterpret_cast<volatile char *>(p < addr ? addr : p);
+		*c = *c;
+	}
+
+	/* The driver merges the pages of a huge page into one entry */
+	if (merged && (size > 0)) {
+		unsigned long page = backing_page_size(addr);
+		if (page > chunk)
+			chunk = page;
+	}
+
+	/* Entries end at chunk boundaries, emulating a fragmented memory */
+	this->nents = 0;
+	this->sg = new struct sg_entry[ (size / SIM_PAGE_SIZE) + 2 ];
+	while (addr < end) {
+		unsigned long limit = (addr & ~(chunk - 1)) + chunk;
+		if (limit > end)
+			limit = end;
+		this->sg[nents].addr = addr;
+		this->sg[nents].size = limit - addr;
+		nents++;
+		addr = limit;
+	}
+}
+
+UserMemory::~UserMemory()
+{
+	delete [] this->sg;
+}
+
+void UserMemory::sync(sync_dir dir)
+{
+	if (SimDMAModel::active != NULL)
+		SimDMAModel::active->sync(reinterpret_cast<void *>(vma), size);
+}
+
+/* As the driver, syncs the whole SG entries holding the range */
+void UserMemory::sync(sync_dir dir, unsigned int offset, unsigned int length)
+{
+	int first = 0, last;
+	unsigned long end;
+
+	if ((length == 0) || (offset >= size) || (length > size - offset))
+		throw Exception(Exception::INTERNAL_ERROR);
+
+	for ( ; offset >= sg[first].size; first++)
+		offset -= sg[first].size;
+	end = offset + length;
+	for (last = first; end > sg[last].size; last++)
+		end -= sg[last].size;
+
+	if (SimDMAModel::active != NULL)
+		SimDMAModel::active->sync(reinterpret_cast<void *>(sg[first].addr),
+				sg[last].addr + sg[last].size - sg[first].addr);
+}
+
+}
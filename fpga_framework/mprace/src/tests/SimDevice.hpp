@@ -0,0 +1,311 @@
+/**
+ *
+ * @file SimDevice.hpp
+ * @date 2026-10-17
+ *
+ * In-memory stand-in for a board with a WG DMA controller, to run the
+ * DMA engine code without hardware.
+ *
+ * SimDevice.cpp also implements the pciDriver::PciDevice, KernelMemory
+ * and UserMemory classes in memory, so programs linked with it never open
+ * /dev/fpga*. The "physical" addresses handed to the engine are the user
+ * space addresses, which lets the model follow descriptor lists and copy
+ * the data directly.
+ *
+ */
+#ifndef _SIM_DEVICE_HPP
+#define _SIM_DEVICE_HPP
+
+#include <mprace/Board.h>
+#include <mprace/DMAEngineWG.h>
+#include <pthread.h>
+#include <vector>
+
+namespace mprace {
+
+/**
+ *
+ * Software model of the WG DMA controller registers. A channel is
+ * started by writing its control register, and reports BUSY in its
+ * status register until the configured latency has elapsed. The data
+ * is moved when the channel finishes.
+ *
+ */
+class SimDMAModel {
+public:
+	/** Register map of the model, in dwords */
+	static const unsigned int REG_IER = 0x04;
+	static const unsigned int REG_ISR = 0x02;
+	static const unsigned int REG_DMA0 = 0x10;
+	static const unsigned int REG_DMA1 = 0x20;
+	static const unsigned int REG_TRANS0 = 0x30;
+	static const unsigned int REG_TRANS1 = 0x31;
+	static const unsigned int REG_SIZE = 0x40;
+
+	/**
+	 *
+	 * @param mem_words Size of the board memory, in dwords.
+	 *
+	 */
+	SimDMAModel(unsigned int mem_words);
+	~SimDMAModel();
+
+	/**
+	 *
+	 * Set the time a channel stays busy for each transfer.
+	 *
+	 * @param usec Fixed latency, in microseconds.
+	 * @param mbps Transfer rate in MB/s, added to the latency (0 = infinite).
+	 *
+	 */
+	void setLatency(double usec, double mbps = 0.0);
+
+	/**
+	 *
+	 * Set the time from the end of a transfer until a process sleeping
+	 * in waitForInterrupt() runs again.
+	 *
+	 * @param usec Interrupt and wake-up latency, in microseconds.
+	 *
+	 */
+	void setInterruptLatency(double usec);
+
+	/**
+	 *
+	 * Set the time taken by each single register access to the board
+	 * memory, as a posted write or a non-posted read on the bus.
+	 *
+	 * @param write_usec Cost of a write, in microseconds.
+	 * @param read_usec  Cost of a read, in microseconds.
+	 *
+	 */
+	void setPIOLatency(double write_usec, double read_usec);
+
+	/** Spin for the cost of a single access to the board memory */
+	void accessPIO(bool read);
+
+	/**
+	 *
+	 * Make each sync of a buffer copy the bytes synced, as the bounce
+	 * buffers (SWIOTLB) of a system where the device can not reach all
+	 * the memory do. Without it a sync only counts the bytes.
+	 *
+	 */
+	void setBounce(bool enable);
+
+	/** Sync length bytes from addr, called by the in-memory driver */
+	void sync(const void *addr, unsigned long length);
+
+	/**
+	 *
+	 * Advance a channel: latch a written control word, and finish the
+	 * transfer if its time has come.
+	 *
+	 */
+	void step(unsigned int ch);
+
+	/**
+	 *
+	 * Block until the channel is not busy anymore, as an interrupt would.
+	 * The caller sleeps instead of spinning, and wakes up after the
+	 * interrupt latency.
+	 *
+	 */
+	void waitForInterrupt(unsigned int ch);
+
+	/**
+	 *
+	 * Block until any channel in mask is not busy anymore, or until the
+	 * timeout, as the driver does with several sources.
+	 *
+	 * @param mask    Channels to wait for, bit i for channel i.
+	 * @param timeout Timeout in microseconds, 0.0 waits forever.
+	 * @return the mask of the channels done, 0 if the timeout expired.
+	 *
+	 */
+	unsigned int waitForInterrupts(unsigned int mask, double timeout);
+
+	/**
+	 *
+	 * Leave an interrupt of the channel queued, as one not taken after an
+	 * earlier transfer: the next wait on the channel returns at once,
+	 * whatever its state. Clearing the interrupt queue drops it.
+	 *
+	 */
+	void queueStaleInterrupt(unsigned int ch);
+
+	/** Drop the stale interrupts of a channel */
+	void clearInterrupts(unsigned int ch);
+
+	/**
+	 *
+	 * Make a board address behave as a FIFO full of counter values:
+	 * each dword read from it without increment is the next value.
+	 *
+	 * @param word  Board address, in dwords (~0 to disable).
+	 * @param first First value of the counter.
+	 *
+	 */
+	void setCounterSource(unsigned int word, unsigned int first = 0);
+
+	/** Next value of the counter source */
+	inline unsigned int getCounter() { return counter; }
+
+	inline unsigned int *getRegisters() { return regs; }
+	inline unsigned int *getMemory() { return mem; }
+	inline unsigned int getMemorySize() { return mem_size; }
+
+	/** Number of transfers finished in a channel */
+	inline unsigned long getTransfers(unsigned int ch) { return transfers[ch]; }
+	/** Bytes moved in a channel */
+	inline unsigned long long getBytes(unsigned int ch) { return bytes[ch]; }
+	/** Descriptors processed in a channel */
+	inline unsigned long getDescriptors(unsigned int ch) { return descriptors[ch]; }
+	/** Transfers which went out of the board memory */
+	inline unsigned long getErrors() { return errors; }
+	/** Control words latched in a channel, i.e. times it was started */
+	inline unsigned long getStarts(unsigned int ch) { return starts[ch]; }
+	/** Descriptors processed with the interrupt on done set */
+	inline unsigned long getInterrupts(unsigned int ch) { return interrupts[ch]; }
+	/** Bytes synced between the CPU and the device */
+	inline unsigned long long getSynced() { return synced; }
+
+	/** A descriptor processed by the model */
+	struct segment {
+		unsigned int ch;
+		unsigned long long per;		// peripheral byte address
+		unsigned long long host;	// host address
+		unsigned int length;		// in bytes
+	};
+
+	/**
+	 *
+	 * Record every processed descriptor, in order. Enabling it clears the
+	 * previous record.
+	 *
+	 */
+	void setTrace(bool enable);
+	inline const std::vector<segment>& getTrace() { return trace; }
+
+	/** Model used by the in-memory PciDevice, the last one created */
+	static SimDMAModel *active;
+
+	/** Pages per entry in a merged SG list of the in-memory driver (default 4) */
+	static unsigned int sg_pages;
+
+private:
+	unsigned int regs[REG_SIZE];
+	unsigned int *mem;
+	unsigned int mem_size;
+
+	double latency_usec;
+	double rate_mbps;
+	double irq_latency_usec;
+	double pio_usec[2];			// write, read
+
+	struct channel_state {
+		bool busy;
+		unsigned int control;		// latched control word
+		unsigned int desc[7];		// latched descriptor registers
+		double start;				// time of the start, in usec
+		double duration;			// time to finish, in usec
+	} state[2];
+
+	unsigned long transfers[2];
+	unsigned long long bytes[2];
+	unsigned long descriptors[2];
+	unsigned long starts[2];
+	unsigned long interrupts[2];
+	unsigned long errors;
+	unsigned int stale[2];		// interrupts queued, not of the running transfer
+
+	bool bounce;
+	std::vector<char> bounce_area;
+	unsigned long long synced;
+
+	bool tracing;
+	std::vector<segment> trace;
+
+	unsigned int counter_word;
+	unsigned int counter;
+
+	pthread_mutex_t lock;
+
+	unsigned int *channel(unsigned int ch);
+	unsigned int chainLength(unsigned int ch);
+	void latch(unsigned int ch);
+	void run(unsigned int ch);
+};
+
+/**
+ *
+ * DMAEngineWG running on a SimDMAModel. Reading the status of a channel
+ * advances the model, as the hardware would have advanced meanwhile.
+ *
+ */
+class SimDMAEngine : public DMAEngineWG {
+public:
+	SimDMAEngine(Driver& driver, SimDMAModel& model);
+
+	virtual DMAStatus getStatus(const unsigned int channel);
+
+	// Exposed to check the interrupt enable register
+	using DMAEngineWG::enableInterrupt;
+	using DMAEngineWG::disableInterrupt;
+
+private:
+	SimDMAModel& model;
+};
+
+/**
+ *
+ * Board built on the in-memory driver and a SimDMAModel. DMA addresses
+ * are dword addresses in the model memory, as for the ABB.
+ *
+ */
+class SimBoard : public Board {
+public:
+	SimBoard(unsigned int mem_words = 65536);
+	virtual ~SimBoard();
+
+	virtual void setReg(const unsigned int address, const unsigned int value);
+	virtual unsigned int getReg(const unsigned int address);
+	virtual void write(const unsigned int address, const unsigned int value);
+	virtual unsigned int read(const unsigned int address);
+
+	virtual void writeDMA(const unsigned int address, const DMABuffer& buf,
+			const unsigned int count, const unsigned int offset = 0,
+			const bool inc = true, const bool lock = true,
+			const float timeout = 0.0);
+
+	virtual void readDMA(const unsigned int address, DMABuffer& buf,
+			const unsigned int count, const unsigned int offset = 0,
+			const bool inc = true, const bool lock = true,
+			const float timeout = 0.0);
+
+	virtual void transferDuplex(const unsigned int write_address,
+			const DMABuffer& write_buf, const unsigned int write_count,
+			const unsigned int read_address, DMABuffer& read_buf,
+			const unsigned int read_count, const bool inc = true,
+			const float timeout = 0.0);
+
+	virtual DMAEngine& getDMAEngine() { return *dma; }
+
+	virtual void waitForInterrupt(unsigned int int_id);
+
+	inline SimDMAModel& getModel() { return *model; }
+	inline SimDMAEngine& getEngine() { return *dma; }
+
+	static const unsigned int DMA_MEM = 1;
+
+	/** Largest incrementing transaction, larger ones are chunked as in the ABB */
+	static const unsigned int DMA_MAX_COUNT = 8192;
+
+private:
+	SimDMAModel *model;
+	SimDMAEngine *dma;
+};
+
+};
+
+#endif
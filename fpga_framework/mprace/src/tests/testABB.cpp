@@ -43,6 +43,7 @@ using namespace std;
 #define DMA_CORRECT
 #define DMA_PERF
 //#define DMA_CONCURRENT_PERF
+#define DMA_DUPLEX_PERF
 #define USE_INTERRUPTS
 //#define INFLOOP
 
@@ -63,6 +64,7 @@ double testPIOWperf(Board *board, unsigned int buf[], const unsigned int size, c
 double testDMARperf(Board *board, DMABuffer& buf, const unsigned int size);
 double testDMAWperf(Board *board, DMABuffer& buf, const unsigned int size);
 void testDMARWperf(Board *board, DMABuffer& buf_in, DMABuffer& buf_out, const unsigned int size, double *rtime, double *wtime);
+void testDMADuplexperf(Board *board, DMABuffer& buf_in, DMABuffer& buf_out, const unsigned int size, double *stime, double *dtime);
 
 bool testDMAwrite(Board *board, DMABuffer& buf, const unsigned int size, const int pattern, const unsigned int mask=0xFFFFFFFF);
 bool testDMAread(Board *board, DMABuffer& buf, const unsigned int size, const int pattern, const unsigned int mask=0xFFFFFFFF);
@@ -320,6 +322,22 @@ void doMemoryTest(Board *board, DMABuffer::MemType type) {
 	}
 	cout << endl;
 #endif	
+
+#ifdef DMA_DUPLEX_PERF
+	cout << "Testing Duplex DMA performance (combined read and write): " << endl;
+	cout << "size \t: sequential - duplex" << endl;
+	for( size=MIN_SIZE; size<=max_size; size*=2 ) {
+		double stime, dtime;
+		double smbps, dmbps;
+		DMABuffer buf_in(*board, size*4, type);
+		DMABuffer buf_out(*board, size*4, type);
+		testDMADuplexperf(board, buf_in, buf_out, size, &stime, &dtime);
+		smbps = (stime < 1e-12) ? 0.0 : asMB(2*size*4)/stime;
+		dmbps = (dtime < 1e-12) ? 0.0 : asMB(2*size*4)/dtime;
+		cout << " " << asKB(size*4) << " kB\t: " << smbps << " MBps" << " - " << dmbps << " MBps" << endl;
+	}
+	cout << endl;
+#endif
 		
 }
 
@@ -620,3 +638,23 @@ void testDMARWperf(Board *board, DMABuffer& buf_in, DMABuffer& buf_out, const un
 	*wtime = (*wtime) / NLOOPS;
 }
 
+/* Time of a writeDMA followed by a readDMA, against one transferDuplex */
+void testDMADuplexperf(Board *board, DMABuffer& buf_in, DMABuffer& buf_out, const unsigned int size, double *stime, double *dtime)
+{
+	unsigned int i;
+	Timer t;
+
+	t.start();
+	for(i=0;i<NLOOPS;i++) {
+		board->writeDMA(FPGA_ADDR, buf_out, size, 0, false, true);
+		board->readDMA(FPGA_ADDR, buf_in, size, 0, false, true);
+	}
+	t.stop();
+	*stime = t.asSeconds()/NLOOPS;
+
+	t.start();
+	for(i=0;i<NLOOPS;i++)
+		board->transferDuplex(FPGA_ADDR, buf_out, size, FPGA_ADDR, buf_in, size, false);
+	t.stop();
+	*dtime = t.asSeconds()/NLOOPS;
+}
@@ -0,0 +1,142 @@
+/**
+ * Counts the heap allocations of the DMA transfer path on the simulated
+ * device, with a replaced global operator new. After a first transfer
+ * of each kind (to size the patch areas and the free handles), the
+ * blocking calls, submit() and wait() or poll(), and transferDuplex must
+ * not allocate at all, for kernel and user buffers, with or without
+ * interrupts.
+ *
+ * @file testAllocFree.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <new>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/Exception.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define BOARD_ADDR	0x0
+#define WORDS		4096		/* 16 KB per transfer */
+#define LOOPS		200
+
+static volatile unsigned long allocations = 0;
+
+void *operator new(size_t size) throw (std::bad_alloc)
+{
+	void *ptr = malloc((size > 0) ? size : 1);
+
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	__sync_fetch_and_add(&allocations, 1);
+	return ptr;
+}
+
+void operator delete(void *ptr) throw ()
+{
+	free(ptr);
+}
+
+/* Runs a kind of transfer once to warm up, then counts the allocations of LOOPS more */
+template <typename F>
+static void count(const char *what, F f)
+{
+	f();
+
+	unsigned long before = allocations;
+	for (int k = 0; k < LOOPS; k++)
+		f();
+	unsigned long n = allocations - before;
+
+	cout << "        " << setw(36) << left << what << right
+	     << setw(6) << n << " allocations in " << LOOPS << " transfers" << endl;
+	check(n == 0, what);
+}
+
+struct blocking {
+	SimBoard& board;
+	DMABuffer& buf;
+	unsigned int ch;
+	void operator()() {
+		if (ch == 0)
+			board.getEngine().host2board(SimBoard::DMA_MEM, BOARD_ADDR, buf, WORDS);
+		else
+			board.getEngine().board2host(SimBoard::DMA_MEM, BOARD_ADDR, buf, WORDS - 100, 100);
+	}
+};
+
+struct submitted {
+	SimBoard& board;
+	DMABuffer& buf;
+	unsigned int ch;
+	bool polled;
+	void operator()() {
+		DMATransfer *t = board.getEngine().submit(ch, SimBoard::DMA_MEM, BOARD_ADDR, buf, WORDS / 2, WORDS / 4);
+		if (polled) {
+			while (!t->poll())
+				;
+		} else {
+			t->wait();
+		}
+		delete t;
+	}
+};
+
+struct duplex {
+	SimBoard& board;
+	DMABuffer& wbuf;
+	DMABuffer& rbuf;
+	void operator()() {
+		board.transferDuplex(BOARD_ADDR, wbuf, WORDS, BOARD_ADDR + WORDS, rbuf, WORDS);
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	DMABuffer ubuf(board, WORDS * 4, DMABuffer::USER);
+	DMABuffer ubuf2(board, WORDS * 4, DMABuffer::USER);
+	DMABuffer kbuf(board, WORDS * 4, DMABuffer::KERNEL);
+
+	model.setLatency(2.0, 4000.0);
+
+	for (int irq = 0; irq < 2; irq++) {
+		board.getEngine().setUseInterrupts(irq == 1);
+		cout << "        " << ((irq == 1) ? "interrupts" : "polling") << endl;
+
+		blocking kw = { board, kbuf, 0 };
+		blocking kr = { board, kbuf, 1 };
+		blocking uw = { board, ubuf, 0 };
+		blocking ur = { board, ubuf, 1 };
+		submitted sw = { board, ubuf, 0, false };
+		submitted sr = { board, ubuf, 1, true };
+		submitted sk = { board, kbuf, 1, false };
+		duplex dx = { board, ubuf, ubuf2 };
+
+		count("host2board, kernel buffer", kw);
+		count("board2host, kernel buffer", kr);
+		count("host2board, user buffer", uw);
+		count("board2host, user buffer", ur);
+		count("submit and wait, user buffer", sw);
+		count("submit and poll, user buffer", sr);
+		count("submit and wait, kernel buffer", sk);
+		count("transferDuplex, user buffers", dx);
+	}
+	board.getEngine().setUseInterrupts(false);
+
+	check(model.getErrors() == 0, "no transfer errors");
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+/**
+ * Tests the asynchronous DMA submission of the DMAEngineWG
+ * (DMAEngineWG::submit and DMATransfer) on the simulated device.
+ *
+ * @file testAsyncDMA.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/Exception.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define BUF_WORDS	(16 * 1024)	/* 64 KB, 4 SG entries in the simulation */
+#define BOARD_ADDR	(0x100)
+
+static void count_callback(DMATransfer& t, void *arg)
+{
+	(*static_cast<int *>(arg))++;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	DMAEngineWG& dma = board.getEngine();
+	unsigned int *mem = model.getMemory();
+
+	DMABuffer wbuf(board, BUF_WORDS * 4, DMABuffer::USER);
+	DMABuffer rbuf(board, BUF_WORDS * 4, DMABuffer::USER);
+	list_copy before, after;
+
+	for (unsigned int i = 0; i < BUF_WORDS; i++)
+		wbuf[i] = 0xA0000000 | i;
+
+	/* Full buffer, polled */
+	{
+		int calls = 0;
+		model.setLatency(200.0);
+		snapshot(wbuf, before);
+
+		DMATransfer *t = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR, wbuf, BUF_WORDS);
+		t->setCallback(count_callback, &calls);
+		check(!t->isDone() && (calls == 0), "submit returns before the transfer is done");
+
+		unsigned long polls = 0;
+		while (!t->poll())
+			polls++;
+
+		snapshot(wbuf, after);
+		check(t->isDone() && (t->getStatus() == DMAEngine::IDLE), "poll detects completion");
+		check(calls == 1, "callback called once");
+		check(memcmp(mem + BOARD_ADDR, wbuf.getPointer(), BUF_WORDS * 4) == 0, "data written to the board");
+		check(same(before, after), "descriptor list unchanged");
+
+		t->poll();
+		check(calls == 1, "callback not called again");
+		delete t;
+		cout << "        (" << polls << " polls)" << endl;
+	}
+
+	/* Sub-range on both channels at once, waited */
+	{
+		const unsigned int offset = 1500, count = 9000;
+		model.setLatency(500.0);
+		snapshot(rbuf, before);
+		memset(rbuf.getPointer(), 0, BUF_WORDS * 4);
+
+		DMATransfer *r = dma.submit(1, SimBoard::DMA_MEM, BOARD_ADDR, rbuf, count, offset);
+		DMATransfer *w = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR + BUF_WORDS, wbuf, count, offset);
+		snapshot(rbuf, after);
+		check(same(before, after), "descriptor list not patched in flight");
+		r->wait();
+		w->wait();
+
+		snapshot(rbuf, after);
+		check(r->isDone() && w->isDone(), "wait on two channels");
+		check(memcmp(rbuf.getPointer() + offset, mem + BOARD_ADDR, count * 4) == 0, "sub-range read");
+		check((rbuf[offset - 1] == 0) && (rbuf[offset + count] == 0), "sub-range read stays in range");
+		check(memcmp(mem + BOARD_ADDR + BUF_WORDS, wbuf.getPointer() + offset, count * 4) == 0, "sub-range write");
+		check(same(before, after), "descriptor list unchanged after sub-range");
+		delete r;
+		delete w;
+	}
+
+	/* Two sub-ranges of the same buffer in flight, one on each channel */
+	{
+		const unsigned int woff = 2000, roff = 9000, count = 5000;
+		model.setLatency(500.0);
+		for (unsigned int i = 0; i < count; i++)
+			mem[BOARD_ADDR + BUF_WORDS + i] = 0x5A000000 | i;
+		for (unsigned int i = 0; i < BUF_WORDS; i++)
+			wbuf[i] = 0xA0000000 | i;
+
+		DMATransfer *w = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR, wbuf, count, woff);
+		DMATransfer *r = dma.submit(1, SimBoard::DMA_MEM, BOARD_ADDR + BUF_WORDS, wbuf, count, roff);
+		check(!w->isDone() && !r->isDone(), "both sub-ranges in flight");
+		w->wait();
+		r->wait();
+
+		bool ok = (memcmp(wbuf.getPointer() + roff, mem + BOARD_ADDR + BUF_WORDS, count * 4) == 0);
+		for (unsigned int i = 0; i < count; i++)
+			if (mem[BOARD_ADDR + i] != (0xA0000000 | (woff + i)))
+				ok = false;
+		check(ok && (wbuf[roff - 1] == (0xA0000000 | (roff - 1))), "sub-ranges of one buffer on both channels");
+		delete w;
+		delete r;
+
+		for (unsigned int i = 0; i < BUF_WORDS; i++)
+			wbuf[i] = 0xA0000000 | i;
+	}
+
+	/* A second submit on a busy channel waits for the first one */
+	{
+		int calls = 0;
+		model.setLatency(300.0);
+		DMATransfer *a = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR, wbuf, 100, 0);
+		a->setCallback(count_callback, &calls);
+		DMATransfer *b = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR, wbuf, 200, 300);
+		check(a->isDone() && (calls == 1), "submit on a busy channel completes the previous one");
+		b->wait();
+		check(mem[BOARD_ADDR] == wbuf[300], "second transfer done");
+		delete a;
+		delete b;
+	}
+
+	/* Timeout */
+	{
+		model.setLatency(200000.0);
+		snapshot(wbuf, before);
+		DMATransfer *t = dma.submit(0, SimBoard::DMA_MEM, BOARD_ADDR, wbuf, 5000, 100);
+		bool timed_out = false;
+		try {
+			t->wait(2.0);
+		} catch (Exception *e) {
+			timed_out = (e->getType() == Exception::DMA_TIMEOUT);
+			delete e;
+		}
+		snapshot(wbuf, after);
+		check(timed_out && t->isDone(), "wait times out");
+		check(same(before, after), "descriptor list unchanged after timeout");
+		delete t;
+	}
+
+	/* Interrupts, and a kernel buffer */
+	{
+		DMABuffer kbuf(board, 4096, DMABuffer::KERNEL);
+		for (unsigned int i = 0; i < 1024; i++)
+			kbuf[i] = ~i;
+
+		model.setLatency(100.0);
+		dma.setUseInterrupts(true);
+		DMATransfer *t = dma.submit(0, SimBoard::DMA_MEM, 0, kbuf, 1024);
+		t->wait();
+		dma.setUseInterrupts(false);
+		check(memcmp(mem, kbuf.getPointer(), 4096) == 0, "kernel buffer with interrupts");
+		delete t;
+	}
+
+	/* Blocking calls still work after the asynchronous ones */
+	{
+		model.setLatency(0.0);
+		memset(rbuf.getPointer(), 0, BUF_WORDS * 4);
+		board.readDMA(BOARD_ADDR, rbuf, BUF_WORDS);
+		check(memcmp(rbuf.getPointer(), mem + BOARD_ADDR, BUF_WORDS * 4) == 0, "blocking readDMA");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
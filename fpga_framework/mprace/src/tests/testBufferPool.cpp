@@ -0,0 +1,150 @@
+/**
+ * Tests the DMABufferPool on the simulated device: leases, hit/miss and
+ * pinned bytes counters, DMA through recycled buffers, and the time to
+ * get a buffer from the pool against creating one per event.
+ *
+ * @file testBufferPool.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMABufferPool.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define EVENTS		2000
+#define EVENT_WORDS	(16 * 1024)	/* 64 KB per event */
+
+int main(int argc, char *argv[])
+{
+	SimBoard board(1024 * 1024);
+	SimDMAModel& model = board.getModel();
+	unsigned int *mem = model.getMemory();
+
+	/* Size classes */
+	check((DMABufferPool::sizeClass(1) == 4096) && (DMABufferPool::sizeClass(4096) == 4096) &&
+	      (DMABufferPool::sizeClass(4097) == 8192) && (DMABufferPool::sizeClass(100000) == 131072),
+	      "size classes");
+
+	/* Leases and counters */
+	{
+		DMABufferPool pool(board);
+		DMABuffer *first;
+
+		{
+			DMABufferPool::Lease a(pool, 10000, DMABuffer::USER);
+			DMABufferPool::Lease b(pool, 10000, DMABuffer::KERNEL);
+			first = &a.get();
+			check((a->size() == 16384) && (a->getType() == DMABuffer::USER) &&
+			      (b->getType() == DMABuffer::KERNEL), "lease of the size class and type");
+			check((pool.getMisses() == 2) && (pool.getHits() == 0) && (pool.getLeased() == 2), "first leases miss");
+			check((pool.getPinnedBytes() == 2 * 16384) && (pool.getIdleBytes() == 0), "pinned bytes counted");
+		}
+		check((pool.getLeased() == 0) && (pool.getIdleBytes() == 2 * 16384), "leases give the buffers back");
+
+		{
+			DMABufferPool::Lease a(pool, 16000, DMABuffer::USER);
+			check((&a.get() == first) && (pool.getHits() == 1), "same class and type is a hit");
+			DMABufferPool::Lease c(pool, 16000, DMABuffer::KERNEL_PIECES);
+			check(pool.getMisses() == 3, "another type is a miss");
+			c.release();
+			check(pool.getLeased() == 1, "early release");
+		}
+
+		pool.reserve(4096, DMABuffer::USER, 4);
+		check((pool.getPinnedBytes() == 3 * 16384 + 4 * 4096) && (pool.getIdleBytes() == pool.getPinnedBytes()),
+		      "reserve maps buffers in advance");
+		pool.trim();
+		check((pool.getPinnedBytes() == 0) && (pool.getIdleBytes() == 0), "trim frees the idle buffers");
+	}
+
+	/* Idle limit */
+	{
+		DMABufferPool pool(board, 2 * 4096);
+		DMABuffer *b[3];
+		for (int i = 0; i < 3; i++)
+			b[i] = pool.get(4096);
+		for (int i = 0; i < 3; i++)
+			pool.put(b[i]);
+		check((pool.getIdleBytes() == 2 * 4096) && (pool.getPinnedBytes() == 2 * 4096), "buffers over the idle limit are freed");
+	}
+
+	/* DMA through recycled buffers, with sub-ranges in between */
+	{
+		DMABufferPool pool(board);
+		bool data = true;
+
+		model.setLatency(20.0);
+		for (unsigned int round = 0; round < 8; round++) {
+			DMABufferPool::Lease w(pool, EVENT_WORDS * 4);
+			DMABufferPool::Lease r(pool, EVENT_WORDS * 4);
+			unsigned int offset = (round % 2) ? 100 * round : 0;
+			unsigned int count = EVENT_WORDS - 2 * offset;
+
+			for (unsigned int i = 0; i < EVENT_WORDS; i++)
+				(*w)[i] = (round << 24) | i;
+			memset(r->getPointer(), 0, EVENT_WORDS * 4);
+
+			board.writeDMA(0, *w, count, offset);
+			board.readDMA(0, *r, count, offset);
+
+			if (memcmp(r->getPointer() + offset, w->getPointer() + offset, count * 4) != 0)
+				data = false;
+			if (memcmp(mem, w->getPointer() + offset, count * 4) != 0)
+				data = false;
+		}
+		check(data, "transfers with recycled buffers");
+		check((pool.getMisses() == 2) && (pool.getHits() == 14), "two buffers serve all the rounds");
+	}
+
+	/* Time to get a buffer per event */
+	{
+		DMABufferPool pool(board);
+		util::Timer timer;
+		double fresh, pooled;
+
+		model.setLatency(0.0);
+
+		timer.start();
+		for (int e = 0; e < EVENTS; e++) {
+			DMABuffer buf(board, EVENT_WORDS * 4, DMABuffer::USER);
+			board.writeDMA(0, buf, EVENT_WORDS);
+		}
+		timer.stop();
+		fresh = timer.asSeconds();
+
+		pool.reserve(EVENT_WORDS * 4, DMABuffer::USER, 1);
+		timer.start();
+		for (int e = 0; e < EVENTS; e++) {
+			DMABufferPool::Lease buf(pool, EVENT_WORDS * 4);
+			board.writeDMA(0, *buf, EVENT_WORDS);
+		}
+		timer.stop();
+		pooled = timer.asSeconds();
+
+		cout << setprecision(2) << fixed;
+		cout << "        " << EVENTS << " events of " << (EVENT_WORDS * 4 / 1024) << " KB" << endl;
+		cout << "        new buffer per event: " << (fresh * 1e6 / EVENTS) << " usec/event" << endl;
+		cout << "        pooled buffer:        " << (pooled * 1e6 / EVENTS) << " usec/event" << endl;
+		cout << "        hits " << pool.getHits() << ", misses " << pool.getMisses()
+		     << ", pinned " << pool.getPinnedBytes() << " bytes" << endl;
+		/* The simulated driver does not pin pages, so the times are only
+		 * reported: the gain on a board is much larger. */
+		check((pool.getHits() == EVENTS) && (pool.getMisses() == 0), "every event hits the pool");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/**
+ * Tests the transparent chunking of incrementing transfers over
+ * SimBoard::DMA_MAX_COUNT dwords on the simulated device, which works as
+ * the ABB. Sweeps the transfer size and compares the bandwidth of a
+ * single writeDMA/readDMA against splitting by hand into calls of
+ * DMA_MAX_COUNT dwords, each one waited for.
+ *
+ * @file testChunking.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define MEM_WORDS	(1024*1024)	/* 4 MB of board memory */
+#define MAX_COUNT	SimBoard::DMA_MAX_COUNT
+
+static void manual_write(SimBoard& board, DMABuffer& buf, unsigned int count)
+{
+	for (unsigned int done = 0; done < count; done += MAX_COUNT) {
+		unsigned int c = (count - done > MAX_COUNT) ? MAX_COUNT : count - done;
+		board.writeDMA(done, buf, c, done);
+	}
+}
+
+static void manual_read(SimBoard& board, DMABuffer& buf, unsigned int count)
+{
+	for (unsigned int done = 0; done < count; done += MAX_COUNT) {
+		unsigned int c = (count - done > MAX_COUNT) ? MAX_COUNT : count - done;
+		board.readDMA(done, buf, c, done);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board(MEM_WORDS);
+	SimDMAModel& model = board.getModel();
+	unsigned int *mem = model.getMemory();
+	DMABuffer wbuf(board, MEM_WORDS * 4, DMABuffer::USER);
+	DMABuffer rbuf(board, MEM_WORDS * 4, DMABuffer::USER);
+
+	for (unsigned int i = 0; i < MEM_WORDS; i++)
+		wbuf[i] = 0xA5000000 ^ (i * 2654435761U);
+
+	/* Oversized transfers are chunked and chained */
+	{
+		const unsigned int count = 8 * MAX_COUNT + 100;
+		unsigned int starts = model.getStarts(0);
+
+		memset(mem, 0, MEM_WORDS * 4);
+		board.writeDMA(0, wbuf, count);
+		check(memcmp(mem, wbuf.getPointer(), count * 4) == 0, "oversized write lands in the board");
+		check(model.getStarts(0) == starts + 1, "its chunks run as one chain");
+		check(mem[count] == 0, "nothing written past the end");
+
+		starts = model.getStarts(1);
+		memset(rbuf.getPointer(), 0, MEM_WORDS * 4);
+		board.readDMA(0, rbuf, count);
+		check(memcmp(mem, rbuf.getPointer(), count * 4) == 0, "oversized read comes from the board");
+		check(model.getStarts(1) == starts + 1, "its chunks run as one chain");
+	}
+
+	/* More chunks than a chain holds, from an offset in the buffer */
+	{
+		const unsigned int count = MEM_WORDS - 1000;
+		unsigned int starts = model.getStarts(0);
+
+		memset(mem, 0, MEM_WORDS * 4);
+		board.writeDMA(0, wbuf, count, 1000);
+		check(memcmp(mem, wbuf.getPointer() + 1000, count * 4) == 0, "write from an offset, several chains");
+		check(model.getStarts(0) > starts + 1, "one chain per queue of chunks");
+	}
+
+	/* An unlocked write is finished before the channel is used again */
+	{
+		memset(mem, 0, MEM_WORDS * 4);
+		board.writeDMA(0, wbuf, 4 * MAX_COUNT, 0, true, false);
+		board.writeDMA(4 * MAX_COUNT, wbuf, 16, 4 * MAX_COUNT);
+		check(memcmp(mem, wbuf.getPointer(), (4 * MAX_COUNT + 16) * 4) == 0, "unlocked oversized write");
+	}
+
+	/* Bad requests */
+	{
+		bool thrown = false;
+		try {
+			board.writeDMA(0, wbuf, MEM_WORDS, 1);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::ADDRESS_OUT_OF_RANGE);
+		}
+		check(thrown && (board.getEngine().getQueueLength(0) == 0), "past the end of the buffer rejected");
+	}
+
+	/* Duplex over the limit falls back to one direction after the other */
+	{
+		const unsigned int count = 2 * MAX_COUNT;
+
+		for (unsigned int i = 0; i < count; i++)
+			mem[MEM_WORDS / 2 + i] = 0xD0000000 + i;
+		memset(rbuf.getPointer(), 0, count * 4);
+		board.transferDuplex(0, wbuf, count, MEM_WORDS / 2, rbuf, count);
+		check((memcmp(mem, wbuf.getPointer(), count * 4) == 0) &&
+		      (memcmp(mem + MEM_WORDS / 2, rbuf.getPointer(), count * 4) == 0), "oversized duplex");
+	}
+
+	/* Sweep: chunked call against splitting by hand */
+	{
+		util::Timer timer;
+		bool faster = true;
+
+		model.setLatency(20.0, 1000.0);
+
+		cout << setprecision(1) << fixed;
+		cout << "        " << setw(10) << "KB" << setw(14) << "write manual" << setw(14) << "write auto"
+		     << setw(14) << "read manual" << setw(14) << "read auto" << "   (MB/s)" << endl;
+		for (unsigned int count = MAX_COUNT; count <= MEM_WORDS; count *= 4) {
+			const int loops = (count < MEM_WORDS / 4) ? 20 : 4;
+			const double mb = (static_cast<double>(count) * 4 * loops) / (1024 * 1024);
+			double wm, wa, rm, ra;
+
+			timer.start();
+			for (int k = 0; k < loops; k++)
+				manual_write(board, wbuf, count);
+			timer.stop();
+			wm = mb / timer.asSeconds();
+
+			timer.start();
+			for (int k = 0; k < loops; k++)
+				board.writeDMA(0, wbuf, count);
+			timer.stop();
+			wa = mb / timer.asSeconds();
+
+			timer.start();
+			for (int k = 0; k < loops; k++)
+				manual_read(board, rbuf, count);
+			timer.stop();
+			rm = mb / timer.asSeconds();
+
+			timer.start();
+			for (int k = 0; k < loops; k++)
+				board.readDMA(0, rbuf, count);
+			timer.stop();
+			ra = mb / timer.asSeconds();
+
+			cout << "        " << setw(10) << (count * 4 / 1024)
+			     << setw(14) << wm << setw(14) << wa << setw(14) << rm << setw(14) << ra << endl;
+			if (count > MAX_COUNT)
+				faster = faster && (wa > wm) && (ra > rm);
+		}
+		check(model.getErrors() == 0, "no transfer errors");
+		check(faster, "chained chunks faster than split calls");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+/**
+ * Tests the per-channel DMA queue of the DMAEngineWG (enqueue / flush),
+ * which chains several buffers into one descriptor list, on the
+ * simulated device. Checks the order in which the engine model runs the
+ * descriptors, the data moved, and compares the time and the number of
+ * channel starts against one transfer per buffer.
+ *
+ * @file testDMAQueue.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/DMAWaitPolicy.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define NBUFS		6
+#define BENCH_BUFS	32
+#define BENCH_WORDS	1024	/* 4 KB per buffer */
+#define BENCH_LOOPS	20
+
+struct job {
+	DMABuffer::MemType type;
+	unsigned int words;		/* buffer size */
+	unsigned int addr;		/* board address */
+	unsigned int count;
+	unsigned int offset;
+};
+
+int main(int argc, char *argv[])
+{
+	SimBoard board(1024 * 1024);
+	SimDMAModel& model = board.getModel();
+	DMAEngineWG& dma = board.getEngine();
+	unsigned int *mem = model.getMemory();
+
+	/* USER buffers have 16 KB per SG entry in the simulation */
+	const job jobs[NBUFS] = {
+		{ DMABuffer::USER,   8192, 0x00000, 8192,    0 },	/* full, 2 entries */
+		{ DMABuffer::KERNEL, 1024, 0x10000, 1000,   10 },	/* kernel, sub-range */
+		{ DMABuffer::USER,  16384, 0x20000, 9000, 2000 },	/* sub-range over entries */
+		{ DMABuffer::USER,   1024, 0x30000, 1024,    0 },	/* single entry */
+		{ DMABuffer::KERNEL, 2048, 0x40000, 2048,    0 },	/* kernel, full */
+		{ DMABuffer::USER,   4096, 0x30000,  100,   50 },	/* overwrites job 3 start */
+	};
+	DMABuffer *bufs[NBUFS];
+	list_copy before[NBUFS], after;
+
+	for (int i = 0; i < NBUFS; i++) {
+		bufs[i] = new DMABuffer(board, jobs[i].words * 4, jobs[i].type);
+		for (unsigned int j = 0; j < jobs[i].words; j++)
+			(*bufs[i])[j] = (i << 24) | j;
+		if (jobs[i].type != DMABuffer::KERNEL)
+			snapshot(*bufs[i], before[i]);
+	}
+
+	/* Ordering and data, host to board */
+	{
+		unsigned long starts = model.getStarts(0);
+		unsigned long long bytes = model.getBytes(0);
+		unsigned long long expected = 0;
+
+		model.setLatency(100.0, 1000.0);
+		model.setTrace(true);
+
+		for (int i = 0; i < NBUFS; i++) {
+			dma.enqueue(0, SimBoard::DMA_MEM, jobs[i].addr, *bufs[i], jobs[i].count, jobs[i].offset);
+			expected += jobs[i].count * 4;
+		}
+		check(dma.getQueueLength(0) == NBUFS, "transfers queued");
+
+		DMATransfer *t = dma.flush(0);
+		check((t != NULL) && (dma.getQueueLength(0) == 0), "flush empties the queue");
+		check(t->getSize() == NBUFS, "one handle for the batch");
+		t->wait();
+		model.setTrace(false);
+
+		check(model.getStarts(0) == starts + 1, "batch started the channel once");
+		check(model.getBytes(0) - bytes == expected, "bytes moved match the queued transfers");
+
+		/* The trace must go through the jobs in order, each one contiguous */
+		const vector<SimDMAModel::segment>& trace = model.getTrace();
+		bool ordered = true;
+		unsigned int seg = 0;
+		for (int i = 0; i < NBUFS && ordered; i++) {
+			unsigned long long host = reinterpret_cast<unsigned long>(bufs[i]->getPointer() + jobs[i].offset);
+			unsigned long long per = jobs[i].addr * 4;
+			unsigned int left = jobs[i].count * 4;
+			while (left > 0 && seg < trace.size()) {
+				if ((trace[seg].host != host) || (trace[seg].per != per) || (trace[seg].length > left)) {
+					ordered = false;
+					break;
+				}
+				host += trace[seg].length;
+				per += trace[seg].length;
+				left -= trace[seg].length;
+				seg++;
+			}
+			if (left != 0)
+				ordered = false;
+		}
+		check(ordered && (seg == trace.size()), "descriptors run in queue order");
+
+		bool data = true;
+		for (int i = 0; i < NBUFS; i++) {
+			unsigned int skip = (i == 3) ? 100 : 0;		/* overwritten by job 5 */
+			if (memcmp(mem + jobs[i].addr + skip, bufs[i]->getPointer() + jobs[i].offset + skip, (jobs[i].count - skip) * 4) != 0)
+				data = false;
+		}
+		check(data, "data of every transfer on the board");
+		check(memcmp(mem + 0x30000, bufs[5]->getPointer() + 50, 100 * 4) == 0, "later transfer wins on the same address");
+
+		bool unchanged = true;
+		for (int i = 0; i < NBUFS; i++) {
+			if (jobs[i].type == DMABuffer::KERNEL)
+				continue;
+			snapshot(*bufs[i], after);
+			if (!same(before[i], after))
+				unchanged = false;
+		}
+		check(unchanged, "descriptor lists unchanged");
+		delete t;
+	}
+
+	/* Board to host, read back into the buffers */
+	{
+		for (int i = 0; i < NBUFS; i++)
+			memset(bufs[i]->getPointer(), 0, jobs[i].words * 4);
+
+		for (int i = 0; i < 5; i++)
+			dma.enqueue(1, SimBoard::DMA_MEM, jobs[i].addr, *bufs[i], jobs[i].count, jobs[i].offset);
+		DMATransfer *t = dma.flush(1);
+		while (!t->poll())
+			;
+
+		bool data = true;
+		for (int i = 0; i < 5; i++) {
+			if (memcmp(bufs[i]->getPointer() + jobs[i].offset, mem + jobs[i].addr, jobs[i].count * 4) != 0)
+				data = false;
+			if ((jobs[i].offset > 0) && ((*bufs[i])[jobs[i].offset - 1] != 0))
+				data = false;
+		}
+		check(data, "batch read back");
+		delete t;
+	}
+
+	/* Sub-ranges of the same buffer in one batch */
+	{
+		/* Both cross the SG entry boundary at 4096 dwords */
+		dma.enqueue(0, SimBoard::DMA_MEM, 0x50000, *bufs[0], 3000, 3000);
+		dma.enqueue(0, SimBoard::DMA_MEM, 0x51000, *bufs[0], 2000, 4000);
+		DMATransfer *t = dma.flush(0);
+		t->wait();
+
+		snapshot(*bufs[0], after);
+		check((memcmp(mem + 0x50000, bufs[0]->getPointer() + 3000, 3000 * 4) == 0) &&
+		      (memcmp(mem + 0x51000, bufs[0]->getPointer() + 4000, 2000 * 4) == 0), "a user buffer queued twice");
+		check(same(before[0], after), "descriptor list unchanged");
+		delete t;
+	}
+
+	/* With interrupts, only the end of the batch raises one */
+	{
+		DMAInterruptWaitPolicy interrupt;
+		unsigned long irqs = model.getInterrupts(0);
+
+		dma.setWaitPolicy(&interrupt);
+		dma.enqueue(0, SimBoard::DMA_MEM, 0x10000, *bufs[1], 1000, 10);
+		dma.enqueue(0, SimBoard::DMA_MEM, 0x40000, *bufs[4], 2048);
+		dma.enqueue(0, SimBoard::DMA_MEM, 0x50000, *bufs[1], 500);
+		DMATransfer *t = dma.flush(0);
+		t->wait();
+		delete t;
+		dma.setWaitPolicy(NULL);
+
+		check(model.getInterrupts(0) == irqs + 1, "one interrupt for a batch of kernel buffers");
+	}
+
+	/* Errors and corner cases */
+	{
+		dma.enqueue(0, SimBoard::DMA_MEM, 0, *bufs[0], 16);
+		DMATransfer *t = dma.flush(0);
+		t->wait();
+		check(t->getSize() == 1, "a single transfer is flushed as a plain submit");
+		delete t;
+
+		check(dma.flush(0) == NULL, "flushing an empty queue");
+	}
+
+	for (int i = 0; i < NBUFS; i++)
+		delete bufs[i];
+
+	/* Throughput: one start per buffer against one start per batch */
+	{
+		DMABuffer *b[BENCH_BUFS];
+		util::Timer timer;
+		double single, batch;
+		unsigned long starts;
+
+		for (int i = 0; i < BENCH_BUFS; i++)
+			b[i] = new DMABuffer(board, BENCH_WORDS * 4, DMABuffer::USER);
+
+		/* 5 us to program and start a channel, 2 GB/s afterwards */
+		model.setLatency(5.0, 2000.0);
+
+		starts = model.getStarts(0);
+		timer.start();
+		for (int l = 0; l < BENCH_LOOPS; l++) {
+			for (int i = 0; i < BENCH_BUFS; i++) {
+				DMATransfer *t = dma.submit(0, SimBoard::DMA_MEM, i * BENCH_WORDS, *b[i], BENCH_WORDS);
+				t->wait();
+				delete t;
+			}
+		}
+		timer.stop();
+		single = timer.asSeconds();
+		unsigned long single_starts = model.getStarts(0) - starts;
+
+		starts = model.getStarts(0);
+		timer.start();
+		for (int l = 0; l < BENCH_LOOPS; l++) {
+			for (int i = 0; i < BENCH_BUFS; i++)
+				dma.enqueue(0, SimBoard::DMA_MEM, i * BENCH_WORDS, *b[i], BENCH_WORDS);
+			DMATransfer *t = dma.flush(0);
+			t->wait();
+			delete t;
+		}
+		timer.stop();
+		batch = timer.asSeconds();
+		unsigned long batch_starts = model.getStarts(0) - starts;
+
+		double mb = (BENCH_LOOPS * BENCH_BUFS * BENCH_WORDS * 4.0) / (1024 * 1024);
+		cout << setprecision(2) << fixed;
+		cout << "        " << BENCH_BUFS << " x " << (BENCH_WORDS * 4) << " bytes, " << BENCH_LOOPS << " loops" << endl;
+		cout << "        single: " << single_starts << " starts, " << (mb / single) << " MB/s" << endl;
+		cout << "        queued: " << batch_starts << " starts, " << (mb / batch) << " MB/s" << endl;
+		check((single_starts == BENCH_LOOPS * BENCH_BUFS) && (batch_starts == BENCH_LOOPS), "one start per batch");
+		check(batch < single, "queued transfers are faster");
+
+		for (int i = 0; i < BENCH_BUFS; i++)
+			delete b[i];
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+/**
+ * Tests the DMAStream ring on the simulated device. The model serves a
+ * counter pattern from a FIFO address, so every slot must continue the
+ * counter of the previous one: no data is lost or read twice, also when
+ * the consumer is too slow and the ring overruns. Compares the
+ * throughput against a board2host loop copying the data out.
+ *
+ * @file testDMAStream.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMAStream.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define FIFO_ADDR	0x100
+#define SLOT_WORDS	4096	/* 16 KB per slot */
+#define NSLOTS		8
+#define BENCH_SLOTS	400
+#define WORK_USEC	60.0	/* processing time of a slot in the benchmark */
+
+/* Busy for some time, as the processing of a slot */
+static void work(double usec)
+{
+	util::Timer timer;
+
+	timer.start();
+	do {
+		timer.stop();
+	} while (timer.asMillis() * 1000.0 < usec);
+}
+
+/* Checks a slot continues the counter, and advances it */
+static bool follows(DMABuffer& slot, unsigned int& next)
+{
+	bool ok = true;
+
+	for (unsigned int i = 0; i < SLOT_WORDS; i++)
+		if (slot[i] != next++)
+			ok = false;
+
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+
+	model.setLatency(20.0, 1000.0);
+	model.setCounterSource(FIFO_ADDR);
+
+	/* Fast consumer */
+	{
+		DMAStream stream(board, SimBoard::DMA_MEM, FIFO_ADDR, SLOT_WORDS, NSLOTS);
+		unsigned int next = model.getCounter();
+		bool ordered = true;
+		unsigned long starts = model.getStarts(1);
+
+		check(stream.getSlots() == NSLOTS && stream.getFillLevel() == 0 && !stream.isRunning(), "stream created stopped");
+		stream.start();
+		for (int k = 0; k < 200; k++) {
+			DMABuffer *slot = stream.acquire();
+			if ((slot == NULL) || !follows(*slot, next)) {
+				ordered = false;
+				break;
+			}
+			stream.release(slot);
+		}
+		stream.stop();
+
+		check(ordered, "slots continue the counter");
+		check(stream.getErrors() == 0, "no transfer errors");
+		check(model.getStarts(1) - starts < stream.getFilled() / 2, "free slots filled by chains");
+
+		/* What was filled before stopping is still there */
+		unsigned int left = stream.getFillLevel();
+		unsigned int got = 0;
+		DMABuffer *slot;
+		while ((slot = stream.tryAcquire()) != NULL) {
+			ordered = ordered && follows(*slot, next);
+			stream.release(slot);
+			got++;
+		}
+		check(ordered && (got == left) && (next == model.getCounter()), "filled slots drained after stop");
+		check(stream.acquire(1.0) == NULL, "acquire on a stopped, empty stream");
+	}
+
+	/* Slow consumer: the ring fills up and overruns, but loses nothing */
+	{
+		DMAStream stream(board, SimBoard::DMA_MEM, FIFO_ADDR, SLOT_WORDS, NSLOTS);
+		unsigned int next = model.getCounter();
+		unsigned int max_level = 0;
+		bool ordered = true;
+
+		stream.start();
+		for (int k = 0; k < 30; k++) {
+			DMABuffer *slot = stream.acquire();
+			ordered = ordered && (slot != NULL) && follows(*slot, next);
+			usleep(1000);
+			/* The slot held, and the ones filled meanwhile */
+			unsigned int level = stream.getFillLevel() + 1;
+			if (level > max_level)
+				max_level = level;
+			stream.release(slot);
+		}
+		stream.stop();
+
+		cout << "        slow consumer: " << stream.getOverruns() << " overruns, fill level up to "
+		     << max_level << "/" << NSLOTS << endl;
+		check(stream.getOverruns() > 0, "overruns reported");
+		check(max_level == NSLOTS, "ring fills up");
+		check(ordered, "no data lost on overruns");
+	}
+
+	/* Slots are released in order */
+	{
+		DMAStream stream(board, SimBoard::DMA_MEM, FIFO_ADDR, SLOT_WORDS, NSLOTS);
+		bool thrown = false;
+
+		stream.start();
+		DMABuffer *a = stream.acquire();
+		DMABuffer *b = stream.acquire();
+		try {
+			stream.release(b);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::DMA_STREAM_ERROR);
+		}
+		check(thrown, "out of order release rejected");
+		stream.release(a);
+		stream.release(b);
+		stream.stop();
+	}
+
+	/* Throughput with processing: copy loop against the stream */
+	{
+		DMABuffer buf(board, SLOT_WORDS * 4, DMABuffer::USER);
+		unsigned int *copy = new unsigned int[SLOT_WORDS];
+		util::Timer timer;
+		double loop, ring;
+
+		timer.start();
+		for (int k = 0; k < BENCH_SLOTS; k++) {
+			board.getEngine().board2host(SimBoard::DMA_MEM, FIFO_ADDR, buf, SLOT_WORDS, 0, false);
+			memcpy(copy, buf.getPointer(), SLOT_WORDS * 4);
+			work(WORK_USEC);
+		}
+		timer.stop();
+		loop = timer.asSeconds();
+
+		DMAStream stream(board, SimBoard::DMA_MEM, FIFO_ADDR, SLOT_WORDS, NSLOTS);
+		timer.start();
+		stream.start();
+		for (int k = 0; k < BENCH_SLOTS; k++) {
+			DMABuffer *slot = stream.acquire();
+			work(WORK_USEC);
+			stream.release(slot);
+		}
+		timer.stop();
+		stream.stop();
+		ring = timer.asSeconds();
+
+		double mb = (BENCH_SLOTS * SLOT_WORDS * 4.0) / (1024 * 1024);
+		cout << setprecision(2) << fixed;
+		cout << "        " << BENCH_SLOTS << " slots of " << (SLOT_WORDS * 4 / 1024) << " KB, "
+		     << WORK_USEC << " usec of processing per slot" << endl;
+		cout << "        board2host + memcpy: " << (mb / loop) << " MB/s" << endl;
+		cout << "        stream:              " << (mb / ring) << " MB/s, "
+		     << stream.getOverruns() << " overruns" << endl;
+		check(ring < loop, "stream overlaps the DMA with the processing");
+		delete [] copy;
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+/**
+ * Checks the descriptor lists built by DMADescriptorListWG on the
+ * simulated device, and benchmarks the build for buffers of 1 MB to
+ * 1 GB: the single pass of DMADescriptorListWG::build() against filling
+ * an array of DMADescriptorWG objects one setter at a time, as the list
+ * was built before. Reports the time per list and the memory kept next
+ * to the native descriptors.
+ *
+ * @file testDescriptorBuild.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMADescriptorListWG.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define MAX_MB		1024
+#define STEP		16384		/* bytes per entry, as the simulated SG list */
+#define BOARD_ADDR	0x0
+
+static DMADescriptorListWG& descriptors(DMABuffer& buf)
+{
+	return static_cast<DMADescriptorListWG&>(buf.getDescriptors());
+}
+
+/* Entries linked in order, covering the whole buffer */
+static bool linked(DMADescriptorListWG& list, unsigned int size)
+{
+	const unsigned long long *pa = list.getPhysicalAddresses();
+	unsigned long long total = 0;
+
+	for (unsigned int i = 0; i < list.getSize(); i++) {
+		unsigned long long next = (i == list.getSize()-1) ? 0ULL : pa[i+1];
+		if ((list[i].getPhysicalAddress() != pa[i]) || (list[i].getNextDescriptorAddress() != next))
+			return false;
+		total += list[i].getLength();
+	}
+	return total == size;
+}
+
+/* The list as it was built before: an object per entry, field by field */
+static void build_objects(DMADescriptorListWG& list, unsigned long long base, unsigned int size)
+{
+	const unsigned int n = list.getSize();
+	const unsigned long long *pa = list.getPhysicalAddresses();
+	DMADescriptorWG *array = new DMADescriptorWG[n];
+
+	for (unsigned int i = 0; i < n; i++) {
+		array[i].setNativeDescriptor(list[i].getNativeDescriptor());
+		array[i].setPhysicalAddress(pa[i]);
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		DMADescriptorWG *d = &array[i];
+		d->setHostAddress(base + static_cast<unsigned long long>(i)*STEP);
+		d->setLength((i == n-1) ? size - i*STEP : STEP);
+		d->setControl(0);
+		d->setPeripheralAddress(0UL);
+		d->setNextDescriptorAddress((i == n-1) ? 0UL : array[i+1].getPhysicalAddress());
+	}
+
+	delete [] array;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	DMAEngineWG& dma = board.getEngine();
+
+	/* The lists built for a buffer are linked, and the engine follows them */
+	{
+		DMABuffer buf(board, 1024 * 1024, DMABuffer::USER);
+		unsigned int *mem = model.getMemory();
+		DMADescriptorListWG& list = descriptors(buf);
+
+		check(linked(list, buf.size()), "list of a user buffer linked in order");
+
+		for (unsigned int i = 0; i < 16384; i++)
+			buf[i] = 0x5A000000 + i;
+		dma.host2board(SimBoard::DMA_MEM, BOARD_ADDR, buf, 16384, 0);
+		check(memcmp(mem + BOARD_ADDR, buf.getPointer(), 16384 * 4) == 0, "transfer through the list");
+
+		DMABuffer pieces(board, 64 * 1024, DMABuffer::KERNEL_PIECES, 5);
+		check((descriptors(pieces).getSize() == 5) && linked(descriptors(pieces), pieces.size()), "kernel pieces linked in order");
+	}
+
+	/* Build time and memory, from 1 MB to 1 GB */
+	{
+		const size_t area_size = static_cast<size_t>(MAX_MB) * 1024 * 1024;
+		void *area = mmap(NULL, area_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		util::Timer timer;
+		bool same = true;
+
+		if (area == MAP_FAILED) {
+			cout << "        no memory for the benchmark, skipped" << endl;
+		} else {
+			cout << setprecision(1) << fixed;
+			cout << "        " << setw(8) << "size" << setw(9) << "entries"
+			     << setw(14) << "objects (us)" << setw(12) << "build (us)"
+			     << setw(16) << "objects (KB)" << setw(12) << "flat (KB)" << endl;
+
+			for (unsigned int mb = 1; mb <= MAX_MB; mb *= 4) {
+				const unsigned int size = mb * 1024 * 1024;
+				const int loops = (mb < 64) ? 100 : 5;
+				DMABuffer buf(board, size, static_cast<unsigned int *>(area));
+				DMADescriptorListWG& list = descriptors(buf);
+				const unsigned int n = list.getSize();
+				const unsigned long long base = list[0].getHostAddress();
+				double objects, flat;
+
+				timer.start();
+				for (int k = 0; k < loops; k++)
+					build_objects(list, base, size);
+				timer.stop();
+				objects = timer.asMillis() * 1000.0 / loops;
+
+				DMADescriptorWG::descriptor last = *(list[n-1].getNativeDescriptor());
+
+				timer.start();
+				for (int k = 0; k < loops; k++)
+					list.build(base, STEP, size);
+				timer.stop();
+				flat = timer.asMillis() * 1000.0 / loops;
+
+				same = same && (memcmp(&last, list[n-1].getNativeDescriptor(), sizeof(last)) == 0) && linked(list, size);
+
+				cout << "        " << setw(5) << mb << " MB" << setw(9) << n
+				     << setw(14) << objects << setw(12) << flat
+				     << setw(16) << (n * sizeof(DMADescriptorWG) / 1024.0)
+				     << setw(12) << (n * sizeof(unsigned long long) / 1024.0) << endl;
+			}
+			munmap(area, area_size);
+			check(same, "both builds write the same list");
+		}
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
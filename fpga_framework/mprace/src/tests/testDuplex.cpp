@@ -0,0 +1,116 @@
+/**
+ * Tests Board::transferDuplex on the simulated device: a loopback
+ * writes one buffer to the board memory and reads another region back
+ * in the same call. Benchmarks the combined bandwidth of the duplex
+ * call against a writeDMA followed by a readDMA, from one thread.
+ *
+ * @file testDuplex.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define WRITE_ADDR	0x0
+#define READ_ADDR	0x8000
+#define WORDS		8192		/* 32 KB per transfer */
+#define LOOPS		300
+
+static void fill(DMABuffer& buf, unsigned int seed)
+{
+	for (unsigned int i = 0; i < WORDS; i++)
+		buf[i] = (seed << 16) ^ i;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	unsigned int *mem = model.getMemory();
+	DMABuffer wbuf(board, WORDS * 4, DMABuffer::USER);
+	DMABuffer rbuf(board, WORDS * 4, DMABuffer::USER);
+
+	model.setLatency(5.0, 1000.0);
+
+	/* Loopback: what is read back is what the board holds */
+	{
+		for (unsigned int i = 0; i < WORDS; i++)
+			mem[READ_ADDR + i] = 0xC0DE0000 + i;
+		fill(wbuf, 1);
+		memset(rbuf.getPointer(), 0, WORDS * 4);
+
+		board.transferDuplex(WRITE_ADDR, wbuf, WORDS, READ_ADDR, rbuf, WORDS);
+
+		check(memcmp(mem + WRITE_ADDR, wbuf.getPointer(), WORDS * 4) == 0, "write half lands in the board");
+		check(memcmp(mem + READ_ADDR, rbuf.getPointer(), WORDS * 4) == 0, "read half comes from the board");
+		check((model.getStarts(0) == 1) && (model.getStarts(1) == 1), "one transfer per channel");
+	}
+
+	/* The default implementation gives the same result, one after the other */
+	{
+		fill(wbuf, 2);
+		memset(rbuf.getPointer(), 0, WORDS * 4);
+
+		board.Board::transferDuplex(WRITE_ADDR, wbuf, WORDS, READ_ADDR, rbuf, WORDS);
+
+		check((memcmp(mem + WRITE_ADDR, wbuf.getPointer(), WORDS * 4) == 0) &&
+		      (memcmp(mem + READ_ADDR, rbuf.getPointer(), WORDS * 4) == 0), "sequential fallback");
+	}
+
+	/* A bad read address fails before anything starts */
+	{
+		unsigned int starts = model.getStarts(0);
+		bool thrown = false;
+
+		try {
+			board.transferDuplex(WRITE_ADDR, wbuf, WORDS, model.getMemorySize(), rbuf, WORDS);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::ADDRESS_OUT_OF_RANGE);
+		}
+		check(thrown && (model.getStarts(0) == starts), "out of range address rejected");
+	}
+
+	/* Combined bandwidth, sequential calls against the duplex call */
+	{
+		util::Timer timer;
+		double seq, dup;
+
+		timer.start();
+		for (int k = 0; k < LOOPS; k++) {
+			board.writeDMA(WRITE_ADDR, wbuf, WORDS);
+			board.readDMA(READ_ADDR, rbuf, WORDS);
+		}
+		timer.stop();
+		seq = timer.asSeconds();
+
+		timer.start();
+		for (int k = 0; k < LOOPS; k++)
+			board.transferDuplex(WRITE_ADDR, wbuf, WORDS, READ_ADDR, rbuf, WORDS);
+		timer.stop();
+		dup = timer.asSeconds();
+
+		double mb = (2.0 * LOOPS * WORDS * 4) / (1024 * 1024);
+		cout << setprecision(2) << fixed;
+		cout << "        " << LOOPS << " writes and reads of " << (WORDS * 4 / 1024) << " KB" << endl;
+		cout << "        writeDMA + readDMA: " << (mb / seq) << " MB/s combined" << endl;
+		cout << "        transferDuplex:     " << (mb / dup) << " MB/s combined" << endl;
+		check(model.getErrors() == 0, "no transfer errors");
+		check(dup < seq, "duplex overlaps the two directions");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/**
+ * Tests the concurrent use of both channels of a DMAEngineWG from two
+ * threads, without any mutex in the application: one thread writes with
+ * host2board, the other reads a counter pattern with board2host and
+ * submit, with interrupts enabled so that both threads modify the
+ * interrupt enable register all the time.
+ *
+ * @file testDuplexThreads.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define WRITE_ADDR	0x0
+#define FIFO_ADDR	0x8000
+#define WORDS		4096		/* 16 KB per transfer */
+#define LOOPS		1500
+
+struct worker {
+	SimBoard *board;
+	DMABuffer *buf;
+	unsigned int errors;
+	unsigned int exceptions;
+	unsigned int counter;		/* reader: next counter value expected */
+};
+
+static void *writer(void *arg)
+{
+	worker& w = *static_cast<worker *>(arg);
+	DMAEngineWG& dma = w.board->getEngine();
+	unsigned int *mem = w.board->getModel().getMemory();
+
+	for (unsigned int n = 0; n < LOOPS; n++) {
+		for (unsigned int i = 0; i < WORDS; i += 64)
+			(*w.buf)[i] = (n << 16) | i;
+		try {
+			dma.host2board(SimBoard::DMA_MEM, WRITE_ADDR, *w.buf, WORDS, 0, true, true, 1000.0);
+		} catch (Exception *e) {
+			delete e;
+			w.exceptions++;
+			continue;
+		} catch (Exception&) {
+			w.exceptions++;
+			continue;
+		}
+		if (memcmp(mem + WRITE_ADDR, w.buf->getPointer(), WORDS * 4) != 0)
+			w.errors++;
+	}
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	worker& w = *static_cast<worker *>(arg);
+	DMAEngineWG& dma = w.board->getEngine();
+
+	for (unsigned int n = 0; n < LOOPS; n++) {
+		try {
+			/* Alternate the blocking and the asynchronous calls */
+			if (n % 2) {
+				dma.board2host(SimBoard::DMA_MEM, FIFO_ADDR, *w.buf, WORDS, 0, false, true, 1000.0);
+			} else {
+				DMATransfer *t = dma.submit(1, SimBoard::DMA_MEM, FIFO_ADDR, *w.buf, WORDS, 0, false);
+				t->wait(1000.0);
+				delete t;
+			}
+		} catch (Exception *e) {
+			delete e;
+			w.exceptions++;
+			continue;
+		} catch (Exception&) {
+			w.exceptions++;
+			continue;
+		}
+		for (unsigned int i = 0; i < WORDS; i++)
+			if ((*w.buf)[i] != w.counter++) {
+				w.errors++;
+				w.counter = (*w.buf)[i] + 1;
+			}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	SimDMAEngine& dma = board.getEngine();
+	unsigned int *ier = model.getRegisters() + SimDMAModel::REG_IER;
+
+	/* Disabling the interrupt of one channel keeps the other one */
+	{
+		*ier = 0;
+		dma.enableInterrupt(0);
+		dma.enableInterrupt(1);
+		unsigned int both = *ier;
+		dma.disableInterrupt(0);
+		unsigned int one = *ier;
+		dma.disableInterrupt(1);
+		check((both == 0x3) && (one == 0x1) && (*ier == 0), "interrupt enable bits are independent");
+	}
+
+	/* Both channels from two threads */
+	{
+		DMABuffer wbuf(board, WORDS * 4, DMABuffer::USER);
+		DMABuffer rbuf(board, WORDS * 4, DMABuffer::USER);
+		worker w = { &board, &wbuf, 0, 0, 0 };
+		worker r = { &board, &rbuf, 0, 0, 0 };
+		pthread_t tw, tr;
+		util::Timer timer;
+
+		model.setLatency(5.0, 2000.0);
+		model.setCounterSource(FIFO_ADDR);
+		r.counter = model.getCounter();
+		dma.setUseInterrupts(true);
+
+		timer.start();
+		pthread_create(&tw, NULL, writer, &w);
+		pthread_create(&tr, NULL, reader, &r);
+		pthread_join(tw, NULL);
+		pthread_join(tr, NULL);
+		timer.stop();
+
+		dma.setUseInterrupts(false);
+
+		double mb = (2.0 * LOOPS * WORDS * 4) / (1024 * 1024);
+		cout << setprecision(2) << fixed;
+		cout << "        " << LOOPS << " writes and reads of " << (WORDS * 4 / 1024) << " KB: "
+		     << (mb / timer.asSeconds()) << " MB/s combined" << endl;
+		check((w.exceptions == 0) && (r.exceptions == 0), "no timeouts or errors from the engine");
+		check(w.errors == 0, "writes complete and correct");
+		check(r.errors == 0, "reads complete and in order");
+		check((model.getTransfers(0) >= LOOPS) && (model.getTransfers(1) >= LOOPS) && (model.getErrors() == 0), "all transfers done");
+		check(*ier == 0, "interrupts disabled after the transfers");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+/**
+ * Tests the lock-free SPSCQueue, and benchmarks it for handing completed
+ * DMA buffers from the thread driving the engine to a consumer thread,
+ * on the simulated device. It is compared with a queue under a mutex,
+ * and with the pattern of testParallelABB (a mutex around every
+ * readDMA, each thread processing its own buffer).
+ *
+ * Reports transfers/s and the handoff latency (from the end of the
+ * transfer until the consumer has the buffer), median and 99th
+ * percentile.
+ *
+ * @file testHandoff.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/SPSCQueue.h>
+#include <mprace/Exception.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define FIFO_ADDR	0x100
+#define NBUFS		8
+#define WORDS		1024		/* 4 KB per transfer */
+#define TRANSFERS	20000
+#define STRESS		1000000
+
+static inline double now_usec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+/*******************************************************************
+ * Queue unit test
+ *******************************************************************/
+
+static SPSCQueue<unsigned int> *stress_q;
+
+static void *stress_producer(void *)
+{
+	for (unsigned int i = 0; i < STRESS; i++)
+		while (!stress_q->push(i))
+			sched_yield();
+	return NULL;
+}
+
+static void test_queue()
+{
+	SPSCQueue<unsigned int> q(5);
+	unsigned int v = 0;
+	bool ok = true;
+
+	check(q.capacity() == 8 && q.empty(), "capacity rounded to a power of two");
+
+	for (unsigned int i = 0; i < 8; i++)
+		ok = ok && q.push(i);
+	check(ok && !q.push(8) && (q.size() == 8), "push until full");
+
+	/* Wrap around the end a few times */
+	for (unsigned int i = 0; i < 100; i++) {
+		ok = ok && q.pop(v) && (v == i);
+		ok = ok && q.push(i + 8);
+	}
+	for (unsigned int i = 100; i < 108; i++)
+		ok = ok && q.pop(v) && (v == i);
+	check(ok && !q.pop(v) && q.empty(), "FIFO order across wrap-around");
+
+	/* Two threads */
+	pthread_t producer;
+	stress_q = new SPSCQueue<unsigned int>(64);
+	pthread_create(&producer, NULL, stress_producer, NULL);
+
+	unsigned int expected = 0;
+	ok = true;
+	while (expected < STRESS) {
+		if (!stress_q->pop(v)) {
+			sched_yield();
+			continue;
+		}
+		if (v != expected)
+			ok = false;
+		expected++;
+	}
+	pthread_join(producer, NULL);
+	delete stress_q;
+	check(ok, "one million elements between two threads, in order");
+}
+
+/*******************************************************************
+ * Handoff benchmark
+ *******************************************************************/
+
+struct item {
+	DMABuffer *buf;
+	double done;		/* time the transfer finished, in usec */
+};
+
+struct bench {
+	SimBoard *board;
+	DMABuffer *bufs[NBUFS];
+
+	/* lock-free: full buffers to the consumer, free ones back */
+	SPSCQueue<item> *full_q;
+	SPSCQueue<DMABuffer *> *free_q;
+
+	/* mutex: the same queues under a lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	deque<item> full_d;
+	deque<DMABuffer *> free_d;
+
+	/* testParallelABB */
+	pthread_mutex_t dma_read_mutex;
+	unsigned int next_worker;
+
+	vector<double> latency;
+	bool ordered;
+	unsigned int counter;
+};
+
+static void consume(bench& b, DMABuffer& buf)
+{
+	for (unsigned int i = 0; i < WORDS; i++)
+		if (buf[i] != b.counter++)
+			b.ordered = false;
+}
+
+static void *spsc_producer(void *arg)
+{
+	bench& b = *static_cast<bench *>(arg);
+	DMAEngineWG& dma = b.board->getEngine();
+
+	for (unsigned int n = 0; n < TRANSFERS; n++) {
+		DMABuffer *buf;
+		while (!b.free_q->pop(buf))
+			sched_yield();
+
+		dma.board2host(SimBoard::DMA_MEM, FIFO_ADDR, *buf, WORDS, 0, false);
+
+		item it = { buf, now_usec() };
+		while (!b.full_q->push(it))
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void *mutex_producer(void *arg)
+{
+	bench& b = *static_cast<bench *>(arg);
+	DMAEngineWG& dma = b.board->getEngine();
+
+	for (unsigned int n = 0; n < TRANSFERS; n++) {
+		pthread_mutex_lock(&b.lock);
+		while (b.free_d.empty())
+			pthread_cond_wait(&b.cond, &b.lock);
+		DMABuffer *buf = b.free_d.front();
+		b.free_d.pop_front();
+		pthread_mutex_unlock(&b.lock);
+
+		dma.board2host(SimBoard::DMA_MEM, FIFO_ADDR, *buf, WORDS, 0, false);
+
+		item it = { buf, now_usec() };
+		pthread_mutex_lock(&b.lock);
+		b.full_d.push_back(it);
+		pthread_cond_broadcast(&b.cond);
+		pthread_mutex_unlock(&b.lock);
+	}
+	return NULL;
+}
+
+static double run_spsc(bench& b)
+{
+	pthread_t producer;
+	double start = now_usec();
+
+	for (unsigned int i = 0; i < NBUFS; i++)
+		b.free_q->push(b.bufs[i]);
+	pthread_create(&producer, NULL, spsc_producer, &b);
+
+	for (unsigned int n = 0; n < TRANSFERS; n++) {
+		item it;
+		while (!b.full_q->pop(it))
+			sched_yield();
+		b.latency.push_back(now_usec() - it.done);
+		consume(b, *it.buf);
+		b.free_q->push(it.buf);
+	}
+
+	pthread_join(producer, NULL);
+
+	DMABuffer *buf;
+	while (b.free_q->pop(buf))
+		;
+	return now_usec() - start;
+}
+
+static double run_mutex(bench& b)
+{
+	pthread_t producer;
+	double start = now_usec();
+
+	for (unsigned int i = 0; i < NBUFS; i++)
+		b.free_d.push_back(b.bufs[i]);
+	pthread_create(&producer, NULL, mutex_producer, &b);
+
+	for (unsigned int n = 0; n < TRANSFERS; n++) {
+		pthread_mutex_lock(&b.lock);
+		while (b.full_d.empty())
+			pthread_cond_wait(&b.cond, &b.lock);
+		item it = b.full_d.front();
+		b.full_d.pop_front();
+		pthread_mutex_unlock(&b.lock);
+
+		b.latency.push_back(now_usec() - it.done);
+		consume(b, *it.buf);
+
+		pthread_mutex_lock(&b.lock);
+		b.free_d.push_back(it.buf);
+		pthread_cond_broadcast(&b.cond);
+		pthread_mutex_unlock(&b.lock);
+	}
+
+	pthread_join(producer, NULL);
+	b.free_d.clear();
+	return now_usec() - start;
+}
+
+/* testParallelABB: every thread reads into its own buffer under the
+ * global read mutex. The turn keeps the counter in order, to check it. */
+static void *parallel_worker(void *arg)
+{
+	bench& b = *static_cast<bench *>(arg);
+	static unsigned int ids = 0;
+	unsigned int id = __sync_fetch_and_add(&ids, 1) % 2;
+
+	for (unsigned int n = 0; n < TRANSFERS / 2; n++) {
+		pthread_mutex_lock(&b.dma_read_mutex);
+		while (b.next_worker != id)
+			pthread_cond_wait(&b.cond, &b.dma_read_mutex);
+		b.board->readDMA(FIFO_ADDR, *b.bufs[id], WORDS, 0, false);
+		consume(b, *b.bufs[id]);
+		b.next_worker = 1 - id;
+		pthread_cond_broadcast(&b.cond);
+		pthread_mutex_unlock(&b.dma_read_mutex);
+	}
+	return NULL;
+}
+
+static double run_parallel(bench& b)
+{
+	pthread_t workers[2];
+	double start = now_usec();
+
+	b.next_worker = 0;
+	for (int i = 0; i < 2; i++)
+		pthread_create(&workers[i], NULL, parallel_worker, &b);
+	for (int i = 0; i < 2; i++)
+		pthread_join(workers[i], NULL);
+
+	return now_usec() - start;
+}
+
+static void report(const char *name, bench& b, double usec)
+{
+	const bool handoff = !b.latency.empty();
+
+	sort(b.latency.begin(), b.latency.end());
+	cout << "        " << setw(10) << left << name << right
+	     << setw(10) << (TRANSFERS / usec * 1e6) << " transfers/s";
+	if (handoff)
+		cout << ", handoff median " << b.latency[b.latency.size() / 2]
+		     << " usec, p99 " << b.latency[b.latency.size() * 99 / 100] << " usec";
+	cout << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	test_queue();
+
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	bench b;
+	double usec;
+
+	model.setLatency(5.0, 2000.0);
+	model.setCounterSource(FIFO_ADDR);
+
+	b.board = &board;
+	for (unsigned int i = 0; i < NBUFS; i++)
+		b.bufs[i] = new DMABuffer(board, WORDS * 4, DMABuffer::USER);
+	b.full_q = new SPSCQueue<item>(NBUFS);
+	b.free_q = new SPSCQueue<DMABuffer *>(NBUFS);
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_mutex_init(&b.dma_read_mutex, NULL);
+	pthread_cond_init(&b.cond, NULL);
+
+	cout << setprecision(1) << fixed;
+	cout << "        " << TRANSFERS << " transfers of " << (WORDS * 4) << " bytes, "
+	     << NBUFS << " buffers" << endl;
+
+	b.latency.clear(); b.ordered = true; b.counter = model.getCounter();
+	usec = run_parallel(b);
+	report("parallel", b, usec);
+	check(b.ordered, "mutex around readDMA: data in order");
+
+	b.latency.clear(); b.ordered = true; b.counter = model.getCounter();
+	usec = run_mutex(b);
+	report("mutex", b, usec);
+	check(b.ordered, "mutex queue: data in order");
+
+	b.latency.clear(); b.ordered = true; b.counter = model.getCounter();
+	usec = run_spsc(b);
+	report("spsc", b, usec);
+	check(b.ordered && (b.latency.size() == TRANSFERS), "lock-free queue: data in order");
+
+	pthread_cond_destroy(&b.cond);
+	pthread_mutex_destroy(&b.dma_read_mutex);
+	pthread_mutex_destroy(&b.lock);
+	delete b.full_q;
+	delete b.free_q;
+	for (unsigned int i = 0; i < NBUFS; i++)
+		delete b.bufs[i];
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/**
+ * Compares USER buffers with USER_HUGEPAGES buffers on the simulated
+ * device: number of SG entries, and memory taken by the descriptor
+ * list, for buffers from 1 MB to 64 MB. A FIFO read checks the engine
+ * follows the longer entries of a huge page buffer.
+ *
+ * The simulated driver merges the pages like the real one, looking at
+ * the page size backing the buffer. Without huge pages (no hugetlbfs
+ * pages reserved and transparent huge pages disabled) both columns are
+ * the same.
+ *
+ * @file testHugePages.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMADescriptorListWG.h>
+#include <mprace/Exception.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define FIFO_ADDR	0x100
+#define READ_WORDS	(1024*1024)	/* 4 MB FIFO read */
+
+static unsigned int entries(DMABuffer& buf)
+{
+	return static_cast<DMADescriptorListWG&>(buf.getDescriptors()).getSize();
+}
+
+/* Bytes of the descriptor list, allocated in whole pages */
+static unsigned long list_bytes(unsigned int n)
+{
+	const unsigned long per_page = 4096 / sizeof(DMADescriptorWG::descriptor);
+
+	return ((n + per_page - 1) / per_page) * 4096;
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+
+	model.setCounterSource(FIFO_ADDR);
+
+	/* The engine reads a whole huge page buffer through its entries */
+	{
+		DMABuffer buf(board, READ_WORDS * 4, DMABuffer::USER_HUGEPAGES);
+		unsigned int next = model.getCounter();
+		bool ordered = true;
+
+		memset(buf.getPointer(), 0, READ_WORDS * 4);
+		board.getEngine().board2host(SimBoard::DMA_MEM, FIFO_ADDR, buf, READ_WORDS, 0, false);
+		for (unsigned int i = 0; i < READ_WORDS; i++)
+			if (buf[i] != next++)
+				ordered = false;
+
+		check(buf.getType() == DMABuffer::USER_HUGEPAGES, "huge page buffer created");
+		check(ordered && (model.getErrors() == 0), "FIFO read into a huge page buffer");
+
+		/* Part of the buffer, starting inside an entry */
+		next = model.getCounter();
+		board.getEngine().board2host(SimBoard::DMA_MEM, FIFO_ADDR, buf, 1000, 4096 + 12, false);
+		ordered = true;
+		for (unsigned int i = 0; i < 1000; i++)
+			if (buf[4096 + 12 + i] != next++)
+				ordered = false;
+		check(ordered, "offset read inside a huge page entry");
+	}
+
+	/* SG entries and descriptor memory, against normal pages */
+	{
+		unsigned long saved = 0;
+		bool fewer = true;
+
+		cout << "        " << setw(8) << "size" << setw(14) << "USER" << setw(16) << "USER_HUGEPAGES"
+		     << setw(14) << "list (KB)" << endl;
+		for (unsigned int mb = 1; mb <= 64; mb *= 2) {
+			DMABuffer normal(board, mb * 1024 * 1024, DMABuffer::USER);
+			DMABuffer huge(board, mb * 1024 * 1024, DMABuffer::USER_HUGEPAGES);
+			unsigned int n = entries(normal);
+			unsigned int h = entries(huge);
+
+			cout << "        " << setw(5) << mb << " MB"
+			     << setw(14) << n << setw(16) << h
+			     << setw(8) << (list_bytes(n) / 1024) << " -> " << (list_bytes(h) / 1024) << endl;
+			fewer = fewer && (h <= n);
+			saved += list_bytes(n) - list_bytes(h);
+		}
+		cout << "        descriptor memory saved over all sizes: " << (saved / 1024) << " KB" << endl;
+		check(fewer, "no more entries with huge pages");
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/**
+ * Checks and benchmarks the PIO block write of util/PIO.h, used by the
+ * ABB and the ML605 when the memory BAR is mapped write-combining. A
+ * plain anonymous mapping stands in for the BAR: the block write must
+ * copy exactly the block for every alignment and size, and its bandwidth
+ * is compared against the dword loop used for the uncached mapping.
+ *
+ * On a board the same comparison is ABB(n) against ABB(n, true); in
+ * memory it shows the cost of the stores themselves, not of the TLPs.
+ *
+ * @file testPIOWrite.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#include <mprace/util/PIO.h>
+#include <mprace/util/Timer.h>
+
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define BAR_WORDS	(2*1024*1024)	/* 8 MB stand-in BAR */
+#define GUARD		0xDEADBEEF
+
+/* The dword loop of the uncached path */
+static void dword_write(unsigned int *dst, const unsigned int *src, unsigned int count)
+{
+	volatile unsigned int *vdst = dst;
+
+	for (unsigned int i = 0; i < count; i++)
+		vdst[i] = src[i];
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int *bar = static_cast<unsigned int *>(mmap(NULL, BAR_WORDS * 4,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	unsigned int *src = new unsigned int[BAR_WORDS + 8];
+
+	if (bar == MAP_FAILED) {
+		check(false, "stand-in BAR mapped");
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < BAR_WORDS + 8; i++)
+		src[i] = 0x7E000000 ^ (i * 2654435761U);
+
+	/* Every destination and source alignment, sizes around the store widths */
+	{
+		bool exact = true;
+
+		for (unsigned int dofs = 0; dofs < 8; dofs++) {
+			for (unsigned int sofs = 0; sofs < 4; sofs++) {
+				for (unsigned int count = 0; count <= 70; count++) {
+					for (unsigned int i = 0; i < 96; i++)
+						bar[i] = GUARD;
+
+					util::pioStreamWrite(bar + dofs, src + sofs, count);
+
+					exact = exact && (memcmp(bar + dofs, src + sofs, count * 4) == 0);
+					for (unsigned int i = 0; i < dofs; i++)
+						exact = exact && (bar[i] == GUARD);
+					for (unsigned int i = dofs + count; i < 96; i++)
+						exact = exact && (bar[i] == GUARD);
+				}
+			}
+		}
+		check(exact, "block write exact for every alignment and size");
+
+		util::pioStreamWrite(bar + 3, src, BAR_WORDS - 3);
+		check(memcmp(bar + 3, src, (BAR_WORDS - 3) * 4) == 0, "block write of the whole BAR");
+
+		bar[1] = GUARD;
+		util::pioRepeatWrite(bar, src, 100);
+		check((bar[0] == src[99]) && (bar[1] == GUARD), "repeated write leaves the last value");
+	}
+
+	/* Bandwidth, dword loop against wide non-temporal stores */
+	{
+		util::Timer timer;
+
+		if (!util::Timer::is_calibrated())
+			util::Timer::calibrate();
+
+		cout << setprecision(1) << fixed;
+		cout << "        " << setw(10) << "bytes" << setw(14) << "dword loop" << setw(14) << "stream"
+		     << "   (MB/s)" << endl;
+		for (unsigned int count = 64; count <= BAR_WORDS; count *= 8) {
+			const unsigned int loops = (BAR_WORDS / count) * 4;
+			const double mb = (static_cast<double>(count) * 4 * loops) / (1024 * 1024);
+			double loop, stream;
+
+			timer.start();
+			for (unsigned int k = 0; k < loops; k++)
+				dword_write(bar, src, count);
+			timer.stop();
+			loop = mb / timer.asSeconds();
+
+			timer.start();
+			for (unsigned int k = 0; k < loops; k++)
+				util::pioStreamWrite(bar, src, count);
+			timer.stop();
+			stream = mb / timer.asSeconds();
+
+			cout << "        " << setw(10) << (count * 4) << setw(14) << loop << setw(14) << stream << endl;
+		}
+	}
+
+	munmap(bar, BAR_WORDS * 4);
+	delete [] src;
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -13,6 +13,7 @@
 #include <getopt.h>
 #include <cstdlib>
 #include <cstdio>
+#include <unistd.h>
 
 #include <mprace/Board.h>
 #include <mprace/DMABuffer.h>
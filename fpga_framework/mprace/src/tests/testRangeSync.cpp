@@ -0,0 +1,135 @@
+/**
+ * Tests that the DMA engine syncs only the range of a buffer a transfer
+ * uses, on the simulated device with bounce buffers: every sync copies
+ * the bytes synced, as the SWIOTLB does. Small reads from a large buffer
+ * are timed against syncing the whole buffer before and after each one,
+ * as the engine did before.
+ *
+ * @file testRangeSync.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMATransfer.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define MEM_WORDS	(1024*1024)				/* 4 MB of board memory */
+#define BUF_WORDS	(16*1024*1024)			/* 64 MB buffer */
+#define READ_WORDS	1024					/* 4 KB reads */
+#define ENTRY_BYTES	(4096 * SimDMAModel::sg_pages)
+#define READS		50
+
+int main(int argc, char *argv[])
+{
+	SimBoard board(MEM_WORDS);
+	SimDMAModel& model = board.getModel();
+	unsigned int *mem = model.getMemory();
+	DMABuffer ubuf(board, BUF_WORDS * 4, DMABuffer::USER);
+	DMABuffer kbuf(board, MEM_WORDS * 4, DMABuffer::KERNEL);
+
+	for (unsigned int i = 0; i < MEM_WORDS; i++)
+		mem[i] = 0x5A000000 ^ (i * 2654435761U);
+	model.setBounce(true);
+
+	/* A small read syncs the SG entries it touches, not the buffer */
+	{
+		const unsigned int offset = BUF_WORDS / 2 + 100;
+		unsigned long long before = model.getSynced();
+
+		memset(ubuf.getPointer() + offset, 0, READ_WORDS * 4);
+		board.readDMA(0, ubuf, READ_WORDS, offset);
+		check(memcmp(ubuf.getPointer() + offset, mem, READ_WORDS * 4) == 0, "read lands in the user buffer");
+		check(model.getSynced() - before <= 2 * (2 * ENTRY_BYTES) + 4096,
+				"user buffer synced over the entries of the range only");
+
+		before = model.getSynced();
+		board.writeDMA(MEM_WORDS / 2, ubuf, READ_WORDS, offset);
+		check(model.getSynced() - before <= 2 * ENTRY_BYTES + 4096, "write syncs only its range");
+
+		before = model.getSynced();
+		board.readDMA(0, kbuf, READ_WORDS, 77);
+		check(memcmp(kbuf.getPointer() + 77, mem, READ_WORDS * 4) == 0, "read lands in the kernel buffer");
+		check(model.getSynced() - before == 2 * READ_WORDS * 4, "kernel buffer synced over the exact range");
+	}
+
+	/* Submitted transfers sync their range when waited for */
+	{
+		unsigned long long before = model.getSynced();
+		DMATransfer *t = board.getEngine().submit(1, SimBoard::DMA_MEM, 0, ubuf, READ_WORDS, 4096);
+
+		t->wait();
+		delete t;
+		check(memcmp(ubuf.getPointer() + 4096, mem, READ_WORDS * 4) == 0, "submitted read lands");
+		check(model.getSynced() - before <= 2 * (2 * ENTRY_BYTES) + 4096, "submitted read syncs only its range");
+	}
+
+	/* Bad ranges */
+	{
+		bool thrown = false;
+		try {
+			ubuf.sync(DMABuffer::FROMDEVICE, BUF_WORDS - 10, 11);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::ADDRESS_OUT_OF_RANGE);
+		}
+		check(thrown, "range past the end of the buffer rejected");
+
+		unsigned long long before = model.getSynced();
+		ubuf.sync(DMABuffer::FROMDEVICE, 0, 0);
+		check(model.getSynced() == before, "empty range syncs nothing");
+	}
+
+	/* Small reads from a large buffer: range against whole buffer */
+	{
+		util::Timer timer;
+		double range_ms, whole_ms;
+		unsigned long long range_bytes, whole_bytes;
+
+		if (!util::Timer::is_calibrated())
+			util::Timer::calibrate();
+
+		srand(1);
+		range_bytes = model.getSynced();
+		timer.start();
+		for (unsigned int i = 0; i < READS; i++)
+			board.readDMA(0, ubuf, READ_WORDS, (rand() % (BUF_WORDS / READ_WORDS)) * READ_WORDS);
+		timer.stop();
+		range_ms = timer.asMillis();
+		range_bytes = model.getSynced() - range_bytes;
+
+		srand(1);
+		whole_bytes = model.getSynced();
+		timer.start();
+		for (unsigned int i = 0; i < READS; i++) {
+			ubuf.sync(DMABuffer::TODEVICE);
+			board.readDMA(0, ubuf, READ_WORDS, (rand() % (BUF_WORDS / READ_WORDS)) * READ_WORDS);
+			ubuf.sync(DMABuffer::FROMDEVICE);
+		}
+		timer.stop();
+		whole_ms = timer.asMillis();
+		whole_bytes = model.getSynced() - whole_bytes;
+
+		cout << setprecision(1) << fixed;
+		cout << "        " << READS << " reads of 4 KB from 64 MB: range sync " << range_ms << " ms, "
+		     << (range_bytes / READS / 1024) << " KB copied each; whole buffer " << whole_ms << " ms, "
+		     << (whole_bytes / READS / 1024) << " KB copied each" << endl;
+		check(range_ms < whole_ms, "range sync faster than whole buffer sync");
+	}
+
+	check(model.getErrors() == 0, "no transfer errors");
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
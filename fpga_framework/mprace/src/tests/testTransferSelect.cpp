@@ -0,0 +1,163 @@
+/**
+ * Tests Board::transfer() on the simulated device, with a DMA start
+ * latency and a cost for each register access: the calibration finds a
+ * lower crossover for reads (non-posted) than for writes, transfers below
+ * the crossover do not start the DMA engine, and the crossovers survive
+ * a save and load. A workload of mixed sizes is timed with transfer()
+ * against always DMA and always PIO.
+ *
+ * @file testTransferSelect.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define MAX_COUNT	4096		/* largest size calibrated, in dwords */
+#define BOARD_ADDR	0x0
+#define CAL_FILE	"/tmp/testTransferSelect.cal"
+#define WORKLOAD	400			/* transfers in the mixed workload */
+
+/* Runs the workload with the given crossovers, returns the time in ms */
+static double workload(SimBoard& board, DMABuffer& buf, const unsigned int *sizes,
+		unsigned int to, unsigned int from)
+{
+	util::Timer timer;
+
+	board.setCrossover(Board::TO_BOARD, to);
+	board.setCrossover(Board::FROM_BOARD, from);
+
+	timer.start();
+	for (unsigned int i = 0; i < WORKLOAD; i++)
+		board.transfer(((i & 1) == 0) ? Board::TO_BOARD : Board::FROM_BOARD, BOARD_ADDR, buf, sizes[i]);
+	timer.stop();
+	return timer.asMillis();
+}
+
+int main(int argc, char *argv[])
+{
+	SimBoard board;
+	SimDMAModel& model = board.getModel();
+	unsigned int *mem = model.getMemory();
+	DMABuffer buf(board, MAX_COUNT * 4, DMABuffer::USER);
+
+	model.setLatency(10.0, 1000.0);
+	model.setPIOLatency(0.05, 0.5);
+
+	/* Calibration */
+	board.calibrateTransfer(BOARD_ADDR, buf, MAX_COUNT);
+	const unsigned int to = board.getCrossover(Board::TO_BOARD);
+	const unsigned int from = board.getCrossover(Board::FROM_BOARD);
+
+	cout << "        crossover to board " << to << ", from board " << from << " dwords" << endl;
+	check((to > 1) && (to <= MAX_COUNT), "write crossover inside the range measured");
+	check((from > 1) && (from < to), "read crossover below the write crossover");
+
+	/* Below the crossover PIO, from it on DMA */
+	{
+		const unsigned int small = from / 2;
+		unsigned long starts;
+
+		for (unsigned int i = 0; i < MAX_COUNT; i++)
+			buf[i] = 0x3C000000 + i;
+		memset(mem, 0, MAX_COUNT * 4);
+
+		starts = model.getStarts(0);
+		board.transfer(Board::TO_BOARD, BOARD_ADDR, buf, small, 7);
+		check((model.getStarts(0) == starts) && (memcmp(mem, buf.getPointer() + 7, small * 4) == 0),
+				"small write done with PIO");
+
+		board.transfer(Board::TO_BOARD, BOARD_ADDR, buf, to);
+		check((model.getStarts(0) == starts + 1) && (memcmp(mem, buf.getPointer(), to * 4) == 0),
+				"large write done with DMA");
+
+		memset(buf.getPointer(), 0, MAX_COUNT * 4);
+		starts = model.getStarts(1);
+		board.transfer(Board::FROM_BOARD, BOARD_ADDR, buf, small, 3);
+		check((model.getStarts(1) == starts) && (memcmp(mem, buf.getPointer() + 3, small * 4) == 0),
+				"small read done with PIO");
+
+		board.transfer(Board::FROM_BOARD, BOARD_ADDR, buf, from);
+		check((model.getStarts(1) == starts + 1) && (memcmp(mem, buf.getPointer(), from * 4) == 0),
+				"large read done with DMA");
+
+		bool thrown = false;
+		try {
+			board.transfer(Board::FROM_BOARD, BOARD_ADDR, buf, 2, MAX_COUNT - 1);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::ADDRESS_OUT_OF_RANGE);
+		}
+		check(thrown, "PIO past the end of the buffer rejected");
+	}
+
+	/* Persistence */
+	{
+		board.saveCalibration(CAL_FILE);
+		board.setCrossover(Board::TO_BOARD, 1);
+		board.setCrossover(Board::FROM_BOARD, 1);
+		board.loadCalibration(CAL_FILE);
+		check((board.getCrossover(Board::TO_BOARD) == to) && (board.getCrossover(Board::FROM_BOARD) == from),
+				"crossovers saved and loaded");
+
+		ofstream bad(CAL_FILE);
+		bad << "something else" << endl;
+		bad.close();
+
+		bool thrown = false;
+		try {
+			board.loadCalibration(CAL_FILE);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::UNKNOWN_FILE_FORMAT);
+		}
+		check(thrown && (board.getCrossover(Board::TO_BOARD) == to), "unknown file format rejected");
+
+		remove(CAL_FILE);
+		thrown = false;
+		try {
+			board.loadCalibration(CAL_FILE);
+		} catch (Exception& e) {
+			thrown = (e.getType() == Exception::FILE_NOT_FOUND);
+		}
+		check(thrown, "missing file rejected");
+	}
+
+	/* Mixed sizes: selected against a single method */
+	{
+		static const unsigned int choice[] = { 4, 16, 64, 256, 1024, 4096 };
+		unsigned int sizes[WORKLOAD];
+		double selected, dma, pio;
+
+		srand(1);
+		for (unsigned int i = 0; i < WORKLOAD; i++)
+			sizes[i] = choice[rand() % 6];
+
+		dma = workload(board, buf, sizes, 0, 0);
+		pio = workload(board, buf, sizes, MAX_COUNT + 1, MAX_COUNT + 1);
+		selected = workload(board, buf, sizes, to, from);
+
+		cout << setprecision(1) << fixed;
+		cout << "        " << WORKLOAD << " transfers of 4 to 4096 dwords: selected " << selected
+		     << " ms, always DMA " << dma << " ms, always PIO " << pio << " ms" << endl;
+		check((selected < dma) && (selected < pio), "selection faster than either method alone");
+	}
+
+	check(model.getErrors() == 0, "no transfer errors");
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/**
+ * Compares the wait policies of the DMAEngineWG (poll, interrupt and
+ * adaptive) on the simulated device, for small, medium and large
+ * transfers. Reports the time per transfer, the throughput and the CPU
+ * time spent waiting.
+ *
+ * Usage: testWaitPolicy [latency [irq_latency [rate]]]
+ *   latency     Fixed latency of a transfer, in usec (default 10).
+ *   irq_latency Interrupt and wake-up latency, in usec (default 50).
+ *   rate        Transfer rate of the device, in MB/s (default 1000).
+ *
+ * @file testWaitPolicy.cpp
+ * @date 2026-10-17
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include <mprace/DMABuffer.h>
+#include <mprace/DMAEngineWG.h>
+#include <mprace/DMAWaitPolicy.h>
+#include <mprace/Exception.h>
+#include <mprace/util/Timer.h>
+
+#include "SimDevice.hpp"
+#include "SimCheck.hpp"
+
+using namespace std;
+using namespace mprace;
+
+#define NSIZES		3
+#define NPOLICIES	3
+#define WARMUP		5
+
+static double cpu_usec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+struct result {
+	double usec;		/* time per transfer */
+	double mbps;
+	double cpu;			/* cpu time per transfer, in usec */
+};
+
+static result run(SimBoard& board, DMABuffer& buf, unsigned int words, unsigned int loops)
+{
+	DMAEngineWG& dma = board.getEngine();
+	util::Timer timer;
+	result r;
+	double cpu;
+
+	for (unsigned int i = 0; i < WARMUP; i++)
+		dma.host2board(SimBoard::DMA_MEM, 0, buf, words);
+
+	cpu = cpu_usec();
+	timer.start();
+	for (unsigned int i = 0; i < loops; i++)
+		dma.host2board(SimBoard::DMA_MEM, 0, buf, words);
+	timer.stop();
+	cpu = cpu_usec() - cpu;
+
+	r.usec = timer.asSeconds() * 1e6 / loops;
+	r.mbps = (words * 4.0 * loops) / (1024 * 1024) / timer.asSeconds();
+	r.cpu = cpu / loops;
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	double latency = (argc > 1) ? atof(argv[1]) : 10.0;
+	double irq_latency = (argc > 2) ? atof(argv[2]) : 50.0;
+	double rate = (argc > 3) ? atof(argv[3]) : 1000.0;
+
+	const unsigned int words[NSIZES] = { 1024, 16 * 1024, 256 * 1024 };	/* 4 KB, 64 KB, 1 MB */
+	const unsigned int loops[NSIZES] = { 400, 200, 40 };
+	const char *names[NPOLICIES] = { "poll", "interrupt", "adaptive" };
+
+	SimBoard board(512 * 1024);
+	SimDMAModel& model = board.getModel();
+	DMAEngineWG& dma = board.getEngine();
+
+	DMAPollWaitPolicy poll;
+	DMAInterruptWaitPolicy interrupt;
+	DMAAdaptiveWaitPolicy adaptive;
+	DMAWaitPolicy *policies[NPOLICIES] = { &poll, &interrupt, &adaptive };
+	result res[NPOLICIES][NSIZES];
+
+	model.setLatency(latency, rate);
+	model.setInterruptLatency(irq_latency);
+
+	DMABuffer buf(board, words[NSIZES - 1] * 4, DMABuffer::USER);
+	for (unsigned int i = 0; i < words[NSIZES - 1]; i++)
+		buf[i] = i ^ 0x5A5A5A5A;
+
+	cout << "        latency " << latency << " usec, interrupt latency " << irq_latency
+	     << " usec, " << rate << " MB/s" << endl;
+	cout << setprecision(1) << fixed;
+
+	for (unsigned int s = 0; s < NSIZES; s++) {
+		unsigned long spins = adaptive.getSpinCount();
+		unsigned long sleeps = adaptive.getSleepCount();
+
+		cout << "        " << (words[s] * 4 / 1024) << " KB:" << endl;
+		for (unsigned int p = 0; p < NPOLICIES; p++) {
+			dma.setWaitPolicy(policies[p]);
+			res[p][s] = run(board, buf, words[s], loops[s]);
+			cout << "          " << setw(10) << left << names[p] << right
+			     << setw(9) << res[p][s].usec << " usec "
+			     << setw(9) << res[p][s].mbps << " MB/s "
+			     << setw(9) << res[p][s].cpu << " usec cpu" << endl;
+		}
+		cout << "          adaptive: expected " << adaptive.getExpected(0, words[s] * 4)
+		     << " usec, " << (adaptive.getSpinCount() - spins) << " spins, "
+		     << (adaptive.getSleepCount() - sleeps) << " sleeps" << endl;
+	}
+	dma.setWaitPolicy(NULL);
+
+	check(memcmp(model.getMemory(), buf.getPointer(), words[NSIZES - 1] * 4) == 0, "data written with every policy");
+	check((adaptive.getExpected(0, words[0] * 4) > 0.0) && (adaptive.getExpected(0, words[NSIZES - 1] * 4) > 0.0),
+			"adaptive policy learns the completion times");
+	check(adaptive.getExpected(0, words[0] * 4) < adaptive.getExpected(0, words[NSIZES - 1] * 4),
+			"larger transfers are expected to take longer");
+
+	/* Short transfers finish while spinning, without the interrupt latency */
+	if (latency + words[0] * 4 / rate < 100.0)
+		check(res[2][0].usec < res[1][0].usec, "adaptive is faster than interrupts for short transfers");
+
+	/* Long transfers sleep, instead of keeping the CPU busy */
+	if (latency + words[NSIZES - 1] * 4 / rate > 400.0)
+		check(res[2][NSIZES - 1].cpu < res[0][NSIZES - 1].cpu, "adaptive uses less CPU than polling for long transfers");
+
+	/* A timeout is still reported */
+	{
+		bool timed_out = false;
+
+		model.setLatency(50000.0);
+		dma.setWaitPolicy(&adaptive);
+		try {
+			dma.host2board(SimBoard::DMA_MEM, 0, buf, words[0], 0, true, true, 2.0);
+		} catch (Exception *e) {
+			timed_out = (e->getType() == Exception::DMA_TIMEOUT);
+			delete e;
+		}
+		dma.reset(0);
+		dma.setWaitPolicy(NULL);
+		check(timed_out, "timeout with the adaptive policy");
+	}
+
+	/* The interrupt wait gives up at the timeout, not when the transfer ends */
+	{
+		bool timed_out = false;
+		util::Timer timer;
+
+		model.setLatency(50000.0);
+		dma.setWaitPolicy(&interrupt);
+		timer.start();
+		try {
+			dma.host2board(SimBoard::DMA_MEM, 0, buf, words[0], 0, true, true, 2.0);
+		} catch (Exception *e) {
+			timed_out = (e->getType() == Exception::DMA_TIMEOUT);
+			delete e;
+		}
+		timer.stop();
+		dma.reset(0);
+		dma.setWaitPolicy(NULL);
+		check(timed_out, "timeout with the interrupt policy");
+		check(timer.asMillis() < 25.0, "interrupt wait ends at the timeout");
+	}
+
+	/* A stale interrupt wakes the sleep, the wait goes on until the end */
+	{
+		DMAWaitPolicy *sleepers[2] = { &interrupt, &adaptive };
+
+		model.setLatency(2000.0);
+		for (unsigned int p = 0; p < 2; p++) {
+			bool ok = true;
+
+			dma.setWaitPolicy(sleepers[p]);
+			memset(model.getMemory(), 0, words[0] * 4);
+			model.queueStaleInterrupt(0);
+			try {
+				dma.host2board(SimBoard::DMA_MEM, 0, buf, words[0]);
+			} catch (Exception *e) {
+				ok = false;
+				delete e;
+			}
+			ok = ok && (memcmp(model.getMemory(), buf.getPointer(), words[0] * 4) == 0);
+			check(ok, (p == 0) ? "interrupt wait outlasts a stale interrupt"
+					   : "adaptive wait outlasts a stale interrupt");
+		}
+		dma.setWaitPolicy(NULL);
+	}
+
+	cout << ((failures == 0) ? "All tests passed" : "Some tests FAILED") << endl;
+	return (failures == 0) ? 0 : 1;
+}
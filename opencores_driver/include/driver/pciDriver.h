@@ -71,6 +71,8 @@
 /* mmap mode of the device */
 #define PCIDRIVER_MMAP_PCI	0
 #define PCIDRIVER_MMAP_KMEM 1
+#define PCIDRIVER_MMAP_PCI_WC	2	/* PCI BAR, write-combining */
+#define PCIDRIVER_MMAP_IRQ_RING	3	/* Interrupt event ring, read-only */
 
 /* Direction of a DMA operation */
 #define PCIDRIVER_DMA_BIDIRECTIONAL 0
@@ -89,6 +91,40 @@
 /* Maximum number of interrupt sources */
 #define PCIDRIVER_INT_MAXSOURCES 16
 
+/* Interrupt modes. The irq_mode module parameter gives the best one to try,
+ * the driver falls back from MSI-X to MSI to INTx */
+#define PCIDRIVER_IRQ_AUTO	0
+#define PCIDRIVER_IRQ_INTX	1
+#define PCIDRIVER_IRQ_MSI	2
+#define PCIDRIVER_IRQ_MSIX	3
+
+/* Events in the interrupt ring, a power of two */
+#define PCIDRIVER_IRQ_RING_EVENTS	1024
+
+/* Buffer types of a transfer queued in the kernel */
+#define PCIDRIVER_DMA_SCHED_KMEM	0
+#define PCIDRIVER_DMA_SCHED_UMEM	1
+
+/* Flags of a queued transfer */
+#define PCIDRIVER_DMA_SCHED_INC		1	/* increment the peripheral address */
+
+/* Channels of the DMA scheduler: 0 writes to the device, 1 reads from it */
+#define PCIDRIVER_DMA_SCHED_CHANNELS	2
+
+/* Sub-commands of a batch */
+#define PCIDRIVER_BATCH_KMEM_SYNC	1	/* arg.kmem_sync */
+#define PCIDRIVER_BATCH_UMEM_SYNC	2	/* arg.umem_sync */
+#define PCIDRIVER_BATCH_UMEM_MAP	3	/* arg.umem_map: SGMAP, then SGGET */
+#define PCIDRIVER_BATCH_WAIT		4	/* arg.irq_source, as WAITI */
+#define PCIDRIVER_BATCH_CLEAR_IOQ	5	/* arg.irq_source */
+#define PCIDRIVER_BATCH_PCI_CFG_RD	6	/* arg.pci_cfg */
+
+/* Flags of a batch */
+#define PCIDRIVER_BATCH_FLAG_CONTINUE	1	/* run the commands after a failed one */
+
+/* Most commands in a batch */
+#define PCIDRIVER_BATCH_MAX		64
+
 /* Types */
 typedef struct {
 	unsigned long pa;
@@ -120,6 +156,27 @@ typedef struct {
 	int dir;
 } kmem_sync_t;
 
+/* Sync of part of a buffer, offset and length in bytes from its start */
+typedef struct {
+	kmem_handle_t handle;
+	int dir;
+	unsigned long offset;
+	unsigned long length;
+} kmem_sync_range_t;
+
+typedef struct {
+	int handle_id;
+	int dir;
+	unsigned long offset;
+	unsigned long length;
+} umem_sync_range_t;
+
+/* Maps a user buffer and gets its SG list in the same call. If sg is too
+ * small the mapping is kept, and nents gives the entries needed. */
+typedef struct {
+	umem_handle_t handle;		/* in: vma and size, out: handle_id */
+	umem_sglist_t sglist;		/* in: type, nents and sg, out: nents */
+} umem_map_t;
 
 typedef struct {
 	int size;
@@ -131,6 +188,101 @@ typedef struct {
 	} val;
 } pci_cfg_cmd;
 
+/* Binds an eventfd to an interrupt source, fd -1 unbinds it */
+typedef struct {
+	unsigned int source;
+	int fd;
+} irq_eventfd_t;
+
+/* Takes the interrupts outstanding in several sources at once */
+typedef struct {
+	unsigned int mask;			/* in: sources to take, out: sources which had interrupts */
+	unsigned int count[PCIDRIVER_INT_MAXSOURCES];	/* out: interrupts taken, per source */
+} irq_pending_t;
+
+/* Waits for the interrupts of several sources, up to a deadline */
+typedef struct {
+	unsigned int mask;			/* in: sources to wait for, out: sources which had interrupts */
+	unsigned int max_events;	/* in: most interrupts to take, 0 for all those outstanding */
+	unsigned long long deadline;	/* in: CLOCK_MONOTONIC, in ns, 0 to wait forever */
+	unsigned int count[PCIDRIVER_INT_MAXSOURCES];	/* out: interrupts taken, per source */
+} irq_wait_t;
+
+/* An interrupt, as recorded by the handler in the event ring */
+typedef struct {
+	unsigned int seq;			/* number of the event, events[seq % PCIDRIVER_IRQ_RING_EVENTS] */
+	unsigned int source;		/* interrupt source */
+	unsigned int status;		/* interrupt status register, or the bits of the vector with MSI-X/MSI */
+	unsigned int dma_trans;		/* DMA_TRANS counter of the channel, 0 for other sources */
+	unsigned long long timestamp;	/* CLOCK_MONOTONIC, in ns */
+	unsigned int reserved[2];
+} pcidriver_irq_event_t;
+
+/* The event ring, mmapped read-only. The handler fills events[head % size],
+ * then increments head, so the slot of event n is rewritten while head is
+ * n + size. A reader copies events, then reads head again: an event n
+ * copied is valid if that head is less than n + size. */
+typedef struct {
+	volatile unsigned int head;	/* events recorded since the device was probed */
+	unsigned int size;			/* PCIDRIVER_IRQ_RING_EVENTS */
+	unsigned int reserved[14];	/* head alone in its cache line */
+	pcidriver_irq_event_t events[PCIDRIVER_IRQ_RING_EVENTS];
+} pcidriver_irq_ring_t;
+
+/* Steers the vector of an interrupt source to a CPU, cpu -1 drops the hint */
+typedef struct {
+	unsigned int source;
+	int cpu;
+	int mode;					/* out: PCIDRIVER_IRQ_* in use */
+	int irq;					/* out: Linux IRQ of the vector, -1 if the source has none */
+} irq_affinity_t;
+
+/* A command of a batch. The status of the commands not run is -ECANCELED. */
+typedef struct batch_cmd_s {
+	unsigned int cmd;			/* PCIDRIVER_BATCH_* */
+	int status;					/* out: 0, or the negative error of the command */
+	union {
+		kmem_sync_range_t kmem_sync;	/* length 0 syncs the whole buffer */
+		umem_sync_range_t umem_sync;	/* length 0 syncs the whole area */
+		umem_map_t umem_map;
+		unsigned int irq_source;
+		pci_cfg_cmd pci_cfg;			/* out: val */
+	} arg;
+} batch_cmd_t;
+
+/* Runs several commands in one ioctl, in order */
+typedef struct {
+	unsigned int count;			/* commands, at most PCIDRIVER_BATCH_MAX */
+	unsigned int flags;			/* PCIDRIVER_BATCH_FLAG_* */
+	unsigned int done;			/* out: commands run */
+	batch_cmd_t *cmds;
+} batch_t;
+
+/* A record for the DMA scheduler of the ABB / WG engine: a range of a kmem
+ * or umem buffer and where it goes on the device. Its interrupt reaches
+ * user space when the whole record is done. */
+typedef struct {
+	int type;					/* PCIDRIVER_DMA_SCHED_KMEM or _UMEM */
+	int handle_id;
+	int dir;					/* PCIDRIVER_DMA_TODEVICE (channel 0) or _FROMDEVICE (channel 1) */
+	unsigned int bar;			/* BAR on the device */
+	unsigned int addr;			/* peripheral address, in bytes */
+	unsigned int flags;			/* PCIDRIVER_DMA_SCHED_* */
+	unsigned long offset;		/* in the buffer, in bytes, a multiple of 4 */
+	unsigned long length;		/* in bytes, a multiple of 4 */
+	unsigned int tag;			/* reported as last_tag once the record ended */
+} dma_sched_xfer_t;
+
+/* Progress of a channel of the DMA scheduler */
+typedef struct {
+	unsigned int channel;		/* in */
+	unsigned int submitted;		/* records queued since the device was probed */
+	unsigned int completed;		/* records ended, failed ones included */
+	unsigned int errors;		/* records failed, or dropped by an abort */
+	unsigned int last_tag;		/* tag of the last record ended */
+	unsigned int last_status;	/* channel status when it ended, 0 if dropped */
+} dma_sched_status_t;
+
 typedef struct {
 	unsigned short vendor_id;
 	unsigned short device_id;
@@ -177,4 +329,32 @@ typedef struct {
 /* Clear interrupt queues */
 #define PCIDRIVER_IOC_CLEAR_IOQ   _IO(   PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 13 )
 
+/* Sync only a range of a buffer */
+#define PCIDRIVER_IOC_KMEM_SYNC_RANGE _IOW( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 14, kmem_sync_range_t * )
+#define PCIDRIVER_IOC_UMEM_SYNC_RANGE _IOW( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 15, umem_sync_range_t * )
+
+/* Interrupt notification without a blocked thread per source: poll() the
+ * device file, then take the outstanding interrupts, or bind eventfds */
+#define PCIDRIVER_IOC_IRQ_EVENTFD _IOW(  PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 16, irq_eventfd_t * )
+#define PCIDRIVER_IOC_IRQ_TAKE    _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 17, irq_pending_t * )
+#define PCIDRIVER_IOC_IRQ_AFFINITY _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 18, irq_affinity_t * )
+
+/* Sleeps until the ring head differs from the argument (not a pointer) */
+#define PCIDRIVER_IOC_IRQ_RING_WAIT _IO( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 19 )
+
+/* Waits for several sources with a deadline, returns -ETIMEDOUT after it */
+#define PCIDRIVER_IOC_IRQ_WAIT _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 20, irq_wait_t * )
+
+/* Transfers programmed by the interrupt handler, one record after the
+ * other. Abort takes the channel as argument (not a pointer). */
+#define PCIDRIVER_IOC_DMA_SCHED_SUBMIT _IOW(  PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 21, dma_sched_xfer_t * )
+#define PCIDRIVER_IOC_DMA_SCHED_STATUS _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 22, dma_sched_status_t * )
+#define PCIDRIVER_IOC_DMA_SCHED_ABORT  _IO(   PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 23 )
+
+/* Several commands in one syscall, each with its own status */
+#define PCIDRIVER_IOC_BATCH _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 24, batch_t * )
+
+/* SGMAP and SGGET in one call, -ENOSPC if the SG list did not fit */
+#define PCIDRIVER_IOC_UMEM_SGMAP_GET _IOWR( PCIDRIVER_IOC_MAGIC, PCIDRIVER_IOC_BASE + 25, umem_map_t * )
+
 #endif
@@ -0,0 +1,67 @@
+#ifndef PD_BATCH_H_
+#define PD_BATCH_H_
+
+#include "PciDevice.h"
+#include "KernelMemory.h"
+#include "UserMemory.h"
+
+/* The driver's batch_cmd_t */
+struct batch_cmd_s;
+
+namespace pciDriver {
+
+/**
+ * Commands for the driver gathered to run in a single syscall, such as the
+ * syncs and the interrupt wait around a transfer. Each add returns the
+ * index of the command, to read its status and results after run().
+ */
+class Batch {
+	friend class PciDevice;
+protected:
+	PciDevice *device;
+	unsigned int max;
+	unsigned int count;
+	unsigned int done;
+	bool stopOnError;
+	struct batch_cmd_s *cmds;
+	UserMemory::sg_entry **sgs;		// SG lists of the mappings, until taken
+
+	Batch(PciDevice& device, unsigned int max);
+	unsigned int add(unsigned int cmd);
+	void unmapPending();
+public:
+	~Batch();
+
+	/* A length of 0 syncs the whole buffer */
+	unsigned int syncKernelMemory(const KernelMemory& mem, KernelMemory::sync_dir dir,
+			unsigned int offset = 0, unsigned int length = 0);
+	unsigned int syncUserMemory(const UserMemory& mem, UserMemory::sync_dir dir,
+			unsigned int offset = 0, unsigned int length = 0);
+	/* Maps and gets the SG list at once, see getUserMemory() */
+	unsigned int mapUserMemory(void *mem, unsigned int size, bool merged = true);
+	unsigned int waitForInterrupt(unsigned int int_id);
+	unsigned int clearInterruptQueue(unsigned int int_id);
+	/* Reads 1, 2 or 4 bytes, see getConfigValue() */
+	unsigned int readConfig(unsigned int addr, unsigned int bytes = 4);
+
+	/* By default the first failed command ends the batch */
+	inline void setStopOnError(bool stop) { stopOnError = stop; }
+
+	/* Returns the number of commands run */
+	unsigned int run();
+	/* Drops the commands, to fill the batch again */
+	void clear();
+
+	inline unsigned int size() { return count; }
+	inline unsigned int getDone() { return done; }
+
+	/* 0, or the negative errno of the command, -ECANCELED if not run */
+	int getStatus(unsigned int index);
+	unsigned int getConfigValue(unsigned int index);
+	/* The mapping of a mapUserMemory command, once; the caller deletes it */
+	UserMemory& getUserMemory(unsigned int index);
+};
+
+}
+
+#endif /*PD_BATCH_H_*/
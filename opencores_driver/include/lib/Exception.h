@@ -43,7 +43,9 @@ public:
 		MMAP_FAILED,
 		ALLOC_FAILED,
 		SGMAP_FAILED,
-		INTERRUPT_FAILED
+		INTERRUPT_FAILED,
+		DMA_QUEUE_FAILED,
+		BATCH_FAILED
 	};
 
 	static const char* descriptions[];
@@ -17,6 +17,7 @@ namespace pciDriver {
 
 class KernelMemory {
 	friend class PciDevice;
+	friend class Batch;
 	
 protected:
 	unsigned long pa;
@@ -55,6 +56,7 @@ public:
 	};
 
 	void sync(sync_dir dir);
+	void sync(sync_dir dir, unsigned int offset, unsigned int length);
 };
 	
 }
@@ -37,6 +37,7 @@ namespace pciDriver {
 // Forward references
 class KernelMemory;
 class UserMemory;
+class Batch;
 	
 class PciDevice {
 private:
@@ -50,6 +51,33 @@ protected:
 	char name[50];
 	pthread_mutex_t mmap_mutex;
 public:
+	/* An interrupt in the event ring, see pcidriver_irq_event_t */
+	struct InterruptEvent {
+		unsigned int seq;
+		unsigned int source;
+		unsigned int status;
+		unsigned int dma_trans;
+		unsigned long long timestamp;	// CLOCK_MONOTONIC, in ns
+		unsigned int reserved[2];
+	};
+
+	/* The event ring as mapped, see pcidriver_irq_ring_t */
+	struct InterruptRing {
+		volatile unsigned int head;
+		unsigned int size;
+		unsigned int reserved[14];
+		InterruptEvent events[1024];
+	};
+
+	/* Progress of a channel of the DMA scheduler, see dma_sched_status_t */
+	struct DMAQueueStatus {
+		unsigned int submitted;
+		unsigned int completed;		// failed records included
+		unsigned int errors;
+		unsigned int last_tag;
+		unsigned int last_status;
+	};
+
 	PciDevice(int number);
 	~PciDevice();
 	
@@ -65,14 +93,45 @@ public:
 	inline UserMemory& mapUserMemory( void *mem, unsigned int size ) 
 		{ return mapUserMemory(mem,size,true); }
 
+	/* Commands run together in a single ioctl, see Batch */
+	Batch& createBatch( unsigned int max = 64 );
+
 	inline void mmap_lock() { pthread_mutex_lock( &mmap_mutex ); }
 	inline void mmap_unlock() { pthread_mutex_unlock( &mmap_mutex ); }
 	
 	void waitForInterrupt(unsigned int int_id);
+	/* Wait for any source in mask, returns those taken, 0 on timeout */
+	unsigned int waitForInterrupts(unsigned int mask, unsigned int timeout_us,
+			unsigned int *counts = NULL, unsigned int max_events = 0);
 	void clearInterruptQueue(unsigned int int_id);
+	/* Instead of waiting: poll() getHandle(), then take the interrupts */
+	unsigned int takeInterrupts(unsigned int mask, unsigned int *counts = NULL);
+	/* Count the interrupts of int_id in an eventfd, efd -1 unbinds it */
+	void bindInterruptEventfd(unsigned int int_id, int efd);
+	/* Steer the MSI/MSI-X vector of int_id to cpu, returns its IRQ or -1 */
+	int setInterruptAffinity(unsigned int int_id, int cpu);
+
+	/* Event ring of all the interrupts, read without a syscall */
+	const InterruptRing *mapInterruptRing();
+	void unmapInterruptRing(const InterruptRing *ring);
+	unsigned int readInterruptRing(const InterruptRing *ring, unsigned int& next,
+			InterruptEvent *events, unsigned int max, bool wait = false);
+
+	/* DMA scheduler of the driver, ABB only: the interrupt handler starts
+	 * the queued records one after the other, and each one ends with an
+	 * interrupt of its channel. Offset and length in bytes. Returns false
+	 * if the queue has no room for the record now. */
+	bool queueDMA(const KernelMemory& mem, bool toDevice, unsigned int bar, unsigned int addr,
+			unsigned int offset, unsigned int length, unsigned int tag, bool inc = true);
+	bool queueDMA(const UserMemory& mem, bool toDevice, unsigned int bar, unsigned int addr,
+			unsigned int offset, unsigned int length, unsigned int tag, bool inc = true);
+	void getDMAQueueStatus(unsigned int channel, DMAQueueStatus& status);
+	/* Stop a channel, returns the records dropped */
+	unsigned int abortDMAQueue(unsigned int channel);
 	
 	unsigned int getBARsize(unsigned int bar);
-	void *mapBAR(unsigned int bar);
+	/* writeCombining maps the BAR write-combining: stores must be fenced */
+	void *mapBAR(unsigned int bar, bool writeCombining = false);
 	void unmapBAR(unsigned int bar, void *ptr);
 	
 	unsigned char readConfigByte(unsigned int addr);
@@ -82,6 +141,10 @@ public:
 	void writeConfigByte(unsigned int addr, unsigned char val);
 	void writeConfigWord(unsigned int addr, unsigned short val);
 	void writeConfigDWord(unsigned int addr, unsigned int val);
+
+protected:
+	bool queueDMARecord(int type, int handle_id, bool toDevice, unsigned int bar, unsigned int addr,
+			unsigned int offset, unsigned int length, unsigned int tag, bool inc);
 };
 	
 }
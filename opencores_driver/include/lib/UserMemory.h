@@ -26,6 +26,7 @@ namespace pciDriver {
 
 class UserMemory {
 	friend class PciDevice;
+	friend class Batch;
 private:
 	struct sg_entry {
 		unsigned long addr;
@@ -41,6 +42,8 @@ protected:
 	struct sg_entry *sg;
 
 	UserMemory(PciDevice& device, void *mem, unsigned int size, bool merged );
+	/* Takes a mapping made by a Batch, and its SG list */
+	UserMemory(PciDevice& device, void *mem, unsigned int size, int handle_id, int nents, struct sg_entry *sg);
 public:
 	~UserMemory();
 	
@@ -51,6 +54,7 @@ public:
 	};
 	
 	void sync(sync_dir dir);
+	void sync(sync_dir dir, unsigned int offset, unsigned int length);
 
 	inline unsigned int getSGcount() { return nents; }	
 	inline unsigned long getSGentryAddress(unsigned int entry ) { return sg[entry].addr; }
@@ -62,6 +62,52 @@ typedef struct {
 	pd_device_t *pci_handle;
 } pd_umem_t;
 
+/* An interrupt in the event ring of a device */
+typedef struct {
+	unsigned int seq;			/* number of the event, ring->events[seq % PD_IRQ_RING_EVENTS] */
+	unsigned int source;		/* interrupt source */
+	unsigned int status;		/* interrupt status, as read or as signaled by the vector */
+	unsigned int dma_trans;		/* DMA_TRANS counter of the channel, 0 for other sources */
+	unsigned long long timestamp;	/* CLOCK_MONOTONIC, in ns */
+	unsigned int reserved[2];
+} pd_irq_event_t;
+
+#define PD_IRQ_RING_EVENTS	1024
+
+/* The event ring, as mapped by pd_mapInterruptRing */
+typedef struct {
+	volatile unsigned int head;	/* events recorded so far */
+	unsigned int size;			/* PD_IRQ_RING_EVENTS */
+	unsigned int reserved[14];
+	pd_irq_event_t events[PD_IRQ_RING_EVENTS];
+} pd_irq_ring_t;
+
+/* Progress of a channel of the DMA scheduler of the driver */
+typedef struct {
+	unsigned int submitted;		/* records queued */
+	unsigned int completed;		/* records ended, failed ones included */
+	unsigned int errors;		/* records failed or dropped */
+	unsigned int last_tag;		/* tag of the last record ended */
+	unsigned int last_status;	/* channel status when it ended */
+} pd_dma_queue_status_t;
+
+/* Flags of a record for the DMA scheduler */
+#define PD_DMA_QUEUE_INC	1	/* increment the peripheral address */
+
+/* Commands run together in one call, see pd_batchInit */
+typedef struct {
+	pd_device_t *pci_handle;
+	unsigned int max;			/* commands it holds, at most PD_BATCH_MAX */
+	unsigned int count;			/* commands added */
+	unsigned int done;			/* commands run by the last pd_batchRun */
+	int flags;					/* PD_BATCH_* */
+	void *cmds;					/* the commands, as the driver takes them */
+	pd_umem_t **umem;			/* per command, the handle a mapping fills */
+} pd_batch_t;
+
+#define PD_BATCH_MAX		64
+#define PD_BATCH_CONTINUE	1	/* run the commands after a failed one */
+
 /* Direction of a Sync operation */
 #define PD_DIR_BIDIRECTIONAL	0
 #define	PD_DIR_TODEVICE			1
@@ -81,15 +127,58 @@ int pd_unmapUserMemory( pd_umem_t *umem_handle );
 /* Sync Functions */
 int pd_syncKernelMemory( pd_kmem_t *kmem_handle, int dir );
 int pd_syncUserMemory( pd_umem_t *umem_handle, int dir );
+int pd_syncKernelMemoryRange( pd_kmem_t *kmem_handle, int dir, unsigned long offset, unsigned long length );
+int pd_syncUserMemoryRange( pd_umem_t *umem_handle, int dir, unsigned long offset, unsigned long length );
 
 /* Interrupt Function */
 int pd_waitForInterrupt(pd_device_t *pci_handle , unsigned int int_id );
 int pd_clearInterruptQueue(pd_device_t *pci_handle , unsigned int int_id );
+int pd_waitForInterrupts(pd_device_t *pci_handle, unsigned int *mask, unsigned int timeout_us,
+		unsigned int *counts, unsigned int max_events );
+int pd_takeInterrupts(pd_device_t *pci_handle, unsigned int *mask, unsigned int *counts );
+int pd_bindInterruptEventfd(pd_device_t *pci_handle, unsigned int int_id, int efd );
+int pd_setInterruptAffinity(pd_device_t *pci_handle, unsigned int int_id, int cpu );
+const pd_irq_ring_t *pd_mapInterruptRing(pd_device_t *pci_handle );
+int pd_unmapInterruptRing(pd_device_t *pci_handle, const pd_irq_ring_t *ring );
+int pd_readInterruptRing(pd_device_t *pci_handle, const pd_irq_ring_t *ring, unsigned int *next,
+		pd_irq_event_t *events, unsigned int max, int wait );
+
+/* DMA scheduler of the driver (ABB): records started by the interrupt handler.
+ * PD_DIR_TODEVICE uses channel 0, PD_DIR_FROMDEVICE channel 1. The queue
+ * functions return 1 if the queue has no room for the record now, the
+ * abort returns the records dropped. */
+int pd_queueKernelMemoryDMA( pd_kmem_t *kmem_handle, int dir, unsigned int bar, unsigned int addr,
+		unsigned long offset, unsigned long length, unsigned int tag, int flags );
+int pd_queueUserMemoryDMA( pd_umem_t *umem_handle, int dir, unsigned int bar, unsigned int addr,
+		unsigned long offset, unsigned long length, unsigned int tag, int flags );
+int pd_getDMAQueueStatus( pd_device_t *pci_handle, unsigned int channel, pd_dma_queue_status_t *status );
+int pd_abortDMAQueue( pd_device_t *pci_handle, unsigned int channel );
+
+/* Batches: the add functions return the index of the command, or -1 if
+ * the batch is full. pd_batchRun returns the commands run, a failed one
+ * ends the batch unless flags has PD_BATCH_CONTINUE; pd_batchStatus gives
+ * 0 or the negative errno of a command. A map fills its pd_umem_t when
+ * the batch runs, freed with pd_unmapUserMemory as usual. */
+int pd_batchInit( pd_device_t *pci_handle, pd_batch_t *batch, unsigned int max );
+int pd_batchFree( pd_batch_t *batch );
+void pd_batchClear( pd_batch_t *batch );
+int pd_batchSyncKernelMemory( pd_batch_t *batch, pd_kmem_t *kmem_handle, int dir,
+		unsigned long offset, unsigned long length );
+int pd_batchSyncUserMemory( pd_batch_t *batch, pd_umem_t *umem_handle, int dir,
+		unsigned long offset, unsigned long length );
+int pd_batchMapUserMemory( pd_batch_t *batch, void *mem, unsigned int size, pd_umem_t *umem_handle );
+int pd_batchWaitForInterrupt( pd_batch_t *batch, unsigned int int_id );
+int pd_batchClearInterruptQueue( pd_batch_t *batch, unsigned int int_id );
+int pd_batchReadConfig( pd_batch_t *batch, unsigned int addr, unsigned int bytes );
+int pd_batchRun( pd_batch_t *batch );
+int pd_batchStatus( pd_batch_t *batch, unsigned int index );
+unsigned int pd_batchConfigValue( pd_batch_t *batch, unsigned int index );
 
 /* PCI Functions */
 int pd_getID( pd_device_t *pci_handle );
 int pd_getBARsize( pd_device_t *pci_handle, unsigned int bar );
 void *pd_mapBAR( pd_device_t *pci_handle, unsigned int bar );
+void *pd_mapBAR_wc( pd_device_t *pci_handle, unsigned int bar );
 int pd_unmapBAR( pd_device_t *pci_handle, unsigned int bar, void *ptr );
 
 unsigned char pd_readConfigByte( pd_device_t *pci_handle, unsigned int addr );
@@ -113,6 +202,7 @@ int pd_writeConfigDWord( pd_device_t *pci_handle, unsigned int addr, unsigned in
 #include "PciDevice.h"
 #include "KernelMemory.h"
 #include "UserMemory.h"
+#include "Batch.h"
 
 #include "pciDriver_compat.h"
 
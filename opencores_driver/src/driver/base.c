@@ -163,6 +163,7 @@
 #include <linux/stat.h>
 #include <linux/interrupt.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
 
 /* Configuration for the driver (what should be compiled in, module name, etc...) */
 #include "config.h"
@@ -293,7 +294,7 @@ static struct pci_driver pcidriver_driver = {
  */
 static int __devinit pcidriver_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 {
-	int err;
+	int err, i;
 	int devno;
 	pcidriver_privdata_t *privdata;
 	int devid;
@@ -380,10 +381,17 @@ static int __devinit pcidriver_probe(struct pci_dev *pdev, const struct pci_devi
 	INIT_LIST_HEAD(&(privdata->kmem_list));
 	spin_lock_init(&(privdata->kmemlist_lock));
 	atomic_set(&privdata->kmem_count, 0);
+	idr_init(&(privdata->kmem_idr));
 
 	INIT_LIST_HEAD(&(privdata->umem_list));
 	spin_lock_init(&(privdata->umemlist_lock));
 	atomic_set(&privdata->umem_count, 0);
+	idr_init(&(privdata->umem_idr));
+
+	for (i = 0; i < (1 << UMEM_CACHE_HASH_BITS); i++)
+		INIT_HLIST_HEAD(&(privdata->umem_hash[i]));
+	INIT_LIST_HEAD(&(privdata->umem_mms));
+	mutex_init(&(privdata->umem_mms_lock));
 
 	pci_set_drvdata( pdev, privdata );
 	privdata->pdev = pdev;
@@ -421,6 +429,7 @@ static int __devinit pcidriver_probe(struct pci_dev *pdev, const struct pci_devi
 	sysfs_attr(kbuffers);
 	sysfs_attr(umappings);
 	sysfs_attr(umem_unmap);
+	sysfs_attr(umem_cache);
 	#undef sysfs_attr
 
 	/* Register character device */
@@ -440,7 +449,7 @@ static int __devinit pcidriver_probe(struct pci_dev *pdev, const struct pci_devi
 probe_device_create_fail:
 probe_cdevadd_fail:
 probe_irq_probe_fail:
-	pcidriver_irq_unmap_bars(privdata);
+	pcidriver_remove_irq(privdata);
 	kfree(privdata);
 probe_nomem:
 	atomic_dec(&pcidriver_deviceCount);
@@ -479,11 +488,18 @@ static void __devexit pcidriver_remove(struct pci_dev *pdev)
 	sysfs_attr(kbuffers);
 	sysfs_attr(umappings);
 	sysfs_attr(umem_unmap);
+	sysfs_attr(umem_cache);
 	#undef sysfs_attr
 
 	/* Free all allocated kmem buffers before leaving */
 	pcidriver_kmem_free_all( privdata );
 
+	/* Release the user memory mappings, in use or cached */
+	pcidriver_umem_sgunmap_all( privdata );
+
+	idr_destroy(&(privdata->kmem_idr));
+	idr_destroy(&(privdata->umem_idr));
+
 #ifdef ENABLE_IRQ
 	pcidriver_remove_irq(privdata);
 #endif
@@ -522,6 +538,9 @@ static struct file_operations pcidriver_fops = {
 #endif
 	.unlocked_ioctl = pcidriver_ioctl,
 	.mmap = pcidriver_mmap,
+#ifdef ENABLE_IRQ
+	.poll = pcidriver_poll,
+#endif
 	.open = pcidriver_open,
 	.release = pcidriver_release,
 };
@@ -545,8 +564,8 @@ int pcidriver_open(struct inode *inode, struct file *filp)
 
 /**
  *
- * Called when the application close()s the file descriptor. Does nothing at
- * the moment.
+ * Called when the application close()s the file descriptor. Unbinds the
+ * eventfds bound through it, and stops the DMA records queued through it.
  *
  */
 int pcidriver_release(struct inode *inode, struct file *filp)
@@ -556,6 +575,13 @@ int pcidriver_release(struct inode *inode, struct file *filp)
 	/* Get the private data area */
 	privdata = filp->private_data;
 
+#ifdef ENABLE_IRQ
+	pcidriver_irq_unbind_eventfds(privdata, filp);
+#endif
+#ifdef ENABLE_DMA_SCHED
+	pcidriver_dma_sched_release(privdata, filp);
+#endif
+
 	return 0;
 }
 
@@ -581,6 +607,7 @@ int pcidriver_mmap(struct file *filp, struct vm_area_struct *vma)
 	/* Check the current mmap mode */
 	switch (privdata->mmap_mode) {
 		case PCIDRIVER_MMAP_PCI:
+		case PCIDRIVER_MMAP_PCI_WC:
 			/* Mmap a PCI region */
 			switch (privdata->mmap_area) {
 				case PCIDRIVER_BAR0:	bar = 0; break;
@@ -594,12 +621,19 @@ int pcidriver_mmap(struct file *filp, struct vm_area_struct *vma)
 					return -EINVAL;			/* invalid parameter */
 					break;
 			}
-			ret = pcidriver_mmap_pci(privdata, vma, bar);
+			ret = pcidriver_mmap_pci(privdata, vma, bar,
+					(privdata->mmap_mode == PCIDRIVER_MMAP_PCI_WC));
 			break;
 		case PCIDRIVER_MMAP_KMEM:
 			/* mmap a Kernel buffer */
 			ret = pcidriver_mmap_kmem(privdata, vma);
 			break;
+#ifdef ENABLE_IRQ
+		case PCIDRIVER_MMAP_IRQ_RING:
+			/* mmap the interrupt event ring */
+			ret = pcidriver_mmap_irq_ring(privdata, vma);
+			break;
+#endif
 		default:
 			mod_info( "Invalid mmap_mode value (%d)\n",privdata->mmap_mode );
 			return -EINVAL;			/* Invalid parameter (mode) */
@@ -610,7 +644,7 @@ int pcidriver_mmap(struct file *filp, struct vm_area_struct *vma)
 
 /*************************************************************************/
 /* Internal driver functions */
-int pcidriver_mmap_pci(pcidriver_privdata_t *privdata, struct vm_area_struct *vmap, int bar)
+int pcidriver_mmap_pci(pcidriver_privdata_t *privdata, struct vm_area_struct *vmap, int bar, int wc)
 {
 	int ret = 0;
 	unsigned long bar_addr;
@@ -635,6 +669,11 @@ int pcidriver_mmap_pci(pcidriver_privdata_t *privdata, struct vm_area_struct *vm
 	if (bar_flags & IORESOURCE_IO) {
 		/* Unlikely case, we will mmap a IO region */
 
+		if (wc) {
+			mod_info("BAR%d is an IO region, it can not be write-combined\n", bar);
+			return -EINVAL;
+		}
+
 		/* IO regions are never cacheable */
 #ifdef pgprot_noncached
 		vmap->vm_page_prot = pgprot_noncached(vmap->vm_page_prot);
@@ -663,6 +702,15 @@ int pcidriver_mmap_pci(pcidriver_privdata_t *privdata, struct vm_area_struct *vm
 //			vmap->vm_page_prot = pgprot_noncached(vmap->vm_page_prot);
 #endif
 
+		/* Write-combining lets the CPU merge consecutive stores into
+		 * full-payload TLPs. Stores may then be merged or reordered, so
+		 * user space must fence them; only ask for it on memory-like BARs. */
+		if (wc) {
+			if (!(bar_flags & IORESOURCE_PREFETCH))
+				mod_info_dbg("BAR%d is not prefetchable, write-combining it anyway\n", bar);
+			vmap->vm_page_prot = pgprot_writecombine(vmap->vm_page_prot);
+		}
+
 		/* Map the BAR */
 		ret = remap_pfn_range_compat(
 					vmap,
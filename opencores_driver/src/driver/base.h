@@ -60,7 +60,7 @@ int pcidriver_pci_read( pcidriver_privdata_t *privdata, pci_cfg_cmd *pci_cmd );
 int pcidriver_pci_write( pcidriver_privdata_t *privdata, pci_cfg_cmd *pci_cmd );
 int pcidriver_pci_info( pcidriver_privdata_t *privdata, pci_board_info *pci_info );
 
-int pcidriver_mmap_pci( pcidriver_privdata_t *privdata, struct vm_area_struct *vmap , int bar );
+int pcidriver_mmap_pci( pcidriver_privdata_t *privdata, struct vm_area_struct *vmap , int bar, int wc );
 int pcidriver_mmap_kmem( pcidriver_privdata_t *privdata, struct vm_area_struct *vmap );
 
 /*************************************************************************/
@@ -80,6 +80,7 @@ static DEVICE_ATTR(kmem_alloc, S_IWUGO, NULL, pcidriver_store_kmem_alloc);
 static DEVICE_ATTR(kmem_free, S_IWUGO, NULL, pcidriver_store_kmem_free);
 static DEVICE_ATTR(umappings, S_IRUGO, pcidriver_show_umappings, NULL);
 static DEVICE_ATTR(umem_unmap, S_IWUGO, NULL, pcidriver_store_umem_unmap);
+static DEVICE_ATTR(umem_cache, S_IRUGO, pcidriver_show_umem_cache, NULL);
 
 #ifdef ENABLE_IRQ
 static DEVICE_ATTR(irq_count, S_IRUGO, pcidriver_show_irq_count, NULL);
@@ -1,6 +1,12 @@
 #ifndef _PCIDRIVER_COMMON_H
 #define _PCIDRIVER_COMMON_H
 
+#include <linux/idr.h>
+#include <linux/rcupdate.h>
+#ifdef PCIDRIVER_EVENTFD
+#include <linux/eventfd.h>
+#endif
+
 /*************************************************************************/
 /* Private data types and structures */
 
@@ -20,15 +26,31 @@ typedef struct {
 typedef struct {
 	int id;
 	struct list_head list;
+	struct hlist_node hash;		/* in the cache hash while it can be reused, else unhashed */
+	struct mm_struct *mm;		/* cache key: address space, start and size of the area */
+	unsigned long vma;
+	unsigned long size;
+	int refs;					/* handles given out for this mapping, 0 if idle in the cache */
 	unsigned int nr_pages;		/* number of pages for this user memeory area */
+	unsigned int nr_sg;			/* entries passed to the map function, contiguous pages share one */
 	struct page **pages;		/* list of pointers to the pages */
 	unsigned int nents;			/* actual entries in the scatter/gatter list (NOT nents for the map function, but the result) */
 	struct scatterlist *sg;		/* list of sg entries */
 	struct class_device_attribute sysfs_attr;	/* initialized when adding the entry */
 } pcidriver_umem_entry_t;
 
+struct pcidriver_privdata_s;
+
+/* An interrupt vector serving a single source, from MSI-X or multiple MSI */
+typedef struct {
+	struct pcidriver_privdata_s *privdata;	/* the handler gets the vector as dev_id */
+	int source;							/* interrupt source it signals */
+	unsigned int irq;					/* Linux IRQ number of the vector */
+	int cpu;							/* CPU of the affinity hint, -1 if none */
+} pcidriver_irq_vector_t;
+
 /* Hold the driver private data */
-typedef struct  {
+typedef struct pcidriver_privdata_s {
 	dev_t devno;						/* device number (major and minor) */
 	struct pci_dev *pdev;				/* PCI device */
 	struct class_device *class_dev;		/* Class device */
@@ -39,11 +61,33 @@ typedef struct  {
 #ifdef ENABLE_IRQ
 	int irq_enabled;					/* Non-zero if IRQ is enabled */
 	int irq_count;						/* Just an IRQ counter */
+	int irq_mode;						/* PCIDRIVER_IRQ_INTX, _MSI or _MSIX, as set up */
+	int irq_nvecs;						/* Vectors with their own source, 0 if one handler reads the status */
+	pcidriver_irq_vector_t irq_vectors[ PCIDRIVER_INT_MAXSOURCES ];
+										/* Indexed by source */
 
 	wait_queue_head_t irq_queues[ PCIDRIVER_INT_MAXSOURCES ];
 										/* One queue per interrupt source */
 	atomic_t irq_outstanding[ PCIDRIVER_INT_MAXSOURCES ];
 										/* Outstanding interrupts per queue */
+	wait_queue_head_t irq_poll_queue;	/* Woken on interrupts of any source, for poll() */
+	pcidriver_irq_ring_t *irq_ring;		/* Event ring, mmapped by user space, NULL if not allocated */
+	spinlock_t irq_ring_lock;			/* Orders the handlers of several vectors on the ring */
+	spinlock_t irq_enable_lock;			/* Orders the read-modify-writes of the interrupt enable register */
+	wait_queue_head_t irq_ring_queue;	/* Woken on every event in the ring */
+#ifdef PCIDRIVER_EVENTFD
+	spinlock_t irq_eventfd_lock;		/* Protects the eventfds against the handler */
+	struct eventfd_ctx *irq_eventfd[ PCIDRIVER_INT_MAXSOURCES ];
+										/* Signaled instead of the queue, if bound */
+	struct file *irq_eventfd_owner[ PCIDRIVER_INT_MAXSOURCES ];
+										/* File through which each one was bound */
+#endif
+#ifdef ENABLE_DMA_SCHED
+	struct dmasched_chan_s *dma_sched;	/* A queue per channel, NULL without a WG engine */
+	struct file *dma_sched_owner[ PCIDRIVER_DMA_SCHED_CHANNELS ];
+										/* File which queued the records, the channel is aborted when it is closed */
+	spinlock_t dma_sched_lock;			/* Protects the queues against the handlers */
+#endif
 	volatile unsigned int *bars_kmapped[6];		/* PCI BARs mmapped in kernel space */
 
 #endif
@@ -51,10 +95,23 @@ typedef struct  {
 	spinlock_t kmemlist_lock;			/* Spinlock to lock kmem list operations */
 	struct list_head kmem_list;			/* List of 'kmem_list_entry's associated with this device */
 	atomic_t kmem_count;				/* id for next kmem entry */
+	struct idr kmem_idr;				/* kmem entries by id, written under kmemlist_lock, read under RCU */
 
 	spinlock_t umemlist_lock;			/* Spinlock to lock umem list operations */
 	struct list_head umem_list;			/* List of 'umem_list_entry's associated with this device */
 	atomic_t umem_count;				/* id for next umem entry */
+	struct idr umem_idr;				/* umem entries by id, written under umemlist_lock, read under RCU */
+
+	struct hlist_head umem_hash[1 << UMEM_CACHE_HASH_BITS];
+										/* Reusable umem entries, by mm and address */
+	struct list_head umem_mms;			/* Address spaces watched for unmaps */
+	struct mutex umem_mms_lock;			/* Mutex to lock the watched address spaces */
+	unsigned long umem_hits;			/* Cache statistics, under umemlist_lock */
+	unsigned long umem_misses;
+	unsigned long umem_invalidated;
+	unsigned long umem_idle;
+	u64 umem_hit_ns;					/* Time spent in map calls, by outcome */
+	u64 umem_miss_ns;
 
 	
 } pcidriver_privdata_t;
@@ -189,4 +189,83 @@ static inline void set_pages_reserved_compat(unsigned long cpua, unsigned long s
 #endif
 }
 
+/* The kmem/umem entries are found by id in an idr. idr_alloc() replaced
+ * idr_pre_get()/idr_get_new_above() in 3.9: preload outside the lock of the
+ * idr, then insert under it. The id is fresh, so it is inserted as is. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+	#define idr_preload_compat(idr) ({ idr_preload(GFP_KERNEL); 1; })
+	#define idr_preload_end_compat() idr_preload_end()
+
+	static inline int idr_insert_compat(struct idr *idr, void *ptr, int id) {
+		int ret = idr_alloc(idr, ptr, id, id + 1, GFP_NOWAIT);
+		return (ret < 0) ? ret : 0;
+	}
+#else
+	#define idr_preload_compat(idr) idr_pre_get(idr, GFP_KERNEL)
+	#define idr_preload_end_compat() do { } while (0)
+
+	static inline int idr_insert_compat(struct idr *idr, void *ptr, int id) {
+		int newid;
+		return idr_get_new_above(idr, ptr, id, &newid);
+	}
+#endif
+
+/* idr_find() runs under rcu_read_lock() since 2.6.27. Before, readers take
+ * the lock of the idr, and removers have no grace period to wait for. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27)
+	#define idr_read_lock_compat(lock) rcu_read_lock()
+	#define idr_read_unlock_compat(lock) rcu_read_unlock()
+	#define idr_remove_sync_compat() synchronize_rcu()
+#else
+	#define idr_read_lock_compat(lock) spin_lock(lock)
+	#define idr_read_unlock_compat(lock) spin_unlock(lock)
+	#define idr_remove_sync_compat() do { } while (0)
+#endif
+
+/* Enabling an exact number of MSI-X or MSI vectors. The _range functions
+ * replaced pci_enable_msix and pci_enable_msi_block in 3.14; before that,
+ * multiple MSI vectors were available from 2.6.30 on. All return 0 if the
+ * vectors were enabled. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0)
+	#define pci_enable_msix_exact_compat(pdev, entries, nvec) \
+		((pci_enable_msix_range(pdev, entries, nvec, nvec) == (nvec)) ? 0 : -ENOSPC)
+	#define pci_enable_msi_exact_compat(pdev, nvec) \
+		((pci_enable_msi_range(pdev, nvec, nvec) == (nvec)) ? 0 : -ENOSPC)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,30)
+	#define pci_enable_msix_exact_compat(pdev, entries, nvec) \
+		((pci_enable_msix(pdev, entries, nvec) == 0) ? 0 : -ENOSPC)
+	#define pci_enable_msi_exact_compat(pdev, nvec) \
+		((pci_enable_msi_block(pdev, nvec) == 0) ? 0 : -ENOSPC)
+#else
+	#define pci_enable_msix_exact_compat(pdev, entries, nvec) \
+		((pci_enable_msix(pdev, entries, nvec) == 0) ? 0 : -ENOSPC)
+	#define pci_enable_msi_exact_compat(pdev, nvec) (-ENOSYS)
+#endif
+
+/* Affinity hints, which irqbalance follows, appeared in 2.6.35; from 4.4 on
+ * setting one also moves the IRQ to the hinted CPUs. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,35)
+	#define irq_set_affinity_hint_compat(irq, mask) irq_set_affinity_hint(irq, mask)
+#else
+	#define irq_set_affinity_hint_compat(irq, mask) (-ENOSYS)
+#endif
+
+/* ktime_get_ns appeared in 3.17 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)
+	#define ktime_get_ns_compat() ktime_get_ns()
+#else
+	#define ktime_get_ns_compat() ((u64)ktime_to_ns(ktime_get()))
+#endif
+
+/* Kernel code can hold and signal an eventfd from 2.6.31 on */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,31)
+	#define PCIDRIVER_EVENTFD
+#endif
+
+/* pgprot_writecombine appeared in 2.6.26 (x86). Without it, a write-combining
+ * mapping of a BAR is just uncached, which is slower but still correct. */
+#ifndef pgprot_writecombine
+	#define pgprot_writecombine pgprot_noncached
+#endif
+
 #endif
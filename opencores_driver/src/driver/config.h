@@ -8,6 +8,21 @@
 /* Enable/disable IRQ handling */
 #define ENABLE_IRQ
 
+/* Let the interrupt handler program queued transfers of the ABB / WG DMA
+ * engine. Needs ENABLE_IRQ. */
+#define ENABLE_DMA_SCHED
+
+/* Keep user memory mappings pinned after their last unmap, to reuse them
+ * when the same buffer is mapped again. Needs MMU notifiers (2.6.27) to
+ * drop them when the memory is unmapped; without, mappings are not kept. */
+#define ENABLE_UMEM_CACHE
+
+/* Unused mappings kept in the cache, the oldest one is released first */
+#define UMEM_CACHE_IDLE_MAX 32
+
+/* Buckets of the hash of cached mappings, as a power of two */
+#define UMEM_CACHE_HASH_BITS 6
+
 /* The name of the module */
 #define MODNAME "pciDriver"
 
@@ -0,0 +1,203 @@
+/**
+ *
+ * @file dmasched.c
+ * @brief Programs the queued transfers of a DMA channel back to back.
+ *
+ * Every transfer is a single descriptor with the interrupt on done set.
+ * The interrupt handler calls dmasched_complete(), which starts the next
+ * one right away, so the engine does not wait for user space between the
+ * transfers of a queue.
+ *
+ */
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#else
+#include <errno.h>
+#endif
+
+#include "dmasched.h"
+
+static void dmasched_program(dmasched_chan_t *chan);
+
+/**
+ *
+ * Sets up an empty queue for the channel registers at regs.
+ *
+ */
+void dmasched_init(dmasched_chan_t *chan, volatile unsigned int *regs)
+{
+	chan->regs = regs;
+	chan->head = 0;
+	chan->tail = 0;
+	chan->busy = 0;
+	chan->submitted = 0;
+	chan->completed = 0;
+	chan->errors = 0;
+	chan->last_tag = 0;
+	chan->last_status = 0;
+}
+
+/**
+ *
+ * Free slots in the queue. A record is queued only if all its transfers fit.
+ *
+ */
+unsigned int dmasched_space(const dmasched_chan_t *chan)
+{
+	return DMASCHED_DEPTH - (chan->head - chan->tail);
+}
+
+/**
+ *
+ * Appends a transfer. It is not started, see dmasched_kick().
+ *
+ * @returns -ENOSPC if the queue is full
+ *
+ */
+int dmasched_queue(dmasched_chan_t *chan, const dmasched_xfer_t *xfer)
+{
+	if (dmasched_space(chan) == 0)
+		return -ENOSPC;
+
+	chan->queue[ chan->head & (DMASCHED_DEPTH - 1) ] = *xfer;
+	chan->head++;
+	if (xfer->last)
+		chan->submitted++;
+
+	return 0;
+}
+
+/**
+ *
+ * Starts the first queued transfer if the engine is idle.
+ *
+ * @returns non zero if a transfer was started
+ *
+ */
+int dmasched_kick(dmasched_chan_t *chan)
+{
+	if (chan->busy || (chan->tail == chan->head))
+		return 0;
+
+	dmasched_program(chan);
+	return 1;
+}
+
+/**
+ *
+ * Called on the interrupt of the channel. Retires the running transfer and
+ * starts the next one. A failed transfer fails its whole record, the rest
+ * of its transfers are dropped.
+ *
+ */
+int dmasched_complete(dmasched_chan_t *chan)
+{
+	const dmasched_xfer_t *xfer;
+	unsigned int status;
+	int failed;
+
+	if (!chan->busy)
+		return DMASCHED_IDLE;
+
+	status = chan->regs[ DMASCHED_REG_STA ];
+	failed = ((status & DMASCHED_STA_BUSY) && (status & DMASCHED_STA_DONE)) ||
+		 (status & DMASCHED_STA_TOUT);
+	if ((status & DMASCHED_STA_BUSY) && !failed)
+		return DMASCHED_RUNNING;
+
+	chan->busy = 0;
+	do {
+		xfer = &(chan->queue[ chan->tail & (DMASCHED_DEPTH - 1) ]);
+		chan->tail++;
+	} while (failed && !xfer->last);
+
+	if (failed) {
+		chan->errors++;
+		chan->regs[ DMASCHED_REG_CTRL ] = DMASCHED_CTRL_RESET | DMASCHED_CTRL_V;
+	}
+
+	if (xfer->last) {
+		chan->completed++;
+		chan->last_tag = xfer->tag;
+		chan->last_status = status;
+	}
+
+	dmasched_kick(chan);
+
+	return (xfer->last) ? DMASCHED_RECORD : DMASCHED_PIECE;
+}
+
+/**
+ *
+ * Stops the channel and drops everything queued. The dropped records count
+ * as ended and failed.
+ *
+ * @returns the records dropped
+ *
+ */
+unsigned int dmasched_abort(dmasched_chan_t *chan)
+{
+	unsigned int dropped = 0;
+
+	chan->regs[ DMASCHED_REG_CTRL ] = DMASCHED_CTRL_RESET | DMASCHED_CTRL_V;
+
+	for (; chan->tail != chan->head; chan->tail++) {
+		const dmasched_xfer_t *xfer = &(chan->queue[ chan->tail & (DMASCHED_DEPTH - 1) ]);
+
+		if (!xfer->last)
+			continue;
+		dropped++;
+		chan->last_tag = xfer->tag;
+	}
+
+	chan->busy = 0;
+	if (dropped > 0) {
+		chan->completed += dropped;
+		chan->errors += dropped;
+		chan->last_status = 0;
+	}
+
+	return dropped;
+}
+
+/**
+ *
+ * Tells if a transfer of the buffer is queued or running, the buffer must
+ * not go away before the channel is aborted.
+ *
+ */
+int dmasched_uses(const dmasched_chan_t *chan, unsigned long buffer)
+{
+	unsigned int i;
+
+	for (i = chan->tail; i != chan->head; i++)
+		if (chan->queue[ i & (DMASCHED_DEPTH - 1) ].buffer == buffer)
+			return 1;
+
+	return 0;
+}
+
+/**
+ *
+ * Writes the transfer at tail to the channel, the control word last.
+ *
+ */
+static void dmasched_program(dmasched_chan_t *chan)
+{
+	const dmasched_xfer_t *xfer = &(chan->queue[ chan->tail & (DMASCHED_DEPTH - 1) ]);
+	volatile unsigned int *regs = chan->regs;
+
+	regs[ DMASCHED_REG_CTRL ] = DMASCHED_CTRL_RESET | DMASCHED_CTRL_V;
+
+	regs[ DMASCHED_REG_PA_H ] = 0;
+	regs[ DMASCHED_REG_PA_L ] = xfer->per;
+	regs[ DMASCHED_REG_HA_H ] = (unsigned int)(xfer->host >> 32);
+	regs[ DMASCHED_REG_HA_L ] = (unsigned int)(xfer->host & 0xFFFFFFFF);
+	regs[ DMASCHED_REG_BDA_H ] = 0;
+	regs[ DMASCHED_REG_BDA_L ] = 0;
+	regs[ DMASCHED_REG_LENG ] = xfer->length;
+	regs[ DMASCHED_REG_CTRL ] = xfer->control | DMASCHED_CTRL_LAST | DMASCHED_CTRL_UPA |
+				    DMASCHED_CTRL_V | DMASCHED_CTRL_EDI;
+
+	chan->busy = 1;
+}
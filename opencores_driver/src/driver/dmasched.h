@@ -0,0 +1,88 @@
+#ifndef _PCIDRIVER_DMASCHED_H
+#define _PCIDRIVER_DMASCHED_H
+
+/**
+ *
+ * @file dmasched.h
+ * @brief Queues of transfers for the channels of the ABB / WG DMA engine,
+ * programmed one after the other from the interrupt handler.
+ *
+ * Only the channel registers are touched here, no kernel headers are
+ * needed: the tests run it against a model of the registers. Locking is
+ * left to the caller.
+ *
+ */
+
+/* Registers of a channel, in dwords from its base */
+#define DMASCHED_REG_PA_H	0
+#define DMASCHED_REG_PA_L	1
+#define DMASCHED_REG_HA_H	2
+#define DMASCHED_REG_HA_L	3
+#define DMASCHED_REG_BDA_H	4
+#define DMASCHED_REG_BDA_L	5
+#define DMASCHED_REG_LENG	6
+#define DMASCHED_REG_CTRL	7	/* writing it starts the transfer */
+#define DMASCHED_REG_STA	8
+#define DMASCHED_REGS		9
+
+/* Control word */
+#define DMASCHED_CTRL_RESET	0x0000000A
+#define DMASCHED_CTRL_INC	0x00008000
+#define DMASCHED_CTRL_UPA	0x00100000
+#define DMASCHED_CTRL_LAST	0x01000000
+#define DMASCHED_CTRL_V		0x02000000
+#define DMASCHED_CTRL_EDI	0x10000000
+#define DMASCHED_CTRL_BAR(bar)	(((bar) & 0x7) << 16)
+
+/* Status word */
+#define DMASCHED_STA_DONE	0x00000001
+#define DMASCHED_STA_BUSY	0x00000002
+#define DMASCHED_STA_TOUT	0x00000010
+
+/* Transfers queued per channel, a power of two */
+#define DMASCHED_DEPTH		256
+
+/* What dmasched_complete() found */
+#define DMASCHED_IDLE		0	/* nothing was running, not our interrupt */
+#define DMASCHED_RUNNING	1	/* still busy, not our interrupt either */
+#define DMASCHED_PIECE		2	/* a transfer inside a record ended */
+#define DMASCHED_RECORD		3	/* the last transfer of a record ended, or failed */
+
+/* One transfer: a single descriptor, contiguous on the bus */
+typedef struct {
+	unsigned long long host;	/* bus address */
+	unsigned int per;			/* peripheral byte address */
+	unsigned int length;		/* bytes */
+	unsigned int control;		/* BAR and INC bits of the control word */
+	unsigned int tag;			/* of the record, reported when it ends */
+	unsigned long buffer;		/* the buffer it reads or writes, see dmasched_uses() */
+	int last;					/* non zero on the last transfer of a record */
+} dmasched_xfer_t;
+
+typedef struct dmasched_chan_s {
+	volatile unsigned int *regs;	/* channel base */
+	dmasched_xfer_t queue[ DMASCHED_DEPTH ];
+	unsigned int head;			/* free running, next slot to fill */
+	unsigned int tail;			/* free running, transfer on the engine or next to start */
+	int busy;					/* the transfer at tail is programmed */
+	unsigned int submitted;		/* records queued */
+	unsigned int completed;		/* records ended, including the failed ones */
+	unsigned int errors;		/* records failed, or dropped by an abort */
+	unsigned int last_tag;		/* of the last record ended */
+	unsigned int last_status;	/* status register when it ended, 0 if dropped */
+} dmasched_chan_t;
+
+void dmasched_init(dmasched_chan_t *chan, volatile unsigned int *regs);
+unsigned int dmasched_space(const dmasched_chan_t *chan);
+int dmasched_queue(dmasched_chan_t *chan, const dmasched_xfer_t *xfer);
+int dmasched_kick(dmasched_chan_t *chan);
+int dmasched_complete(dmasched_chan_t *chan);
+unsigned int dmasched_abort(dmasched_chan_t *chan);
+int dmasched_uses(const dmasched_chan_t *chan, unsigned long buffer);
+
+static inline int dmasched_busy(const dmasched_chan_t *chan)
+{
+	return chan->busy;
+}
+
+#endif
@@ -46,6 +46,17 @@
 #include <linux/cdev.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/moduleparam.h>
+#include <linux/cpumask.h>
+#include <linux/log2.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
 #include <stdbool.h>
 
 #include "config.h"
@@ -58,6 +69,12 @@
 
 #include "int.h"
 
+#ifdef ENABLE_DMA_SCHED
+#include "kmem.h"
+#include "umem.h"
+#include "dmasched.h"
+#endif
+
 /*
  * The ID between IRQ_SOURCE in irq_outstanding and the actual source is arbitrary.
  * Therefore, be careful when communicating with multiple implementations. 
@@ -78,11 +95,38 @@
 #define ABB_INT_CH0 	        (1 << 1) /* downstream */
 #define ABB_INT_CH1 	        (1)     /* upstream */
 
+#define ABB_CH0_BASE  	        (80 >> 2)
+#define ABB_CH1_BASE  	        (44 >> 2)
 #define ABB_CH0_CTRL  	        (108 >> 2)
 #define ABB_CH1_CTRL  	        (72 >> 2)
 #define ABB_CH_RESET 	        (0x0201000A)
 #define ABB_IG_CTRL 	        (0x0080 >> 2)
 #define ABB_IG_ACK 	        (0x00F0)
+#define ABB_DMA_TRANS0          (0x0094 >> 2)
+#define ABB_DMA_TRANS1          (0x0098 >> 2)
+
+/* With MSI-X or multiple MSI, the ABB signals source i on vector i */
+#define ABB_IRQ_VECTORS         3
+
+static int irq_mode = PCIDRIVER_IRQ_AUTO;
+module_param(irq_mode, int, S_IRUGO);
+MODULE_PARM_DESC(irq_mode, "Best interrupt mode to try: 0 auto, 1 INTx, 2 MSI, 3 MSI-X");
+
+static int irq_cpu[PCIDRIVER_INT_MAXSOURCES] = { [0 ... PCIDRIVER_INT_MAXSOURCES - 1] = -1 };
+module_param_array(irq_cpu, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(irq_cpu, "CPU for the vector of each interrupt source, -1 for none");
+
+IRQ_HANDLER_FUNC(pcidriver_irq_vector_handler);
+static bool pcidriver_irq_mode_allowed(int mode);
+static int pcidriver_irq_probe_vectors(pcidriver_privdata_t *privdata);
+static void pcidriver_irq_free_vectors(pcidriver_privdata_t *privdata);
+static unsigned int pcidriver_irq_take_sources(pcidriver_privdata_t *privdata, unsigned int mask,
+					       unsigned int max, unsigned int *count);
+#ifdef ENABLE_DMA_SCHED
+static void pcidriver_dma_sched_probe(pcidriver_privdata_t *privdata);
+static void pcidriver_dma_sched_remove(pcidriver_privdata_t *privdata);
+static bool pcidriver_dma_sched_irq(pcidriver_privdata_t *privdata, int source, volatile unsigned int *bar);
+#endif
 
 /**
  *
@@ -97,9 +141,48 @@ int pcidriver_probe_irq(pcidriver_privdata_t *privdata)
 	int i;
 	int err;
 
+	/* Nothing to release yet, if we fail half way */
+	privdata->irq_enabled = 0;
+	privdata->irq_mode = PCIDRIVER_IRQ_INTX;
+	privdata->irq_nvecs = 0;
+
 	for (i = 0; i < 6; i++)
 		privdata->bars_kmapped[i] = NULL;
 
+	/* Initialize the wait queues */
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++) {
+		init_waitqueue_head(&(privdata->irq_queues[i]));
+		atomic_set(&(privdata->irq_outstanding[i]), 0);
+	}
+	init_waitqueue_head(&(privdata->irq_poll_queue));
+
+	/* The event ring, pages reserved to be mmapped. Without it, the
+	 * interrupts are only counted. */
+	spin_lock_init(&(privdata->irq_enable_lock));
+	spin_lock_init(&(privdata->irq_ring_lock));
+	init_waitqueue_head(&(privdata->irq_ring_queue));
+	privdata->irq_ring = (pcidriver_irq_ring_t *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, get_order(sizeof(pcidriver_irq_ring_t)));
+	if (privdata->irq_ring != NULL) {
+		privdata->irq_ring->size = PCIDRIVER_IRQ_RING_EVENTS;
+		set_pages_reserved_compat((unsigned long)privdata->irq_ring, PAGE_ALIGN(sizeof(pcidriver_irq_ring_t)));
+	} else
+		mod_info("Failed to allocate the interrupt event ring, continuing without it\n");
+
+#ifdef PCIDRIVER_EVENTFD
+	spin_lock_init(&(privdata->irq_eventfd_lock));
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++) {
+		privdata->irq_eventfd[i] = NULL;
+		privdata->irq_eventfd_owner[i] = NULL;
+	}
+#endif
+
+#ifdef ENABLE_DMA_SCHED
+	spin_lock_init(&(privdata->dma_sched_lock));
+	privdata->dma_sched = NULL;
+	for (i = 0; i < PCIDRIVER_DMA_SCHED_CHANNELS; i++)
+		privdata->dma_sched_owner[i] = NULL;
+#endif
+
 	for (i = 0; i < 6; i++) {
 		bar_addr = pci_resource_start(privdata->pdev, i);
 		bar_len = pci_resource_len(privdata->pdev, i);
@@ -137,43 +220,149 @@ int pcidriver_probe_irq(pcidriver_privdata_t *privdata)
 		}
 	}
 
-	/* Initialize the interrupt handler for this device */
-	/* Initialize the wait queues */
-	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++) {
-		init_waitqueue_head(&(privdata->irq_queues[i]));
-		atomic_set(&(privdata->irq_outstanding[i]), 0);
-	}
+#ifdef ENABLE_DMA_SCHED
+	pcidriver_dma_sched_probe(privdata);
+#endif
 
-	/* Initialize the irq config */
-	if ((err = pci_read_config_byte(privdata->pdev, PCI_INTERRUPT_PIN, &int_pin)) != 0) {
-		/* continue without interrupts */
-		int_pin = 0;
-		mod_info("Error getting the interrupt pin. Disabling interrupts for this device\n");
-	}
+	/* Initialize the interrupt handler for this device */
+	/* A vector per source if the device has them: no status reads needed */
+	if (pcidriver_irq_probe_vectors(privdata) == 0)
+		return 0;
 
-	/* Disable interrupts and activate them if everything can be set up properly */
-	privdata->irq_enabled = 0;
+	/* Else one handler reads the status for all the sources, on a single
+	 * MSI if available, which at least is not shared with other devices */
+	int_pin = 0;
+	int_line = 0;
+	if (pcidriver_irq_mode_allowed(PCIDRIVER_IRQ_MSI) && (pci_enable_msi(privdata->pdev) == 0)) {
+		privdata->irq_mode = PCIDRIVER_IRQ_MSI;
+	} else {
+		/* Initialize the irq config */
+		if ((err = pci_read_config_byte(privdata->pdev, PCI_INTERRUPT_PIN, &int_pin)) != 0) {
+			/* continue without interrupts */
+			int_pin = 0;
+			mod_info("Error getting the interrupt pin. Disabling interrupts for this device\n");
+		}
 
-	if (int_pin == 0)
-		return 0;
+		if (int_pin == 0)
+			return 0;
 
-	if ((err = pci_read_config_byte(privdata->pdev, PCI_INTERRUPT_LINE, &int_line)) != 0) {
-		mod_info("Error getting the interrupt line. Disabling interrupts for this device\n");
-		return 0;
+		if ((err = pci_read_config_byte(privdata->pdev, PCI_INTERRUPT_LINE, &int_line)) != 0) {
+			mod_info("Error getting the interrupt line. Disabling interrupts for this device\n");
+			return 0;
+		}
 	}
 
 	/* register interrupt handler */
 	if ((err = request_irq(privdata->pdev->irq, pcidriver_irq_handler, MODNAME, privdata)) != 0) {
 		mod_info("Error registering the interrupt handler. Disabling interrupts for this device\n");
+		if (privdata->irq_mode == PCIDRIVER_IRQ_MSI)
+			pci_disable_msi(privdata->pdev);
+		privdata->irq_mode = PCIDRIVER_IRQ_INTX;
 		return 0;
 	}
 
 	privdata->irq_enabled = 1;
-	mod_info("Registered Interrupt Handler at pin %i, line %i, IRQ %i\n", int_pin, int_line, privdata->pdev->irq );
+	if (privdata->irq_mode == PCIDRIVER_IRQ_MSI)
+		mod_info("Registered Interrupt Handler at MSI IRQ %i\n", privdata->pdev->irq );
+	else
+		mod_info("Registered Interrupt Handler at pin %i, line %i, IRQ %i\n", int_pin, int_line, privdata->pdev->irq );
 
 	return 0;
 }
 
+/**
+ *
+ * True if the irq_mode parameter lets us try the given mode.
+ *
+ */
+static bool pcidriver_irq_mode_allowed(int mode)
+{
+	return (irq_mode == PCIDRIVER_IRQ_AUTO) || (irq_mode >= mode);
+}
+
+/**
+ *
+ * Sets up a vector per interrupt source, with MSI-X or else multiple MSI,
+ * and registers pcidriver_irq_vector_handler on each of them.
+ *
+ * @returns 0 if the vectors are in use, else the device is left as it was
+ *
+ */
+static int pcidriver_irq_probe_vectors(pcidriver_privdata_t *privdata)
+{
+	struct pci_dev *pdev = privdata->pdev;
+	struct msix_entry entries[ABB_IRQ_VECTORS];
+	int i, err;
+
+	/* Only the ABB is known to signal its sources on separate vectors */
+	if ((pdev->vendor != PCIEABB_VENDOR_ID) || (pdev->device != PCIEABB_DEVICE_ID))
+		return -ENODEV;
+
+	for (i = 0; i < ABB_IRQ_VECTORS; i++)
+		entries[i].entry = i;
+
+	if (pcidriver_irq_mode_allowed(PCIDRIVER_IRQ_MSIX) &&
+	    (pci_enable_msix_exact_compat(pdev, entries, ABB_IRQ_VECTORS) == 0)) {
+		privdata->irq_mode = PCIDRIVER_IRQ_MSIX;
+		for (i = 0; i < ABB_IRQ_VECTORS; i++)
+			privdata->irq_vectors[i].irq = entries[i].vector;
+	} else if (pcidriver_irq_mode_allowed(PCIDRIVER_IRQ_MSI) &&
+		   (pci_enable_msi_exact_compat(pdev, roundup_pow_of_two(ABB_IRQ_VECTORS)) == 0)) {
+		/* Multiple MSI come in powers of two, the last ones stay unused */
+		privdata->irq_mode = PCIDRIVER_IRQ_MSI;
+		for (i = 0; i < ABB_IRQ_VECTORS; i++)
+			privdata->irq_vectors[i].irq = pdev->irq + i;
+	} else
+		return -ENODEV;
+
+	for (i = 0; i < ABB_IRQ_VECTORS; i++) {
+		privdata->irq_vectors[i].privdata = privdata;
+		privdata->irq_vectors[i].source = i;
+		privdata->irq_vectors[i].cpu = -1;
+
+		if ((err = request_irq(privdata->irq_vectors[i].irq, pcidriver_irq_vector_handler, MODNAME, &(privdata->irq_vectors[i]))) != 0)
+			goto probe_vectors_irq_fail;
+		privdata->irq_nvecs = i + 1;
+
+		if (irq_cpu[i] >= 0)
+			pcidriver_irq_set_affinity(privdata, i, irq_cpu[i]);
+	}
+
+	privdata->irq_enabled = 1;
+	mod_info("Registered %d %s vectors, IRQ %u to %u\n", ABB_IRQ_VECTORS,
+		 (privdata->irq_mode == PCIDRIVER_IRQ_MSIX) ? "MSI-X" : "MSI",
+		 privdata->irq_vectors[0].irq, privdata->irq_vectors[ABB_IRQ_VECTORS - 1].irq);
+
+	return 0;
+
+probe_vectors_irq_fail:
+	mod_info("Error registering the handler of vector %d, falling back to a single interrupt\n", i);
+	pcidriver_irq_free_vectors(privdata);
+	return err;
+}
+
+/**
+ *
+ * Frees the vector handlers and disables MSI-X or MSI.
+ *
+ */
+static void pcidriver_irq_free_vectors(pcidriver_privdata_t *privdata)
+{
+	int i;
+
+	for (i = 0; i < privdata->irq_nvecs; i++) {
+		irq_set_affinity_hint_compat(privdata->irq_vectors[i].irq, NULL);
+		free_irq(privdata->irq_vectors[i].irq, &(privdata->irq_vectors[i]));
+	}
+	privdata->irq_nvecs = 0;
+
+	if (privdata->irq_mode == PCIDRIVER_IRQ_MSIX)
+		pci_disable_msix(privdata->pdev);
+	else if (privdata->irq_mode == PCIDRIVER_IRQ_MSI)
+		pci_disable_msi(privdata->pdev);
+	privdata->irq_mode = PCIDRIVER_IRQ_INTX;
+}
+
 /**
  *
  * Frees/cleans up the data structures, called from pcidriver_remove()
@@ -181,13 +370,61 @@ int pcidriver_probe_irq(pcidriver_privdata_t *privdata)
  */
 void pcidriver_remove_irq(pcidriver_privdata_t *privdata)
 {
-	/* Release the IRQ handler */
-	if (privdata->irq_enabled != 0)
+	/* Release the IRQ handlers */
+	if (privdata->irq_nvecs > 0)
+		pcidriver_irq_free_vectors(privdata);
+	else if (privdata->irq_enabled != 0) {
 		free_irq(privdata->pdev->irq, privdata);
+		if (privdata->irq_mode == PCIDRIVER_IRQ_MSI)
+			pci_disable_msi(privdata->pdev);
+	}
+	privdata->irq_enabled = 0;
+
+	/* No handler anymore, drop the eventfds still bound */
+	pcidriver_irq_unbind_eventfds(privdata, NULL);
+
+	if (privdata->irq_ring != NULL) {
+		free_pages((unsigned long)privdata->irq_ring, get_order(sizeof(pcidriver_irq_ring_t)));
+		privdata->irq_ring = NULL;
+	}
+
+#ifdef ENABLE_DMA_SCHED
+	pcidriver_dma_sched_remove(privdata);
+#endif
 
 	pcidriver_irq_unmap_bars(privdata);
 }
 
+/**
+ *
+ * Sets the affinity hint of the vector of a source to one CPU, or drops it
+ * with cpu -1. From 2.6.35 irqbalance follows the hint, from 4.4 on the IRQ
+ * also moves right away.
+ *
+ * @returns -ENODEV if the source has no vector of its own
+ *
+ */
+int pcidriver_irq_set_affinity(pcidriver_privdata_t *privdata, unsigned int source, int cpu)
+{
+	pcidriver_irq_vector_t *vector;
+	int err;
+
+	if (source >= PCIDRIVER_INT_MAXSOURCES)
+		return -EINVAL;
+	if ((int)source >= privdata->irq_nvecs)
+		return -ENODEV;
+	if ((cpu >= (int)nr_cpu_ids) || ((cpu >= 0) && !cpu_online(cpu)))
+		return -EINVAL;
+
+	vector = &(privdata->irq_vectors[source]);
+	err = irq_set_affinity_hint_compat(vector->irq, (cpu >= 0) ? cpumask_of(cpu) : NULL);
+	if (err != 0)
+		return err;
+
+	vector->cpu = cpu;
+	return 0;
+}
+
 /**
  *
  * Unmaps the BARs and releases them
@@ -206,6 +443,358 @@ void pcidriver_irq_unmap_bars(pcidriver_privdata_t *privdata)
 	}
 }
 
+/**
+ *
+ * Signal the eventfd bound to an interrupt source, if any.
+ *
+ * @returns true if an eventfd was bound to the source
+ *
+ */
+static bool pcidriver_irq_signal_eventfd(pcidriver_privdata_t *privdata, int source)
+{
+#ifdef PCIDRIVER_EVENTFD
+	unsigned long flags;
+	bool bound;
+
+	spin_lock_irqsave(&(privdata->irq_eventfd_lock), flags);
+	bound = (privdata->irq_eventfd[source] != NULL);
+	if (bound)
+		eventfd_signal(privdata->irq_eventfd[source], 1);
+	spin_unlock_irqrestore(&(privdata->irq_eventfd_lock), flags);
+
+	return bound;
+#else
+	return false;
+#endif
+}
+
+/**
+ *
+ * Bind an eventfd to an interrupt source. Its interrupts are then counted
+ * in the eventfd, and no longer in the outstanding queue of the source.
+ * The binding lasts until replaced, or the file it was made through is
+ * closed.
+ *
+ * @param fd The eventfd, or -1 to unbind the source.
+ *
+ */
+int pcidriver_irq_bind_eventfd(pcidriver_privdata_t *privdata, struct file *filp, unsigned int source, int fd)
+{
+#ifdef PCIDRIVER_EVENTFD
+	struct eventfd_ctx *ctx = NULL, *old;
+	unsigned long flags;
+
+	if (source >= PCIDRIVER_INT_MAXSOURCES)
+		return -EINVAL;
+
+	if (fd >= 0) {
+		ctx = eventfd_ctx_fdget(fd);
+		if (IS_ERR(ctx))
+			return PTR_ERR(ctx);
+	}
+
+	spin_lock_irqsave(&(privdata->irq_eventfd_lock), flags);
+	old = privdata->irq_eventfd[source];
+	privdata->irq_eventfd[source] = ctx;
+	privdata->irq_eventfd_owner[source] = (ctx != NULL) ? filp : NULL;
+	spin_unlock_irqrestore(&(privdata->irq_eventfd_lock), flags);
+
+	if (old != NULL)
+		eventfd_ctx_put(old);
+
+	return 0;
+#else
+	mod_info("Asked to bind an eventfd, but the kernel does not support it\n");
+	return -ENOSYS;
+#endif
+}
+
+/**
+ *
+ * Unbind the eventfds bound through filp, or all of them if filp is NULL.
+ *
+ */
+void pcidriver_irq_unbind_eventfds(pcidriver_privdata_t *privdata, struct file *filp)
+{
+#ifdef PCIDRIVER_EVENTFD
+	struct eventfd_ctx *old[PCIDRIVER_INT_MAXSOURCES];
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&(privdata->irq_eventfd_lock), flags);
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++) {
+		old[i] = NULL;
+		if ((filp != NULL) && (privdata->irq_eventfd_owner[i] != filp))
+			continue;
+		old[i] = privdata->irq_eventfd[i];
+		privdata->irq_eventfd[i] = NULL;
+		privdata->irq_eventfd_owner[i] = NULL;
+	}
+	spin_unlock_irqrestore(&(privdata->irq_eventfd_lock), flags);
+
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++)
+		if (old[i] != NULL)
+			eventfd_ctx_put(old[i]);
+#endif
+}
+
+/**
+ *
+ * Take the outstanding interrupts of the sources in pending->mask, in one
+ * call. On return the mask has the sources which had any, and count the
+ * number taken from each.
+ *
+ */
+int pcidriver_irq_take(pcidriver_privdata_t *privdata, irq_pending_t *pending)
+{
+	pending->mask = pcidriver_irq_take_sources(privdata, pending->mask, 0, pending->count);
+
+	return 0;
+}
+
+/**
+ *
+ * Takes up to max outstanding interrupts (0 for all) from the sources in
+ * mask, lowest source first.
+ *
+ * @param count Gets the number taken per source, PCIDRIVER_INT_MAXSOURCES entries
+ * @returns the mask of the sources taken from
+ *
+ */
+static unsigned int pcidriver_irq_take_sources(pcidriver_privdata_t *privdata, unsigned int mask,
+					       unsigned int max, unsigned int *count)
+{
+	unsigned int i, taken = 0, left = max;
+	int n, take;
+
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++) {
+		count[i] = 0;
+		if (((mask & (1U << i)) == 0) || ((max != 0) && (left == 0)))
+			continue;
+
+		if (max == 0) {
+			count[i] = atomic_xchg(&(privdata->irq_outstanding[i]), 0);
+		} else {
+			/* take part of them, others may take the rest meanwhile */
+			do {
+				n = atomic_read(&(privdata->irq_outstanding[i]));
+				take = ((unsigned int)n < left) ? n : left;
+			} while ((take > 0) && (atomic_cmpxchg(&(privdata->irq_outstanding[i]), n, n - take) != n));
+			count[i] = take;
+			left -= take;
+		}
+
+		if (count[i] > 0)
+			taken |= (1U << i);
+	}
+
+	return taken;
+}
+
+/**
+ *
+ * True if any source in mask has outstanding interrupts.
+ *
+ */
+static bool pcidriver_irq_pending(pcidriver_privdata_t *privdata, unsigned int mask)
+{
+	int i;
+
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++)
+		if ((mask & (1U << i)) && (atomic_read(&(privdata->irq_outstanding[i])) > 0))
+			return true;
+
+	return false;
+}
+
+/**
+ *
+ * Waits until any of the sources in wait->mask has interrupts, or until the
+ * deadline, and takes them as pcidriver_irq_take does, at most
+ * wait->max_events of them if not 0. The deadline is absolute, so a wait
+ * interrupted by a signal can be restarted as is.
+ *
+ * @returns -ETIMEDOUT if the deadline passed with nothing taken
+ *
+ */
+int pcidriver_irq_wait(pcidriver_privdata_t *privdata, irq_wait_t *wait)
+{
+	unsigned int mask = wait->mask & ((1U << PCIDRIVER_INT_MAXSOURCES) - 1);
+	long timeout, ret;
+	s64 left;
+
+	if (mask == 0)
+		return -EINVAL;
+
+	for (;;) {
+		wait->mask = pcidriver_irq_take_sources(privdata, mask, wait->max_events, wait->count);
+		if (wait->mask != 0)
+			return 0;
+
+		if (wait->deadline == 0) {
+			timeout = MAX_SCHEDULE_TIMEOUT;
+		} else {
+			left = (s64)(wait->deadline - ktime_get_ns_compat());
+			if (left <= 0)
+				return -ETIMEDOUT;
+
+			/* longer waits go around the loop; round up, as a jiffy
+			 * too late is better than too early */
+			if (left > NSEC_PER_SEC)
+				left = NSEC_PER_SEC;
+			timeout = usecs_to_jiffies((unsigned int)div_u64(left + NSEC_PER_USEC - 1, NSEC_PER_USEC));
+		}
+
+		/* Woken by pcidriver_irq_deliver() on every interrupt counted */
+		ret = wait_event_interruptible_timeout( (privdata->irq_poll_queue),
+				pcidriver_irq_pending(privdata, mask), timeout );
+		if (ret < 0)
+			return -ERESTARTSYS;
+	}
+}
+
+/**
+ *
+ * poll() on the device file: readable while any source has outstanding
+ * interrupts. Sources with an eventfd bound are polled through it.
+ *
+ */
+unsigned int pcidriver_poll(struct file *filp, poll_table *wait)
+{
+	pcidriver_privdata_t *privdata = filp->private_data;
+	int i;
+
+	poll_wait(filp, &(privdata->irq_poll_queue), wait);
+
+	for (i = 0; i < PCIDRIVER_INT_MAXSOURCES; i++)
+		if (atomic_read(&(privdata->irq_outstanding[i])) > 0)
+			return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+/**
+ *
+ * mmap() the interrupt event ring to user space, read-only.
+ *
+ */
+int pcidriver_mmap_irq_ring(pcidriver_privdata_t *privdata, struct vm_area_struct *vma)
+{
+	unsigned long vma_size;
+	int ret;
+
+	if (privdata->irq_ring == NULL) {
+		mod_info("Trying to mmap the interrupt event ring, but there is none\n");
+		return -ENODEV;
+	}
+
+	/* user space may only read it */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma_size = (vma->vm_end - vma->vm_start);
+	if ((vma->vm_pgoff != 0) || (vma_size > PAGE_ALIGN(sizeof(pcidriver_irq_ring_t)))) {
+		mod_info("Interrupt event ring size (%lu) and vma size do not match (%lu)\n",
+			 (unsigned long)sizeof(pcidriver_irq_ring_t), vma_size);
+		return -EINVAL;
+	}
+
+	vma->vm_flags |= (VM_RESERVED);
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	ret = remap_pfn_range_cpua_compat(
+					vma,
+					vma->vm_start,
+					(unsigned long)privdata->irq_ring,
+					vma_size,
+					vma->vm_page_prot);
+	if (ret) {
+		mod_info("remap_pfn_range failed\n");
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+/**
+ *
+ * Records an interrupt in the event ring. The handlers of several vectors
+ * can run at once, the lock keeps the events in the order of head.
+ *
+ * @param status The interrupt status register as read by the handler, or
+ * the status bits the vector stands for.
+ *
+ */
+static void pcidriver_irq_record(pcidriver_privdata_t *privdata, int source, unsigned int status)
+{
+	pcidriver_irq_ring_t *ring = privdata->irq_ring;
+	volatile unsigned int *bar = privdata->bars_kmapped[0];
+	pcidriver_irq_event_t *event;
+	unsigned int seq, dma_trans = 0;
+	unsigned long flags;
+
+	if (ring == NULL)
+		return;
+
+	/* read outside the lock, it goes over the bus */
+	if (source == ABB_IRQ_CH0)
+		dma_trans = bar[ABB_DMA_TRANS0];
+	else if (source == ABB_IRQ_CH1)
+		dma_trans = bar[ABB_DMA_TRANS1];
+
+	spin_lock_irqsave(&(privdata->irq_ring_lock), flags);
+	seq = ring->head;
+	event = &(ring->events[seq & (PCIDRIVER_IRQ_RING_EVENTS - 1)]);
+	event->seq = seq;
+	event->source = source;
+	event->status = status;
+	event->dma_trans = dma_trans;
+	event->timestamp = ktime_get_ns_compat();
+
+	/* the event must be complete before readers see the new head */
+	smp_wmb();
+	ring->head = seq + 1;
+	spin_unlock_irqrestore(&(privdata->irq_ring_lock), flags);
+
+	wake_up_interruptible(&(privdata->irq_ring_queue));
+}
+
+/**
+ *
+ * Hands an interrupt of a source to whoever waits for it.
+ *
+ */
+static void pcidriver_irq_deliver(pcidriver_privdata_t *privdata, int source, unsigned int status)
+{
+	pcidriver_irq_record(privdata, source, status);
+
+	/* An eventfd bound to the source gets the interrupt */
+	if (pcidriver_irq_signal_eventfd(privdata, source))
+		return;
+
+        /* Else wake up the waiting loop in ioctl.c:ioctl_wait_interrupt(), and poll() */
+	atomic_inc(&(privdata->irq_outstanding[source]));
+	wake_up_interruptible(&(privdata->irq_queues[source]));
+	wake_up_interruptible(&(privdata->irq_poll_queue));
+}
+
+/**
+ *
+ * Clears or sets bits of the interrupt enable register of the ABB. The
+ * handlers of several vectors, and the DMA scheduler, change it from
+ * several CPUs: each one only touches its own bits, under the lock.
+ *
+ */
+static void pcidriver_irq_enable(pcidriver_privdata_t *privdata, volatile unsigned int *bar,
+				 unsigned int clear, unsigned int set)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&(privdata->irq_enable_lock), flags);
+	bar[ABB_INT_ENABLE] = (bar[ABB_INT_ENABLE] & ~clear) | set;
+	spin_unlock_irqrestore(&(privdata->irq_enable_lock), flags);
+}
+
 /**
  *
  * Acknowledge the interrupt by ACKing the interrupt generator.
@@ -214,18 +803,21 @@ void pcidriver_irq_unmap_bars(pcidriver_privdata_t *privdata)
  *
  */
 static bool check_acknowlegde_channel(pcidriver_privdata_t *privdata, int interrupt,
-				      int channel, volatile unsigned int *bar)
+				      int channel, volatile unsigned int *bar, unsigned int status)
 {
-	if (!(bar[ABB_INT_STAT] & interrupt))
+	if (!(status & interrupt))
 		return false;
 
-	bar[ABB_INT_ENABLE] &= !interrupt;
+	pcidriver_irq_enable(privdata, bar, interrupt, 0);
 	if (interrupt == ABB_INT_IG)
 		bar[ABB_IG_CTRL] = ABB_IG_ACK;
 
-        /* Wake up the waiting loop in ioctl.c:ioctl_wait_interrupt() */
-	atomic_inc(&(privdata->irq_outstanding[channel]));
-	wake_up_interruptible(&(privdata->irq_queues[channel]));
+#ifdef ENABLE_DMA_SCHED
+	if (!pcidriver_dma_sched_irq(privdata, channel, bar))
+		return true;
+#endif
+
+	pcidriver_irq_deliver(privdata, channel, status);
 	return true;
 }
 
@@ -242,6 +834,7 @@ static bool check_acknowlegde_channel(pcidriver_privdata_t *privdata, int interr
 static bool pcidriver_irq_acknowledge(pcidriver_privdata_t *privdata)
 {
 	volatile unsigned int *bar;
+	unsigned int status;
 
 	/* TODO: add subvendor / subsystem ids */
 	/* FIXME: guillermo: which ones? all? */
@@ -257,19 +850,22 @@ static bool pcidriver_irq_acknowledge(pcidriver_privdata_t *privdata)
 
 	mod_info_dbg("interrupt registers. ISR: %x, IER: %x\n", bar[ABB_INT_STAT], bar[ABB_INT_ENABLE]);
 
-	if (check_acknowlegde_channel(privdata, ABB_INT_CH0, ABB_IRQ_CH0, bar))
+	/* One read of the status for all the checks, it is also the snapshot in the event ring */
+	status = bar[ABB_INT_STAT];
+
+	if (check_acknowlegde_channel(privdata, ABB_INT_CH0, ABB_IRQ_CH0, bar, status))
 		return true;
 
-	if (check_acknowlegde_channel(privdata, ABB_INT_CH1, ABB_IRQ_CH1, bar))
+	if (check_acknowlegde_channel(privdata, ABB_INT_CH1, ABB_IRQ_CH1, bar, status))
 		return true;
 
-	if (check_acknowlegde_channel(privdata, ABB_INT_IG, ABB_IRQ_IG, bar))
+	if (check_acknowlegde_channel(privdata, ABB_INT_IG, ABB_IRQ_IG, bar, status))
 		return true;
 
-        if (check_acknowlegde_channel(privdata, ABB_INT_CH0_TIMEOUT, ABB_IRQ_CH0, bar))
+        if (check_acknowlegde_channel(privdata, ABB_INT_CH0_TIMEOUT, ABB_IRQ_CH0, bar, status))
                 return true;
 
-        if (check_acknowlegde_channel(privdata, ABB_INT_CH1_TIMEOUT, ABB_IRQ_CH1, bar))
+        if (check_acknowlegde_channel(privdata, ABB_INT_CH1_TIMEOUT, ABB_IRQ_CH1, bar, status))
                 return true;
 
 	mod_info_dbg("err: interrupt registers. ISR: %x, IER: %x\n", bar[ ABB_INT_STAT ], bar[ ABB_INT_ENABLE ] );
@@ -295,3 +891,471 @@ IRQ_HANDLER_FUNC(pcidriver_irq_handler)
 	privdata->irq_count++;
 	return IRQ_HANDLED;
 }
+
+/**
+ *
+ * Handles the vector of a single source, with MSI-X or multiple MSI. The
+ * vector tells the source, so the status register is not read, and the
+ * vector is not shared with other devices.
+ *
+ */
+IRQ_HANDLER_FUNC(pcidriver_irq_vector_handler)
+{
+	static const unsigned int vector_status[ABB_IRQ_VECTORS] = {
+		ABB_INT_CH0 | ABB_INT_CH0_TIMEOUT, ABB_INT_CH1 | ABB_INT_CH1_TIMEOUT, ABB_INT_IG };
+	pcidriver_irq_vector_t *vector = (pcidriver_irq_vector_t *)dev_id;
+	pcidriver_privdata_t *privdata = vector->privdata;
+	volatile unsigned int *bar = privdata->bars_kmapped[0];
+
+	/* Only the bits of this source: the other vectors may have
+	 * transfers running, with their waiters on other CPUs */
+	pcidriver_irq_enable(privdata, bar, vector_status[vector->source], 0);
+	if (vector->source == ABB_IRQ_IG)
+		bar[ABB_IG_CTRL] = ABB_IG_ACK;
+
+#ifdef ENABLE_DMA_SCHED
+	if (!pcidriver_dma_sched_irq(privdata, vector->source, bar)) {
+		privdata->irq_count++;
+		return IRQ_HANDLED;
+	}
+#endif
+
+	pcidriver_irq_deliver(privdata, vector->source, vector_status[vector->source]);
+
+	privdata->irq_count++;
+	return IRQ_HANDLED;
+}
+
+#ifdef ENABLE_DMA_SCHED
+/* Interrupt enable bit of each scheduled channel */
+static const unsigned int dma_sched_inte[PCIDRIVER_DMA_SCHED_CHANNELS] = { ABB_INT_CH0, ABB_INT_CH1 };
+
+/* The buffer of a transfer, kernel and user buffers have ids of their own */
+#define DMA_SCHED_BUFFER(type, id)	((((unsigned long)(id)) << 1) | ((type) == PCIDRIVER_DMA_SCHED_UMEM))
+
+static int pcidriver_dma_sched_kmem(pcidriver_privdata_t *privdata, struct file *filp,
+				    unsigned int ch, dma_sched_xfer_t *xfer);
+static int pcidriver_dma_sched_umem(pcidriver_privdata_t *privdata, struct file *filp,
+				    unsigned int ch, dma_sched_xfer_t *xfer);
+static unsigned int pcidriver_dma_sched_walk(pcidriver_umem_entry_t *umem_entry, dma_sched_xfer_t *xfer,
+					     dmasched_chan_t *chan);
+static int pcidriver_dma_sched_claim(pcidriver_privdata_t *privdata, struct file *filp, unsigned int ch);
+static void pcidriver_dma_sched_start(pcidriver_privdata_t *privdata, unsigned int ch);
+
+/**
+ *
+ * Sets up a queue per channel of the WG engine, which only the ABB has.
+ *
+ */
+static void pcidriver_dma_sched_probe(pcidriver_privdata_t *privdata)
+{
+	static const unsigned int base[PCIDRIVER_DMA_SCHED_CHANNELS] = { ABB_CH0_BASE, ABB_CH1_BASE };
+	volatile unsigned int *bar = privdata->bars_kmapped[0];
+	int ch;
+
+	if ((privdata->pdev->vendor != PCIEABB_VENDOR_ID) ||
+	    (privdata->pdev->device != PCIEABB_DEVICE_ID) || (bar == NULL))
+		return;
+
+	privdata->dma_sched = kcalloc(PCIDRIVER_DMA_SCHED_CHANNELS, sizeof(dmasched_chan_t), GFP_KERNEL);
+	if (privdata->dma_sched == NULL) {
+		mod_info("Failed to allocate the DMA scheduler, continuing without it\n");
+		return;
+	}
+
+	for (ch = 0; ch < PCIDRIVER_DMA_SCHED_CHANNELS; ch++)
+		dmasched_init(&(privdata->dma_sched[ch]), bar + base[ch]);
+}
+
+/**
+ *
+ * Stops the channels and frees the queues. The handlers are gone already.
+ *
+ */
+static void pcidriver_dma_sched_remove(pcidriver_privdata_t *privdata)
+{
+	int ch;
+
+	if (privdata->dma_sched == NULL)
+		return;
+
+	for (ch = 0; ch < PCIDRIVER_DMA_SCHED_CHANNELS; ch++)
+		dmasched_abort(&(privdata->dma_sched[ch]));
+
+	kfree(privdata->dma_sched);
+	privdata->dma_sched = NULL;
+}
+
+/**
+ *
+ * Runs the scheduler on an interrupt, after the handler cleared the
+ * enable bits of the source: the channel of the source starts its next
+ * transfer, and gets its enable bit back if it is running again.
+ *
+ * @returns false if the interrupt ends a transfer inside a record, or was
+ * not raised by the end of one, and must not reach user space
+ *
+ */
+static bool pcidriver_dma_sched_irq(pcidriver_privdata_t *privdata, int source, volatile unsigned int *bar)
+{
+	int ret;
+
+	if ((privdata->dma_sched == NULL) || (source >= PCIDRIVER_DMA_SCHED_CHANNELS))
+		return true;
+
+	spin_lock(&(privdata->dma_sched_lock));
+	ret = dmasched_complete(&(privdata->dma_sched[source]));
+	if (dmasched_busy(&(privdata->dma_sched[source])))
+		pcidriver_irq_enable(privdata, bar, 0, dma_sched_inte[source]);
+	spin_unlock(&(privdata->dma_sched_lock));
+
+	return (ret == DMASCHED_IDLE) || (ret == DMASCHED_RECORD);
+}
+
+/**
+ *
+ * Queues a record, a transfer per contiguous piece of the buffer, and
+ * starts the channel if it is idle. A record to the device is synced for
+ * it here; one from the device is synced by the caller once it ended.
+ *
+ * @returns -ENOSPC if the queue has no room for the record now
+ * @returns -EBUSY if records queued through another file are pending
+ *
+ */
+int pcidriver_dma_sched_submit(pcidriver_privdata_t *privdata, struct file *filp, dma_sched_xfer_t *xfer)
+{
+	unsigned int ch;
+
+	if (privdata->dma_sched == NULL)
+		return -ENODEV;
+
+	switch (xfer->dir) {
+		case PCIDRIVER_DMA_TODEVICE:
+			ch = 0;
+			break;
+		case PCIDRIVER_DMA_FROMDEVICE:
+			ch = 1;
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	/* The engine moves dwords */
+	if ((xfer->length == 0) || ((xfer->offset | xfer->length | xfer->addr) & 3))
+		return -EINVAL;
+
+	switch (xfer->type) {
+		case PCIDRIVER_DMA_SCHED_KMEM:
+			return pcidriver_dma_sched_kmem(privdata, filp, ch, xfer);
+		case PCIDRIVER_DMA_SCHED_UMEM:
+			return pcidriver_dma_sched_umem(privdata, filp, ch, xfer);
+		default:
+			return -EINVAL;
+	}
+}
+
+/**
+ *
+ * A kernel buffer is contiguous, the record is a single transfer.
+ *
+ */
+static int pcidriver_dma_sched_kmem(pcidriver_privdata_t *privdata, struct file *filp,
+				    unsigned int ch, dma_sched_xfer_t *xfer)
+{
+	pcidriver_kmem_entry_t *kmem_entry;
+	kmem_sync_range_t kmem_sync;
+	dmasched_xfer_t piece;
+	unsigned long flags;
+	int err;
+
+	idr_read_lock_compat( &(privdata->kmemlist_lock) );
+	kmem_entry = idr_find( &(privdata->kmem_idr), xfer->handle_id );
+	if ((kmem_entry == NULL) || (xfer->offset >= kmem_entry->size) ||
+	    (xfer->length > kmem_entry->size - xfer->offset) || (xfer->length > 0xFFFFFFFFUL)) {
+		idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+		return -EINVAL;
+	}
+	kmem_sync.handle.pa = kmem_entry->dma_handle;
+	kmem_sync.handle.size = kmem_entry->size;
+	idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+
+	if (xfer->dir == PCIDRIVER_DMA_TODEVICE) {
+		kmem_sync.handle.handle_id = xfer->handle_id;
+		kmem_sync.dir = PCIDRIVER_DMA_TODEVICE;
+		kmem_sync.offset = xfer->offset;
+		kmem_sync.length = xfer->length;
+		if ((err = pcidriver_kmem_sync_range(privdata, &kmem_sync)) != 0)
+			return err;
+	}
+
+	/* Looked up again, the buffer may have been freed meanwhile */
+	idr_read_lock_compat( &(privdata->kmemlist_lock) );
+	kmem_entry = idr_find( &(privdata->kmem_idr), xfer->handle_id );
+	if ((kmem_entry == NULL) || (kmem_entry->dma_handle != kmem_sync.handle.pa) ||
+	    (kmem_entry->size != kmem_sync.handle.size)) {
+		idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+		return -EINVAL;
+	}
+
+	piece.host = kmem_entry->dma_handle + xfer->offset;
+	piece.per = xfer->addr;
+	piece.length = xfer->length;
+	piece.control = DMASCHED_CTRL_BAR(xfer->bar);
+	if (xfer->flags & PCIDRIVER_DMA_SCHED_INC)
+		piece.control |= DMASCHED_CTRL_INC;
+	piece.tag = xfer->tag;
+	piece.buffer = DMA_SCHED_BUFFER(PCIDRIVER_DMA_SCHED_KMEM, kmem_entry->id);
+	piece.last = 1;
+
+	/* Queued before the lookup ends: a free of the buffer waits for it,
+	 * then aborts the channel, see pcidriver_dma_sched_forget() */
+	spin_lock_irqsave(&(privdata->dma_sched_lock), flags);
+	if ((err = pcidriver_dma_sched_claim(privdata, filp, ch)) == 0) {
+		err = dmasched_queue(&(privdata->dma_sched[ch]), &piece);
+		if (err == 0)
+			pcidriver_dma_sched_start(privdata, ch);
+	}
+	spin_unlock_irqrestore(&(privdata->dma_sched_lock), flags);
+
+	idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+
+	return err;
+}
+
+/**
+ *
+ * A user buffer takes a transfer per entry of its mapped SG list in the
+ * range. An unmap of the entry aborts the channel before the pages go,
+ * see pcidriver_dma_sched_forget().
+ *
+ */
+static int pcidriver_dma_sched_umem(pcidriver_privdata_t *privdata, struct file *filp,
+				    unsigned int ch, dma_sched_xfer_t *xfer)
+{
+	pcidriver_umem_entry_t *umem_entry;
+	umem_sync_range_t umem_sync;
+	dmasched_chan_t *chan = &(privdata->dma_sched[ch]);
+	unsigned long flags;
+	int err;
+
+	if (xfer->dir == PCIDRIVER_DMA_TODEVICE) {
+		umem_sync.handle_id = xfer->handle_id;
+		umem_sync.dir = PCIDRIVER_DMA_TODEVICE;
+		umem_sync.offset = xfer->offset;
+		umem_sync.length = xfer->length;
+		if ((err = pcidriver_umem_sync_range(privdata, &umem_sync)) != 0)
+			return err;
+	}
+
+	idr_read_lock_compat( &(privdata->umemlist_lock) );
+	umem_entry = idr_find( &(privdata->umem_idr), xfer->handle_id );
+	if ((umem_entry == NULL) || (xfer->offset >= umem_entry->size) ||
+	    (xfer->length > umem_entry->size - xfer->offset)) {
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
+		return -EINVAL;
+	}
+
+	/* Queued whole or not at all */
+	spin_lock_irqsave(&(privdata->dma_sched_lock), flags);
+	if ((err = pcidriver_dma_sched_claim(privdata, filp, ch)) == 0) {
+		if (pcidriver_dma_sched_walk(umem_entry, xfer, NULL) > dmasched_space(chan))
+			err = -ENOSPC;
+		else {
+			pcidriver_dma_sched_walk(umem_entry, xfer, chan);
+			pcidriver_dma_sched_start(privdata, ch);
+		}
+	}
+	spin_unlock_irqrestore(&(privdata->dma_sched_lock), flags);
+
+	idr_read_unlock_compat( &(privdata->umemlist_lock) );
+
+	return err;
+}
+
+/**
+ *
+ * Goes over the mapped SG entries in the range of the record. Counts the
+ * transfers it takes, and queues them if chan is not NULL.
+ *
+ */
+static unsigned int pcidriver_dma_sched_walk(pcidriver_umem_entry_t *umem_entry, dma_sched_xfer_t *xfer,
+					     dmasched_chan_t *chan)
+{
+	dmasched_xfer_t piece;
+	unsigned long skip = xfer->offset;
+	unsigned long left = xfer->length;
+	unsigned long len;
+	unsigned int count = 0;
+	unsigned int i;
+
+	piece.per = xfer->addr;
+	piece.control = DMASCHED_CTRL_BAR(xfer->bar);
+	if (xfer->flags & PCIDRIVER_DMA_SCHED_INC)
+		piece.control |= DMASCHED_CTRL_INC;
+	piece.tag = xfer->tag;
+	piece.buffer = DMA_SCHED_BUFFER(PCIDRIVER_DMA_SCHED_UMEM, umem_entry->id);
+
+	for (i = 0; (i < umem_entry->nents) && (left > 0); i++) {
+		len = sg_dma_len( &(umem_entry->sg[i]) );
+		if (skip >= len) {
+			skip -= len;
+			continue;
+		}
+
+		len -= skip;
+		if (len > left)
+			len = left;
+
+		if (chan != NULL) {
+			piece.host = sg_dma_address( &(umem_entry->sg[i]) ) + skip;
+			piece.length = len;
+			piece.last = (len == left);
+			dmasched_queue(chan, &piece);
+			if (xfer->flags & PCIDRIVER_DMA_SCHED_INC)
+				piece.per += len;
+		}
+
+		count++;
+		skip = 0;
+		left -= len;
+	}
+
+	return count;
+}
+
+/**
+ *
+ * The records of a channel come through one file at a time. Called with
+ * the scheduler lock held.
+ *
+ */
+static int pcidriver_dma_sched_claim(pcidriver_privdata_t *privdata, struct file *filp, unsigned int ch)
+{
+	dmasched_chan_t *chan = &(privdata->dma_sched[ch]);
+
+	if ((privdata->dma_sched_owner[ch] != NULL) && (privdata->dma_sched_owner[ch] != filp) &&
+	    (dmasched_space(chan) < DMASCHED_DEPTH))
+		return -EBUSY;
+
+	privdata->dma_sched_owner[ch] = filp;
+	return 0;
+}
+
+/**
+ *
+ * Starts an idle channel on what was queued, with its interrupt enabled
+ * first. Called with the scheduler lock held.
+ *
+ */
+static void pcidriver_dma_sched_start(pcidriver_privdata_t *privdata, unsigned int ch)
+{
+	volatile unsigned int *bar = privdata->bars_kmapped[0];
+
+	if (dmasched_busy(&(privdata->dma_sched[ch])))
+		return;
+
+	pcidriver_irq_enable(privdata, bar, 0, dma_sched_inte[ch]);
+	dmasched_kick(&(privdata->dma_sched[ch]));
+}
+
+/**
+ *
+ * Reads the counters of a channel.
+ *
+ */
+int pcidriver_dma_sched_status(pcidriver_privdata_t *privdata, dma_sched_status_t *status)
+{
+	dmasched_chan_t *chan;
+	unsigned long flags;
+
+	if (privdata->dma_sched == NULL)
+		return -ENODEV;
+	if (status->channel >= PCIDRIVER_DMA_SCHED_CHANNELS)
+		return -EINVAL;
+
+	chan = &(privdata->dma_sched[status->channel]);
+
+	spin_lock_irqsave(&(privdata->dma_sched_lock), flags);
+	status->submitted = chan->submitted;
+	status->completed = chan->completed;
+	status->errors = chan->errors;
+	status->last_tag = chan->last_tag;
+	status->last_status = chan->last_status;
+	spin_unlock_irqrestore(&(privdata->dma_sched_lock), flags);
+
+	return 0;
+}
+
+/**
+ *
+ * Stops a channel and drops its queue.
+ *
+ * @returns the records dropped, or -EBUSY if they came through another file
+ *
+ */
+int pcidriver_dma_sched_abort(pcidriver_privdata_t *privdata, struct file *filp, unsigned int ch)
+{
+	unsigned long flags;
+	int ret;
+
+	if (privdata->dma_sched == NULL)
+		return -ENODEV;
+	if (ch >= PCIDRIVER_DMA_SCHED_CHANNELS)
+		return -EINVAL;
+
+	spin_lock_irqsave(&(privdata->dma_sched_lock), flags);
+	if ((ret = pcidriver_dma_sched_claim(privdata, filp, ch)) == 0) {
+		ret = dmasched_abort(&(privdata->dma_sched[ch]));
+		privdata->dma_sched_owner[ch] = NULL;
+	}
+	spin_unlock_irqrestore(&(privdata->dma_sched_lock), flags);
+
+	return ret;
+}
+
+/**
+ *
+ * Aborts the channels used through a file being closed: its buffers are
+ * about to go away.
+ *
+ */
+void pcidriver_dma_sched_release(pcidriver_privdata_t *privdata, struct file *filp)
+{
+	unsigned int ch;
+
+	if (privdata->dma_sched == NULL)
+		return;
+
+	for (ch = 0; ch < PCIDRIVER_DMA_SCHED_CHANNELS; ch++)
+		if (privdata->dma_sched_owner[ch] == filp)
+			pcidriver_dma_sched_abort(privdata, filp, ch);
+}
+
+/**
+ *
+ * Aborts the channels with transfers of a buffer about to be freed or
+ * unmapped, whoever queued them. Called once the buffer is out of the id
+ * lookup and no submit can still find it.
+ *
+ */
+void pcidriver_dma_sched_forget(pcidriver_privdata_t *privdata, int type, int id)
+{
+	unsigned long buffer = DMA_SCHED_BUFFER(type, id);
+	unsigned long flags;
+	unsigned int ch, dropped;
+
+	if (privdata->dma_sched == NULL)
+		return;
+
+	spin_lock_irqsave(&(privdata->dma_sched_lock), flags);
+	for (ch = 0; ch < PCIDRIVER_DMA_SCHED_CHANNELS; ch++) {
+		if (!dmasched_uses(&(privdata->dma_sched[ch]), buffer))
+			continue;
+
+		dropped = dmasched_abort(&(privdata->dma_sched[ch]));
+		privdata->dma_sched_owner[ch] = NULL;
+		mod_info("DMA channel %u aborted, %u records dropped: buffer freed while queued\n", ch, dropped);
+	}
+	spin_unlock_irqrestore(&(privdata->dma_sched_lock), flags);
+}
+#endif
@@ -5,5 +5,19 @@ int pcidriver_probe_irq(pcidriver_privdata_t *privdata);
 void pcidriver_remove_irq(pcidriver_privdata_t *privdata);
 void pcidriver_irq_unmap_bars(pcidriver_privdata_t *privdata);
 IRQ_HANDLER_FUNC(pcidriver_irq_handler);
+int pcidriver_mmap_irq_ring(pcidriver_privdata_t *privdata, struct vm_area_struct *vma);
+int pcidriver_irq_set_affinity(pcidriver_privdata_t *privdata, unsigned int source, int cpu);
+int pcidriver_irq_bind_eventfd(pcidriver_privdata_t *privdata, struct file *filp, unsigned int source, int fd);
+void pcidriver_irq_unbind_eventfds(pcidriver_privdata_t *privdata, struct file *filp);
+int pcidriver_irq_take(pcidriver_privdata_t *privdata, irq_pending_t *pending);
+int pcidriver_irq_wait(pcidriver_privdata_t *privdata, irq_wait_t *wait);
+unsigned int pcidriver_poll(struct file *filp, poll_table *wait);
+#ifdef ENABLE_DMA_SCHED
+int pcidriver_dma_sched_submit(pcidriver_privdata_t *privdata, struct file *filp, dma_sched_xfer_t *xfer);
+int pcidriver_dma_sched_status(pcidriver_privdata_t *privdata, dma_sched_status_t *status);
+int pcidriver_dma_sched_abort(pcidriver_privdata_t *privdata, struct file *filp, unsigned int ch);
+void pcidriver_dma_sched_release(pcidriver_privdata_t *privdata, struct file *filp);
+void pcidriver_dma_sched_forget(pcidriver_privdata_t *privdata, int type, int id);
+#endif
 
 #endif
@@ -26,6 +26,7 @@
 #include <linux/vmalloc.h>
 #include <linux/stat.h>
 #include <linux/interrupt.h>
+#include <linux/poll.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
 
@@ -35,6 +36,7 @@
 #include "common.h" 			/* Internal definitions for all parts */
 #include "kmem.h" 			/* Internal definitions for kernel memory */
 #include "umem.h" 			/* Internal definitions for user space memory */
+#include "int.h" 			/* Internal definitions for the IRQ handling */
 #include "ioctl.h"			/* Internal definitions for the ioctl part */
 
 /** Declares a variable of the given type with the given name and copies it from userspace */
@@ -48,16 +50,22 @@
 	if ((ret = copy_to_user((type*)arg, &name, sizeof(name))) != 0) \
 		return -EFAULT;
 
+static int umem_sgget_to_user(pcidriver_privdata_t *privdata, umem_sglist_t *usglist);
+static int umem_sgmap_to_user(pcidriver_privdata_t *privdata, umem_map_t *umap);
+static int ioctl_batch_cmd(pcidriver_privdata_t *privdata, batch_cmd_t *cmd);
+
 /**
  *
  * Sets the mmap mode for following mmap() calls.
  *
- * @param arg Not a pointer, but either PCIDRIVER_MMAP_PCI or PCIDRIVER_MMAP_KMEM
+ * @param arg Not a pointer, but PCIDRIVER_MMAP_PCI, PCIDRIVER_MMAP_PCI_WC, PCIDRIVER_MMAP_KMEM
+ * or PCIDRIVER_MMAP_IRQ_RING
  *
  */
 static int ioctl_mmap_mode(pcidriver_privdata_t *privdata, unsigned long arg)
 {
-	if ((arg != PCIDRIVER_MMAP_PCI) && (arg != PCIDRIVER_MMAP_KMEM))
+	if ((arg != PCIDRIVER_MMAP_PCI) && (arg != PCIDRIVER_MMAP_PCI_WC) && (arg != PCIDRIVER_MMAP_KMEM) &&
+	    (arg != PCIDRIVER_MMAP_IRQ_RING))
 		return -EINVAL;
 
 	/* change the mode */
@@ -83,6 +91,44 @@ static int ioctl_mmap_area(pcidriver_privdata_t *privdata, unsigned long arg)
 	return 0;
 }
 
+/**
+ *
+ * Reads a byte/word/dword of the device's PCI config.
+ *
+ */
+int pcidriver_pci_read(pcidriver_privdata_t *privdata, pci_cfg_cmd *pci_cmd)
+{
+	switch (pci_cmd->size) {
+		case PCIDRIVER_PCI_CFG_SZ_BYTE:
+			return pci_read_config_byte( privdata->pdev, pci_cmd->addr, &(pci_cmd->val.byte) );
+		case PCIDRIVER_PCI_CFG_SZ_WORD:
+			return pci_read_config_word( privdata->pdev, pci_cmd->addr, &(pci_cmd->val.word) );
+		case PCIDRIVER_PCI_CFG_SZ_DWORD:
+			return pci_read_config_dword( privdata->pdev, pci_cmd->addr, &(pci_cmd->val.dword) );
+		default:
+			return -EINVAL;		/* Wrong size setting */
+	}
+}
+
+/**
+ *
+ * Writes a byte/word/dword of the device's PCI config.
+ *
+ */
+int pcidriver_pci_write(pcidriver_privdata_t *privdata, pci_cfg_cmd *pci_cmd)
+{
+	switch (pci_cmd->size) {
+		case PCIDRIVER_PCI_CFG_SZ_BYTE:
+			return pci_write_config_byte( privdata->pdev, pci_cmd->addr, pci_cmd->val.byte );
+		case PCIDRIVER_PCI_CFG_SZ_WORD:
+			return pci_write_config_word( privdata->pdev, pci_cmd->addr, pci_cmd->val.word );
+		case PCIDRIVER_PCI_CFG_SZ_DWORD:
+			return pci_write_config_dword( privdata->pdev, pci_cmd->addr, pci_cmd->val.dword );
+		default:
+			return -EINVAL;		/* Wrong size setting */
+	}
+}
+
 /**
  *
  * Reads/writes a byte/word/dword of the device's PCI config.
@@ -96,36 +142,13 @@ static int ioctl_pci_config_read_write(pcidriver_privdata_t *privdata, unsigned
 	int ret;
 	READ_FROM_USER(pci_cfg_cmd, pci_cmd);
 
-	if (cmd == PCIDRIVER_IOC_PCI_CFG_RD) {
-		switch (pci_cmd.size) {
-			case PCIDRIVER_PCI_CFG_SZ_BYTE:
-				ret = pci_read_config_byte( privdata->pdev, pci_cmd.addr, &(pci_cmd.val.byte) );
-				break;
-			case PCIDRIVER_PCI_CFG_SZ_WORD:
-				ret = pci_read_config_word( privdata->pdev, pci_cmd.addr, &(pci_cmd.val.word) );
-				break;
-			case PCIDRIVER_PCI_CFG_SZ_DWORD:
-				ret = pci_read_config_dword( privdata->pdev, pci_cmd.addr, &(pci_cmd.val.dword) );
-				break;
-			default:
-				return -EINVAL;		/* Wrong size setting */
-		}
-	} else {
-		switch (pci_cmd.size) {
-			case PCIDRIVER_PCI_CFG_SZ_BYTE:
-				ret = pci_write_config_byte( privdata->pdev, pci_cmd.addr, pci_cmd.val.byte );
-				break;
-			case PCIDRIVER_PCI_CFG_SZ_WORD:
-				ret = pci_write_config_word( privdata->pdev, pci_cmd.addr, pci_cmd.val.word );
-				break;
-			case PCIDRIVER_PCI_CFG_SZ_DWORD:
-				ret = pci_write_config_dword( privdata->pdev, pci_cmd.addr, pci_cmd.val.dword );
-				break;
-			default:
-				return -EINVAL;		/* Wrong size setting */
-				break;
-		}
-	}
+	if (cmd == PCIDRIVER_IOC_PCI_CFG_RD)
+		ret = pcidriver_pci_read(privdata, &pci_cmd);
+	else
+		ret = pcidriver_pci_write(privdata, &pci_cmd);
+
+	if (ret == -EINVAL)
+		return ret;
 
 	WRITE_TO_USER(pci_cfg_cmd, pci_cmd);
 
@@ -220,6 +243,21 @@ static int ioctl_kmem_sync(pcidriver_privdata_t *privdata, unsigned long arg)
 	return pcidriver_kmem_sync(privdata, &ksync);
 }
 
+/**
+ *
+ * Syncs a range of kernel memory.
+ *
+ * @see pcidriver_kmem_sync_range
+ *
+ */
+static int ioctl_kmem_sync_range(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+	int ret;
+	READ_FROM_USER(kmem_sync_range_t, ksync);
+
+	return pcidriver_kmem_sync_range(privdata, &ksync);
+}
+
 /*
  *
  * Maps the given scatter/gather list from memory to PCI bus addresses.
@@ -250,15 +288,10 @@ static int ioctl_umem_sgmap(pcidriver_privdata_t *privdata, unsigned long arg)
 static int ioctl_umem_sgunmap(pcidriver_privdata_t *privdata, unsigned long arg)
 {
 	int ret;
-	pcidriver_umem_entry_t *umem_entry;
 	READ_FROM_USER(umem_handle_t, uhandle);
 
-	/* Find the associated umem_entry for this buffer,
-	 * return -EINVAL if the specified handle id is invalid */
-	if ((umem_entry = pcidriver_umem_find_entry_id(privdata, uhandle.handle_id)) == NULL)
-		return -EINVAL;
-
-	if ((ret = pcidriver_umem_sgunmap(privdata, umem_entry)) != 0)
+	/* -EINVAL if the specified handle id is invalid */
+	if ((ret = pcidriver_umem_sgunmap(privdata, uhandle.handle_id)) != 0)
 		return ret;
 
 	return 0;
@@ -276,32 +309,106 @@ static int ioctl_umem_sgget(pcidriver_privdata_t *privdata, unsigned long arg)
 	int ret;
 	READ_FROM_USER(umem_sglist_t, usglist);
 
-	/* The umem_sglist_t has a pointer to the scatter/gather list itself which
-	 * needs to be copied separately. The number of elements is stored in ->nents.
-	 * As the list can get very big, we need to use vmalloc. */
-	if ((usglist.sg = vmalloc(usglist.nents * sizeof(umem_sgentry_t))) == NULL)
-		return -ENOMEM;
+	if ((ret = umem_sgget_to_user(privdata, &usglist)) != 0)
+		return ret;
+
+	WRITE_TO_USER(umem_sglist_t, usglist);
+
+	return 0;
+}
 
-	/* copy array to kernel structure */
-	ret = copy_from_user(usglist.sg, ((umem_sglist_t *)arg)->sg, (usglist.nents)*sizeof(umem_sgentry_t));
-	if (ret) return -EFAULT;
+/**
+ *
+ * Maps a user buffer and copies its scatter/gather list to userspace in
+ * the same call. If the list does not fit, the mapping is kept and nents
+ * tells the entries needed, so the caller gets it with SGGET.
+ *
+ */
+static int ioctl_umem_sgmap_get(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+	int ret;
+	READ_FROM_USER(umem_map_t, umap);
 
-	if ((ret = pcidriver_umem_sgget(privdata, &usglist)) != 0)
+	ret = umem_sgmap_to_user(privdata, &umap);
+	if ((ret != 0) && (ret != -ENOSPC))
 		return ret;
 
-	/* write data to user space */
-	ret = copy_to_user(((umem_sglist_t *)arg)->sg, usglist.sg, (usglist.nents)*sizeof(umem_sgentry_t));
-	if (ret) return -EFAULT;
+	/* the caller needs the handle and the entries needed on -ENOSPC too */
+	if (copy_to_user((umem_map_t *)arg, &umap, sizeof(umap)) != 0) {
+		pcidriver_umem_sgunmap(privdata, umap.handle.handle_id);
+		return -EFAULT;
+	}
 
-	/* free array memory */
-	vfree(usglist.sg);
+	return ret;
+}
 
-	/* restore sg pointer to vma address in user space before copying */
-	usglist.sg = ((umem_sglist_t *)arg)->sg;
+/**
+ *
+ * Maps a user buffer and gets its scatter/gather list into the array of
+ * the umem_sglist_t. Undoes the mapping on failure, except -ENOSPC.
+ *
+ */
+static int umem_sgmap_to_user(pcidriver_privdata_t *privdata, umem_map_t *umap)
+{
+	int ret;
 
-	WRITE_TO_USER(umem_sglist_t, usglist);
+	if ((ret = pcidriver_umem_sgmap(privdata, &(umap->handle))) != 0)
+		return ret;
 
-	return 0;
+	umap->sglist.handle_id = umap->handle.handle_id;
+	ret = umem_sgget_to_user(privdata, &(umap->sglist));
+
+	/* do not leave a mapping the caller has no use for */
+	if ((ret != 0) && (ret != -ENOSPC))
+		pcidriver_umem_sgunmap(privdata, umap->handle.handle_id);
+
+	return ret;
+}
+
+/**
+ *
+ * Gets the scatter/gather list of a mapping into the array of a
+ * umem_sglist_t, with sg still pointing to it in user space.
+ *
+ */
+static int umem_sgget_to_user(pcidriver_privdata_t *privdata, umem_sglist_t *usglist)
+{
+	umem_sgentry_t *user_sg = usglist->sg;
+	int count;
+	int ret;
+
+	if (usglist->nents <= 0)
+		return -EINVAL;
+
+	/* nents comes from user space: the array is never larger than the
+	 * list of the mapping, and a short one is refused before allocating */
+	if ((count = pcidriver_umem_sgcount(privdata, usglist->handle_id)) < 0)
+		return count;
+	if (usglist->nents < count) {
+		usglist->nents = count;
+		return -ENOSPC;
+	}
+	usglist->nents = count;
+
+	/* The umem_sglist_t has a pointer to the scatter/gather list itself which
+	 * needs to be copied separately. The number of elements is stored in ->nents.
+	 * As the list can get very big, we need to use vmalloc. */
+	if ((usglist->sg = vmalloc(count * sizeof(umem_sgentry_t))) == NULL) {
+		usglist->sg = user_sg;
+		return -ENOMEM;
+	}
+
+	if ((ret = pcidriver_umem_sgget(privdata, usglist)) == 0) {
+		/* write data to user space */
+		if (copy_to_user(user_sg, usglist->sg, (usglist->nents)*sizeof(umem_sgentry_t)) != 0)
+			ret = -EFAULT;
+	}
+
+	/* free array memory, and restore the sg pointer to user space */
+	vfree(usglist->sg);
+	usglist->sg = user_sg;
+
+	return ret;
 }
 
 /**
@@ -319,6 +426,21 @@ static int ioctl_umem_sync(pcidriver_privdata_t *privdata, unsigned long arg)
 	return pcidriver_umem_sync( privdata, &uhandle );
 }
 
+/**
+ *
+ * Syncs a range of user memory.
+ *
+ * @see pcidriver_umem_sync_range
+ *
+ */
+static int ioctl_umem_sync_range(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+	int ret;
+	READ_FROM_USER(umem_sync_range_t, usync);
+
+	return pcidriver_umem_sync_range( privdata, &usync );
+}
+
 /**
  *
  * Waits for an interrupt
@@ -330,27 +452,18 @@ static int ioctl_wait_interrupt(pcidriver_privdata_t *privdata, unsigned long ar
 {
 #ifdef ENABLE_IRQ
 	unsigned int irq_source;
-	int temp;
 
 	if (arg >= PCIDRIVER_INT_MAXSOURCES)
 		return -EFAULT;						/* User tried to overrun the IRQ_SOURCES array */
 
 	irq_source = arg;
 
-	/* Thanks to Joern for the correction and tips! */
-	/* done this way to avoid wrong behaviour (endless loop) of the compiler in AMD platforms */
-	temp=1;
-	while (temp) {
-		/* We wait here with an interruptible timeout. This will be interrupted
-                 * by int.c:check_acknowledge_channel() as soon as in interrupt for
-                 * the specified source arrives. */
-		wait_event_interruptible_timeout( (privdata->irq_queues[irq_source]), (atomic_read(&(privdata->irq_outstanding[irq_source])) > 0), (10*HZ/1000) );
-
-		if (atomic_add_negative( -1, &(privdata->irq_outstanding[irq_source])) )
-			atomic_inc( &(privdata->irq_outstanding[irq_source]) );
-		else
-			temp =0;
-	}
+	/* Sleep until int.c:check_acknowledge_channel() wakes the queue, and take
+	 * one interrupt in the same step, so no timeout is needed to catch one
+	 * which arrives between the check and the sleep. */
+	if (wait_event_interruptible( (privdata->irq_queues[irq_source]),
+			atomic_add_unless(&(privdata->irq_outstanding[irq_source]), -1, 0) ))
+		return -ERESTARTSYS;
 
 	return 0;
 #else
@@ -385,6 +498,304 @@ static int ioctl_clear_ioq(pcidriver_privdata_t *privdata, unsigned long arg)
 #endif
 }
 
+/**
+ *
+ * Binds an eventfd to an interrupt source, or unbinds it with fd -1.
+ *
+ * @see pcidriver_irq_bind_eventfd
+ *
+ */
+static int ioctl_irq_eventfd(pcidriver_privdata_t *privdata, struct file *filp, unsigned long arg)
+{
+#ifdef ENABLE_IRQ
+	int ret;
+	READ_FROM_USER(irq_eventfd_t, irq_eventfd);
+
+	return pcidriver_irq_bind_eventfd(privdata, filp, irq_eventfd.source, irq_eventfd.fd);
+#else
+	mod_info("Asked to bind an eventfd but interrupts are not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Takes the outstanding interrupts of several sources without waiting.
+ *
+ * @see pcidriver_irq_take
+ *
+ */
+static int ioctl_irq_take(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+#ifdef ENABLE_IRQ
+	int ret;
+	READ_FROM_USER(irq_pending_t, pending);
+
+	if ((ret = pcidriver_irq_take(privdata, &pending)) != 0)
+		return ret;
+
+	WRITE_TO_USER(irq_pending_t, pending);
+
+	return 0;
+#else
+	mod_info("Asked to take interrupts but interrupts are not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Waits for the interrupts of several sources, with a deadline.
+ *
+ * @see pcidriver_irq_wait
+ *
+ */
+static int ioctl_irq_wait(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+#ifdef ENABLE_IRQ
+	int ret, err;
+	READ_FROM_USER(irq_wait_t, wait);
+
+	if ((err = pcidriver_irq_wait(privdata, &wait)) != 0)
+		return err;
+
+	WRITE_TO_USER(irq_wait_t, wait);
+
+	return 0;
+#else
+	mod_info("Asked to wait for interrupts but interrupts are not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Steers the vector of an interrupt source to a CPU, and tells which IRQ it
+ * is. Sources without a vector of their own (INTx, single MSI) only get
+ * the mode and irq -1 back.
+ *
+ * @see pcidriver_irq_set_affinity
+ *
+ */
+static int ioctl_irq_affinity(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+#ifdef ENABLE_IRQ
+	int ret;
+	READ_FROM_USER(irq_affinity_t, affinity);
+
+	if (affinity.source >= PCIDRIVER_INT_MAXSOURCES)
+		return -EINVAL;
+
+	affinity.mode = privdata->irq_mode;
+	affinity.irq = -1;
+	if ((int)affinity.source < privdata->irq_nvecs) {
+		if ((ret = pcidriver_irq_set_affinity(privdata, affinity.source, affinity.cpu)) != 0)
+			return ret;
+		affinity.irq = privdata->irq_vectors[affinity.source].irq;
+	}
+
+	WRITE_TO_USER(irq_affinity_t, affinity);
+
+	return 0;
+#else
+	mod_info("Asked to steer an interrupt but interrupts are not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Sleeps until the interrupt event ring has events past those already
+ * read, for readers which found it empty.
+ *
+ * @param arg Not a pointer, but the ring head the reader has seen
+ *
+ */
+static int ioctl_irq_ring_wait(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+#ifdef ENABLE_IRQ
+	pcidriver_irq_ring_t *ring = privdata->irq_ring;
+
+	if (ring == NULL)
+		return -ENODEV;
+
+	if (wait_event_interruptible( (privdata->irq_ring_queue), (ring->head != (unsigned int)arg) ))
+		return -ERESTARTSYS;
+
+	return 0;
+#else
+	mod_info("Asked to wait for interrupt events but interrupts are not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Queues a record for the DMA scheduler, the interrupt handler starts it
+ * when the records before it are done.
+ *
+ * @see pcidriver_dma_sched_submit
+ *
+ */
+static int ioctl_dma_sched_submit(pcidriver_privdata_t *privdata, struct file *filp, unsigned long arg)
+{
+#ifdef ENABLE_DMA_SCHED
+	int ret;
+	READ_FROM_USER(dma_sched_xfer_t, xfer);
+
+	return pcidriver_dma_sched_submit(privdata, filp, &xfer);
+#else
+	mod_info("Asked to queue a DMA transfer but the DMA scheduler is not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Reads the counters of a channel of the DMA scheduler.
+ *
+ */
+static int ioctl_dma_sched_status(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+#ifdef ENABLE_DMA_SCHED
+	int ret, err;
+	READ_FROM_USER(dma_sched_status_t, status);
+
+	if ((err = pcidriver_dma_sched_status(privdata, &status)) != 0)
+		return err;
+
+	WRITE_TO_USER(dma_sched_status_t, status);
+
+	return 0;
+#else
+	mod_info("Asked for the DMA scheduler but it is not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Stops a channel of the DMA scheduler and drops its queue.
+ *
+ * @param arg Not a pointer, but the channel.
+ * @returns the number of records dropped
+ *
+ */
+static int ioctl_dma_sched_abort(pcidriver_privdata_t *privdata, struct file *filp, unsigned long arg)
+{
+#ifdef ENABLE_DMA_SCHED
+	return pcidriver_dma_sched_abort(privdata, filp, (unsigned int)arg);
+#else
+	mod_info("Asked for the DMA scheduler but it is not enabled in the driver\n");
+	return -EFAULT;
+#endif
+}
+
+/**
+ *
+ * Runs the commands of a batch in order, and gives each one its status.
+ * By default the first failed command ends the batch; a wait ended by a
+ * signal always does, with -EINTR.
+ *
+ * @returns 0 once the batch ran, even if commands failed
+ *
+ */
+static int ioctl_batch(pcidriver_privdata_t *privdata, unsigned long arg)
+{
+	batch_cmd_t *cmds;
+	unsigned int i;
+	int ret;
+	READ_FROM_USER(batch_t, batch);
+
+	if ((batch.count == 0) || (batch.count > PCIDRIVER_BATCH_MAX))
+		return -EINVAL;
+
+	if ((cmds = kmalloc(batch.count * sizeof(batch_cmd_t), GFP_KERNEL)) == NULL)
+		return -ENOMEM;
+
+	if (copy_from_user(cmds, batch.cmds, batch.count * sizeof(batch_cmd_t)) != 0) {
+		kfree(cmds);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < batch.count; i++)
+		cmds[i].status = -ECANCELED;
+
+	for (batch.done = 0; batch.done < batch.count; ) {
+		cmds[batch.done].status = ioctl_batch_cmd(privdata, &(cmds[batch.done]));
+		batch.done++;
+
+		if (cmds[batch.done - 1].status == -ERESTARTSYS) {
+			cmds[batch.done - 1].status = -EINTR;
+			break;
+		}
+		if ((cmds[batch.done - 1].status != 0) && !(batch.flags & PCIDRIVER_BATCH_FLAG_CONTINUE))
+			break;
+	}
+
+	ret = copy_to_user(batch.cmds, cmds, batch.count * sizeof(batch_cmd_t));
+	kfree(cmds);
+	if (ret != 0)
+		return -EFAULT;
+
+	WRITE_TO_USER(batch_t, batch);
+
+	return 0;
+}
+
+/**
+ *
+ * Runs one command of a batch, as its own ioctl would.
+ *
+ * @returns the status of the command
+ *
+ */
+static int ioctl_batch_cmd(pcidriver_privdata_t *privdata, batch_cmd_t *cmd)
+{
+	kmem_sync_t ksync;
+	umem_handle_t uhandle;
+	int ret;
+
+	switch (cmd->cmd) {
+		case PCIDRIVER_BATCH_KMEM_SYNC:
+			if (cmd->arg.kmem_sync.length != 0)
+				return pcidriver_kmem_sync_range(privdata, &(cmd->arg.kmem_sync));
+
+			ksync.handle = cmd->arg.kmem_sync.handle;
+			ksync.dir = cmd->arg.kmem_sync.dir;
+			return pcidriver_kmem_sync(privdata, &ksync);
+
+		case PCIDRIVER_BATCH_UMEM_SYNC:
+			if (cmd->arg.umem_sync.length != 0)
+				return pcidriver_umem_sync_range(privdata, &(cmd->arg.umem_sync));
+
+			uhandle.handle_id = cmd->arg.umem_sync.handle_id;
+			uhandle.dir = cmd->arg.umem_sync.dir;
+			return pcidriver_umem_sync(privdata, &uhandle);
+
+		case PCIDRIVER_BATCH_UMEM_MAP:
+			/* a failed command leaves no mapping, even on -ENOSPC */
+			ret = umem_sgmap_to_user(privdata, &(cmd->arg.umem_map));
+			if (ret == -ENOSPC)
+				pcidriver_umem_sgunmap(privdata, cmd->arg.umem_map.handle.handle_id);
+			return ret;
+
+		case PCIDRIVER_BATCH_WAIT:
+			return ioctl_wait_interrupt(privdata, cmd->arg.irq_source);
+
+		case PCIDRIVER_BATCH_CLEAR_IOQ:
+			return ioctl_clear_ioq(privdata, cmd->arg.irq_source);
+
+		case PCIDRIVER_BATCH_PCI_CFG_RD:
+			/* the config accessors fail with positive PCIBIOS codes */
+			ret = pcidriver_pci_read(privdata, &(cmd->arg.pci_cfg));
+			return (ret > 0) ? -EIO : ret;
+
+		default:
+			return -EINVAL;
+	}
+}
+
 /**
  *
  * This function handles all ioctl file operations.
@@ -422,6 +833,9 @@ long pcidriver_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		case PCIDRIVER_IOC_KMEM_SYNC:
 			return ioctl_kmem_sync(privdata, arg);
 
+		case PCIDRIVER_IOC_KMEM_SYNC_RANGE:
+			return ioctl_kmem_sync_range(privdata, arg);
+
 		case PCIDRIVER_IOC_UMEM_SGMAP:
 			return ioctl_umem_sgmap(privdata, arg);
 
@@ -434,12 +848,45 @@ long pcidriver_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		case PCIDRIVER_IOC_UMEM_SYNC:
 			return ioctl_umem_sync(privdata, arg);
 
+		case PCIDRIVER_IOC_UMEM_SYNC_RANGE:
+			return ioctl_umem_sync_range(privdata, arg);
+
 		case PCIDRIVER_IOC_WAITI:
 			return ioctl_wait_interrupt(privdata, arg);
 
 		case PCIDRIVER_IOC_CLEAR_IOQ:
 			return ioctl_clear_ioq(privdata, arg);
 
+		case PCIDRIVER_IOC_IRQ_EVENTFD:
+			return ioctl_irq_eventfd(privdata, filp, arg);
+
+		case PCIDRIVER_IOC_IRQ_TAKE:
+			return ioctl_irq_take(privdata, arg);
+
+		case PCIDRIVER_IOC_IRQ_AFFINITY:
+			return ioctl_irq_affinity(privdata, arg);
+
+		case PCIDRIVER_IOC_IRQ_RING_WAIT:
+			return ioctl_irq_ring_wait(privdata, arg);
+
+		case PCIDRIVER_IOC_IRQ_WAIT:
+			return ioctl_irq_wait(privdata, arg);
+
+		case PCIDRIVER_IOC_DMA_SCHED_SUBMIT:
+			return ioctl_dma_sched_submit(privdata, filp, arg);
+
+		case PCIDRIVER_IOC_DMA_SCHED_STATUS:
+			return ioctl_dma_sched_status(privdata, arg);
+
+		case PCIDRIVER_IOC_DMA_SCHED_ABORT:
+			return ioctl_dma_sched_abort(privdata, filp, arg);
+
+		case PCIDRIVER_IOC_BATCH:
+			return ioctl_batch(privdata, arg);
+
+		case PCIDRIVER_IOC_UMEM_SGMAP_GET:
+			return ioctl_umem_sgmap_get(privdata, arg);
+
 		default:
 			return -EINVAL;
 	}
@@ -16,14 +16,21 @@
 #include <linux/wait.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/poll.h>
 
 #include "config.h"			/* compile-time configuration */
 #include "compat.h"			/* compatibility definitions for older linux */
 #include "pciDriver.h"			/* external interface for the driver */
 #include "common.h"			/* internal definitions for all parts */
 #include "kmem.h"			/* prototypes for kernel memory */
+#include "int.h"			/* prototypes for interrupts and the DMA scheduler */
 #include "sysfs.h"			/* prototypes for sysfs */
 
+static void pcidriver_kmem_free_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry);
+static void pcidriver_kmem_release(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry);
+static pcidriver_kmem_entry_t *pcidriver_kmem_lookup(pcidriver_privdata_t *privdata, kmem_handle_t *kmem_handle);
+static int pcidriver_kmem_sync_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry, int dir, unsigned long offset, unsigned long length);
+
 /**
  *
  * Allocates new kernel memory including the corresponding management structure, makes
@@ -63,13 +70,24 @@ int pcidriver_kmem_alloc(pcidriver_privdata_t *privdata, kmem_handle_t *kmem_han
 
 	set_pages_reserved_compat(kmem_entry->cpua, kmem_entry->size);
 
-	/* Add the kmem_entry to the list of the device */
+	/* Add the kmem_entry to the list of the device, and to the id lookup */
+	if (!idr_preload_compat( &(privdata->kmem_idr) ))
+		goto kmem_alloc_idr_fail;
 	spin_lock( &(privdata->kmemlist_lock) );
+	if (idr_insert_compat( &(privdata->kmem_idr), kmem_entry, kmem_entry->id ) != 0) {
+		spin_unlock( &(privdata->kmemlist_lock) );
+		idr_preload_end_compat();
+		goto kmem_alloc_idr_fail;
+	}
 	list_add_tail( &(kmem_entry->list), &(privdata->kmem_list) );
 	spin_unlock( &(privdata->kmemlist_lock) );
+	idr_preload_end_compat();
 
 	return 0;
 
+kmem_alloc_idr_fail:
+		pci_free_consistent( privdata->pdev, kmem_entry->size, (void *)(kmem_entry->cpua), kmem_entry->dma_handle );
+		pcidriver_sysfs_remove(privdata, &(kmem_entry->sysfs_attr));
 kmem_alloc_mem_fail:
 		kfree(kmem_entry);
 kmem_alloc_entry_fail:
@@ -78,18 +96,49 @@ kmem_alloc_entry_fail:
 
 /**
  *
- * Called via sysfs, frees kernel memory and the corresponding management structure
+ * Called via ioctl, frees kernel memory and the corresponding management structure
  *
  */
 int pcidriver_kmem_free( pcidriver_privdata_t *privdata, kmem_handle_t *kmem_handle )
 {
 	pcidriver_kmem_entry_t *kmem_entry;
 
-	/* Find the associated kmem_entry for this buffer */
-	if ((kmem_entry = pcidriver_kmem_find_entry(privdata, kmem_handle)) == NULL)
+	/* Found and removed at once: of two frees of a handle, one fails */
+	spin_lock( &(privdata->kmemlist_lock) );
+	if ((kmem_entry = pcidriver_kmem_lookup(privdata, kmem_handle)) == NULL) {
+		spin_unlock( &(privdata->kmemlist_lock) );
 		return -EINVAL;					/* kmem_handle is not valid */
+	}
+	idr_remove( &(privdata->kmem_idr), kmem_entry->id );
+	list_del( &(kmem_entry->list) );
+	spin_unlock( &(privdata->kmemlist_lock) );
+
+	pcidriver_kmem_free_entry(privdata, kmem_entry);
 
-	return pcidriver_kmem_free_entry(privdata, kmem_entry);
+	return 0;
+}
+
+/**
+ *
+ * Called via sysfs, frees the kernel memory with the given id.
+ *
+ */
+int pcidriver_kmem_free_id( pcidriver_privdata_t *privdata, int id )
+{
+	pcidriver_kmem_entry_t *kmem_entry;
+
+	spin_lock( &(privdata->kmemlist_lock) );
+	if ((kmem_entry = idr_find( &(privdata->kmem_idr), id )) == NULL) {
+		spin_unlock( &(privdata->kmemlist_lock) );
+		return -EINVAL;
+	}
+	idr_remove( &(privdata->kmem_idr), kmem_entry->id );
+	list_del( &(kmem_entry->list) );
+	spin_unlock( &(privdata->kmemlist_lock) );
+
+	pcidriver_kmem_free_entry(privdata, kmem_entry);
+
+	return 0;
 }
 
 /**
@@ -101,11 +150,21 @@ int pcidriver_kmem_free_all(pcidriver_privdata_t *privdata)
 {
 	struct list_head *ptr, *next;
 	pcidriver_kmem_entry_t *kmem_entry;
+	LIST_HEAD(dead);
 
-	/* iterate safely over the entries and delete them */
+	/* Unlink all the entries at once, so there is a single grace period to wait for */
+	spin_lock( &(privdata->kmemlist_lock) );
 	list_for_each_safe(ptr, next, &(privdata->kmem_list)) {
 		kmem_entry = list_entry(ptr, pcidriver_kmem_entry_t, list);
-		pcidriver_kmem_free_entry(privdata, kmem_entry); 		/* spin lock inside! */
+		idr_remove( &(privdata->kmem_idr), kmem_entry->id );
+		list_move_tail( &(kmem_entry->list), &dead );
+	}
+	spin_unlock( &(privdata->kmemlist_lock) );
+	idr_remove_sync_compat();
+
+	list_for_each_safe(ptr, next, &dead) {
+		kmem_entry = list_entry(ptr, pcidriver_kmem_entry_t, list);
+		pcidriver_kmem_release(privdata, kmem_entry);
 	}
 
 	return 0;
@@ -119,28 +178,80 @@ int pcidriver_kmem_free_all(pcidriver_privdata_t *privdata)
 int pcidriver_kmem_sync( pcidriver_privdata_t *privdata, kmem_sync_t *kmem_sync )
 {
 	pcidriver_kmem_entry_t *kmem_entry;
+	int ret;
+
+	/* Find the associated kmem_entry for this buffer. It can not be
+	 * released until the sync is done, the read lock is held over both. */
+	idr_read_lock_compat( &(privdata->kmemlist_lock) );
+	if ((kmem_entry = pcidriver_kmem_lookup(privdata, &(kmem_sync->handle))) == NULL) {
+		idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+		return -EINVAL;					/* kmem_handle is not valid */
+	}
+
+	ret = pcidriver_kmem_sync_entry(privdata, kmem_entry, kmem_sync->dir, 0, kmem_entry->size);
+
+	idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+
+	return ret;
+}
+
+/**
+ *
+ * Synchronize only a range of the memory, the bytes a transfer touches.
+ *
+ */
+int pcidriver_kmem_sync_range( pcidriver_privdata_t *privdata, kmem_sync_range_t *kmem_sync )
+{
+	pcidriver_kmem_entry_t *kmem_entry;
+	int ret;
 
-	/* Find the associated kmem_entry for this buffer */
-	if ((kmem_entry = pcidriver_kmem_find_entry(privdata, &(kmem_sync->handle))) == NULL)
+	idr_read_lock_compat( &(privdata->kmemlist_lock) );
+	if ((kmem_entry = pcidriver_kmem_lookup(privdata, &(kmem_sync->handle))) == NULL) {
+		idr_read_unlock_compat( &(privdata->kmemlist_lock) );
 		return -EINVAL;					/* kmem_handle is not valid */
+	}
+
+	/* The range must be inside the buffer */
+	if ((kmem_sync->length == 0) || (kmem_sync->offset >= kmem_entry->size) ||
+	    (kmem_sync->length > kmem_entry->size - kmem_sync->offset)) {
+		idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+		return -EINVAL;
+	}
+
+	ret = pcidriver_kmem_sync_entry(privdata, kmem_entry, kmem_sync->dir, kmem_sync->offset, kmem_sync->length);
+
+	idr_read_unlock_compat( &(privdata->kmemlist_lock) );
+
+	return ret;
+}
 
+/**
+ *
+ * Sync length bytes from offset of the entry. Older kernels can only sync
+ * the whole buffer.
+ *
+ */
+static int pcidriver_kmem_sync_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry, int dir, unsigned long offset, unsigned long length)
+{
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,11)
-	switch (kmem_sync->dir) {
+	struct device *dev = &(privdata->pdev->dev);
+
+	switch (dir) {
 		case PCIDRIVER_DMA_TODEVICE:
-			pci_dma_sync_single_for_device( privdata->pdev, kmem_entry->dma_handle, kmem_entry->size, PCI_DMA_TODEVICE );
+			dma_sync_single_range_for_device( dev, kmem_entry->dma_handle, offset, length, DMA_TO_DEVICE );
 			break;
 		case PCIDRIVER_DMA_FROMDEVICE:
-			pci_dma_sync_single_for_cpu( privdata->pdev, kmem_entry->dma_handle, kmem_entry->size, PCI_DMA_FROMDEVICE );
+			dma_sync_single_range_for_cpu( dev, kmem_entry->dma_handle, offset, length, DMA_FROM_DEVICE );
 			break;
 		case PCIDRIVER_DMA_BIDIRECTIONAL:
-			pci_dma_sync_single_for_device( privdata->pdev, kmem_entry->dma_handle, kmem_entry->size, PCI_DMA_BIDIRECTIONAL );
-			pci_dma_sync_single_for_cpu( privdata->pdev, kmem_entry->dma_handle, kmem_entry->size, PCI_DMA_BIDIRECTIONAL );
+			dma_sync_single_range_for_device( dev, kmem_entry->dma_handle, offset, length, DMA_BIDIRECTIONAL );
+			dma_sync_single_range_for_cpu( dev, kmem_entry->dma_handle, offset, length, DMA_BIDIRECTIONAL );
 			break;
 		default:
 			return -EINVAL;				/* wrong direction parameter */
 	}
 #else
-	switch (kmem_sync->dir) {
+	switch (dir) {
 		case PCIDRIVER_DMA_TODEVICE:
 			pci_dma_sync_single( privdata->pdev, kmem_entry->dma_handle, kmem_entry->size, PCI_DMA_TODEVICE );
 			break;
@@ -160,11 +271,29 @@ int pcidriver_kmem_sync( pcidriver_privdata_t *privdata, kmem_sync_t *kmem_sync
 
 /**
  *
- * Free the given kmem_entry and its memory.
+ * Free a kmem_entry removed from the list and the id lookup, once the
+ * lookups under the read lock which may have found it are over.
  *
  */
-int pcidriver_kmem_free_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry)
+static void pcidriver_kmem_free_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry)
 {
+	idr_remove_sync_compat();
+
+	pcidriver_kmem_release(privdata, kmem_entry);
+}
+
+/**
+ *
+ * Free the memory of a kmem_entry which is no longer reachable.
+ *
+ */
+static void pcidriver_kmem_release(pcidriver_privdata_t *privdata, pcidriver_kmem_entry_t *kmem_entry)
+{
+#ifdef ENABLE_DMA_SCHED
+	/* The scheduler may still have transfers of it queued */
+	pcidriver_dma_sched_forget(privdata, PCIDRIVER_DMA_SCHED_KMEM, kmem_entry->id);
+#endif
+
 	pcidriver_sysfs_remove(privdata, &(kmem_entry->sysfs_attr));
 
 	/* Go over the pages of the kmem buffer, and mark them as not reserved */
@@ -199,65 +328,26 @@ int pcidriver_kmem_free_entry(pcidriver_privdata_t *privdata, pcidriver_kmem_ent
 	/* Release DMA memory */
 	pci_free_consistent( privdata->pdev, kmem_entry->size, (void *)(kmem_entry->cpua), kmem_entry->dma_handle );
 
-	/* Remove the kmem list entry */
-	spin_lock( &(privdata->kmemlist_lock) );
-	list_del( &(kmem_entry->list) );
-	spin_unlock( &(privdata->kmemlist_lock) );
-
 	/* Release kmem_entry memory */
 	kfree(kmem_entry);
-
-	return 0;
-}
-
-/**
- *
- * Find the corresponding kmem_entry for the given kmem_handle.
- *
- */
-pcidriver_kmem_entry_t *pcidriver_kmem_find_entry(pcidriver_privdata_t *privdata, kmem_handle_t *kmem_handle)
-{
-	struct list_head *ptr;
-	pcidriver_kmem_entry_t *entry, *result = NULL;
-
-	/* should I implement it better using the handle_id? */
-
-	spin_lock(&(privdata->kmemlist_lock));
-	list_for_each(ptr, &(privdata->kmem_list)) {
-		entry = list_entry(ptr, pcidriver_kmem_entry_t, list);
-
-		if (entry->dma_handle == kmem_handle->pa) {
-			result = entry;
-			break;
-		}
-	}
-
-	spin_unlock(&(privdata->kmemlist_lock));
-	return result;
 }
 
 /**
  *
- * find the corresponding kmem_entry for the given id.
+ * Look up the kmem_entry for the given kmem_handle by its id. The bus
+ * address must match too, an id alone may come from a stale handle.
+ * The caller holds the idr read lock, or the list lock.
  *
  */
-pcidriver_kmem_entry_t *pcidriver_kmem_find_entry_id(pcidriver_privdata_t *privdata, int id)
+static pcidriver_kmem_entry_t *pcidriver_kmem_lookup(pcidriver_privdata_t *privdata, kmem_handle_t *kmem_handle)
 {
-	struct list_head *ptr;
-	pcidriver_kmem_entry_t *entry, *result = NULL;
-
-	spin_lock(&(privdata->kmemlist_lock));
-	list_for_each(ptr, &(privdata->kmem_list)) {
-		entry = list_entry(ptr, pcidriver_kmem_entry_t, list);
+	pcidriver_kmem_entry_t *entry;
 
-		if (entry->id == id) {
-			result = entry;
-			break;
-		}
-	}
+	entry = idr_find( &(privdata->kmem_idr), kmem_handle->handle_id );
+	if ((entry == NULL) || (entry->dma_handle != kmem_handle->pa))
+		return NULL;
 
-	spin_unlock(&(privdata->kmemlist_lock));
-	return result;
+	return entry;
 }
 
 /**
@@ -17,6 +17,7 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/kernel.h>
+#include <asm/div64.h>
 
 #include "compat.h"
 #include "config.h"
@@ -154,9 +155,9 @@ SYSFS_SET_FUNCTION(pcidriver_store_mmap_mode)
 	pcidriver_privdata_t *privdata = SYSFS_GET_PRIVDATA;
 	int mode = -1;
 
-	/* Set the mmap-mode if it is either PCIDRIVER_MMAP_PCI or PCIDRIVER_MMAP_KMEM */
+	/* Set the mmap-mode if it is PCIDRIVER_MMAP_PCI, PCIDRIVER_MMAP_PCI_WC or PCIDRIVER_MMAP_KMEM */
 	if (sscanf(buf, "%d", &mode) == 1 &&
-	    (mode == PCIDRIVER_MMAP_PCI || mode == PCIDRIVER_MMAP_KMEM))
+	    (mode == PCIDRIVER_MMAP_PCI || mode == PCIDRIVER_MMAP_PCI_WC || mode == PCIDRIVER_MMAP_KMEM))
 		privdata->mmap_mode = mode;
 
 	return strlen(buf);
@@ -205,17 +206,13 @@ SYSFS_SET_FUNCTION(pcidriver_store_kmem_free)
 {
 	pcidriver_privdata_t *privdata = SYSFS_GET_PRIVDATA;
 	unsigned int id;
-	pcidriver_kmem_entry_t *kmem_entry;
 
 	/* Parse the ID of the kernel memory to be freed, check bounds */
 	if (sscanf(buf, "%u", &id) != 1 ||
 	    (id >= atomic_read(&(privdata->kmem_count))))
 		goto err;
 
-	if ((kmem_entry = pcidriver_kmem_find_entry_id(privdata,id)) == NULL)
-		goto err;
-
-	pcidriver_kmem_free_entry(privdata, kmem_entry );
+	pcidriver_kmem_free_id(privdata, id);
 err:
 	return strlen(buf);
 }
@@ -257,7 +254,7 @@ SYSFS_GET_FUNCTION(pcidriver_show_umappings)
 	pcidriver_umem_entry_t *entry;
 
 	/* print the header */
-	offset += snprintf(buf, PAGE_SIZE, "umap#\tn_pages\tsg_ents\n");
+	offset += snprintf(buf, PAGE_SIZE, "umap#\tn_pages\tn_runs\tsg_ents\trefs\n");
 
 	spin_lock( &(privdata->umemlist_lock) );
 	list_for_each( ptr, &(privdata->umem_list) ) {
@@ -269,8 +266,9 @@ SYSFS_GET_FUNCTION(pcidriver_show_umappings)
 			return PAGE_SIZE;
 		}
 
-		offset += snprintf(buf+offset, PAGE_SIZE-offset, "%3d\t%lu\t%lu\n", entry->id,
-				(unsigned long)(entry->nr_pages), (unsigned long)(entry->nents));
+		offset += snprintf(buf+offset, PAGE_SIZE-offset, "%3d\t%lu\t%lu\t%lu\t%d\n", entry->id,
+				(unsigned long)(entry->nr_pages), (unsigned long)(entry->nr_sg),
+				(unsigned long)(entry->nents), entry->refs);
 	}
 
 	spin_unlock( &(privdata->umemlist_lock) );
@@ -279,20 +277,45 @@ SYSFS_GET_FUNCTION(pcidriver_show_umappings)
 	return (offset > PAGE_SIZE ? PAGE_SIZE : offset+1);
 }
 
+SYSFS_GET_FUNCTION(pcidriver_show_umem_cache)
+{
+	pcidriver_privdata_t *privdata = SYSFS_GET_PRIVDATA;
+	unsigned long hits, misses, invalidated, idle, rate;
+	u64 hit_ns, miss_ns;
+
+	spin_lock( &(privdata->umemlist_lock) );
+	hits = privdata->umem_hits;
+	misses = privdata->umem_misses;
+	invalidated = privdata->umem_invalidated;
+	idle = privdata->umem_idle;
+	hit_ns = privdata->umem_hit_ns;
+	miss_ns = privdata->umem_miss_ns;
+	spin_unlock( &(privdata->umemlist_lock) );
+
+	/* Averages per map call, do_div() for 32 bit kernels */
+	if (hits > 0)
+		do_div(hit_ns, hits);
+	if (misses > 0)
+		do_div(miss_ns, misses);
+	rate = ((hits + misses) > 0) ? (hits * 100) / (hits + misses) : 0;
+
+	return snprintf(buf, PAGE_SIZE, "hits\tmisses\thit_%%\tidle\tinvalid\thit_ns\tmiss_ns\n"
+			"%lu\t%lu\t%lu\t%lu\t%lu\t%llu\t%llu\n",
+			hits, misses, rate, idle, invalidated,
+			(unsigned long long)hit_ns, (unsigned long long)miss_ns);
+}
+
 SYSFS_SET_FUNCTION(pcidriver_store_umem_unmap)
 {
 	pcidriver_privdata_t *privdata = SYSFS_GET_PRIVDATA;
-	pcidriver_umem_entry_t *umem_entry;
 	unsigned int id;
 
 	if (sscanf(buf, "%u", &id) != 1 ||
 	    (id >= atomic_read(&(privdata->umem_count))))
 		goto err;
 
-	if ((umem_entry = pcidriver_umem_find_entry_id(privdata, id)) == NULL)
-		goto err;
-
-	pcidriver_umem_sgunmap(privdata, umem_entry);
+	/* Released even if handles to it remain, or cached */
+	pcidriver_umem_sgfree(privdata, id);
 err:
 	return strlen(buf);
 }
@@ -20,4 +20,5 @@ SYSFS_SET_FUNCTION(pcidriver_store_kmem_alloc);
 SYSFS_SET_FUNCTION(pcidriver_store_kmem_free);
 SYSFS_GET_FUNCTION(pcidriver_show_umappings);
 SYSFS_SET_FUNCTION(pcidriver_store_umem_unmap);
+SYSFS_GET_FUNCTION(pcidriver_show_umem_cache);
 #endif
@@ -16,15 +16,223 @@
 #include <linux/wait.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/poll.h>
 #include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 
 #include "config.h"			/* compile-time configuration */
 #include "compat.h"			/* compatibility definitions for older linux */
 #include "pciDriver.h"			/* external interface for the driver */
 #include "common.h"		/* internal definitions for all parts */
 #include "umem.h"		/* prototypes for kernel memory */
+#include "int.h"		/* prototypes for interrupts and the DMA scheduler */
 #include "sysfs.h"		/* prototypes for sysfs */
 
+static void pcidriver_umem_unlink(pcidriver_privdata_t *privdata, pcidriver_umem_entry_t *umem_entry);
+static void pcidriver_umem_release(pcidriver_privdata_t *privdata, pcidriver_umem_entry_t *umem_entry);
+static int pcidriver_umem_sync_sg(pcidriver_privdata_t *privdata, struct scatterlist *sg, int nents, int dir);
+
+/* A mapping is only reused while nothing was unmapped over it, which needs
+ * MMU notifiers. The callbacks below have the signature of the kernels that
+ * still provide the get_user_pages() call used here (up to 4.5). */
+#if defined(ENABLE_UMEM_CACHE) && defined(CONFIG_MMU_NOTIFIER) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27))
+#define UMEM_CACHE
+#include <linux/mmu_notifier.h>
+#endif
+
+#ifdef UMEM_CACHE
+
+/* An address space with cached mappings, watched for unmaps */
+typedef struct {
+	struct list_head list;
+	struct mmu_notifier mn;
+	struct mm_struct *mm;
+	pcidriver_privdata_t *privdata;
+	int dead;				/* the mm exited, unregister on the next sweep */
+} pcidriver_umem_mm_t;
+
+static inline struct hlist_head *umem_bucket(pcidriver_privdata_t *privdata, struct mm_struct *mm, unsigned long vma)
+{
+	return &(privdata->umem_hash[ hash_long(vma ^ (unsigned long)mm, UMEM_CACHE_HASH_BITS) ]);
+}
+
+/**
+ *
+ * Take out of the cache every mapping of mm overlapping [start,end). Idle
+ * ones are released, the ones in use are released at their last unmap.
+ *
+ */
+static void pcidriver_umem_invalidate(pcidriver_privdata_t *privdata, struct mm_struct *mm, unsigned long start, unsigned long end)
+{
+	struct list_head *ptr, *next;
+	pcidriver_umem_entry_t *entry;
+	LIST_HEAD(idle);
+
+	spin_lock( &(privdata->umemlist_lock) );
+	list_for_each_safe( ptr, next, &(privdata->umem_list) ) {
+		entry = list_entry(ptr, pcidriver_umem_entry_t, list );
+
+		if ((entry->mm != mm) || hlist_unhashed(&(entry->hash)) ||
+		    (entry->vma >= end) || (entry->vma + entry->size <= start))
+			continue;
+
+		hlist_del_init( &(entry->hash) );
+		privdata->umem_invalidated++;
+		if (entry->refs == 0) {
+			privdata->umem_idle--;
+			pcidriver_umem_unlink( privdata, entry );
+			list_add_tail( &(entry->list), &idle );
+		}
+	}
+	spin_unlock( &(privdata->umemlist_lock) );
+
+	if (list_empty(&idle))
+		return;
+
+	/* Released outside the lock, this sleeps */
+	idr_remove_sync_compat();
+	list_for_each_safe( ptr, next, &idle ) {
+		entry = list_entry(ptr, pcidriver_umem_entry_t, list );
+		list_del( &(entry->list) );
+		pcidriver_umem_release( privdata, entry );
+	}
+}
+
+static void pcidriver_umem_mn_invalidate_range_start(struct mmu_notifier *mn, struct mm_struct *mm, unsigned long start, unsigned long end)
+{
+	pcidriver_umem_mm_t *umm = container_of(mn, pcidriver_umem_mm_t, mn);
+
+	pcidriver_umem_invalidate( umm->privdata, mm, start, end );
+}
+
+static void pcidriver_umem_mn_release(struct mmu_notifier *mn, struct mm_struct *mm)
+{
+	pcidriver_umem_mm_t *umm = container_of(mn, pcidriver_umem_mm_t, mn);
+
+	pcidriver_umem_invalidate( umm->privdata, mm, 0, ~0UL );
+	umm->dead = 1;
+}
+
+static const struct mmu_notifier_ops pcidriver_umem_mn_ops = {
+	.invalidate_range_start = pcidriver_umem_mn_invalidate_range_start,
+	.release = pcidriver_umem_mn_release,
+};
+
+/**
+ *
+ * Make sure unmaps in mm are notified. Address spaces which exited are
+ * unregistered here, the notifier can not do it from its own callback.
+ *
+ * @return 0 if mm is watched, and its mappings can be cached.
+ *
+ */
+static int pcidriver_umem_watch(pcidriver_privdata_t *privdata, struct mm_struct *mm)
+{
+	struct list_head *ptr, *next;
+	pcidriver_umem_mm_t *umm;
+	int found = 0;
+
+	mutex_lock( &(privdata->umem_mms_lock) );
+	list_for_each_safe( ptr, next, &(privdata->umem_mms) ) {
+		umm = list_entry(ptr, pcidriver_umem_mm_t, list );
+
+		if (umm->dead) {
+			list_del( &(umm->list) );
+			mmu_notifier_unregister( &(umm->mn), umm->mm );
+			kfree(umm);
+		} else if (umm->mm == mm) {
+			found = 1;
+		}
+	}
+
+	if (!found) {
+		if ((umm = kzalloc(sizeof(*umm), GFP_KERNEL)) == NULL)
+			goto umem_watch_fail;
+
+		umm->mn.ops = &pcidriver_umem_mn_ops;
+		umm->mm = mm;
+		umm->privdata = privdata;
+		if (mmu_notifier_register( &(umm->mn), mm ) != 0) {
+			kfree(umm);
+			goto umem_watch_fail;
+		}
+		list_add_tail( &(umm->list), &(privdata->umem_mms) );
+	}
+	mutex_unlock( &(privdata->umem_mms_lock) );
+	return 0;
+
+umem_watch_fail:
+	mutex_unlock( &(privdata->umem_mms_lock) );
+	return -ENOMEM;
+}
+
+/**
+ *
+ * Stop watching all the address spaces, when the device goes away.
+ *
+ */
+static void pcidriver_umem_unwatch_all(pcidriver_privdata_t *privdata)
+{
+	struct list_head *ptr, *next;
+	pcidriver_umem_mm_t *umm;
+
+	mutex_lock( &(privdata->umem_mms_lock) );
+	list_for_each_safe( ptr, next, &(privdata->umem_mms) ) {
+		umm = list_entry(ptr, pcidriver_umem_mm_t, list );
+		list_del( &(umm->list) );
+		mmu_notifier_unregister( &(umm->mn), umm->mm );
+		kfree(umm);
+	}
+	mutex_unlock( &(privdata->umem_mms_lock) );
+}
+
+/**
+ *
+ * Take a reference to the cached mapping of exactly this area, if any.
+ *
+ */
+static pcidriver_umem_entry_t *pcidriver_umem_cache_get(pcidriver_privdata_t *privdata, struct mm_struct *mm, unsigned long vma, unsigned long size)
+{
+	struct hlist_node *node;
+	pcidriver_umem_entry_t *entry;
+
+	spin_lock( &(privdata->umemlist_lock) );
+	hlist_for_each( node, umem_bucket(privdata, mm, vma) ) {
+		entry = hlist_entry(node, pcidriver_umem_entry_t, hash );
+
+		if ((entry->mm == mm) && (entry->vma == vma) && (entry->size == size)) {
+			if (entry->refs++ == 0)
+				privdata->umem_idle--;
+			spin_unlock( &(privdata->umemlist_lock) );
+			return entry;
+		}
+	}
+	spin_unlock( &(privdata->umemlist_lock) );
+
+	return NULL;
+}
+
+#endif /* UMEM_CACHE */
+
+/* Accounts a map call in the cache statistics */
+static void pcidriver_umem_account(pcidriver_privdata_t *privdata, int hit, ktime_t start)
+{
+	u64 ns = ktime_to_ns( ktime_sub(ktime_get(), start) );
+
+	spin_lock( &(privdata->umemlist_lock) );
+	if (hit) {
+		privdata->umem_hits++;
+		privdata->umem_hit_ns += ns;
+	} else {
+		privdata->umem_misses++;
+		privdata->umem_miss_ns += ns;
+	}
+	spin_unlock( &(privdata->umemlist_lock) );
+}
+
 /**
  *
  * Reserve a new scatter/gather list and map it from memory to PCI bus addresses.
@@ -32,12 +240,16 @@
  */
 int pcidriver_umem_sgmap(pcidriver_privdata_t *privdata, umem_handle_t *umem_handle)
 {
-	int i, res, nr_pages;
+	int i, res, nr_pages, nr_sg;
 	struct page **pages;
 	struct scatterlist *sg = NULL;
 	pcidriver_umem_entry_t *umem_entry;
 	unsigned int nents;
-	unsigned long count,offset,length;
+	unsigned long count,offset,length,max_seg;
+	ktime_t start = ktime_get();
+#ifdef UMEM_CACHE
+	int cached;
+#endif
 
 	/*
 	 * We do some checks first. Then, the following is necessary to create a
@@ -45,18 +257,33 @@ int pcidriver_umem_sgmap(pcidriver_privdata_t *privdata, umem_handle_t *umem_han
 	 *  - Determine the number of pages
 	 *  - Get the pages for the memory area
 	 * 	- Lock them.
-	 *  - Create a scatter/gather list of the pages
+	 *  - Create a scatter/gather list of the pages, one entry for each run
+	 *    of contiguous pages (e.g. a huge page)
 	 *  - Map the list from memory to PCI bus addresses
 	 *
 	 * Then, we:
 	 *  - Create an entry on the umem list of the device, to cache the mapping.
 	 *  - Create a sysfs attribute that gives easy access to the SG list
+	 *
+	 * If the same area of the same process is mapped already, or was and
+	 * is still cached, that mapping is returned with one more reference.
 	 */
 
 	/* zero-size?? */
 	if (umem_handle->size == 0)
 		return -EINVAL;
 
+#ifdef UMEM_CACHE
+	if ((umem_entry = pcidriver_umem_cache_get(privdata, current->mm, umem_handle->vma, umem_handle->size)) != NULL) {
+		umem_handle->handle_id = umem_entry->id;
+		pcidriver_umem_account(privdata, 1, start);
+		return 0;
+	}
+
+	/* Not cached if unmaps in this process can not be followed */
+	cached = (pcidriver_umem_watch(privdata, current->mm) == 0);
+#endif
+
 	/* Direction is better ignoring during mapping. */
 	/* We assume bidirectional buffers always, except when sync'ing */
 
@@ -116,21 +343,41 @@ int pcidriver_umem_sgmap(pcidriver_privdata_t *privdata, umem_handle_t *umem_han
 
 	sg_set_page(&sg[0], pages[0], length, offset);
 
+	/* Largest entry the device accepts in the mapping */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,24)
+	max_seg = dma_get_max_seg_size(&(privdata->pdev->dev));
+#else
+	max_seg = 65536;
+#endif
+
+	nr_sg = 1;
 	count = umem_handle->size - length;
 	for(i=1;i<nr_pages;i++) {
 		/* Lock page first */
 		if ( !PageReserved(pages[i]) )
 			compat_lock_page(pages[i]);
 
+		length = ((count > PAGE_SIZE) ? PAGE_SIZE : count);
+		count -= length;
+
+		/* A page following the previous one in memory extends its entry */
+		if ((page_to_pfn(pages[i]) == page_to_pfn(pages[i-1]) + 1) &&
+		    (sg[nr_sg-1].length + length <= max_seg)) {
+			sg[nr_sg-1].length += length;
+			continue;
+		}
+
 		/* Populate the list */
-		sg_set_page(&sg[i], pages[i], ((count > PAGE_SIZE) ? PAGE_SIZE : count), 0);
-		count -= sg[i].length;
+		sg_set_page(&sg[nr_sg], pages[i], length, 0);
+		nr_sg++;
 	}
 
+	mod_info_dbg("Built SG list (%d entries for %d pages).\n", nr_sg, nr_pages);
+
 	/* Use the page list to populate the SG list */
 	/* SG entries may be merged, res is the number of used entries */
-	/* We have originally nr_pages entries in the sg list */
-	if ((nents = pci_map_sg(privdata->pdev, sg, nr_pages, PCI_DMA_BIDIRECTIONAL)) == 0)
+	/* We have originally nr_sg entries in the sg list */
+	if ((nents = pci_map_sg(privdata->pdev, sg, nr_sg, PCI_DMA_BIDIRECTIONAL)) == 0)
 		goto umem_sgmap_unmap;
 
 	mod_info_dbg("Mapped SG list (%d entries).\n", nents);
@@ -142,7 +389,13 @@ int pcidriver_umem_sgmap(pcidriver_privdata_t *privdata, umem_handle_t *umem_han
 
 	/* Fill entry to be added to the umem list */
 	umem_entry->id = atomic_inc_return(&privdata->umem_count) - 1;
+	umem_entry->mm = current->mm;
+	umem_entry->vma = umem_handle->vma;
+	umem_entry->size = umem_handle->size;
+	umem_entry->refs = 1;
+	INIT_HLIST_NODE( &(umem_entry->hash) );
 	umem_entry->nr_pages = nr_pages;	/* Will be needed when unmapping */
+	umem_entry->nr_sg = nr_sg;
 	umem_entry->pages = pages;
 	umem_entry->nents = nents;
 	umem_entry->sg = sg;
@@ -150,20 +403,35 @@ int pcidriver_umem_sgmap(pcidriver_privdata_t *privdata, umem_handle_t *umem_han
 	if (pcidriver_sysfs_initialize_umem(privdata, umem_entry->id, &(umem_entry->sysfs_attr)) != 0)
 		goto umem_sgmap_name_fail;
 
-	/* Add entry to the umem list */
+	/* Add entry to the umem list, to the id lookup and to the cache */
+	if (!idr_preload_compat( &(privdata->umem_idr) ))
+		goto umem_sgmap_idr_fail;
 	spin_lock( &(privdata->umemlist_lock) );
+	if (idr_insert_compat( &(privdata->umem_idr), umem_entry, umem_entry->id ) != 0) {
+		spin_unlock( &(privdata->umemlist_lock) );
+		idr_preload_end_compat();
+		goto umem_sgmap_idr_fail;
+	}
 	list_add_tail( &(umem_entry->list), &(privdata->umem_list) );
+#ifdef UMEM_CACHE
+	if (cached)
+		hlist_add_head( &(umem_entry->hash), umem_bucket(privdata, umem_entry->mm, umem_entry->vma) );
+#endif
 	spin_unlock( &(privdata->umemlist_lock) );
+	idr_preload_end_compat();
 
 	/* Update the Handle with the Handle ID of the entry */
 	umem_handle->handle_id = umem_entry->id;
 
+	pcidriver_umem_account(privdata, 0, start);
 	return 0;
 
+umem_sgmap_idr_fail:
+	pcidriver_sysfs_remove(privdata, &(umem_entry->sysfs_attr));
 umem_sgmap_name_fail:
 	kfree(umem_entry);
 umem_sgmap_entry:
-	pci_unmap_sg( privdata->pdev, sg, nr_pages, PCI_DMA_BIDIRECTIONAL );
+	pci_unmap_sg( privdata->pdev, sg, nr_sg, PCI_DMA_BIDIRECTIONAL );
 umem_sgmap_unmap:
 	/* release pages */
 	if (nr_pages > 0) {
@@ -184,16 +452,126 @@ umem_sgmap_pages:
 
 /**
  *
- * Unmap a scatter/gather list
+ * Drop a reference to the scatter/gather list with the given id. At the
+ * last one, the list is kept pinned in the cache if it can be reused,
+ * else unmapped. When the cache holds too many unused lists, the oldest
+ * one is unmapped instead.
+ *
+ */
+int pcidriver_umem_sgunmap(pcidriver_privdata_t *privdata, int id)
+{
+	struct list_head *ptr;
+	pcidriver_umem_entry_t *umem_entry;
+	pcidriver_umem_entry_t *victim = NULL;
+
+	/* Looked up under the list lock, it can not be released meanwhile */
+	spin_lock( &(privdata->umemlist_lock) );
+
+	if ((umem_entry = idr_find( &(privdata->umem_idr), id )) == NULL) {
+		spin_unlock( &(privdata->umemlist_lock) );
+		return -EINVAL;
+	}
+
+	if (umem_entry->refs == 0) {
+		/* Unmapped already, only cached */
+		spin_unlock( &(privdata->umemlist_lock) );
+		return -EINVAL;
+	}
+
+	if (--(umem_entry->refs) > 0) {
+		spin_unlock( &(privdata->umemlist_lock) );
+		return 0;
+	}
+
+	if (hlist_unhashed( &(umem_entry->hash) )) {
+		pcidriver_umem_unlink( privdata, umem_entry );
+		spin_unlock( &(privdata->umemlist_lock) );
+		idr_remove_sync_compat();
+		pcidriver_umem_release(privdata, umem_entry);
+		return 0;
+	}
+
+	/* Idle in the cache, the list is kept from the oldest to the newest */
+	list_move_tail( &(umem_entry->list), &(privdata->umem_list) );
+	if (++(privdata->umem_idle) > UMEM_CACHE_IDLE_MAX) {
+		list_for_each( ptr, &(privdata->umem_list) ) {
+			victim = list_entry(ptr, pcidriver_umem_entry_t, list );
+			if (victim->refs == 0)
+				break;
+		}
+		pcidriver_umem_unlink( privdata, victim );
+		privdata->umem_idle--;
+	}
+	spin_unlock( &(privdata->umemlist_lock) );
+
+	if (victim != NULL) {
+		idr_remove_sync_compat();
+		pcidriver_umem_release(privdata, victim);
+	}
+
+	return 0;
+}
+
+/**
+ *
+ * Unmap the scatter/gather list with the given id now, whatever its
+ * references.
+ *
+ */
+int pcidriver_umem_sgfree(pcidriver_privdata_t *privdata, int id)
+{
+	pcidriver_umem_entry_t *umem_entry;
+
+	spin_lock( &(privdata->umemlist_lock) );
+	if ((umem_entry = idr_find( &(privdata->umem_idr), id )) == NULL) {
+		spin_unlock( &(privdata->umemlist_lock) );
+		return -EINVAL;
+	}
+	pcidriver_umem_unlink( privdata, umem_entry );
+	if (umem_entry->refs == 0)
+		privdata->umem_idle--;
+	spin_unlock( &(privdata->umemlist_lock) );
+
+	idr_remove_sync_compat();
+	pcidriver_umem_release(privdata, umem_entry);
+
+	return 0;
+}
+
+/**
+ *
+ * Take an entry out of the list, the cache and the id lookup. Called
+ * with the list lock held. Lookups by id may still hold the entry until
+ * the next grace period.
  *
  */
-int pcidriver_umem_sgunmap(pcidriver_privdata_t *privdata, pcidriver_umem_entry_t *umem_entry)
+static void pcidriver_umem_unlink(pcidriver_privdata_t *privdata, pcidriver_umem_entry_t *umem_entry)
+{
+	list_del( &(umem_entry->list) );
+	if (!hlist_unhashed( &(umem_entry->hash) ))
+		hlist_del_init( &(umem_entry->hash) );
+	idr_remove( &(privdata->umem_idr), umem_entry->id );
+}
+
+/**
+ *
+ * Unmap the pages of an entry and free it. The entry is unlinked, and no
+ * lookup by id can still be using it.
+ *
+ */
+static void pcidriver_umem_release(pcidriver_privdata_t *privdata, pcidriver_umem_entry_t *umem_entry)
 {
 	int i;
+
+#ifdef ENABLE_DMA_SCHED
+	/* The scheduler may still have transfers of it queued */
+	pcidriver_dma_sched_forget(privdata, PCIDRIVER_DMA_SCHED_UMEM, umem_entry->id);
+#endif
+
 	pcidriver_sysfs_remove(privdata, &(umem_entry->sysfs_attr));
 
 	/* Unmap user memory */
-	pci_unmap_sg( privdata->pdev, umem_entry->sg, umem_entry->nr_pages, PCI_DMA_BIDIRECTIONAL );
+	pci_unmap_sg( privdata->pdev, umem_entry->sg, umem_entry->nr_sg, PCI_DMA_BIDIRECTIONAL );
 
 	/* Release the pages */
 	if (umem_entry->nr_pages > 0) {
@@ -208,11 +586,6 @@ int pcidriver_umem_sgunmap(pcidriver_privdata_t *privdata, pcidriver_umem_entry_
 		}
 	}
 
-	/* Remove the umem list entry */
-	spin_lock( &(privdata->umemlist_lock) );
-	list_del( &(umem_entry->list) );
-	spin_unlock( &(privdata->umemlist_lock) );
-
 	/* Release SG list and page list memory */
 	/* These two are in the vm area of the kernel */
 	vfree(umem_entry->pages);
@@ -220,8 +593,6 @@ int pcidriver_umem_sgunmap(pcidriver_privdata_t *privdata, pcidriver_umem_entry_
 
 	/* Release umem_entry memory */
 	kfree(umem_entry);
-
-	return 0;
 }
 
 /**
@@ -233,20 +604,60 @@ int pcidriver_umem_sgunmap_all(pcidriver_privdata_t *privdata)
 {
 	struct list_head *ptr, *next;
 	pcidriver_umem_entry_t *umem_entry;
+	LIST_HEAD(dead);
+
+#ifdef UMEM_CACHE
+	/* No more invalidations from here on */
+	pcidriver_umem_unwatch_all( privdata );
+#endif
 
-	/* iterate safely over the entries and delete them */
+	/* Unlink all the entries at once, then wait for a single grace period */
+	spin_lock( &(privdata->umemlist_lock) );
 	list_for_each_safe( ptr, next, &(privdata->umem_list) ) {
 		umem_entry = list_entry(ptr, pcidriver_umem_entry_t, list );
-		pcidriver_umem_sgunmap( privdata, umem_entry ); 		/* spin lock inside! */
+		pcidriver_umem_unlink( privdata, umem_entry );
+		list_add_tail( &(umem_entry->list), &dead );
+	}
+	privdata->umem_idle = 0;
+	spin_unlock( &(privdata->umemlist_lock) );
+	idr_remove_sync_compat();
+
+	list_for_each_safe( ptr, next, &dead ) {
+		umem_entry = list_entry(ptr, pcidriver_umem_entry_t, list );
+		pcidriver_umem_release( privdata, umem_entry );
 	}
 
 	return 0;
 }
 
+/**
+ *
+ * Entries of the scatter/gather list with the given id, the most
+ * pcidriver_umem_sgget() needs.
+ *
+ * @returns -EINVAL if the id is not valid
+ *
+ */
+int pcidriver_umem_sgcount(pcidriver_privdata_t *privdata, int id)
+{
+	pcidriver_umem_entry_t *umem_entry;
+	int count;
+
+	idr_read_lock_compat( &(privdata->umemlist_lock) );
+	umem_entry = idr_find( &(privdata->umem_idr), id );
+	count = (umem_entry == NULL) ? -EINVAL : (int)umem_entry->nents;
+	idr_read_unlock_compat( &(privdata->umemlist_lock) );
+
+	return count;
+}
+
 /**
  *
  * Copies the scatter/gather list from kernelspace to userspace.
  *
+ * @returns -ENOSPC if the list has not enough entries, with nents set to
+ * the entries needed
+ *
  */
 int pcidriver_umem_sgget(pcidriver_privdata_t *privdata, umem_sglist_t *umem_sglist)
 {
@@ -257,14 +668,21 @@ int pcidriver_umem_sgget(pcidriver_privdata_t *privdata, umem_sglist_t *umem_sgl
 	dma_addr_t cur_addr;
 	unsigned int cur_size;
 
-	/* Find the associated umem_entry for this buffer */
-	umem_entry = pcidriver_umem_find_entry_id( privdata, umem_sglist->handle_id );
-	if (umem_entry == NULL)
+	/* Find the associated umem_entry for this buffer, and keep it
+	 * from being released while its list is copied */
+	idr_read_lock_compat( &(privdata->umemlist_lock) );
+	umem_entry = idr_find( &(privdata->umem_idr), umem_sglist->handle_id );
+	if (umem_entry == NULL) {
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
 		return -EINVAL;					/* umem_handle is not valid */
+	}
 
-	/* Check if passed SG list is enough */
-	if (umem_sglist->nents < umem_entry->nents)
-		return -EINVAL;					/* sg has not enough entries */
+	/* Check if passed SG list is enough, else tell how many it takes */
+	if (umem_sglist->nents < umem_entry->nents) {
+		umem_sglist->nents = umem_entry->nents;
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
+		return -ENOSPC;					/* sg has not enough entries */
+	}
 
 	/* Copy the SG list to the user format */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,24)
@@ -360,6 +778,8 @@ int pcidriver_umem_sgget(pcidriver_privdata_t *privdata, umem_sglist_t *umem_sgl
 	}
 #endif
 
+	idr_read_unlock_compat( &(privdata->umemlist_lock) );
+
 	return 0;
 }
 
@@ -371,37 +791,98 @@ int pcidriver_umem_sgget(pcidriver_privdata_t *privdata, umem_sglist_t *umem_sgl
 int pcidriver_umem_sync( pcidriver_privdata_t *privdata, umem_handle_t *umem_handle )
 {
 	pcidriver_umem_entry_t *umem_entry;
+	int ret;
+
+	/* Find the associated umem_entry for this buffer, held until synced */
+	idr_read_lock_compat( &(privdata->umemlist_lock) );
+	umem_entry = idr_find( &(privdata->umem_idr), umem_handle->handle_id );
+	if (umem_entry == NULL) {
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
+		return -EINVAL;					/* umem_handle is not valid */
+	}
+
+	ret = pcidriver_umem_sync_sg( privdata, umem_entry->sg, umem_entry->nents, umem_handle->dir );
+
+	idr_read_unlock_compat( &(privdata->umemlist_lock) );
+
+	return ret;
+}
+
+/**
+ *
+ * Sync only the SG entries holding the bytes [offset, offset+length) of
+ * the user memory area.
+ *
+ */
+int pcidriver_umem_sync_range( pcidriver_privdata_t *privdata, umem_sync_range_t *umem_sync )
+{
+	pcidriver_umem_entry_t *umem_entry;
+	unsigned long offset, end;
+	int first, last, ret;
 
-	/* Find the associated umem_entry for this buffer */
-	umem_entry = pcidriver_umem_find_entry_id( privdata, umem_handle->handle_id );
-	if (umem_entry == NULL)
+	idr_read_lock_compat( &(privdata->umemlist_lock) );
+	umem_entry = idr_find( &(privdata->umem_idr), umem_sync->handle_id );
+	if (umem_entry == NULL) {
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
 		return -EINVAL;					/* umem_handle is not valid */
+	}
+
+	/* The range must be inside the area */
+	if ((umem_sync->length == 0) || (umem_sync->offset >= umem_entry->size) ||
+	    (umem_sync->length > umem_entry->size - umem_sync->offset)) {
+		idr_read_unlock_compat( &(privdata->umemlist_lock) );
+		return -EINVAL;
+	}
+
+	/* The entries cover the area in order, without gaps. Skip the
+	 * ones before the range, then find the one where it ends. */
+	offset = umem_sync->offset;
+	for (first = 0; offset >= umem_entry->sg[first].length; first++)
+		offset -= umem_entry->sg[first].length;
+
+	end = offset + umem_sync->length;
+	for (last = first; end > umem_entry->sg[last].length; last++)
+		end -= umem_entry->sg[last].length;
+
+	ret = pcidriver_umem_sync_sg( privdata, &(umem_entry->sg[first]), last - first + 1, umem_sync->dir );
 
+	idr_read_unlock_compat( &(privdata->umemlist_lock) );
+
+	return ret;
+}
+
+/**
+ *
+ * Sync nents entries of a mapped SG list.
+ *
+ */
+static int pcidriver_umem_sync_sg( pcidriver_privdata_t *privdata, struct scatterlist *sg, int nents, int dir )
+{
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,11)
-	switch (umem_handle->dir) {
+	switch (dir) {
 		case PCIDRIVER_DMA_TODEVICE:
-			pci_dma_sync_sg_for_device( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_TODEVICE );
+			pci_dma_sync_sg_for_device( privdata->pdev, sg, nents, PCI_DMA_TODEVICE );
 			break;
 		case PCIDRIVER_DMA_FROMDEVICE:
-			pci_dma_sync_sg_for_cpu( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_FROMDEVICE );
+			pci_dma_sync_sg_for_cpu( privdata->pdev, sg, nents, PCI_DMA_FROMDEVICE );
 			break;
 		case PCIDRIVER_DMA_BIDIRECTIONAL:
-			pci_dma_sync_sg_for_device( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_BIDIRECTIONAL );
-			pci_dma_sync_sg_for_cpu( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_BIDIRECTIONAL );
+			pci_dma_sync_sg_for_device( privdata->pdev, sg, nents, PCI_DMA_BIDIRECTIONAL );
+			pci_dma_sync_sg_for_cpu( privdata->pdev, sg, nents, PCI_DMA_BIDIRECTIONAL );
 			break;
 		default:
 			return -EINVAL;				/* wrong direction parameter */
 	}
 #else
-	switch (umem_handle->dir) {
+	switch (dir) {
 		case PCIDRIVER_DMA_TODEVICE:
-			pci_dma_sync_sg( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_TODEVICE );
+			pci_dma_sync_sg( privdata->pdev, sg, nents, PCI_DMA_TODEVICE );
 			break;
 		case PCIDRIVER_DMA_FROMDEVICE:
-			pci_dma_sync_sg( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_FROMDEVICE );
+			pci_dma_sync_sg( privdata->pdev, sg, nents, PCI_DMA_FROMDEVICE );
 			break;
 		case PCIDRIVER_DMA_BIDIRECTIONAL:
-			pci_dma_sync_sg( privdata->pdev, umem_entry->sg, umem_entry->nents, PCI_DMA_BIDIRECTIONAL );
+			pci_dma_sync_sg( privdata->pdev, sg, nents, PCI_DMA_BIDIRECTIONAL );
 			break;
 		default:
 			return -EINVAL;				/* wrong direction parameter */
@@ -410,29 +891,3 @@ int pcidriver_umem_sync( pcidriver_privdata_t *privdata, umem_handle_t *umem_han
 
 	return 0;
 }
-
-/*
- *
- * Get the pcidriver_umem_entry_t structure for the given id.
- *
- * @param id ID of the umem entry to search for
- *
- */
-pcidriver_umem_entry_t *pcidriver_umem_find_entry_id(pcidriver_privdata_t *privdata, int id)
-{
-	struct list_head *ptr;
-	pcidriver_umem_entry_t *entry;
-
-	spin_lock(&(privdata->umemlist_lock));
-	list_for_each(ptr, &(privdata->umem_list)) {
-		entry = list_entry(ptr, pcidriver_umem_entry_t, list );
-
-		if (entry->id == id) {
-			spin_unlock( &(privdata->umemlist_lock) );
-			return entry;
-		}
-	}
-
-	spin_unlock(&(privdata->umemlist_lock));
-	return NULL;
-}
@@ -0,0 +1,281 @@
+/**
+ *
+ * @file Batch.cpp
+ * @brief Batch class, commands run in a single ioctl
+ *
+ */
+
+#include "Batch.h"
+#include "Exception.h"
+#include "driver/pciDriver.h"
+
+#include <cstring>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using namespace pciDriver;
+
+/**
+ *
+ * Constructor of Batch. Never more than the driver takes in a batch.
+ *
+ */
+Batch::Batch(PciDevice& dev, unsigned int max)
+{
+	if ((max == 0) || (max > PCIDRIVER_BATCH_MAX))
+		max = PCIDRIVER_BATCH_MAX;
+
+	this->device = &dev;
+	this->max = max;
+	this->count = 0;
+	this->done = 0;
+	this->stopOnError = true;
+	this->cmds = new batch_cmd_t[ max ];
+	this->sgs = new UserMemory::sg_entry*[ max ];
+}
+
+/**
+ *
+ * Destructor of Batch. Unmaps the mappings nobody took.
+ *
+ */
+Batch::~Batch()
+{
+	clear();
+
+	delete [] cmds;
+	delete [] sgs;
+}
+
+unsigned int Batch::add(unsigned int cmd)
+{
+	if (count == max)
+		throw Exception( Exception::BATCH_FAILED );
+
+	memset(&cmds[count], 0, sizeof(batch_cmd_t));
+	cmds[count].cmd = cmd;
+	cmds[count].status = -ECANCELED;
+	sgs[count] = NULL;
+
+	return count++;
+}
+
+unsigned int Batch::syncKernelMemory(const KernelMemory& mem, KernelMemory::sync_dir dir,
+		unsigned int offset, unsigned int length)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_KMEM_SYNC);
+
+	/* We assume (C++ API) dir === (Driver API) dir */
+	cmds[i].arg.kmem_sync.handle.handle_id = mem.handle_id;
+	cmds[i].arg.kmem_sync.handle.pa = mem.pa;
+	cmds[i].arg.kmem_sync.handle.size = mem.size;
+	cmds[i].arg.kmem_sync.dir = dir;
+	cmds[i].arg.kmem_sync.offset = offset;
+	cmds[i].arg.kmem_sync.length = length;
+
+	return i;
+}
+
+unsigned int Batch::syncUserMemory(const UserMemory& mem, UserMemory::sync_dir dir,
+		unsigned int offset, unsigned int length)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_UMEM_SYNC);
+
+	cmds[i].arg.umem_sync.handle_id = mem.handle_id;
+	cmds[i].arg.umem_sync.dir = dir;
+	cmds[i].arg.umem_sync.offset = offset;
+	cmds[i].arg.umem_sync.length = length;
+
+	return i;
+}
+
+unsigned int Batch::mapUserMemory(void *mem, unsigned int size, bool merged)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_UMEM_MAP);
+
+	cmds[i].arg.umem_map.handle.vma = reinterpret_cast<unsigned long>(mem);
+	cmds[i].arg.umem_map.handle.size = size;
+	cmds[i].arg.umem_map.sglist.type = ((merged) ? PCIDRIVER_SG_MERGED : PCIDRIVER_SG_NONMERGED);
+
+	return i;
+}
+
+unsigned int Batch::waitForInterrupt(unsigned int int_id)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_WAIT);
+
+	cmds[i].arg.irq_source = int_id;
+
+	return i;
+}
+
+unsigned int Batch::clearInterruptQueue(unsigned int int_id)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_CLEAR_IOQ);
+
+	cmds[i].arg.irq_source = int_id;
+
+	return i;
+}
+
+unsigned int Batch::readConfig(unsigned int addr, unsigned int bytes)
+{
+	unsigned int i = add(PCIDRIVER_BATCH_PCI_CFG_RD);
+
+	cmds[i].arg.pci_cfg.addr = addr;
+	switch (bytes) {
+		case 1:
+			cmds[i].arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_BYTE;
+			break;
+		case 2:
+			cmds[i].arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_WORD;
+			break;
+		default:
+			cmds[i].arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_DWORD;
+			break;
+	}
+
+	return i;
+}
+
+/**
+ *
+ * Runs the commands. A failed command does not throw, see getStatus().
+ * Mappings of a previous run not taken with getUserMemory() are undone.
+ *
+ * @returns the number of commands run
+ *
+ */
+unsigned int Batch::run()
+{
+	batch_t batch;
+	unsigned int i;
+
+	if (count == 0)
+		return 0;
+
+	unmapPending();
+
+	for (i = 0; i < count; i++) {
+		umem_sglist_t *sgl = &(cmds[i].arg.umem_map.sglist);
+
+		if (cmds[i].cmd != PCIDRIVER_BATCH_UMEM_MAP)
+			continue;
+
+		/* Same room for the SG list as UserMemory gives it */
+		sgl->nents = (cmds[i].arg.umem_map.handle.size / getpagesize()) + 2;
+		if (sgs[i] == NULL)
+			sgs[i] = new UserMemory::sg_entry[ sgl->nents ];
+		sgl->sg = reinterpret_cast<umem_sgentry_t *>(sgs[i]);	/* same layout, see UserMemory */
+	}
+
+	batch.count = count;
+	batch.flags = (stopOnError) ? 0 : PCIDRIVER_BATCH_FLAG_CONTINUE;
+	batch.done = 0;
+	batch.cmds = cmds;
+
+	if (ioctl(device->getHandle(), PCIDRIVER_IOC_BATCH, &batch) != 0)
+		throw Exception( Exception::BATCH_FAILED );
+
+	done = batch.done;
+	return done;
+}
+
+/**
+ *
+ * Drops the commands, and unmaps the mappings nobody took.
+ *
+ */
+void Batch::clear()
+{
+	unsigned int i;
+
+	unmapPending();
+
+	for (i = 0; i < count; i++)
+		delete [] sgs[i];
+
+	count = 0;
+	done = 0;
+}
+
+/**
+ *
+ * Undoes the mappings made by the last run and not taken. Does not throw,
+ * it runs from the destructor.
+ *
+ */
+void Batch::unmapPending()
+{
+	umem_handle_t uh;
+	unsigned int i;
+	int handle;
+
+	try {
+		handle = device->getHandle();
+	} catch (Exception& e) {
+		return;		/* closing the device undid them */
+	}
+
+	for (i = 0; i < count; i++) {
+		if ((cmds[i].cmd != PCIDRIVER_BATCH_UMEM_MAP) || (cmds[i].status != 0) || (sgs[i] == NULL))
+			continue;
+
+		uh = cmds[i].arg.umem_map.handle;
+		ioctl(handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &uh);
+		cmds[i].status = -ECANCELED;
+	}
+}
+
+int Batch::getStatus(unsigned int index)
+{
+	if (index >= count)
+		throw Exception( Exception::BATCH_FAILED );
+
+	return cmds[index].status;
+}
+
+unsigned int Batch::getConfigValue(unsigned int index)
+{
+	const pci_cfg_cmd *cfg;
+
+	if ((index >= count) || (cmds[index].cmd != PCIDRIVER_BATCH_PCI_CFG_RD) || (cmds[index].status != 0))
+		throw Exception( Exception::BATCH_FAILED );
+
+	cfg = &(cmds[index].arg.pci_cfg);
+	switch (cfg->size) {
+		case PCIDRIVER_PCI_CFG_SZ_BYTE:
+			return cfg->val.byte;
+		case PCIDRIVER_PCI_CFG_SZ_WORD:
+			return cfg->val.word;
+		default:
+			return cfg->val.dword;
+	}
+}
+
+/**
+ *
+ * Gives the mapping of a mapUserMemory command to a UserMemory, with the
+ * SG list the driver wrote: it is not copied again.
+ *
+ * @returns A UserMemory object
+ *
+ */
+UserMemory& Batch::getUserMemory(unsigned int index)
+{
+	UserMemory *um;
+	const umem_handle_t *uh;
+
+	if ((index >= count) || (cmds[index].cmd != PCIDRIVER_BATCH_UMEM_MAP))
+		throw Exception( Exception::BATCH_FAILED );
+	if ((cmds[index].status != 0) || (sgs[index] == NULL))
+		throw Exception( Exception::SGMAP_FAILED );
+
+	uh = &(cmds[index].arg.umem_map.handle);
+	um = new UserMemory(*device, reinterpret_cast<void *>(uh->vma), uh->size,
+			uh->handle_id, cmds[index].arg.umem_map.sglist.nents, sgs[index]);
+	sgs[index] = NULL;
+
+	return *um;
+}
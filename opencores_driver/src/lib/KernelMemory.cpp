@@ -124,3 +124,23 @@ void KernelMemory::sync(sync_dir dir)
 	if (ioctl(device->getHandle(), PCIDRIVER_IOC_KMEM_SYNC, &ks) != 0)
 		throw Exception(Exception::INTERNAL_ERROR);
 }
+
+/**
+ *
+ * Syncs only length bytes from offset of the kernel memory.
+ *
+ */
+void KernelMemory::sync(sync_dir dir, unsigned int offset, unsigned int length)
+{
+	kmem_sync_range_t ks;
+
+	ks.handle.handle_id = handle_id;
+	ks.handle.pa = pa;
+	ks.handle.size = size;
+	ks.dir = dir;
+	ks.offset = offset;
+	ks.length = length;
+
+	if (ioctl(device->getHandle(), PCIDRIVER_IOC_KMEM_SYNC_RANGE, &ks) != 0)
+		throw Exception(Exception::INTERNAL_ERROR);
+}
@@ -32,9 +32,11 @@
 #include "Exception.h"
 #include "KernelMemory.h"
 #include "UserMemory.h"
+#include "Batch.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -42,9 +44,14 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <time.h>
 
 using namespace pciDriver;
 
+/* The event ring is used as the driver lays it out */
+typedef char check_ring_layout[(sizeof(PciDevice::InterruptRing) == sizeof(pcidriver_irq_ring_t)) ? 1 : -1];
+typedef char check_event_layout[(sizeof(PciDevice::InterruptEvent) == sizeof(pcidriver_irq_event_t)) ? 1 : -1];
+
 /**
  *
  * Construtor for the PciDevice. Checks if the specified device exists and initializes
@@ -171,6 +178,21 @@ UserMemory& PciDevice::mapUserMemory(void *mem, unsigned int size, bool merged)
 	return *um;
 }
 
+/**
+ *
+ * Creates an empty batch of at most max commands.
+ *
+ * @returns A Batch object
+ * @see Batch
+ *
+ */
+Batch& PciDevice::createBatch(unsigned int max)
+{
+	Batch *b = new Batch(*this, max);
+
+	return *b;
+}
+
 /**
  *
  * Waits for an interrupt.
@@ -185,6 +207,52 @@ void PciDevice::waitForInterrupt(unsigned int int_id)
 		throw Exception(Exception::INTERRUPT_FAILED);
 }
 
+/**
+ *
+ * Waits for the interrupts of several sources at once, and takes them.
+ * The timeout is enforced in the driver, which sleeps no longer than it.
+ *
+ * @param mask Sources to wait for, bit i for source i.
+ * @param timeout_us Timeout in microseconds, 0 waits forever.
+ * @param counts If not NULL, gets the number of interrupts taken from each
+ * source, PCIDRIVER_INT_MAXSOURCES entries.
+ * @param max_events Most interrupts to take, 0 for all those outstanding.
+ * @returns the mask of the sources taken from, 0 if the timeout expired
+ *
+ */
+unsigned int PciDevice::waitForInterrupts(unsigned int mask, unsigned int timeout_us,
+		unsigned int *counts, unsigned int max_events)
+{
+	irq_wait_t wait;
+	struct timespec now;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	wait.deadline = 0;
+	if (timeout_us > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wait.deadline = (now.tv_sec * 1000000000ULL) + now.tv_nsec + (timeout_us * 1000ULL);
+	}
+
+	// the deadline is absolute, a wait interrupted by a signal just goes on
+	for (;;) {
+		wait.mask = mask;
+		wait.max_events = max_events;
+		if (ioctl(handle, PCIDRIVER_IOC_IRQ_WAIT, &wait) == 0)
+			break;
+		if (errno == ETIMEDOUT)
+			return 0;
+		if (errno != EINTR)
+			throw Exception(Exception::INTERRUPT_FAILED);
+	}
+
+	if (counts != NULL)
+		memcpy(counts, wait.count, sizeof(wait.count));
+
+	return wait.mask;
+}
+
 /**
  *
  * Clears the interrupt queue.
@@ -199,6 +267,259 @@ void PciDevice::clearInterruptQueue(unsigned int int_id)
 		throw Exception(Exception::INTERNAL_ERROR);
 }
 
+/**
+ *
+ * Takes the outstanding interrupts of the sources in mask, without waiting.
+ * One thread can poll() the device handle for all the sources, and find
+ * out here which ones fired.
+ *
+ * @param counts If not NULL, gets the number of interrupts taken from each
+ * source, PCIDRIVER_INT_MAXSOURCES entries.
+ * @returns the mask of the sources which had interrupts
+ *
+ */
+unsigned int PciDevice::takeInterrupts(unsigned int mask, unsigned int *counts)
+{
+	irq_pending_t pending;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	pending.mask = mask;
+	if (ioctl(handle, PCIDRIVER_IOC_IRQ_TAKE, &pending) != 0)
+		throw Exception(Exception::INTERRUPT_FAILED);
+
+	if (counts != NULL)
+		memcpy(counts, pending.count, sizeof(pending.count));
+
+	return pending.mask;
+}
+
+/**
+ *
+ * Binds an eventfd to an interrupt source. The interrupts of the source are
+ * then added to the eventfd counter, and no longer seen by waitForInterrupt
+ * or takeInterrupts. The binding is dropped when this device is closed.
+ *
+ */
+void PciDevice::bindInterruptEventfd(unsigned int int_id, int efd)
+{
+	irq_eventfd_t bind;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	bind.source = int_id;
+	bind.fd = efd;
+	if (ioctl(handle, PCIDRIVER_IOC_IRQ_EVENTFD, &bind) != 0)
+		throw Exception(Exception::INTERRUPT_FAILED);
+}
+
+/**
+ *
+ * Steers the interrupts of a source to a CPU, usually the one running the
+ * thread which waits for them. Only sources with their own MSI-X or MSI
+ * vector can be steered; on INTx or a single MSI nothing changes.
+ *
+ * @param cpu The CPU, or -1 to let the kernel choose again.
+ * @returns the Linux IRQ of the vector, or -1 if the source has none
+ *
+ */
+int PciDevice::setInterruptAffinity(unsigned int int_id, int cpu)
+{
+	irq_affinity_t affinity;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	affinity.source = int_id;
+	affinity.cpu = cpu;
+	if (ioctl(handle, PCIDRIVER_IOC_IRQ_AFFINITY, &affinity) != 0)
+		throw Exception(Exception::INTERRUPT_FAILED);
+
+	return affinity.irq;
+}
+
+/**
+ *
+ * Maps the interrupt event ring of the device, read-only.
+ *
+ */
+const PciDevice::InterruptRing *PciDevice::mapInterruptRing()
+{
+	void *mem;
+
+	if (handle == -1)
+		throw Exception(Exception::NOT_OPEN);
+
+	mmap_lock();
+
+	if (ioctl(handle, PCIDRIVER_IOC_MMAP_MODE, PCIDRIVER_MMAP_IRQ_RING) != 0) {
+		mmap_unlock();
+		throw Exception(Exception::INTERNAL_ERROR);
+	}
+
+	mem = mmap(0, sizeof(InterruptRing), PROT_READ, MAP_SHARED, handle, 0);
+
+	mmap_unlock();
+
+	if ((mem == MAP_FAILED) || (mem == NULL))
+		throw Exception(Exception::MMAP_FAILED);
+
+	return static_cast<const InterruptRing *>(mem);
+}
+
+/**
+ *
+ * Unmaps the interrupt event ring.
+ *
+ */
+void PciDevice::unmapInterruptRing(const InterruptRing *ring)
+{
+	munmap(const_cast<InterruptRing *>(ring), sizeof(InterruptRing));
+}
+
+/**
+ *
+ * Copies the events of the ring from next on, and advances next past them.
+ * Events overwritten before they were read are skipped, which shows as a
+ * gap in their seq.
+ *
+ * @param wait If the ring has nothing past next, sleep until it has,
+ * instead of returning 0.
+ * @returns the number of events copied, at most max
+ *
+ */
+unsigned int PciDevice::readInterruptRing(const InterruptRing *ring, unsigned int& next,
+		InterruptEvent *events, unsigned int max, bool wait)
+{
+	const unsigned int size = ring->size;
+	unsigned int head, count, lost;
+
+	while ((head = ring->head) == next) {
+		if (!wait)
+			return 0;
+		if ((ioctl(handle, PCIDRIVER_IOC_IRQ_RING_WAIT, next) != 0) && (errno != EINTR))
+			throw Exception(Exception::INTERRUPT_FAILED);
+	}
+	__sync_synchronize();
+
+	// the slot of head - size is the next to be rewritten
+	if (head - next >= size)
+		next = head - size + 1;
+
+	for (count = 0; (count < max) && (next + count != head); count++)
+		events[count] = ring->events[(next + count) & (size - 1)];
+
+	// drop the events rewritten while they were copied
+	__sync_synchronize();
+	head = ring->head;
+	for (lost = 0; (lost < count) && (head - (next + lost) >= size); lost++)
+		;
+	if (lost > 0)
+		memmove(events, events + lost, (count - lost) * sizeof(InterruptEvent));
+
+	next += count;
+	return count - lost;
+}
+
+/**
+ *
+ * Queues a range of a kernel buffer for the DMA scheduler of the driver.
+ * Channel 0 writes to the device, channel 1 reads from it. A buffer read
+ * from the device is synced by the caller once the record ended.
+ *
+ * @returns false if the queue has no room for the record now
+ *
+ */
+bool PciDevice::queueDMA(const KernelMemory& mem, bool toDevice, unsigned int bar, unsigned int addr,
+		unsigned int offset, unsigned int length, unsigned int tag, bool inc)
+{
+	return queueDMARecord(PCIDRIVER_DMA_SCHED_KMEM, mem.handle_id, toDevice, bar, addr, offset, length, tag, inc);
+}
+
+/**
+ *
+ * Queues a range of a user buffer for the DMA scheduler. The driver
+ * splits it in a transfer per SG entry, the interrupt comes at the end.
+ *
+ * @returns false if the queue has no room for the record now
+ *
+ */
+bool PciDevice::queueDMA(const UserMemory& mem, bool toDevice, unsigned int bar, unsigned int addr,
+		unsigned int offset, unsigned int length, unsigned int tag, bool inc)
+{
+	return queueDMARecord(PCIDRIVER_DMA_SCHED_UMEM, mem.handle_id, toDevice, bar, addr, offset, length, tag, inc);
+}
+
+bool PciDevice::queueDMARecord(int type, int handle_id, bool toDevice, unsigned int bar, unsigned int addr,
+		unsigned int offset, unsigned int length, unsigned int tag, bool inc)
+{
+	dma_sched_xfer_t xfer;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	xfer.type = type;
+	xfer.handle_id = handle_id;
+	xfer.dir = (toDevice) ? PCIDRIVER_DMA_TODEVICE : PCIDRIVER_DMA_FROMDEVICE;
+	xfer.bar = bar;
+	xfer.addr = addr;
+	xfer.flags = (inc) ? PCIDRIVER_DMA_SCHED_INC : 0;
+	xfer.offset = offset;
+	xfer.length = length;
+	xfer.tag = tag;
+
+	if (ioctl(handle, PCIDRIVER_IOC_DMA_SCHED_SUBMIT, &xfer) == 0)
+		return true;
+	if (errno == ENOSPC)
+		return false;
+
+	throw Exception(Exception::DMA_QUEUE_FAILED);
+}
+
+/**
+ *
+ * Reads the counters of a channel of the DMA scheduler. A record has ended
+ * once completed passes the count of records queued before it.
+ *
+ */
+void PciDevice::getDMAQueueStatus(unsigned int channel, DMAQueueStatus& status)
+{
+	dma_sched_status_t s;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	s.channel = channel;
+	if (ioctl(handle, PCIDRIVER_IOC_DMA_SCHED_STATUS, &s) != 0)
+		throw Exception(Exception::DMA_QUEUE_FAILED);
+
+	status.submitted = s.submitted;
+	status.completed = s.completed;
+	status.errors = s.errors;
+	status.last_tag = s.last_tag;
+	status.last_status = s.last_status;
+}
+
+/**
+ *
+ * Stops a channel of the DMA scheduler and drops the records it had queued.
+ *
+ */
+unsigned int PciDevice::abortDMAQueue(unsigned int channel)
+{
+	int ret;
+
+	if (handle == -1)
+		throw Exception( Exception::NOT_OPEN );
+
+	if ((ret = ioctl(handle, PCIDRIVER_IOC_DMA_SCHED_ABORT, channel)) < 0)
+		throw Exception(Exception::DMA_QUEUE_FAILED);
+
+	return ret;
+}
+
 /**
  *
  * Gets the size of a BAR.
@@ -267,7 +588,7 @@ unsigned short PciDevice::getSlot()
  * @returns A pointer to the mapped bar.
  *
  */
-void *PciDevice::mapBAR(unsigned int bar)
+void *PciDevice::mapBAR(unsigned int bar, bool writeCombining)
 {
 	void *mem;
 	pci_board_info info;
@@ -287,11 +608,15 @@ void *PciDevice::mapBAR(unsigned int bar)
 	 * Posible fix: Do not allow the driver for mutliple openings of a device */
 	mmap_lock();
 
-	if (ioctl(handle, PCIDRIVER_IOC_MMAP_MODE, PCIDRIVER_MMAP_PCI) != 0)
+	if (ioctl(handle, PCIDRIVER_IOC_MMAP_MODE, (writeCombining ? PCIDRIVER_MMAP_PCI_WC : PCIDRIVER_MMAP_PCI)) != 0) {
+		mmap_unlock();
 		throw Exception(Exception::INTERNAL_ERROR);
+	}
 
-	if (ioctl( handle, PCIDRIVER_IOC_MMAP_AREA, PCIDRIVER_BAR0+bar) != 0)
+	if (ioctl( handle, PCIDRIVER_IOC_MMAP_AREA, PCIDRIVER_BAR0+bar) != 0) {
+		mmap_unlock();
 		throw Exception(Exception::INTERNAL_ERROR);
+	}
 
 	mem = mmap(0, info.bar_length[bar], PROT_WRITE | PROT_READ, MAP_SHARED, handle, 0);
 	
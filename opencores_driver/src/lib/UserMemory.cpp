@@ -29,59 +29,76 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <errno.h>
 
 using namespace pciDriver;
 
 /**
  *
- * Constructor of UserMemory. Allocates a scatter/gather list and receives it
- * from kernel space.
+ * Constructor of UserMemory. Maps the memory and receives its
+ * scatter/gather list from kernel space in one call, straight into the
+ * list kept here.
  *
  */
 UserMemory::UserMemory(PciDevice& dev, void *mem, unsigned int size, bool merged)
 {
-	int i;
-	umem_handle_t uh;
-	umem_sglist_t sgl;
+	/* The driver fills our SG list as is */
+	typedef char check_sg_layout[(sizeof(struct sg_entry) == sizeof(umem_sgentry_t)) ? 1 : -1];
+	umem_map_t um;
 	int dev_handle;
 
+	(void)sizeof(check_sg_layout);
+
 	dev_handle = dev.getHandle();
 
 	this->device = &dev;
 	this->vma = reinterpret_cast<unsigned long>(mem);
 	this->size = size;
 
-	uh.vma = reinterpret_cast<unsigned long>(mem);
-	uh.size = size;
-
-	/* Lock and Map the memory to their pages */
-	if (ioctl(dev_handle, PCIDRIVER_IOC_UMEM_SGMAP, &uh) != 0)
-		throw Exception( Exception::SGMAP_FAILED );
-
-	this->handle_id = uh.handle_id;
-
-	/* Obtain the scatter/gather list for this memory */
-	sgl.handle_id = uh.handle_id;
-	sgl.type = ((merged) ? PCIDRIVER_SG_MERGED : PCIDRIVER_SG_NONMERGED);
-	sgl.nents = (size / getpagesize()) + 2;
-	sgl.sg = new umem_sgentry_t[ sgl.nents ];
-
-	if (ioctl(dev_handle, PCIDRIVER_IOC_UMEM_SGGET, &sgl) != 0) {
-		ioctl( dev_handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &uh );
-		delete [] sgl.sg;
-		throw Exception( Exception::SGMAP_FAILED );
+	um.handle.vma = reinterpret_cast<unsigned long>(mem);
+	um.handle.size = size;
+	um.sglist.type = ((merged) ? PCIDRIVER_SG_MERGED : PCIDRIVER_SG_NONMERGED);
+	um.sglist.nents = (size / getpagesize()) + 2;
+	this->sg = new struct sg_entry[ um.sglist.nents ];
+	um.sglist.sg = reinterpret_cast<umem_sgentry_t *>(this->sg);
+
+	/* Lock and Map the memory to their pages, and get the SG list */
+	if (ioctl(dev_handle, PCIDRIVER_IOC_UMEM_SGMAP_GET, &um) != 0) {
+		if (errno != ENOSPC) {
+			delete [] this->sg;
+			throw Exception( Exception::SGMAP_FAILED );
+		}
+
+		/* Mapped, but the list did not fit: nents tells what it takes */
+		delete [] this->sg;
+		this->sg = new struct sg_entry[ um.sglist.nents ];
+		um.sglist.sg = reinterpret_cast<umem_sgentry_t *>(this->sg);
+
+		if (ioctl(dev_handle, PCIDRIVER_IOC_UMEM_SGGET, &um.sglist) != 0) {
+			ioctl( dev_handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &um.handle );
+			delete [] this->sg;
+			throw Exception( Exception::SGMAP_FAILED );
+		}
 	}
 
-	/* Copy the Scatter / Gather list to our structures */
-	this->nents = sgl.nents;
-	this->sg = new struct sg_entry[ sgl.nents ];
-	for(i = 0; i < sgl.nents; i++) {
-		this->sg[i].addr = sgl.sg[i].addr;
-		this->sg[i].size = sgl.sg[i].size;
-	}
+	this->handle_id = um.handle.handle_id;
+	this->nents = um.sglist.nents;
+}
 
-	/* Temp SG list for the driver is no longer needed */
-	delete [] sgl.sg;
+/**
+ *
+ * Constructor of UserMemory for a mapping made by a Batch, which got the
+ * scatter/gather list already. The list is kept as it is.
+ *
+ */
+UserMemory::UserMemory(PciDevice& dev, void *mem, unsigned int size, int handle_id, int nents, struct sg_entry *sg)
+{
+	this->device = &dev;
+	this->vma = reinterpret_cast<unsigned long>(mem);
+	this->size = size;
+	this->handle_id = handle_id;
+	this->nents = nents;
+	this->sg = sg;
 }
 
 /**
@@ -122,3 +139,22 @@ void UserMemory::sync(sync_dir dir)
 	if (ioctl(device->getHandle(), PCIDRIVER_IOC_UMEM_SYNC, &uh) != 0)
 		throw Exception( Exception::INTERNAL_ERROR );
 }
+
+/**
+ *
+ * Syncs only length bytes from offset of the user memory. The driver
+ * syncs the SG entries holding them.
+ *
+ */
+void UserMemory::sync(sync_dir dir, unsigned int offset, unsigned int length)
+{
+	umem_sync_range_t us;
+
+	us.handle_id = handle_id;
+	us.dir = dir;
+	us.offset = offset;
+	us.length = length;
+
+	if (ioctl(device->getHandle(), PCIDRIVER_IOC_UMEM_SYNC_RANGE, &us) != 0)
+		throw Exception( Exception::INTERNAL_ERROR );
+}
@@ -36,10 +36,17 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <time.h>
 
 #include "pciDriver.h"
 #include "driver/pciDriver.h"
 
+/* The event ring is used as the driver lays it out */
+typedef char check_ring_layout[(sizeof(pd_irq_ring_t) == sizeof(pcidriver_irq_ring_t)) ? 1 : -1];
+typedef char check_event_layout[(sizeof(pd_irq_event_t) == sizeof(pcidriver_irq_event_t)) ? 1 : -1];
+typedef char check_sg_layout[(sizeof(pd_umem_sgentry_t) == sizeof(umem_sgentry_t)) ? 1 : -1];
+typedef char check_batch_limit[(PD_BATCH_MAX == PCIDRIVER_BATCH_MAX) ? 1 : -1];
+
 // two helper functions
 int pd_getpagesize() {
 	return getpagesize();
@@ -168,8 +175,7 @@ int pd_freeKernelMemory( pd_kmem_t *kmem_handle )
 int pd_mapUserMemory( pd_device_t *pci_handle, void *mem, unsigned int size, pd_umem_t *umem_handle )
 {
 	int ret;
-	umem_handle_t uh;
-	umem_sglist_t sgl;
+	umem_map_t um;
 
 	/* Check for null pointers */
 	if (pci_handle == NULL)
@@ -177,33 +183,40 @@ int pd_mapUserMemory( pd_device_t *pci_handle, void *mem, unsigned int size, pd_
 	if (umem_handle == NULL)
 		return -1;
 
-	uh.vma = (unsigned long)mem;
-	uh.size = size;
+	um.handle.vma = (unsigned long)mem;
+	um.handle.size = size;
 
-	/* Lock and Map the memory to their pages */
-	ret = ioctl(pci_handle->handle, PCIDRIVER_IOC_UMEM_SGMAP, &uh );
-	if (ret != 0)
+	/* The driver writes the scatter/gather list straight to our array */
+	um.sglist.type = PCIDRIVER_SG_MERGED;
+	um.sglist.nents = (size / getpagesize()) + 2;
+	if (posix_memalign( (void**)&(um.sglist.sg), 16, um.sglist.nents*sizeof(umem_sgentry_t) ) != 0)
 		return -1;
 
-	umem_handle->pci_handle = pci_handle;
-	umem_handle->handle_id = uh.handle_id;
-
-	/* Obtain the scatter/gather list for this memory */
-	sgl.handle_id = uh.handle_id;
-	sgl.type = PCIDRIVER_SG_MERGED;
-	sgl.nents = (size / getpagesize()) + 1;
-	posix_memalign( (void**)&(sgl.sg), 16, sgl.nents*sizeof(umem_sgentry_t) );
-
-	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_UMEM_SGGET, &sgl );
+	/* Lock and Map the memory to their pages, and get the SG list */
+	ret = ioctl(pci_handle->handle, PCIDRIVER_IOC_UMEM_SGMAP_GET, &um );
+	if ((ret != 0) && (errno == ENOSPC)) {
+		/* Mapped, but the list did not fit: nents tells what it takes */
+		free(um.sglist.sg);
+		if (posix_memalign( (void**)&(um.sglist.sg), 16, um.sglist.nents*sizeof(umem_sgentry_t) ) != 0)
+			um.sglist.sg = NULL;
+
+		ret = (um.sglist.sg == NULL) ? -1 : ioctl( pci_handle->handle, PCIDRIVER_IOC_UMEM_SGGET, &um.sglist );
+		if (ret != 0)
+			ioctl( pci_handle->handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &um.handle );
+	}
 	if (ret != 0) {
-		ioctl( pci_handle->handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &uh );
-		free(sgl.sg);
+		free(um.sglist.sg);
 		return -1;
 	}
 
+	umem_handle->pci_handle = pci_handle;
+	umem_handle->handle_id = um.handle.handle_id;
+	umem_handle->vma = um.handle.vma;
+	umem_handle->size = um.handle.size;
+
 	/* We can do this because (C API) pd_umem_sgentry_t === (Driver API) umem_sgentry_t */
-	umem_handle->nents = sgl.nents;
-	umem_handle->sg = (pd_umem_sgentry_t*)sgl.sg;
+	umem_handle->nents = um.sglist.nents;
+	umem_handle->sg = (pd_umem_sgentry_t*)um.sglist.sg;
 
 	/* On Success, return 0 */
 	return 0;
@@ -277,6 +290,52 @@ int pd_syncUserMemory( pd_umem_t *umem_handle, int dir )
 	return 0;
 }
 
+int pd_syncKernelMemoryRange( pd_kmem_t *kmem_handle, int dir, unsigned long offset, unsigned long length )
+{
+	int ret;
+	kmem_sync_range_t ks;
+
+	/* Check for null pointer */
+	if (kmem_handle == NULL)
+		return -1;
+
+	ks.handle.handle_id = kmem_handle->handle_id;
+	ks.handle.pa = kmem_handle->pa;
+	ks.handle.size = kmem_handle->size;
+	ks.dir = dir;
+	ks.offset = offset;
+	ks.length = length;
+
+	ret = ioctl(kmem_handle->pci_handle->handle, PCIDRIVER_IOC_KMEM_SYNC_RANGE, &ks );
+	if (ret != 0)
+		return -1;
+
+	/* Success */
+	return 0;
+}
+
+int pd_syncUserMemoryRange( pd_umem_t *umem_handle, int dir, unsigned long offset, unsigned long length )
+{
+	int ret;
+	umem_sync_range_t us;
+
+	/* Check for null pointer */
+	if (umem_handle == NULL)
+		return -1;
+
+	us.handle_id = umem_handle->handle_id;
+	us.dir = dir;
+	us.offset = offset;
+	us.length = length;
+
+	ret = ioctl(umem_handle->pci_handle->handle, PCIDRIVER_IOC_UMEM_SYNC_RANGE, &us );
+	if (ret != 0)
+		return -1;
+
+	/* Success */
+	return 0;
+}
+
 /* Interrupt Function */
 int pd_waitForInterrupt(pd_device_t *pci_handle, unsigned int int_id )
 {
@@ -293,6 +352,44 @@ int pd_waitForInterrupt(pd_device_t *pci_handle, unsigned int int_id )
 	return 0;
 }
 
+/* Same as PciDevice::waitForInterrupts, *mask is 0 on return after a timeout */
+int pd_waitForInterrupts(pd_device_t *pci_handle, unsigned int *mask, unsigned int timeout_us,
+		unsigned int *counts, unsigned int max_events )
+{
+	int ret;
+	irq_wait_t wait;
+	struct timespec now;
+
+	/* Check for null pointer */
+	if ((pci_handle == NULL) || (mask == NULL))
+		return -1;
+
+	wait.deadline = 0;
+	if (timeout_us > 0) {
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		wait.deadline = (now.tv_sec * 1000000000ULL) + now.tv_nsec + (timeout_us * 1000ULL);
+	}
+
+	do {
+		wait.mask = *mask;
+		wait.max_events = max_events;
+		ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_IRQ_WAIT, &wait );
+	} while ((ret != 0) && (errno == EINTR));
+
+	if ((ret != 0) && (errno == ETIMEDOUT)) {
+		*mask = 0;
+		return 0;
+	}
+	if (ret != 0)
+		return -1;
+
+	*mask = wait.mask;
+	if (counts != NULL)
+		memcpy( counts, wait.count, sizeof(wait.count) );
+
+	return 0;
+}
+
 int pd_clearInterruptQueue(pd_device_t *pci_handle, unsigned int int_id )
 {
 	int ret;
@@ -308,6 +405,474 @@ int pd_clearInterruptQueue(pd_device_t *pci_handle, unsigned int int_id )
 	return 0;
 }
 
+int pd_takeInterrupts(pd_device_t *pci_handle, unsigned int *mask, unsigned int *counts )
+{
+	int ret;
+	irq_pending_t pending;
+
+	/* Check for null pointer */
+	if ((pci_handle == NULL) || (mask == NULL))
+		return -1;
+
+	pending.mask = *mask;
+	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_IRQ_TAKE, &pending );
+	if (ret != 0)
+		return -1;
+
+	*mask = pending.mask;
+	if (counts != NULL)
+		memcpy( counts, pending.count, sizeof(pending.count) );
+
+	return 0;
+}
+
+int pd_bindInterruptEventfd(pd_device_t *pci_handle, unsigned int int_id, int efd )
+{
+	int ret;
+	irq_eventfd_t bind;
+
+	/* Check for null pointer */
+	if (pci_handle == NULL)
+		return -1;
+
+	bind.source = int_id;
+	bind.fd = efd;
+	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_IRQ_EVENTFD, &bind );
+	if (ret != 0)
+		return -1;
+
+	return 0;
+}
+
+/* Returns the IRQ of the vector of int_id, -1 if it has none, -2 on error */
+int pd_setInterruptAffinity(pd_device_t *pci_handle, unsigned int int_id, int cpu )
+{
+	int ret;
+	irq_affinity_t affinity;
+
+	/* Check for null pointer */
+	if (pci_handle == NULL)
+		return -2;
+
+	affinity.source = int_id;
+	affinity.cpu = cpu;
+	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_IRQ_AFFINITY, &affinity );
+	if (ret != 0)
+		return -2;
+
+	return affinity.irq;
+}
+
+const pd_irq_ring_t *pd_mapInterruptRing(pd_device_t *pci_handle )
+{
+	int ret;
+	void *mem;
+
+	/* Check for null pointer */
+	if (pci_handle == NULL)
+		return NULL;
+
+	pthread_mutex_lock( &pci_handle->mmap_mutex );
+
+	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_MMAP_MODE, PCIDRIVER_MMAP_IRQ_RING );
+	if (ret != 0) {
+		pthread_mutex_unlock( &pci_handle->mmap_mutex );
+		return NULL;
+	}
+
+	mem = mmap( 0, sizeof(pd_irq_ring_t), PROT_READ, MAP_SHARED, pci_handle->handle, 0 );
+
+	pthread_mutex_unlock( &pci_handle->mmap_mutex );
+
+	if ((mem == MAP_FAILED) || (mem == NULL))
+		return NULL;
+
+	return (const pd_irq_ring_t *)mem;
+}
+
+int pd_unmapInterruptRing(pd_device_t *pci_handle, const pd_irq_ring_t *ring )
+{
+	/* Check for null pointer */
+	if ((pci_handle == NULL) || (ring == NULL))
+		return -1;
+
+	return munmap( (void *)ring, sizeof(pd_irq_ring_t) );
+}
+
+/* Same as PciDevice::readInterruptRing. Returns the events copied, or -1 */
+int pd_readInterruptRing(pd_device_t *pci_handle, const pd_irq_ring_t *ring, unsigned int *next,
+		pd_irq_event_t *events, unsigned int max, int wait )
+{
+	unsigned int size, head, count, lost;
+
+	/* Check for null pointer */
+	if ((pci_handle == NULL) || (ring == NULL) || (next == NULL))
+		return -1;
+
+	size = ring->size;
+	while ((head = ring->head) == *next) {
+		if (!wait)
+			return 0;
+		if ((ioctl( pci_handle->handle, PCIDRIVER_IOC_IRQ_RING_WAIT, *next ) != 0) && (errno != EINTR))
+			return -1;
+	}
+	__sync_synchronize();
+
+	/* the slot of head - size is the next to be rewritten */
+	if (head - *next >= size)
+		*next = head - size + 1;
+
+	for (count = 0; (count < max) && (*next + count != head); count++)
+		events[count] = ring->events[(*next + count) & (size - 1)];
+
+	/* drop the events rewritten while they were copied */
+	__sync_synchronize();
+	head = ring->head;
+	for (lost = 0; (lost < count) && (head - (*next + lost) >= size); lost++)
+		;
+	if (lost > 0)
+		memmove( events, events + lost, (count - lost) * sizeof(pd_irq_event_t) );
+
+	*next += count;
+	return count - lost;
+}
+
+static int pd_queueDMA( pd_device_t *pci_handle, int type, int handle_id, int dir, unsigned int bar,
+		unsigned int addr, unsigned long offset, unsigned long length, unsigned int tag, int flags )
+{
+	dma_sched_xfer_t xfer;
+
+	xfer.type = type;
+	xfer.handle_id = handle_id;
+	xfer.dir = dir;
+	xfer.bar = bar;
+	xfer.addr = addr;
+	xfer.flags = (flags & PD_DMA_QUEUE_INC) ? PCIDRIVER_DMA_SCHED_INC : 0;
+	xfer.offset = offset;
+	xfer.length = length;
+	xfer.tag = tag;
+
+	if (ioctl( pci_handle->handle, PCIDRIVER_IOC_DMA_SCHED_SUBMIT, &xfer ) == 0)
+		return 0;
+
+	return (errno == ENOSPC) ? 1 : -1;
+}
+
+int pd_queueKernelMemoryDMA( pd_kmem_t *kmem_handle, int dir, unsigned int bar, unsigned int addr,
+		unsigned long offset, unsigned long length, unsigned int tag, int flags )
+{
+	/* Check for null pointer */
+	if ((kmem_handle == NULL) || (kmem_handle->pci_handle == NULL))
+		return -1;
+
+	return pd_queueDMA( kmem_handle->pci_handle, PCIDRIVER_DMA_SCHED_KMEM, kmem_handle->handle_id,
+			dir, bar, addr, offset, length, tag, flags );
+}
+
+int pd_queueUserMemoryDMA( pd_umem_t *umem_handle, int dir, unsigned int bar, unsigned int addr,
+		unsigned long offset, unsigned long length, unsigned int tag, int flags )
+{
+	/* Check for null pointer */
+	if ((umem_handle == NULL) || (umem_handle->pci_handle == NULL))
+		return -1;
+
+	return pd_queueDMA( umem_handle->pci_handle, PCIDRIVER_DMA_SCHED_UMEM, umem_handle->handle_id,
+			dir, bar, addr, offset, length, tag, flags );
+}
+
+int pd_getDMAQueueStatus( pd_device_t *pci_handle, unsigned int channel, pd_dma_queue_status_t *status )
+{
+	dma_sched_status_t s;
+
+	/* Check for null pointer */
+	if ((pci_handle == NULL) || (status == NULL))
+		return -1;
+
+	s.channel = channel;
+	if (ioctl( pci_handle->handle, PCIDRIVER_IOC_DMA_SCHED_STATUS, &s ) != 0)
+		return -1;
+
+	status->submitted = s.submitted;
+	status->completed = s.completed;
+	status->errors = s.errors;
+	status->last_tag = s.last_tag;
+	status->last_status = s.last_status;
+
+	return 0;
+}
+
+int pd_abortDMAQueue( pd_device_t *pci_handle, unsigned int channel )
+{
+	/* Check for null pointer */
+	if (pci_handle == NULL)
+		return -1;
+
+	return ioctl( pci_handle->handle, PCIDRIVER_IOC_DMA_SCHED_ABORT, channel );
+}
+
+/* Batch Functions */
+int pd_batchInit( pd_device_t *pci_handle, pd_batch_t *batch, unsigned int max )
+{
+	/* Check for null pointers */
+	if ((pci_handle == NULL) || (batch == NULL))
+		return -1;
+
+	if ((max == 0) || (max > PD_BATCH_MAX))
+		max = PD_BATCH_MAX;
+
+	batch->pci_handle = pci_handle;
+	batch->max = max;
+	batch->count = 0;
+	batch->done = 0;
+	batch->flags = 0;
+	batch->cmds = malloc( max * sizeof(batch_cmd_t) );
+	batch->umem = malloc( max * sizeof(pd_umem_t *) );
+
+	if ((batch->cmds == NULL) || (batch->umem == NULL)) {
+		free( batch->cmds );
+		free( batch->umem );
+		return -1;
+	}
+
+	return 0;
+}
+
+int pd_batchFree( pd_batch_t *batch )
+{
+	/* Check for null pointer */
+	if (batch == NULL)
+		return -1;
+
+	free( batch->cmds );
+	free( batch->umem );
+	batch->cmds = NULL;
+	batch->umem = NULL;
+	batch->count = 0;
+
+	return 0;
+}
+
+void pd_batchClear( pd_batch_t *batch )
+{
+	if (batch == NULL)
+		return;
+
+	batch->count = 0;
+	batch->done = 0;
+}
+
+/* Appends a command, returns its index or -1 if the batch is full */
+static int pd_batchAdd( pd_batch_t *batch, unsigned int cmd )
+{
+	batch_cmd_t *c;
+
+	if ((batch == NULL) || (batch->cmds == NULL) || (batch->count == batch->max))
+		return -1;
+
+	c = (batch_cmd_t *)batch->cmds + batch->count;
+	memset( c, 0, sizeof(batch_cmd_t) );
+	c->cmd = cmd;
+	c->status = -ECANCELED;
+	batch->umem[ batch->count ] = NULL;
+
+	return batch->count++;
+}
+
+int pd_batchSyncKernelMemory( pd_batch_t *batch, pd_kmem_t *kmem_handle, int dir,
+		unsigned long offset, unsigned long length )
+{
+	batch_cmd_t *c;
+	int i;
+
+	if (kmem_handle == NULL)
+		return -1;
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_KMEM_SYNC )) < 0)
+		return -1;
+
+	/* We assume (C API) dir === (Driver API) dir */
+	c = (batch_cmd_t *)batch->cmds + i;
+	c->arg.kmem_sync.handle.handle_id = kmem_handle->handle_id;
+	c->arg.kmem_sync.handle.pa = kmem_handle->pa;
+	c->arg.kmem_sync.handle.size = kmem_handle->size;
+	c->arg.kmem_sync.dir = dir;
+	c->arg.kmem_sync.offset = offset;
+	c->arg.kmem_sync.length = length;
+
+	return i;
+}
+
+int pd_batchSyncUserMemory( pd_batch_t *batch, pd_umem_t *umem_handle, int dir,
+		unsigned long offset, unsigned long length )
+{
+	batch_cmd_t *c;
+	int i;
+
+	if (umem_handle == NULL)
+		return -1;
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_UMEM_SYNC )) < 0)
+		return -1;
+
+	c = (batch_cmd_t *)batch->cmds + i;
+	c->arg.umem_sync.handle_id = umem_handle->handle_id;
+	c->arg.umem_sync.dir = dir;
+	c->arg.umem_sync.offset = offset;
+	c->arg.umem_sync.length = length;
+
+	return i;
+}
+
+int pd_batchMapUserMemory( pd_batch_t *batch, void *mem, unsigned int size, pd_umem_t *umem_handle )
+{
+	batch_cmd_t *c;
+	int i;
+
+	if (umem_handle == NULL)
+		return -1;
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_UMEM_MAP )) < 0)
+		return -1;
+
+	c = (batch_cmd_t *)batch->cmds + i;
+	c->arg.umem_map.handle.vma = (unsigned long)mem;
+	c->arg.umem_map.handle.size = size;
+	c->arg.umem_map.sglist.type = PCIDRIVER_SG_MERGED;
+	batch->umem[i] = umem_handle;
+
+	umem_handle->sg = NULL;
+	umem_handle->nents = 0;
+
+	return i;
+}
+
+int pd_batchWaitForInterrupt( pd_batch_t *batch, unsigned int int_id )
+{
+	int i;
+
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_WAIT )) < 0)
+		return -1;
+
+	((batch_cmd_t *)batch->cmds)[i].arg.irq_source = int_id;
+
+	return i;
+}
+
+int pd_batchClearInterruptQueue( pd_batch_t *batch, unsigned int int_id )
+{
+	int i;
+
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_CLEAR_IOQ )) < 0)
+		return -1;
+
+	((batch_cmd_t *)batch->cmds)[i].arg.irq_source = int_id;
+
+	return i;
+}
+
+int pd_batchReadConfig( pd_batch_t *batch, unsigned int addr, unsigned int bytes )
+{
+	batch_cmd_t *c;
+	int i;
+
+	if ((i = pd_batchAdd( batch, PCIDRIVER_BATCH_PCI_CFG_RD )) < 0)
+		return -1;
+
+	c = (batch_cmd_t *)batch->cmds + i;
+	c->arg.pci_cfg.addr = addr;
+	if (bytes == 1)
+		c->arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_BYTE;
+	else if (bytes == 2)
+		c->arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_WORD;
+	else
+		c->arg.pci_cfg.size = PCIDRIVER_PCI_CFG_SZ_DWORD;
+
+	return i;
+}
+
+int pd_batchRun( pd_batch_t *batch )
+{
+	batch_cmd_t *cmds;
+	batch_t b;
+	pd_umem_t *um;
+	unsigned int i;
+	int ret;
+
+	/* Check for null pointer */
+	if ((batch == NULL) || (batch->cmds == NULL))
+		return -1;
+	if (batch->count == 0)
+		return 0;
+
+	cmds = (batch_cmd_t *)batch->cmds;
+
+	/* The driver writes the SG list of a mapping to its handle directly */
+	for (i = 0; i < batch->count; i++) {
+		if ((um = batch->umem[i]) == NULL)
+			continue;
+
+		um->pci_handle = batch->pci_handle;
+		um->vma = cmds[i].arg.umem_map.handle.vma;
+		um->size = cmds[i].arg.umem_map.handle.size;
+		um->nents = 0;
+		cmds[i].arg.umem_map.sglist.nents = (um->size / getpagesize()) + 2;
+		if (posix_memalign( (void**)&(um->sg), 16, cmds[i].arg.umem_map.sglist.nents*sizeof(umem_sgentry_t) ) != 0)
+			um->sg = NULL;
+		cmds[i].arg.umem_map.sglist.sg = (umem_sgentry_t *)um->sg;
+	}
+
+	b.count = batch->count;
+	b.flags = (batch->flags & PD_BATCH_CONTINUE) ? PCIDRIVER_BATCH_FLAG_CONTINUE : 0;
+	b.done = 0;
+	b.cmds = cmds;
+
+	ret = ioctl( batch->pci_handle->handle, PCIDRIVER_IOC_BATCH, &b );
+
+	for (i = 0; i < batch->count; i++) {
+		if ((um = batch->umem[i]) == NULL)
+			continue;
+
+		if ((ret == 0) && (cmds[i].status == 0)) {
+			um->handle_id = cmds[i].arg.umem_map.handle.handle_id;
+			um->nents = cmds[i].arg.umem_map.sglist.nents;
+		} else {
+			free( um->sg );
+			um->sg = NULL;
+		}
+	}
+
+	if (ret != 0)
+		return -1;
+
+	batch->done = b.done;
+	return b.done;
+}
+
+int pd_batchStatus( pd_batch_t *batch, unsigned int index )
+{
+	if ((batch == NULL) || (batch->cmds == NULL) || (index >= batch->count))
+		return -EINVAL;
+
+	return ((batch_cmd_t *)batch->cmds)[index].status;
+}
+
+unsigned int pd_batchConfigValue( pd_batch_t *batch, unsigned int index )
+{
+	const pci_cfg_cmd *cfg;
+
+	if ((batch == NULL) || (batch->cmds == NULL) || (index >= batch->count))
+		return 0;
+	if (((batch_cmd_t *)batch->cmds)[index].cmd != PCIDRIVER_BATCH_PCI_CFG_RD)
+		return 0;
+
+	cfg = &(((batch_cmd_t *)batch->cmds)[index].arg.pci_cfg);
+	switch (cfg->size) {
+		case PCIDRIVER_PCI_CFG_SZ_BYTE:
+			return cfg->val.byte;
+		case PCIDRIVER_PCI_CFG_SZ_WORD:
+			return cfg->val.word;
+		default:
+			return cfg->val.dword;
+	}
+}
+
 /* PCI Functions */
 int pd_getID( pd_device_t *pci_handle )
 {
@@ -348,7 +913,7 @@ int pd_getBARsize( pd_device_t *pci_handle, unsigned int bar )
 	return info.bar_length[ bar ];
 }
 
-void *pd_mapBAR( pd_device_t *pci_handle, unsigned int bar )
+static void *pd_mapBAR_mode( pd_device_t *pci_handle, unsigned int bar, int mode )
 {
 	int ret;
 	void *mem;
@@ -373,13 +938,17 @@ void *pd_mapBAR( pd_device_t *pci_handle, unsigned int bar )
 	 * Posible fix: Do not allow the driver for mutliple openings of a device */
 	pthread_mutex_lock( &pci_handle->mmap_mutex );
 
-	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_MMAP_MODE, PCIDRIVER_MMAP_PCI );
-	if (ret != 0)
+	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_MMAP_MODE, mode );
+	if (ret != 0) {
+		pthread_mutex_unlock( &pci_handle->mmap_mutex );
 		return NULL;
+	}
 
 	ret = ioctl( pci_handle->handle, PCIDRIVER_IOC_MMAP_AREA, PCIDRIVER_BAR0+bar );
-	if (ret != 0)
+	if (ret != 0) {
+		pthread_mutex_unlock( &pci_handle->mmap_mutex );
 		return NULL;
+	}
 
 	mem = mmap( 0, info.bar_length[bar], PROT_WRITE | PROT_READ, MAP_SHARED, pci_handle->handle, 0 );
 
@@ -400,6 +969,17 @@ void *pd_mapBAR( pd_device_t *pci_handle, unsigned int bar )
 	return mem;
 }
 
+void *pd_mapBAR( pd_device_t *pci_handle, unsigned int bar )
+{
+	return pd_mapBAR_mode( pci_handle, bar, PCIDRIVER_MMAP_PCI );
+}
+
+/* The stores to a write-combined BAR must be fenced (sfence) to be seen in order */
+void *pd_mapBAR_wc( pd_device_t *pci_handle, unsigned int bar )
+{
+	return pd_mapBAR_mode( pci_handle, bar, PCIDRIVER_MMAP_PCI_WC );
+}
+
 int pd_unmapBAR( pd_device_t *pci_handle, unsigned int bar, void *ptr )
 {
 	int ret;
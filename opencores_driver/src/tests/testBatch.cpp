@@ -0,0 +1,150 @@
+/*******************************************************************
+ * Syscalls and latency of the bookkeeping around a transfer, one
+ * ioctl per command against a single batch ioctl.
+ *
+ * A transfer here is what user space does around the DMA itself:
+ * sync the buffer to the device, read a config register, sync it
+ * back; or map a user buffer, get its SG list and unmap it. No DMA
+ * is started, so any board with the driver loaded will do.
+ *
+ *******************************************************************/
+
+#include "lib/pciDriver.h"
+#include "lib/PciDevice.h"
+#include "lib/Batch.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <sys/time.h>
+
+using namespace pciDriver;
+using namespace std;
+
+#define BUF_SIZE	(64*1024)
+#define TRANSFERS	20000
+#define MAPS		2000
+
+void testDevice( int i );
+void testKernelTransfer(pciDriver::PciDevice *dev);
+void testUserMap(pciDriver::PciDevice *dev);
+
+static double now_usec()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000.0) + tv.tv_usec;
+}
+
+static void report(const char *what, unsigned int syscalls, double usec)
+{
+	cout << setw(24) << what << setw(14) << syscalls << setw(14) << fixed << setprecision(3) << usec << endl;
+}
+
+int main()
+{
+	int i;
+
+	for(i=0;i<4;i++) {
+		testDevice( i );
+	}
+
+	return 0;
+}
+
+void testDevice( int i ) {
+	pciDriver::PciDevice *device;
+
+	try {
+		cout << "Trying device " << i << " ... ";
+		device = new pciDriver::PciDevice( i );
+		cout << "found" << endl;
+	} catch (Exception& e) {
+		cout << "failed: " << e.toString() << endl;
+		return;
+	}
+
+	cout << setw(24) << "" << setw(14) << "syscalls/xfer" << setw(14) << "usec/xfer" << endl;
+	testKernelTransfer(device);
+	testUserMap(device);
+
+	delete device;
+}
+
+void testKernelTransfer(pciDriver::PciDevice *dev)
+{
+	KernelMemory *km = NULL;
+	unsigned int k;
+	double start;
+
+	dev->open();
+
+	try {
+		km = &(dev->allocKernelMemory(BUF_SIZE));
+
+		start = now_usec();
+		for(k=0;k<TRANSFERS;k++) {
+			km->sync( KernelMemory::TO_DEVICE );
+			dev->readConfigDWord( 0 );
+			km->sync( KernelMemory::FROM_DEVICE );
+		}
+		report("kmem, one by one", 3, (now_usec() - start) / TRANSFERS);
+
+		Batch& batch = dev->createBatch();
+		batch.syncKernelMemory( *km, KernelMemory::TO_DEVICE );
+		batch.readConfig( 0 );
+		batch.syncKernelMemory( *km, KernelMemory::FROM_DEVICE );
+
+		start = now_usec();
+		for(k=0;k<TRANSFERS;k++) {
+			if (batch.run() != batch.size())
+				throw Exception( Exception::BATCH_FAILED );
+		}
+		report("kmem, batched", 1, (now_usec() - start) / TRANSFERS);
+
+		delete &batch;
+	} catch (Exception& e) {
+		cout << "failed: " << e.toString() << endl;
+	}
+
+	delete km;
+
+	dev->close();
+}
+
+void testUserMap(pciDriver::PciDevice *dev)
+{
+	void *mem;
+	unsigned int k;
+	double start;
+
+	if (posix_memalign(&mem, 4096, BUF_SIZE) != 0)
+		return;
+
+	dev->open();
+
+	try {
+		start = now_usec();
+		for(k=0;k<MAPS;k++)
+			delete &(dev->mapUserMemory(mem, BUF_SIZE));
+		report("umem map, one by one", 3, (now_usec() - start) / MAPS);
+
+		Batch& batch = dev->createBatch();
+		batch.mapUserMemory(mem, BUF_SIZE);
+
+		start = now_usec();
+		for(k=0;k<MAPS;k++) {
+			batch.run();
+			delete &(batch.getUserMemory(0));
+		}
+		report("umem map, batched", 2, (now_usec() - start) / MAPS);
+
+		delete &batch;
+	} catch (Exception& e) {
+		cout << "failed: " << e.toString() << endl;
+	}
+
+	dev->close();
+
+	free(mem);
+}
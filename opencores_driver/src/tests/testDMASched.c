@@ -0,0 +1,216 @@
+/*******************************************************************
+ * Test of the queueing logic of the in-kernel DMA scheduler.
+ *
+ * The scheduler core of the driver is built for user space and runs
+ * against a model of the registers of a WG engine channel: the test
+ * plays the engine, setting the status register and calling the
+ * completion as the interrupt handler does. No device is needed.
+ *
+ *******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../driver/dmasched.h"
+
+/* Control bits on every transfer the scheduler programs */
+#define CTRL_FIXED	(DMASCHED_CTRL_LAST | DMASCHED_CTRL_UPA | DMASCHED_CTRL_V | DMASCHED_CTRL_EDI)
+
+static unsigned int regs[ DMASCHED_REGS ];
+static int failed = 0;
+
+static void check(int ok, const char *what)
+{
+	printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		failed = 1;
+}
+
+static dmasched_xfer_t xfer(unsigned long long host, unsigned int per, unsigned int length,
+			    unsigned int tag, int last)
+{
+	dmasched_xfer_t x;
+
+	x.host = host;
+	x.per = per;
+	x.length = length;
+	x.control = DMASCHED_CTRL_BAR(1) | DMASCHED_CTRL_INC;
+	x.tag = tag;
+	x.buffer = 0;
+	x.last = last;
+	return x;
+}
+
+/* The engine holds the given transfer */
+static int programmed(unsigned long long host, unsigned int per, unsigned int length)
+{
+	return (regs[ DMASCHED_REG_HA_H ] == (unsigned int)(host >> 32)) &&
+	       (regs[ DMASCHED_REG_HA_L ] == (unsigned int)host) &&
+	       (regs[ DMASCHED_REG_PA_H ] == 0) && (regs[ DMASCHED_REG_PA_L ] == per) &&
+	       (regs[ DMASCHED_REG_BDA_H ] == 0) && (regs[ DMASCHED_REG_BDA_L ] == 0) &&
+	       (regs[ DMASCHED_REG_LENG ] == length) &&
+	       (regs[ DMASCHED_REG_CTRL ] == (CTRL_FIXED | DMASCHED_CTRL_BAR(1) | DMASCHED_CTRL_INC));
+}
+
+/* The running transfer ends with the given status, as the handler sees it */
+static int finish(dmasched_chan_t *chan, unsigned int status)
+{
+	regs[ DMASCHED_REG_STA ] = status;
+	return dmasched_complete(chan);
+}
+
+static void testRecords(dmasched_chan_t *chan)
+{
+	dmasched_xfer_t x;
+	int ok;
+
+	dmasched_init(chan, regs);
+	check(finish(chan, DMASCHED_STA_DONE) == DMASCHED_IDLE, "idle channel does not take the interrupt");
+
+	x = xfer(0x123456000ULL, 0x100, 4096, 7, 1);
+	dmasched_queue(chan, &x);
+	x = xfer(0x200000ULL, 0x2000, 512, 8, 1);
+	dmasched_queue(chan, &x);
+	check(!dmasched_busy(chan) && (regs[ DMASCHED_REG_CTRL ] == 0), "queueing does not start the engine");
+
+	check(dmasched_kick(chan) && dmasched_busy(chan), "kick starts the first record");
+	check(programmed(0x123456000ULL, 0x100, 4096), "first record programmed, 64-bit host address");
+	check(!dmasched_kick(chan), "kick on a busy channel does nothing");
+
+	check(finish(chan, DMASCHED_STA_BUSY) == DMASCHED_RUNNING, "busy channel keeps its transfer");
+	check(programmed(0x123456000ULL, 0x100, 4096), "nothing programmed while busy");
+
+	check(finish(chan, DMASCHED_STA_DONE) == DMASCHED_RECORD, "first record ends");
+	check(programmed(0x200000ULL, 0x2000, 512), "second record started by the completion");
+	check((chan->completed == 1) && (chan->last_tag == 7) && (chan->last_status == DMASCHED_STA_DONE),
+	      "completion counted with its tag");
+
+	check(finish(chan, DMASCHED_STA_DONE) == DMASCHED_RECORD, "second record ends");
+	check(!dmasched_busy(chan) && (chan->completed == 2) && (chan->last_tag == 8), "channel idle when the queue is empty");
+	check((chan->submitted == 2) && (chan->errors == 0), "counters of records");
+
+	/* A record of several pieces reaches user space once */
+	x = xfer(0x1000, 0, 4096, 9, 0);
+	dmasched_queue(chan, &x);
+	x = xfer(0x8000, 4096, 4096, 9, 0);
+	dmasched_queue(chan, &x);
+	x = xfer(0x3000, 8192, 1024, 9, 1);
+	dmasched_queue(chan, &x);
+	dmasched_kick(chan);
+	ok = (finish(chan, DMASCHED_STA_DONE) == DMASCHED_PIECE) && programmed(0x8000, 4096, 4096);
+	ok = ok && (finish(chan, DMASCHED_STA_DONE) == DMASCHED_PIECE) && programmed(0x3000, 8192, 1024);
+	ok = ok && (finish(chan, DMASCHED_STA_DONE) == DMASCHED_RECORD) && (chan->completed == 3);
+	check(ok, "pieces of a record programmed in order, one completion");
+}
+
+static void testErrors(dmasched_chan_t *chan)
+{
+	dmasched_xfer_t x;
+
+	dmasched_init(chan, regs);
+
+	/* The second piece of a record of three times out */
+	x = xfer(0x1000, 0, 256, 1, 0);
+	dmasched_queue(chan, &x);
+	x = xfer(0x2000, 256, 256, 1, 0);
+	dmasched_queue(chan, &x);
+	x = xfer(0x3000, 512, 256, 1, 1);
+	dmasched_queue(chan, &x);
+	x = xfer(0x4000, 0, 128, 2, 1);
+	dmasched_queue(chan, &x);
+	dmasched_kick(chan);
+
+	finish(chan, DMASCHED_STA_DONE);
+	check(finish(chan, DMASCHED_STA_TOUT) == DMASCHED_RECORD, "timeout ends the record");
+	check((chan->errors == 1) && (chan->completed == 1) && (chan->last_tag == 1) &&
+	      (chan->last_status == DMASCHED_STA_TOUT), "failure counted with its status");
+	check(programmed(0x4000, 0, 128), "rest of the record dropped, next record started");
+
+	check(finish(chan, DMASCHED_STA_BUSY | DMASCHED_STA_DONE) == DMASCHED_RECORD, "busy and done is an error");
+	check((chan->errors == 2) && !dmasched_busy(chan), "channel idle after the error");
+	check(regs[ DMASCHED_REG_CTRL ] == (DMASCHED_CTRL_RESET | DMASCHED_CTRL_V), "engine reset after the error");
+}
+
+static void testLimits(dmasched_chan_t *chan)
+{
+	dmasched_xfer_t x;
+	unsigned int i, n;
+	int ok;
+
+	dmasched_init(chan, regs);
+
+	x = xfer(0x1000, 0, 64, 0, 1);
+	for (i = 0; i < DMASCHED_DEPTH; i++)
+		dmasched_queue(chan, &x);
+	check(dmasched_space(chan) == 0, "queue full after its depth");
+	check(dmasched_queue(chan, &x) == -ENOSPC, "queue full refuses a transfer");
+
+	dmasched_kick(chan);
+	finish(chan, DMASCHED_STA_DONE);
+	check(dmasched_space(chan) == 1, "completion frees a slot");
+
+	check(dmasched_abort(chan) == DMASCHED_DEPTH - 1, "abort drops the records queued");
+	check(!dmasched_busy(chan) && (dmasched_space(chan) == DMASCHED_DEPTH), "queue empty after an abort");
+	check(regs[ DMASCHED_REG_CTRL ] == (DMASCHED_CTRL_RESET | DMASCHED_CTRL_V), "engine reset by the abort");
+	check((chan->completed == DMASCHED_DEPTH) && (chan->errors == DMASCHED_DEPTH - 1),
+	      "dropped records count as failed");
+	check(finish(chan, DMASCHED_STA_DONE) == DMASCHED_IDLE, "late interrupt after an abort is not taken");
+
+	/* Indices run around the queue several times */
+	ok = 1;
+	for (n = 0; n < 5 * DMASCHED_DEPTH; n += 3) {
+		for (i = 0; i < 3; i++) {
+			x = xfer(0x10000 + (n + i) * 0x100, n + i, 4 * (n + i + 1), n + i, 1);
+			dmasched_queue(chan, &x);
+		}
+		dmasched_kick(chan);
+		for (i = 0; i < 3; i++) {
+			ok = ok && programmed(0x10000 + (n + i) * 0x100, n + i, 4 * (n + i + 1));
+			ok = ok && (finish(chan, DMASCHED_STA_DONE) == DMASCHED_RECORD) && (chan->last_tag == n + i);
+		}
+	}
+	check(ok && !dmasched_busy(chan), "order kept across wrap-arounds");
+}
+
+static void testBuffers(dmasched_chan_t *chan)
+{
+	dmasched_xfer_t x;
+
+	dmasched_init(chan, regs);
+	check(!dmasched_uses(chan, 0), "empty queue uses no buffer");
+
+	x = xfer(0x1000, 0, 64, 1, 1);
+	x.buffer = 3;
+	dmasched_queue(chan, &x);
+	x = xfer(0x2000, 0, 64, 2, 0);
+	x.buffer = 5;
+	dmasched_queue(chan, &x);
+	x = xfer(0x3000, 0, 64, 2, 1);
+	dmasched_queue(chan, &x);
+	check(dmasched_uses(chan, 3) && dmasched_uses(chan, 5) && !dmasched_uses(chan, 4),
+	      "queued transfers use their buffers");
+
+	dmasched_kick(chan);
+	check(dmasched_uses(chan, 3), "running transfer still uses its buffer");
+	finish(chan, DMASCHED_STA_DONE);
+	check(!dmasched_uses(chan, 3) && dmasched_uses(chan, 5), "ended transfer no longer uses its buffer");
+
+	dmasched_abort(chan);
+	check(!dmasched_uses(chan, 5), "aborted queue uses no buffer");
+}
+
+int main()
+{
+	static dmasched_chan_t chan;
+
+	memset(regs, 0, sizeof(regs));
+
+	testRecords(&chan);
+	testErrors(&chan);
+	testLimits(&chan);
+	testBuffers(&chan);
+
+	printf("%s\n", failed ? "Some tests FAILED" : "All tests passed");
+	return failed;
+}
@@ -37,6 +37,7 @@ void testMmapMode(int handle);
 void testMmapArea(int handle);
 void testKbuf(int handle);
 void testUmap(int handle);
+void testUmapGet(int handle);
 void testPCIinfo(int handle);
 void testPCIconfig(int handle);
 void testPCImmap(int handle);
@@ -75,6 +76,7 @@ int main() {
 		testKbuf(handle);
 		testKmmap(handle);		
 		testUmap(handle);
+		testUmapGet(handle);
 
 		printf("Press any key...\n");
 		getchar();
@@ -298,6 +300,48 @@ test_umap_fail:
 
 }
 
+/* Test the map and SG list in one call (SGMAP_GET), with a list too small first */
+void testUmapGet(int handle) {
+	umem_map_t um;
+	int ret;
+
+	printf(" Testing PCIDRIVER_IOC_UMEM_SGMAP_GET ...");
+
+	um.handle.vma = (unsigned long)bigbuffer;
+	um.handle.size = BIGBUFSIZE;
+	um.sglist.type = PCIDRIVER_SG_NONMERGED;
+	um.sglist.nents = 1;
+	um.sglist.sg = malloc( sizeof(umem_sgentry_t) );
+
+	ret = ioctl(handle, PCIDRIVER_IOC_UMEM_SGMAP_GET, &um );
+	if (ret == 0) {
+		/* contiguous buffer, e.g. a huge page */
+		printf("ok, fits in one entry.\n");
+		ioctl(handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &um.handle );
+		free( um.sglist.sg );
+		return;
+	}
+	if (errno != ENOSPC) {
+		printf( " failed! (%d)\n", ret );
+		free( um.sglist.sg );
+		return;
+	}
+	printf("ok, %d entries needed.\n", um.sglist.nents );
+
+	printf(" Testing PCIDRIVER_IOC_UMEM_SGGET with them ...");
+	free( um.sglist.sg );
+	um.sglist.sg = malloc( um.sglist.nents*sizeof(umem_sgentry_t) );
+
+	ret = ioctl(handle, PCIDRIVER_IOC_UMEM_SGGET, &um.sglist );
+	if (ret != 0)
+		printf( " failed! (%d)\n", ret );
+	else
+		printf("ok, %d entries.\n", um.sglist.nents );
+
+	ioctl(handle, PCIDRIVER_IOC_UMEM_SGUNMAP, &um.handle );
+	free( um.sglist.sg );
+}
+
 void testPCIinfo(int handle)
 {
 	int ret,i;
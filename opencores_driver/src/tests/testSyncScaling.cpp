@@ -0,0 +1,138 @@
+/*******************************************************************
+ * Stress test for the handle lookup of the pciDriver module.
+ *
+ * Keeps a growing number of small buffers alive, kernel memory and
+ * mapped user memory, and measures the latency of the sync ioctl on
+ * buffers picked at random. The sync looks its buffer up by handle,
+ * so the latency should not grow with the number of live buffers.
+ *
+ *******************************************************************/
+
+#include "lib/pciDriver.h"
+#include "lib/PciDevice.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <sys/time.h>
+
+using namespace pciDriver;
+using namespace std;
+
+#define BUF_SIZE	4096
+#define MAX_KBUFS	1024
+#define MAX_UBUFS	8192
+#define SYNCS		20000
+
+void testDevice( int i );
+void testKernelSync(pciDriver::PciDevice *dev);
+void testUserSync(pciDriver::PciDevice *dev);
+
+static double now_usec()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000.0) + tv.tv_usec;
+}
+
+int main()
+{
+	int i;
+
+	for(i=0;i<4;i++) {
+		testDevice( i );
+	}
+
+	return 0;
+}
+
+void testDevice( int i ) {
+	pciDriver::PciDevice *device;
+
+	try {
+		cout << "Trying device " << i << " ... ";
+		device = new pciDriver::PciDevice( i );
+		cout << "found" << endl;
+	} catch (Exception& e) {
+		cout << "failed: " << e.toString() << endl;
+		return;
+	}
+
+	testKernelSync(device);
+	testUserSync(device);
+
+	delete device;
+}
+
+void testKernelSync(pciDriver::PciDevice *dev)
+{
+	vector<KernelMemory *> bufs;
+	unsigned int live, k;
+	double start;
+
+	dev->open();
+
+	cout << "kernel memory sync" << endl;
+	cout << setw(10) << "buffers" << setw(14) << "usec/sync" << endl;
+	try {
+		for(live=1;live<=MAX_KBUFS;live*=4) {
+			while (bufs.size() < live)
+				bufs.push_back( &(dev->allocKernelMemory(BUF_SIZE)) );
+
+			start = now_usec();
+			for(k=0;k<SYNCS;k++)
+				bufs[ rand() % live ]->sync( KernelMemory::TO_DEVICE );
+
+			cout << setw(10) << live << setw(14) << fixed << setprecision(3)
+			     << (now_usec() - start) / SYNCS << endl;
+		}
+	} catch (Exception& e) {
+		cout << "failed after " << bufs.size() << " buffers: " << e.toString() << endl;
+	}
+
+	for(k=0;k<bufs.size();k++)
+		delete bufs[k];
+
+	dev->close();
+}
+
+void testUserSync(pciDriver::PciDevice *dev)
+{
+	vector<UserMemory *> bufs;
+	vector<void *> mems;
+	unsigned int live, k;
+	void *mem;
+	double start;
+
+	dev->open();
+
+	cout << "user memory sync" << endl;
+	cout << setw(10) << "buffers" << setw(14) << "usec/sync" << endl;
+	try {
+		for(live=1;live<=MAX_UBUFS;live*=4) {
+			while (bufs.size() < live) {
+				if (posix_memalign(&mem, BUF_SIZE, BUF_SIZE) != 0)
+					throw Exception( Exception::ALLOC_FAILED );
+				mems.push_back(mem);
+				bufs.push_back( &(dev->mapUserMemory(mem,BUF_SIZE)) );
+			}
+
+			start = now_usec();
+			for(k=0;k<SYNCS;k++)
+				bufs[ rand() % live ]->sync( UserMemory::TO_DEVICE );
+
+			cout << setw(10) << live << setw(14) << fixed << setprecision(3)
+			     << (now_usec() - start) / SYNCS << endl;
+		}
+	} catch (Exception& e) {
+		cout << "failed after " << bufs.size() << " buffers: " << e.toString() << endl;
+	}
+
+	for(k=0;k<bufs.size();k++)
+		delete bufs[k];
+	for(k=0;k<mems.size();k++)
+		free(mems[k]);
+
+	dev->close();
+}